@@ -0,0 +1,151 @@
+#include "fixtures.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleSharingCache.hh"
+
+using namespace yabrowser::style;
+
+// `depth` nested sections, each with a couple of links
+static const yahtml::DOMChild& deep_document (unsigned depth)
+{
+  static std::map<unsigned, std::unique_ptr<yahtml::HTMLDriver>> drivers;
+  std::unique_ptr<yahtml::HTMLDriver>& driver = drivers[depth];
+
+  if (!driver) {
+    std::string html;
+
+    for (unsigned i = 0; i < depth; i++)
+      html += "<section class=\"s" + std::to_string(i % 16) + "\"><a>x</a>";
+    for (unsigned i = 0; i < depth; i++)
+      html += "<a>y</a></section>";
+
+    driver.reset(new yahtml::HTMLDriver());
+    driver->parse_source(html);
+  }
+
+  return driver->dom;
+}
+
+// descendant rules on `a`, most of them mentioning classes no section has
+static const ComplexStylesheet& descendant_stylesheet (unsigned rules)
+{
+  static std::map<unsigned, std::unique_ptr<ComplexStylesheet>> sheets;
+  std::unique_ptr<ComplexStylesheet>& sheet = sheets[rules];
+
+  if (!sheet) {
+    std::string source;
+
+    for (unsigned i = 0; i < rules; i++)
+      source += ".s" + std::to_string(i) + " section a { color: red; }";
+
+    sheet.reset(new ComplexStylesheet());
+    sheet->parse_source(source);
+  }
+
+  return *sheet;
+}
+
+static size_t match_all (const RuleIndex& index, const StyledNode& sn,
+                         AncestorFilter* filter)
+{
+  if (sn.node->type != yahtml::NodeType::Element)
+    return 0;
+
+  const yahtml::Element& elem =
+      *static_cast<const yahtml::Element*>(sn.node.get());
+  size_t matched = index.matching_rules(elem, sn.parent, filter).size();
+
+  if (filter)
+    filter->push(elem);
+  for (const auto& child : sn.children)
+    matched += match_all(index, *child, filter);
+  if (filter)
+    filter->pop();
+
+  return matched;
+}
+
+// rule matching alone over an already styled tree; range(1) picks the
+// filter (1) or the plain ancestor walk (0)
+static void BM_AncestorMatch (benchmark::State& state)
+{
+  const RuleIndex index (descendant_stylesheet(100));
+  const StyledNode root (deep_document(state.range(0)), index);
+  const bool filtered = state.range(1);
+  size_t matched = 0;
+
+  for (auto _ : state) {
+    AncestorFilter filter;
+    matched = match_all(index, root, filtered ? &filter : nullptr);
+  }
+
+  state.counters["matched"] = matched;
+  state.SetItemsProcessed(state.iterations() * root.subtree_size);
+}
+BENCHMARK(BM_AncestorMatch)
+    ->ArgsProduct({ { 16, 128, 1024 }, { 0, 1 } })
+    ->ArgNames({ "depth", "filter" })
+    ->Unit(benchmark::kMicrosecond);
+
+// the whole styled tree, which pushes and pops the filter as it goes
+static void BM_StyledNode_combinators (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = deep_document(state.range(0));
+  const RuleIndex index (descendant_stylesheet(100));
+
+  for (auto _ : state) {
+    StyledNode root (dom, index);
+    benchmark::DoNotOptimize(root.specified_values);
+  }
+
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode_combinators)
+    ->Arg(16)->Arg(128)->Arg(1024)
+    ->Unit(benchmark::kMicrosecond);
+
+// `cards` alike cards next to each other: cousins all the way down
+static const yahtml::DOMChild& card_document (unsigned cards)
+{
+  static std::map<unsigned, std::unique_ptr<yahtml::HTMLDriver>> drivers;
+  std::unique_ptr<yahtml::HTMLDriver>& driver = drivers[cards];
+
+  if (!driver) {
+    std::string html = "<body>";
+
+    for (unsigned i = 0; i < cards; i++)
+      html += "<div class=\"card\"><h2>t</h2><p>x</p><p>y</p></div>";
+    html += "</body>";
+
+    driver.reset(new yahtml::HTMLDriver());
+    driver->parse_source(html);
+  }
+
+  return driver->dom;
+}
+
+// with combinators, cards can only share their styles between cousins
+static void BM_StyledNode_combinators_cousins (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = card_document(state.range(0));
+  const RuleIndex index (descendant_stylesheet(100));
+  double hits = 0;
+  double misses = 0;
+
+  for (auto _ : state) {
+    StyleSharingCache cache (index);
+    StyledNode root (dom, cache);
+
+    hits = cache.hits();
+    misses = cache.misses();
+  }
+
+  state.counters["cache_hits"] = hits;
+  state.counters["cache_misses"] = misses;
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode_combinators_cousins)
+    ->Arg(100)->Arg(1000)->Arg(10000)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
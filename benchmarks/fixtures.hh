@@ -0,0 +1,141 @@
+#ifndef YABROWSER__BENCHMARKS__FIXTURES_HH
+#define YABROWSER__BENCHMARKS__FIXTURES_HH
+
+#include "yacss/parser/driver.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Synthetic inputs shared by the benchmarks. Documents and stylesheets are
+ * produced as source text and fed to the regular parsers so that the
+ * benchmarks only rely on the public API. Parsed inputs are cached per
+ * size: google-benchmark calls every benchmark several times per argument.
+ */
+namespace fixtures {
+
+// document sizes, in DOM nodes
+const int64_t MIN_NODES = 1000;
+const int64_t MAX_NODES = 1000000;
+
+// stylesheet sizes, in rules
+const int64_t MIN_RULES = 10;
+const int64_t MAX_RULES = 10000;
+
+// makes every element of `synthetic_document` a block
+const char* const BLOCK_RULES = "body, div, li { display: block; }";
+
+// `rules` rules spread over tag, class and id selectors. Only a handful of
+// them match elements generated by `flat_document`.
+inline std::string synthetic_stylesheet (unsigned rules)
+{
+  static const char* tags[] = { "div", "p", "span", "ul", "li", "a", "h1" };
+  std::ostringstream css;
+
+  for (unsigned i = 0; i < rules; i++) {
+    switch (i % 4) {
+      case 0:
+        css << ".c" << i % 97 << " { width: " << i % 300 << "px; }";
+        break;
+      case 1:
+        css << "#id" << i << " { margin: " << i % 20 << "px; }";
+        break;
+      case 2:
+        css << tags[i % 7] << ".c" << i % 89 << " { padding: 1px; }";
+        break;
+      case 3:
+        css << tags[i % 7] << " { display: block; }";
+        break;
+    }
+  }
+
+  return css.str();
+}
+
+// a <body> with `children` list items, each with a couple of classes
+inline std::string flat_document (unsigned children)
+{
+  std::ostringstream html;
+
+  html << "<body>";
+  for (unsigned i = 0; i < children; i++)
+    html << "<li class=\"c" << i % 97 << " c" << i % 89 << "\" id=\"id" << i
+         << "\">item</li>";
+  html << "</body>";
+
+  return html.str();
+}
+
+// about `nodes` DOM nodes: sections of 50 list items, each with a text
+inline std::string synthetic_document (unsigned nodes)
+{
+  const unsigned items = nodes / 2;
+  std::ostringstream html;
+
+  html << "<body>";
+  for (unsigned i = 0; i < items; i++) {
+    if (i % 50 == 0)
+      html << (i ? "</div>" : "") << "<div class=\"s" << i / 50 % 10 << "\">";
+
+    html << "<li class=\"c" << i % 97 << " c" << i % 89 << "\" id=\"id" << i
+         << "\">item</li>";
+  }
+  html << (items ? "</div>" : "") << "</body>";
+
+  return html.str();
+}
+
+inline const yahtml::DOMChild& document (unsigned nodes)
+{
+  static std::map<unsigned, std::unique_ptr<yahtml::HTMLDriver>> parsed;
+  std::unique_ptr<yahtml::HTMLDriver>& driver = parsed[nodes];
+
+  if (!driver) {
+    driver.reset(new yahtml::HTMLDriver());
+    driver->parse_source(synthetic_document(nodes));
+
+    if (driver->result)
+      throw std::runtime_error("failed to parse benchmark document");
+  }
+
+  return driver->dom;
+}
+
+// `rules` synthetic rules followed by `extra`
+inline const yacss::Stylesheet& stylesheet (unsigned rules,
+                                            const std::string& extra = "")
+{
+  static std::map<std::string, std::unique_ptr<yacss::CSSDriver>> parsed;
+  const std::string source = synthetic_stylesheet(rules) + extra;
+  std::unique_ptr<yacss::CSSDriver>& driver = parsed[source];
+
+  if (!driver) {
+    driver.reset(new yacss::CSSDriver());
+    driver->parse_source(source);
+
+    if (driver->result)
+      throw std::runtime_error("failed to parse benchmark stylesheet");
+  }
+
+  return driver->stylesheet;
+}
+
+inline unsigned long count_nodes (const yahtml::DOMChild& node)
+{
+  unsigned long count = 1;
+
+  for (const auto& child : node->children)
+    count += count_nodes(child);
+
+  return count;
+}
+
+} // ! ns fixtures
+
+#endif
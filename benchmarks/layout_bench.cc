@@ -0,0 +1,293 @@
+#include "fixtures.hh"
+#include "yabrowser/Layout.hh"
+#include "yabrowser/ThreadPool.hh"
+
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+
+static const Dimensions VIEWPORT (Rect(0.0, 0.0, 800.0, 600.0));
+
+// every element of the document is a block with some padding
+static const StyledChild& styled_document (unsigned nodes)
+{
+  static std::map<unsigned, StyledChild> styled;
+  StyledChild& root = styled[nodes];
+
+  if (!root) {
+    root = std::make_shared<StyledNode>(
+        fixtures::document(nodes),
+        fixtures::stylesheet(100, std::string(fixtures::BLOCK_RULES) +
+                                      "li { padding: 1px; height: 10px; }"));
+  }
+
+  return root;
+}
+
+// `depth` nested divs
+static const StyledChild& deep_document (unsigned depth)
+{
+  static std::map<unsigned, StyledChild> styled;
+  static std::vector<std::unique_ptr<yahtml::HTMLDriver>> drivers;
+  StyledChild& root = styled[depth];
+
+  if (!root) {
+    std::string html;
+
+    for (unsigned i = 0; i < depth; i++)
+      html += "<div>";
+    html += "<p></p>";
+    for (unsigned i = 0; i < depth; i++)
+      html += "</div>";
+
+    drivers.emplace_back(new yahtml::HTMLDriver());
+    drivers.back()->parse_source(html);
+    root = std::make_shared<StyledNode>(
+        drivers.back()->dom,
+        fixtures::stylesheet(0, "div, p { display: block; padding: 1px; }"));
+  }
+
+  return root;
+}
+
+// a single paragraph of `words` words, drawn from a small vocabulary the
+// way running text repeats its words
+static const StyledChild& paragraph_document (unsigned words)
+{
+  static const char* vocabulary[] = {
+    "the", "of", "and", "a", "to", "in", "is", "layout", "line", "boxes",
+    "are", "broken", "at", "width", "containing", "block", "text", "runs"
+  };
+  static std::map<unsigned, StyledChild> styled;
+  static std::vector<std::unique_ptr<yahtml::HTMLDriver>> drivers;
+  StyledChild& root = styled[words];
+
+  if (!root) {
+    std::string html = "<p>";
+
+    for (unsigned i = 0; i < words; i++) {
+      html += vocabulary[(i * 7 + i / 5) % 18];
+      html += i % 11 == 10 ? "  " : " ";
+    }
+    html += "</p>";
+
+    drivers.emplace_back(new yahtml::HTMLDriver());
+    drivers.back()->parse_source(html);
+    root = std::make_shared<StyledNode>(
+        drivers.back()->dom,
+        fixtures::stylesheet(0, "p { display: block; font-size: 14px; }"));
+  }
+
+  return root;
+}
+
+static void BM_LayoutTree_build (benchmark::State& state)
+{
+  const StyledChild& styled = styled_document(state.range(0));
+  size_t boxes = 0;
+
+  for (auto _ : state) {
+    LayoutTree tree (styled, VIEWPORT);
+    boxes = tree.boxes.size();
+  }
+
+  state.SetItemsProcessed(state.iterations() * boxes);
+}
+BENCHMARK(BM_LayoutTree_build)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_LayoutTree_calculate (benchmark::State& state)
+{
+  LayoutTree tree (styled_document(state.range(0)), VIEWPORT);
+
+  for (auto _ : state) {
+    tree.calculate();
+    benchmark::DoNotOptimize(tree.dimensions(tree.root()).content.height);
+  }
+
+  state.SetItemsProcessed(state.iterations() * tree.boxes.size());
+}
+BENCHMARK(BM_LayoutTree_calculate)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_LayoutTree_calculate_deep (benchmark::State& state)
+{
+  LayoutTree tree (deep_document(state.range(0)), VIEWPORT);
+
+  for (auto _ : state) {
+    tree.calculate();
+    benchmark::DoNotOptimize(tree.dimensions(tree.root()).content.height);
+  }
+
+  state.SetItemsProcessed(state.iterations() * tree.boxes.size());
+}
+BENCHMARK(BM_LayoutTree_calculate_deep)
+    ->Arg(100)->Arg(2000)
+    ->Unit(benchmark::kMicrosecond);
+
+// 100k nodes laid out with `threads` workers
+static void BM_LayoutTree_parallel (benchmark::State& state)
+{
+  LayoutTree tree (styled_document(100000), VIEWPORT);
+  yabrowser::ThreadPool pool (state.range(0));
+
+  for (auto _ : state) {
+    tree.calculate(pool);
+    benchmark::DoNotOptimize(tree.dimensions(tree.root()).content.height);
+  }
+
+  state.SetItemsProcessed(state.iterations() * tree.boxes.size());
+}
+BENCHMARK(BM_LayoutTree_parallel)
+    ->Arg(0)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// 8 screenshot widths of 10k nodes, one box tree, `threads` workers
+static void BM_LayoutTree_viewports (benchmark::State& state)
+{
+  static const float WIDTHS[] = { 320, 375, 414, 768, 1024, 1280, 1440, 1920 };
+  LayoutTree tree (styled_document(10000), VIEWPORT);
+  yabrowser::ThreadPool pool (state.range(0));
+  std::vector<LayoutGeometry> viewports;
+
+  for (float width : WIDTHS)
+    viewports.push_back(
+        tree.new_geometry(Dimensions(Rect(0.0, 0.0, width, 600.0))));
+
+  for (auto _ : state) {
+    tree.calculate_viewports(viewports, pool);
+    benchmark::DoNotOptimize(viewports.back().dimensions.front());
+  }
+
+  state.SetItemsProcessed(state.iterations() * viewports.size());
+}
+BENCHMARK(BM_LayoutTree_viewports)
+    ->Arg(0)->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// the viewport alternates between two widths
+static void BM_LayoutTree_relayout_resize (benchmark::State& state)
+{
+  LayoutTree tree (styled_document(state.range(0)), VIEWPORT);
+  unsigned resizes = 0;
+
+  tree.calculate();
+  for (auto _ : state) {
+    RelayoutStats stats;
+    tree.set_containing_width(resizes++ % 2 ? 800.0 : 799.0);
+    tree.relayout(stats);
+  }
+
+  state.SetItemsProcessed(state.iterations() * tree.boxes.size());
+}
+BENCHMARK(BM_LayoutTree_relayout_resize)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMillisecond);
+
+// a single box in the middle of the tree is edited
+static void BM_LayoutTree_relayout_edit (benchmark::State& state)
+{
+  LayoutTree tree (styled_document(state.range(0)), VIEWPORT);
+  RelayoutStats stats;
+
+  tree.calculate();
+  for (auto _ : state) {
+    tree.mark_dirty(tree.boxes.size() / 2, LAYOUT_STYLE);
+    tree.relayout(stats);
+  }
+
+  state.counters["laid_out"] =
+      benchmark::Counter(stats.laid_out, benchmark::Counter::kAvgIterations);
+  state.counters["shifted"] =
+      benchmark::Counter(stats.shifted, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_LayoutTree_relayout_edit)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMicrosecond);
+
+// breaking a long paragraph into lines; widths are cached after the
+// first iteration
+static void BM_InlineLayout_paragraph (benchmark::State& state)
+{
+  LayoutTree tree (paragraph_document(state.range(0)), VIEWPORT);
+
+  for (auto _ : state) {
+    tree.calculate();
+    benchmark::DoNotOptimize(tree.geometry.inline_layouts.front().lines.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["lines"] = tree.geometry.inline_layouts.front().lines.size();
+}
+BENCHMARK(BM_InlineLayout_paragraph)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMicrosecond);
+
+// the same paragraph reflowed at alternating widths
+static void BM_InlineLayout_paragraph_resize (benchmark::State& state)
+{
+  LayoutTree tree (paragraph_document(state.range(0)), VIEWPORT);
+  unsigned resizes = 0;
+
+  tree.calculate();
+  for (auto _ : state) {
+    RelayoutStats stats;
+    tree.set_containing_width(resizes++ % 2 ? 800.0 : 411.0);
+    tree.relayout(stats);
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_InlineLayout_paragraph_resize)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMicrosecond);
+
+// words looked up from every thread in a cache of `shards` shards; one
+// shard is the same as a global lock
+static void BM_TextWidthCache_width (benchmark::State& state)
+{
+  static TextWidthCache* cache = nullptr;
+  static std::vector<std::string> words;
+  const FixedAdvanceMetrics& metrics =
+      static_cast<const FixedAdvanceMetrics&>(default_font_metrics());
+  const FontDescriptor font;
+
+  if (state.thread_index() == 0) {
+    cache = new TextWidthCache(1 << 12, state.range(0));
+
+    words.clear();
+    for (unsigned i = 0; i < 8192; i++)
+      words.push_back("word" + std::to_string(i));
+  }
+
+  // skewed towards the first words, the way running text repeats them
+  unsigned i = state.thread_index();
+  for (auto _ : state) {
+    const std::string& word = words[(i * i + i / 3) % (i % 4 ? 64 : 8192)];
+    benchmark::DoNotOptimize(
+        cache->width(metrics, font, word.data(), word.size()));
+    i = i * 1103515245 + 12345;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    state.counters["hit_rate"] = cache->stats().hit_rate();
+    delete cache;
+  }
+}
+BENCHMARK(BM_TextWidthCache_width)
+    ->Arg(1)->Arg(16)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
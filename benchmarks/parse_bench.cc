@@ -0,0 +1,181 @@
+#include "fixtures.hh"
+#include "yabrowser/BinaryStylesheet.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/UserAgentStyles.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+static void BM_HTMLDriver_parse_source (benchmark::State& state)
+{
+  const std::string source = fixtures::synthetic_document(state.range(0));
+
+  for (auto _ : state) {
+    yahtml::HTMLDriver driver;
+    driver.parse_source(source);
+    benchmark::DoNotOptimize(driver.dom);
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_HTMLDriver_parse_source)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_CSSDriver_parse_source (benchmark::State& state)
+{
+  const std::string source = fixtures::synthetic_stylesheet(state.range(0));
+
+  for (auto _ : state) {
+    yacss::CSSDriver driver;
+    driver.parse_source(source);
+    benchmark::DoNotOptimize(driver.stylesheet);
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_CSSDriver_parse_source)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+// what every process would pay before its first render if the UA
+// stylesheet were parsed and indexed at startup, rather than compiled in
+static void BM_UserAgentSheet_parse (benchmark::State& state)
+{
+  for (auto _ : state) {
+    yacss::CSSDriver driver;
+    driver.parse_source(yabrowser::style::UA_STYLESHEET_SOURCE);
+    yabrowser::style::RuleIndex index (driver.stylesheet);
+    benchmark::DoNotOptimize(index.rules);
+  }
+}
+BENCHMARK(BM_UserAgentSheet_parse)->Unit(benchmark::kMicrosecond);
+
+// what it pays instead: finding the declarations of a tag
+static void BM_UserAgentSheet_lookup (benchmark::State& state)
+{
+  static const std::string tags[] = { "body", "div", "p", "span", "li" };
+  unsigned i = 0;
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        yabrowser::style::user_agent_rule(tags[i++ % 5]));
+}
+BENCHMARK(BM_UserAgentSheet_lookup);
+
+// a site's stylesheet of about 1 MB
+static const std::string& large_stylesheet ()
+{
+  static const std::string source = [] {
+    const size_t rule_size = fixtures::synthetic_stylesheet(1000).size();
+    return fixtures::synthetic_stylesheet((1 << 20) / rule_size * 1000);
+  }();
+
+  return source;
+}
+
+// a directory of this run's own, so that no file of an earlier run is
+// measured, removed with what was cached in it at exit
+struct TempDirectory
+{
+  std::string path;
+  std::vector<std::string> files;
+
+  TempDirectory ()
+  {
+    const char* tmp = std::getenv("TMPDIR");
+    std::string name = std::string(tmp && *tmp ? tmp : "/tmp") +
+                       "/parse_bench.XXXXXX";
+
+    if (!mkdtemp(&name[0]))
+      throw std::runtime_error("can't create a temporary directory");
+    path = name;
+  }
+
+  ~TempDirectory ()
+  {
+    for (const auto& file : files)
+      std::remove(file.c_str());
+    rmdir(path.c_str());
+  }
+};
+
+// where the binary form of large_stylesheet() is cached
+static std::string large_stylesheet_binary ()
+{
+  using namespace yabrowser::style;
+
+  static TempDirectory directory;
+  static BinaryStylesheetCache cache (directory.path);
+  const std::string& source = large_stylesheet();
+  const std::string path = cache.path(stylesheet_hash(source));
+  ComplexStylesheet ss;
+
+  if (directory.files.empty())
+    directory.files.push_back(path);
+
+  if (cache.load(source, ss) ||
+      !MappedStylesheet::open(path, source_key(source)))
+    throw std::runtime_error("failed to cache benchmark stylesheet");
+
+  return path;
+}
+
+// what every process pays for a stylesheet without a binary cache
+static void BM_BinaryStylesheet_parse (benchmark::State& state)
+{
+  const std::string& source = large_stylesheet();
+
+  for (auto _ : state) {
+    yabrowser::style::ComplexStylesheet ss;
+    ss.parse_source(source);
+    benchmark::DoNotOptimize(ss.stylesheet);
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_BinaryStylesheet_parse)->Unit(benchmark::kMillisecond);
+
+// hashing the source twice, then mapping and checking its file: the records are
+// ready to read from there
+static void BM_BinaryStylesheet_open (benchmark::State& state)
+{
+  const std::string& source = large_stylesheet();
+  const std::string path = large_stylesheet_binary();
+
+  for (auto _ : state) {
+    auto mapped = yabrowser::style::MappedStylesheet::open(
+        path, yabrowser::style::source_key(source));
+    benchmark::DoNotOptimize(mapped->rule_count());
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_BinaryStylesheet_open)->Unit(benchmark::kMillisecond);
+
+// and the ComplexStylesheet that parsing would have built
+static void BM_BinaryStylesheet_load (benchmark::State& state)
+{
+  const std::string& source = large_stylesheet();
+  const std::string path = large_stylesheet_binary();
+
+  for (auto _ : state) {
+    yabrowser::style::ComplexStylesheet ss;
+    auto mapped = yabrowser::style::MappedStylesheet::open(
+        path, yabrowser::style::source_key(source));
+    mapped->to_stylesheet(ss);
+    benchmark::DoNotOptimize(ss.stylesheet);
+  }
+
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_BinaryStylesheet_load)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,121 @@
+#include "fixtures.hh"
+#include "yabrowser/Layout.hh"
+
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+using namespace yacss;
+
+// the string-keyed lookups calculate_block_width used to do
+static float string_keyed_block_width (const DeclarationContainer& decls)
+{
+  static const CSSBaseValue zero_length = LengthValue(0, yacss::UNIT_PX);
+  static const CSSBaseValue auto_keyword = KeywordValue("auto");
+  float total = 0;
+
+  auto lookup = [&](const std::initializer_list<std::string> keys,
+                    const CSSBaseValue& def) {
+    for (const auto& key : keys) {
+      DeclarationContainer::const_iterator it = decls.find(key);
+      if (it != decls.end())
+        return it->second;
+    }
+    return def;
+  };
+
+  total += to_px(lookup({ "width" }, auto_keyword));
+  total += to_px(lookup({ "margin-left", "margin" }, zero_length));
+  total += to_px(lookup({ "margin-right", "margin" }, zero_length));
+  total += to_px(lookup({ "border-left", "border" }, zero_length));
+  total += to_px(lookup({ "border-right", "border" }, zero_length));
+  total += to_px(lookup({ "padding-left", "padding" }, zero_length));
+  total += to_px(lookup({ "padding-right", "padding" }, zero_length));
+
+  return total;
+}
+
+static float id_keyed_block_width (const StyledNode& node)
+{
+  static const Value zero_length = Value::from_length(0);
+  static const Value auto_keyword = Value::from_keyword(KEYWORD_AUTO);
+  float total = 0;
+
+  total += to_px(node.decl_lookup({ PROPERTY_WIDTH }, auto_keyword));
+  total += to_px(node.decl_lookup({ PROPERTY_MARGIN_LEFT, PROPERTY_MARGIN },
+                                  zero_length));
+  total += to_px(node.decl_lookup({ PROPERTY_MARGIN_RIGHT, PROPERTY_MARGIN },
+                                  zero_length));
+  total += to_px(node.decl_lookup({ PROPERTY_BORDER_LEFT, PROPERTY_BORDER },
+                                  zero_length));
+  total += to_px(node.decl_lookup({ PROPERTY_BORDER_RIGHT, PROPERTY_BORDER },
+                                  zero_length));
+  total += to_px(node.decl_lookup({ PROPERTY_PADDING_LEFT, PROPERTY_PADDING },
+                                  zero_length));
+  total += to_px(node.decl_lookup({ PROPERTY_PADDING_RIGHT, PROPERTY_PADDING },
+                                  zero_length));
+
+  return total;
+}
+
+// a single block with most of the properties calculate_block_width reads
+struct BlockFixture
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+  StyledChild styled;
+  DeclarationContainer decls;
+  std::unique_ptr<LayoutTree> tree;
+
+  BlockFixture ()
+  {
+    htmldriver.parse_source("<body></body>");
+    cssdriver.parse_source("body {"
+                           "  display: block;"
+                           "  width: 100px;"
+                           "  margin: auto;"
+                           "  padding-left: 10px;"
+                           "  border: 1px;"
+                           "  color: black;"
+                           "}");
+
+    styled =
+        std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet);
+    decls = compute_specified_values(
+        cssdriver.stylesheet,
+        *static_cast<yahtml::Element*>(htmldriver.dom.get()));
+    tree.reset(
+        new LayoutTree(styled, Dimensions(Rect(0.0, 0.0, 800.0, 600.0))));
+  }
+};
+
+static BlockFixture& block ()
+{
+  static BlockFixture fixture;
+  return fixture;
+}
+
+static void BM_block_width_string_keys (benchmark::State& state)
+{
+  for (auto _ : state)
+    benchmark::DoNotOptimize(string_keyed_block_width(block().decls));
+}
+BENCHMARK(BM_block_width_string_keys);
+
+static void BM_block_width_property_ids (benchmark::State& state)
+{
+  for (auto _ : state)
+    benchmark::DoNotOptimize(id_keyed_block_width(*block().styled));
+}
+BENCHMARK(BM_block_width_property_ids);
+
+static void BM_calculate_block_width (benchmark::State& state)
+{
+  LayoutTree& tree = *block().tree;
+
+  for (auto _ : state) {
+    tree.calculate_block_width(tree.geometry, 0);
+    benchmark::DoNotOptimize(tree.dimensions(tree.root()).content.width);
+  }
+}
+BENCHMARK(BM_calculate_block_width);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,147 @@
+#include "fixtures.hh"
+#include "yabrowser/DisplayList.hh"
+#include "yabrowser/Raster.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Tiles.hh"
+
+using namespace yabrowser;
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+using namespace yabrowser::paint;
+
+static const Dimensions VIEWPORT (Rect(0.0, 0.0, 1920.0, 1080.0));
+
+// a 1080p canvas filled in one go, with kernels `range(0)`; `range(1)`
+// is the alpha of the color
+static void BM_Canvas_fill_rect (benchmark::State& state)
+{
+  const RasterKernels kernels = static_cast<RasterKernels>(state.range(0));
+  const Color color (200, 100, 50, state.range(1));
+
+  if (!raster_kernels_supported(kernels)) {
+    state.SkipWithError("kernels not supported by this CPU");
+    return;
+  }
+
+  Canvas canvas (1920, 1080, Color(255, 255, 255), kernels);
+
+  for (auto _ : state) {
+    canvas.fill_rect(Rect(0.0, 0.0, 1920.0, 1080.0), color);
+    benchmark::DoNotOptimize(canvas.pixels.data());
+  }
+
+  // megapixels per second
+  state.counters["MP/s"] = benchmark::Counter(
+      state.iterations() * canvas.pixels.size() / 1e6,
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Canvas_fill_rect)
+    ->ArgsProduct({ { RASTER_KERNELS_SCALAR, RASTER_KERNELS_SSE2,
+                      RASTER_KERNELS_AVX2 },
+                    { 255, 128 } })
+    ->Unit(benchmark::kMicrosecond);
+
+// every element of the document is a block with a background and borders
+static const LayoutTree& painted_document (unsigned nodes)
+{
+  static std::map<unsigned, std::unique_ptr<LayoutTree>> trees;
+  std::unique_ptr<LayoutTree>& tree = trees[nodes];
+
+  if (!tree) {
+    tree.reset(new LayoutTree(
+        std::make_shared<StyledNode>(
+            fixtures::document(nodes),
+            fixtures::stylesheet(
+                0, std::string(fixtures::BLOCK_RULES) +
+                       "div { padding: 2px; background-color: #eeeeee; }"
+                       "li { height: 10px; border: 1px; color: navy; }")),
+        VIEWPORT));
+    tree->calculate();
+  }
+
+  return *tree;
+}
+
+static void BM_DisplayList_build (benchmark::State& state)
+{
+  const LayoutTree& tree = painted_document(state.range(0));
+  size_t items = 0;
+
+  for (auto _ : state)
+    items = build_display_list(tree).size();
+
+  state.SetItemsProcessed(state.iterations() * tree.boxes.size());
+  state.counters["items"] = items;
+}
+BENCHMARK(BM_DisplayList_build)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES / 10)
+    ->Unit(benchmark::kMicrosecond);
+
+// the first screenful of the document, most of it clipped away
+static void BM_Canvas_paint (benchmark::State& state)
+{
+  const DisplayList list = build_display_list(painted_document(10000));
+  Canvas canvas (1920, 1080);
+
+  for (auto _ : state) {
+    canvas.clear(Color(255, 255, 255));
+    canvas.paint(list);
+    benchmark::DoNotOptimize(canvas.pixels.data());
+  }
+
+  state.counters["items"] = list.size();
+}
+BENCHMARK(BM_Canvas_paint)->Unit(benchmark::kMillisecond);
+
+// the same screenful, every tile repainted on `range(0)` threads
+static void BM_TileGrid_paint (benchmark::State& state)
+{
+  const DisplayList list = build_display_list(painted_document(10000));
+  ThreadPool pool (state.range(0));
+  TileGrid grid (1920, 1080);
+  TileStats stats;
+
+  for (auto _ : state) {
+    grid.invalidate();
+    grid.paint(list, pool, stats);
+    benchmark::DoNotOptimize(grid.canvas.pixels.data());
+  }
+
+  state.counters["tiles"] = grid.columns * grid.rows;
+}
+BENCHMARK(BM_TileGrid_paint)
+    ->Arg(0)->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// one item changes color from frame to frame: only its tiles are repainted
+static void BM_TileGrid_paint_damage (benchmark::State& state)
+{
+  DisplayList list = build_display_list(painted_document(10000));
+  ThreadPool pool (state.range(0));
+  TileGrid grid (1920, 1080);
+  TileStats stats;
+  // halfway down the screen
+  DisplayItem* item = list.items.data();
+  while (item->rect.y < 540.0)
+    item++;
+
+  grid.paint(list, pool, stats);
+  stats = TileStats();
+
+  for (auto _ : state) {
+    item->color.r ^= 1;
+    grid.paint(list, pool, stats);
+    benchmark::DoNotOptimize(grid.canvas.pixels.data());
+  }
+
+  state.counters["painted"] = benchmark::Counter(
+      stats.painted, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_TileGrid_paint_damage)
+    ->Arg(0)->Arg(4)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,165 @@
+#include "fixtures.hh"
+#include "yabrowser/RuleIndex.hh"
+
+using namespace yabrowser::style;
+
+// the elements matched against: every one of a 1k nodes document
+static const std::vector<const yahtml::Element*>& elements ()
+{
+  static std::vector<const yahtml::Element*> elems;
+
+  if (elems.empty()) {
+    std::vector<yahtml::DOMChild> stack { fixtures::document(1000) };
+
+    while (!stack.empty()) {
+      yahtml::DOMChild node = stack.back();
+      stack.pop_back();
+
+      if (node->type != yahtml::NodeType::Element)
+        continue;
+
+      elems.push_back(static_cast<const yahtml::Element*>(node.get()));
+      stack.insert(stack.end(), node->children.begin(), node->children.end());
+    }
+  }
+
+  return elems;
+}
+
+static void BM_selector_matches (benchmark::State& state)
+{
+  const yacss::Stylesheet& ss = fixtures::stylesheet(state.range(0));
+  size_t selectors = 0;
+
+  for (const auto& rule : ss.rules)
+    selectors += rule->selectors.size();
+
+  for (auto _ : state) {
+    for (const auto& elem : elements()) {
+      for (const auto& rule : ss.rules) {
+        for (const auto& selector : rule->selectors)
+          benchmark::DoNotOptimize(selector_matches(selector, *elem));
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * selectors * elements().size());
+}
+BENCHMARK(BM_selector_matches)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_compiled_selector_matches (benchmark::State& state)
+{
+  const RuleIndex index (fixtures::stylesheet(state.range(0)));
+  std::vector<ElementSignature> signatures;
+  size_t selectors = 0;
+
+  for (const auto& elem : elements())
+    signatures.push_back(element_signature(index.atoms, *elem));
+  for (const auto& rule_selectors : index.compiled)
+    selectors += rule_selectors.size();
+
+  for (auto _ : state) {
+    for (const auto& signature : signatures) {
+      for (const auto& rule_selectors : index.compiled) {
+        for (const auto& selector : rule_selectors)
+          benchmark::DoNotOptimize(
+              compiled_selector_matches(selector, signature));
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * selectors * signatures.size());
+}
+BENCHMARK(BM_compiled_selector_matches)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_matching_rules (benchmark::State& state)
+{
+  const yacss::Stylesheet& ss = fixtures::stylesheet(state.range(0));
+
+  for (auto _ : state) {
+    for (const auto& elem : elements())
+      benchmark::DoNotOptimize(matching_rules(ss, *elem));
+  }
+
+  state.SetItemsProcessed(state.iterations() * elements().size());
+}
+BENCHMARK(BM_matching_rules)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+// range(1) is the MatchEngine
+static void BM_RuleIndex_matching_rules (benchmark::State& state)
+{
+  const RuleIndex index (fixtures::stylesheet(state.range(0)),
+                         static_cast<MatchEngine>(state.range(1)));
+
+  for (auto _ : state) {
+    for (const auto& elem : elements())
+      benchmark::DoNotOptimize(index.matching_rules(*elem));
+  }
+
+  state.SetItemsProcessed(state.iterations() * elements().size());
+}
+BENCHMARK(BM_RuleIndex_matching_rules)
+    ->ArgsProduct({ benchmark::CreateRange(fixtures::MIN_RULES,
+                                           fixtures::MAX_RULES, 10),
+                    { MATCH_ENGINE_STRINGS, MATCH_ENGINE_ATOMS } })
+    ->ArgNames({ "rules", "engine" })
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_compute_specified_values (benchmark::State& state)
+{
+  const yacss::Stylesheet& ss = fixtures::stylesheet(state.range(0));
+
+  for (auto _ : state) {
+    for (const auto& elem : elements())
+      benchmark::DoNotOptimize(compute_specified_values(ss, *elem));
+  }
+
+  state.SetItemsProcessed(state.iterations() * elements().size());
+}
+BENCHMARK(BM_compute_specified_values)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_RuleIndex_compute_specified_values (benchmark::State& state)
+{
+  const RuleIndex index (fixtures::stylesheet(state.range(0)));
+
+  for (auto _ : state) {
+    for (const auto& elem : elements())
+      benchmark::DoNotOptimize(compute_specified_values(index, *elem));
+  }
+
+  state.SetItemsProcessed(state.iterations() * elements().size());
+}
+BENCHMARK(BM_RuleIndex_compute_specified_values)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_RuleIndex_build (benchmark::State& state)
+{
+  const yacss::Stylesheet& ss = fixtures::stylesheet(state.range(0));
+
+  for (auto _ : state) {
+    RuleIndex index (ss);
+    benchmark::DoNotOptimize(index.rules.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * ss.rules.size());
+}
+BENCHMARK(BM_RuleIndex_build)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_RULES, fixtures::MAX_RULES)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,51 @@
+#include "fixtures.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/StyleSharingCache.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<unsigned long> g_allocations (0);
+
+void* operator new (size_t size)
+{
+  g_allocations++;
+
+  if (void* ptr = std::malloc(size))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+using namespace yabrowser::style;
+
+static void BM_StyledNode_allocations (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = fixtures::document(state.range(0));
+  const RuleIndex index (fixtures::stylesheet(100));
+  const unsigned long nodes = fixtures::count_nodes(dom);
+  unsigned long allocations = 0;
+
+  for (auto _ : state) {
+    StyleSharingCache cache (index);
+
+    const unsigned long before = g_allocations;
+    StyledNode root (dom, cache);
+    allocations = g_allocations - before;
+  }
+
+  state.counters["allocations_per_node"] = double(allocations) / nodes;
+  state.SetItemsProcessed(state.iterations() * nodes);
+}
+BENCHMARK(BM_StyledNode_allocations)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,131 @@
+#include "fixtures.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/ThreadPool.hh"
+
+using namespace yabrowser;
+using namespace yabrowser::style;
+
+static void BM_StyledNode (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = fixtures::document(state.range(0));
+  const yacss::Stylesheet& ss = fixtures::stylesheet(state.range(1));
+
+  for (auto _ : state) {
+    StyledNode root (dom, ss);
+    benchmark::DoNotOptimize(root.specified_values);
+  }
+
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode)
+    ->RangeMultiplier(10)
+    ->Ranges({ { fixtures::MIN_NODES, fixtures::MAX_NODES },
+               { fixtures::MIN_RULES, fixtures::MAX_RULES } })
+    ->Unit(benchmark::kMillisecond);
+
+// a fresh cache per tree, the index is built once
+static void BM_StyledNode_shared (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = fixtures::document(state.range(0));
+  const RuleIndex index (fixtures::stylesheet(state.range(1)));
+  double hits = 0;
+  double misses = 0;
+
+  for (auto _ : state) {
+    StyleSharingCache cache (index);
+    StyledNode root (dom, cache);
+
+    hits = cache.hits();
+    misses = cache.misses();
+  }
+
+  state.counters["cache_hits"] = hits;
+  state.counters["cache_misses"] = misses;
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode_shared)
+    ->RangeMultiplier(10)
+    ->Ranges({ { fixtures::MIN_NODES, fixtures::MAX_NODES },
+               { fixtures::MIN_RULES, fixtures::MAX_RULES } })
+    ->Unit(benchmark::kMillisecond);
+
+// 100k nodes, 1k rules, styled with `threads` workers
+static void BM_StyledNode_parallel (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = fixtures::document(100000);
+  const RuleIndex index (fixtures::stylesheet(1000));
+  ThreadPool pool (state.range(0));
+
+  for (auto _ : state) {
+    StyleSharingCache cache (index);
+    StyledNode root (dom, cache, pool);
+    benchmark::DoNotOptimize(root.specified_values);
+  }
+
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode_parallel)
+    ->Arg(0)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// the first render of a page, without (0) and with (1) the UA stylesheet
+// cascaded below 100 author rules: the UA declarations of an element are
+// looked up when its block is first computed, never parsed
+static void BM_StyledNode_user_agent (benchmark::State& state)
+{
+  const yahtml::DOMChild& dom = fixtures::document(10000);
+  RuleIndex index (fixtures::stylesheet(100));
+
+  index.user_agent_styles = state.range(0);
+  for (auto _ : state) {
+    StyleSharingCache cache (index);
+    StyledNode root (dom, cache);
+    benchmark::DoNotOptimize(root.specified_values);
+  }
+
+  state.SetItemsProcessed(state.iterations() * fixtures::count_nodes(dom));
+}
+BENCHMARK(BM_StyledNode_user_agent)
+    ->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+// a single class flips on one item per iteration
+static void BM_StyledNode_restyle (benchmark::State& state)
+{
+  // the document is mutated, so it gets one of its own
+  yahtml::HTMLDriver htmldriver;
+  htmldriver.parse_source(fixtures::synthetic_document(state.range(0)));
+
+  const RuleIndex index (fixtures::stylesheet(1000, ".odd { color: red; }"));
+  StyleSharingCache cache (index);
+  StyledNode root (htmldriver.dom, cache);
+  RestyleStats stats;
+  unsigned toggles = 0;
+
+  for (auto _ : state) {
+    StyledNode& section = *root.children[toggles % root.children.size()];
+    StyledNode& item = *section.children[toggles++ % section.children.size()];
+    auto elem = static_cast<yahtml::Element*>(item.node.get());
+
+    if (!elem->classes.empty() && elem->classes.back() == "odd")
+      elem->classes.pop_back();
+    else
+      elem->classes.push_back("odd");
+
+    item.mark_dirty(RESTYLE_SELF);
+    root.restyle(cache, stats);
+  }
+
+  state.counters["restyled"] =
+      benchmark::Counter(stats.restyled, benchmark::Counter::kAvgIterations);
+  state.counters["reused"] =
+      benchmark::Counter(stats.reused, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StyledNode_restyle)
+    ->RangeMultiplier(10)
+    ->Range(fixtures::MIN_NODES, fixtures::MAX_NODES)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
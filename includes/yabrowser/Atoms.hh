@@ -0,0 +1,112 @@
+#ifndef YABROWSER__STYLE__ATOMS_HH
+#define YABROWSER__STYLE__ATOMS_HH
+
+#include "yacss/CSS.hh"
+#include "yahtml/DOM.hh"
+
+#include <string>
+#include <vector>
+
+
+namespace yabrowser { namespace style {
+
+// interned string; NULL_ATOM is never handed out
+typedef unsigned Atom;
+const Atom NULL_ATOM = 0;
+
+/**
+ * Interns the tags, ids and classes a stylesheet mentions. Once every
+ * selector is compiled the table is only read, so it can be shared by the
+ * threads styling a tree.
+ */
+class AtomTable
+{
+private:
+  struct Slot
+  {
+    unsigned hash;
+    Atom atom;
+    std::string str;
+  };
+
+  // open addressing, power of two sized and at most half full: elements
+  // mostly carry values no selector mentions, and those misses should
+  // cost a hash and a probe or two
+  std::vector<Slot> m_slots;
+  size_t m_size;
+public:
+  AtomTable ();
+
+  Atom intern (const std::string&);
+
+  // NULL_ATOM for strings that were never interned
+  Atom find (const std::string&) const;
+
+  // atoms go from 1 to size()
+  inline size_t size () const { return m_size; }
+private:
+  size_t _probe (const std::string&, unsigned hash) const;
+  void _grow ();
+};
+
+/**
+ * A yacss::Selector turned into atoms. NULL_ATOM stands for "anything"
+ * in `tag` (so does `*`) and in `id`.
+ */
+struct CompiledSelector
+{
+  Atom tag;
+  Atom id;
+  // sorted, without duplicates
+  std::vector<Atom> classes;
+
+  CompiledSelector ();
+};
+
+/**
+ * The same for an element. Values that no selector mentions can't be
+ * matched by any of them and are left out: an unknown tag or id becomes
+ * NULL_ATOM, unknown classes are dropped.
+ */
+struct ElementSignature
+{
+  Atom tag;
+  Atom id;
+  // sorted, without duplicates
+  std::vector<Atom> classes;
+
+  ElementSignature ();
+};
+
+CompiledSelector compile_selector (AtomTable&, const yacss::Selector&);
+ElementSignature element_signature (const AtomTable&, const yahtml::Element&);
+
+/**
+ * Same result as selector_matches() for the selector and element the two
+ * were built from, with the same table.
+ */
+inline bool compiled_selector_matches (const CompiledSelector& sel,
+                                       const ElementSignature& elem)
+{
+  if (sel.tag != NULL_ATOM && sel.tag != elem.tag)
+    return false;
+
+  if (sel.id != NULL_ATOM && sel.id != elem.id)
+    return false;
+
+  // sorted inclusion of sel.classes in elem.classes
+  std::vector<Atom>::const_iterator it = elem.classes.begin();
+  for (const auto& klass : sel.classes) {
+    while (it != elem.classes.end() && *it < klass)
+      ++it;
+
+    if (it == elem.classes.end() || *it != klass)
+      return false;
+  }
+
+  return true;
+}
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef YABROWSER__STYLE__BINARYSTYLESHEET_HH
+#define YABROWSER__STYLE__BINARYSTYLESHEET_HH
+
+#include "yabrowser/Selectors.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+namespace yabrowser { namespace style {
+
+// FNV-1a of a stylesheet's source, which names its binary stylesheet
+uint64_t stylesheet_hash (const std::string& source);
+
+/**
+ * What a binary stylesheet is checked against before it is used: FNV-1a
+ * is easily made to collide, so the size of the source and an independent
+ * hash of it (MurmurHash64A) have to match as well.
+ */
+struct SourceKey
+{
+  uint64_t hash;
+  uint64_t size;
+  uint64_t check;
+};
+
+SourceKey source_key (const std::string& source);
+
+/**
+ * The records of a binary stylesheet. A file is a Header followed by one
+ * array per kind of record; records refer to each other by index and to
+ * strings by offset into the string pool, so that a mapped file is used
+ * where it lies, with nothing to fix up. Everything is 4 byte aligned and
+ * in native byte order: a file is only read by the machine that wrote it.
+ */
+namespace binary {
+
+const uint32_t VERSION = 2;
+
+struct String
+{
+  uint32_t offset;
+  uint32_t size;
+};
+
+// a yacss::Selector
+struct Compound
+{
+  String tag;
+  String id;
+  // a range of the classes array
+  uint32_t first_class;
+  uint32_t class_count;
+  uint32_t specificity;
+};
+
+struct Ancestor
+{
+  uint32_t combinator;
+  uint32_t compound;
+};
+
+// a ComplexSelector, with what parsing it computed
+struct Selector
+{
+  uint32_t subject;
+  uint32_t first_ancestor;
+  uint32_t ancestor_count;
+  uint32_t first_hash;
+  uint32_t hash_count;
+  uint32_t specificity;
+};
+
+// a keyword or a length, the only values that are styled with. `unit` is
+// a yacss::Unit, 0 for keywords.
+struct Declaration
+{
+  String property;
+  uint32_t type;
+  uint32_t unit;
+  float length;
+  String keyword;
+};
+
+struct Rule
+{
+  uint32_t first_selector;
+  uint32_t selector_count;
+  uint32_t first_declaration;
+  uint32_t declaration_count;
+};
+
+enum SectionId
+{
+  SECTION_RULES, SECTION_SELECTORS, SECTION_COMPOUNDS, SECTION_CLASSES,
+  SECTION_ANCESTORS, SECTION_HASHES, SECTION_DECLARATIONS, SECTION_STRINGS,
+  SECTIONS
+};
+
+// `count` records (bytes, for the strings) from `offset` in the file
+struct Section
+{
+  uint32_t offset;
+  uint32_t count;
+};
+
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  // of the whole file
+  uint32_t size;
+  // the SourceKey of the source
+  uint64_t source_hash;
+  uint64_t source_size;
+  uint64_t source_check;
+  Section sections[SECTIONS];
+};
+
+} // ! ns binary
+
+/**
+ * Serializes `ss` into `out`, as the stylesheet of the source of `key`.
+ * False, leaving `out` alone, when `ss` failed to parse, holds a value
+ * that is neither a keyword nor a length in a known unit, or is past 4 GB.
+ */
+bool write_binary_stylesheet (std::string& out, const ComplexStylesheet& ss,
+                              const SourceKey& key);
+
+/**
+ * A binary stylesheet read in place: opening one maps the file and checks
+ * that every record and string lies within it, without allocating
+ * anything per rule. to_stylesheet() then builds the same
+ * ComplexStylesheet that parsing the source would have, without parsing
+ * anything or recomputing specificities and ancestor hashes.
+ */
+class MappedStylesheet
+{
+public:
+  ~MappedStylesheet ();
+
+  MappedStylesheet (const MappedStylesheet&) = delete;
+  const MappedStylesheet& operator= (const MappedStylesheet&) = delete;
+
+  /**
+   * Null if `path` can't be mapped, isn't a binary stylesheet of this
+   * version, or was written for another source than that of `key`.
+   */
+  static std::unique_ptr<MappedStylesheet> open (const std::string& path,
+                                                 const SourceKey& key);
+
+  // same checks, on a buffer that must outlive the stylesheet
+  static std::unique_ptr<MappedStylesheet> view (const char* data,
+                                                 size_t size,
+                                                 const SourceKey& key);
+
+  inline const binary::Header& header () const
+  {
+    return *reinterpret_cast<const binary::Header*>(m_data);
+  }
+
+  template<typename Record>
+  inline const Record* records (binary::SectionId id) const
+  {
+    return reinterpret_cast<const Record*>(
+        m_data + header().sections[id].offset);
+  }
+
+  inline size_t count (binary::SectionId id) const
+  {
+    return header().sections[id].count;
+  }
+
+  inline size_t rule_count () const { return count(binary::SECTION_RULES); }
+
+  inline const binary::Rule& rule (size_t i) const
+  {
+    return records<binary::Rule>(binary::SECTION_RULES)[i];
+  }
+
+  inline const char* string_data (const binary::String& str) const
+  {
+    return records<char>(binary::SECTION_STRINGS) + str.offset;
+  }
+
+  inline std::string string (const binary::String& str) const
+  {
+    return std::string(string_data(str), str.size);
+  }
+
+  void to_stylesheet (ComplexStylesheet& ss) const;
+private:
+  const char* m_data;
+  size_t m_size;
+  // whether m_data was mapped by open()
+  bool m_mapped;
+
+  MappedStylesheet (const char* data, size_t size, bool mapped);
+
+  bool _valid (const SourceKey& key) const;
+  yacss::Selector _compound (uint32_t index) const;
+};
+
+/**
+ * Binary stylesheets in a directory, one file per source hash, so that
+ * only the first process to see a stylesheet parses it. Files are
+ * replaced atomically, which lets any number of processes share the
+ * directory.
+ */
+class BinaryStylesheetCache
+{
+public:
+  const std::string directory;
+private:
+  unsigned long m_hits;
+  unsigned long m_misses;
+public:
+  explicit BinaryStylesheetCache (const std::string& directory);
+
+  std::string path (uint64_t source_hash) const;
+
+  /**
+   * `ss` from the file of `source` when there is a good one, otherwise
+   * parsed, and then written for the next time; failing to write is not
+   * an error. Returns what ComplexStylesheet::parse_source() would.
+   */
+  int load (const std::string& source, ComplexStylesheet& ss);
+
+  inline unsigned long hits () const { return m_hits; }
+  inline unsigned long misses () const { return m_misses; }
+};
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef YABROWSER__STYLE__COMPUTEDSTYLE_HH
+#define YABROWSER__STYLE__COMPUTEDSTYLE_HH
+
+#include "yabrowser/Properties.hh"
+#include "yabrowser/Value.hh"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+namespace yabrowser { namespace style {
+
+enum Display
+{
+  DISPLAY_NONE, DISPLAY_INLINE, DISPLAY_BLOCK
+};
+
+enum TextAlign
+{
+  TEXT_ALIGN_LEFT, TEXT_ALIGN_RIGHT, TEXT_ALIGN_CENTER, TEXT_ALIGN_JUSTIFY
+};
+
+// 8 bits per channel, alpha not premultiplied
+struct Color
+{
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t a;
+
+  inline Color (uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255)
+    : r(r), g(g), b(b), a(a) {}
+
+  inline bool operator== (const Color& rhs) const
+  {
+    return r == rhs.r && g == rhs.g && b == rhs.b && a == rhs.a;
+  }
+
+  inline bool operator!= (const Color& rhs) const { return !(*this == rhs); }
+};
+
+const Color COLOR_TRANSPARENT (0, 0, 0, 0);
+
+// a length in px, or `auto` (and then `px` is 0)
+struct ComputedLength
+{
+  float px;
+  bool is_auto;
+
+  inline ComputedLength (float px = 0.0, bool is_auto = false)
+    : px(px), is_auto(is_auto) {}
+
+  inline bool operator== (const ComputedLength& rhs) const
+  {
+    return px == rhs.px && is_auto == rhs.is_auto;
+  }
+};
+
+template<typename T>
+struct ComputedSides
+{
+  T top;
+  T right;
+  T bottom;
+  T left;
+
+  inline bool operator== (const ComputedSides& rhs) const
+  {
+    return top == rhs.top && right == rhs.right && bottom == rhs.bottom &&
+           left == rhs.left;
+  }
+};
+
+/**
+ * The inherited properties. A node that declares none of them points at
+ * the group of its parent, so a whole subtree usually shares one.
+ */
+struct InheritedStyle
+{
+  Color color;
+  Keyword font_family;
+  float font_size;
+  unsigned font_weight;
+  // px; `normal` is left to line_height_normal
+  float line_height;
+  bool line_height_normal;
+  TextAlign text_align;
+
+  // initial values
+  InheritedStyle ();
+
+  inline float used_line_height () const
+  {
+    return line_height_normal ? 1.2 * font_size : line_height;
+  }
+
+  bool operator== (const InheritedStyle&) const;
+};
+
+typedef std::shared_ptr<const InheritedStyle> InheritedStylePtr;
+
+/**
+ * Everything layout needs from a node, resolved once: shorthands are
+ * expanded, missing values take their initial value and inherited ones
+ * come from the parent. Immutable once built, and shared by every node
+ * with the same declarations under the same inherited group.
+ */
+struct ComputedStyle
+{
+  Display display;
+  ComputedLength width;
+  ComputedLength height;
+  ComputedSides<ComputedLength> margin;
+  ComputedSides<float> border;
+  ComputedSides<float> padding;
+  Color background_color;
+  // `currentColor` unless declared
+  Color border_color;
+  InheritedStylePtr inherited;
+
+  ComputedStyle ();
+};
+
+typedef std::shared_ptr<const ComputedStyle> ComputedStylePtr;
+
+/**
+ * Named colors and `#rgb`/`#rrggbb`, which the parser hands over as
+ * keywords. Anything else gives `fallback`.
+ */
+Color resolve_color (const Value&, const Color& fallback);
+
+// what a node without a parent inherits from
+const InheritedStylePtr& initial_inherited_style ();
+
+/**
+ * Computes the style of a node declaring `specified` whose parent has
+ * `parent_inherited`. Throws std::runtime_error on an unknown display.
+ */
+ComputedStylePtr compute_style (const PropertyTable& specified,
+                                const InheritedStylePtr& parent_inherited);
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef YABROWSER__PAINT__DISPLAYLIST_HH
+#define YABROWSER__PAINT__DISPLAYLIST_HH
+
+#include "Layout.hh"
+#include <vector>
+
+namespace yabrowser
+{
+namespace paint
+{
+
+using style::Color;
+
+// a rectangle filled with a solid color
+struct DisplayItem {
+  layout::Rect rect;
+  Color color;
+  // the box it was painted for
+  layout::BoxId box;
+};
+
+/**
+ * What to paint, back to front. Boxes paint their background, then their
+ * borders, then their descendants, in tree order.
+ */
+struct DisplayList {
+  std::vector<DisplayItem> items;
+
+  inline size_t size() const { return items.size(); }
+  inline bool empty() const { return items.empty(); }
+};
+
+/**
+ * Walks the boxes of a laid out tree. Only block boxes are painted:
+ * anonymous blocks have nothing to paint and the edges of inline boxes are
+ * not laid out. Transparent and empty rectangles are left out.
+ */
+DisplayList build_display_list(const layout::LayoutTree&,
+                               const layout::LayoutGeometry&);
+
+inline DisplayList build_display_list(const layout::LayoutTree& tree)
+{
+  return build_display_list(tree, tree.geometry);
+}
+}  // ! ns paint
+}; // ! ns yabrowser
+
+#endif
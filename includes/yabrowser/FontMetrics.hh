@@ -0,0 +1,180 @@
+#ifndef YABROWSER__LAYOUT__FONTMETRICS_HH
+#define YABROWSER__LAYOUT__FONTMETRICS_HH
+
+#include "ComputedStyle.hh"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace yabrowser
+{
+namespace layout
+{
+
+// what text is measured with. See style::keyword_name() for the family.
+struct FontDescriptor {
+  style::Keyword family;
+  float size;
+  unsigned weight;
+
+  inline FontDescriptor(style::Keyword f = style::KEYWORD_SERIF,
+                        float s = 16.0, unsigned w = 400)
+      : family(f), size(s), weight(w)
+  {
+  }
+
+  inline bool operator==(const FontDescriptor& rhs) const
+  {
+    return size == rhs.size && weight == rhs.weight && family == rhs.family;
+  }
+
+  size_t hash() const;
+};
+
+FontDescriptor font_of(const style::InheritedStyle&);
+
+/**
+ * Measures text. Implementations have to be callable from several layout
+ * threads at once.
+ */
+class FontMetrics
+{
+public:
+  // tells instances apart in the widths they cached, even at one address
+  const unsigned id;
+
+public:
+  FontMetrics();
+  virtual ~FontMetrics();
+
+  FontMetrics(const FontMetrics&) = delete;
+  const FontMetrics& operator=(const FontMetrics&) = delete;
+
+  // advance width, in px, of `length` bytes of `text`
+  virtual float text_width(const FontDescriptor&, const char* text,
+                           size_t length) const = 0;
+};
+
+/**
+ * Every byte advances by the same fraction of the font size. Stands in
+ * for a real font backend, and keeps expected widths easy to work out in
+ * tests.
+ */
+class FixedAdvanceMetrics : public FontMetrics
+{
+public:
+  // in em
+  float advance;
+
+public:
+  inline FixedAdvanceMetrics(float em = 0.5) : advance(em) {}
+
+  float text_width(const FontDescriptor&, const char* text,
+                   size_t length) const;
+};
+
+// what layout measures with unless told otherwise
+const FontMetrics& default_font_metrics();
+
+struct TextCacheStats {
+  unsigned long hits;
+  unsigned long misses;
+  // entries dropped to make room for others
+  unsigned long evictions;
+
+  inline TextCacheStats() : hits(0), misses(0), evictions(0) {}
+
+  inline double hit_rate() const
+  {
+    return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0;
+  }
+};
+
+/**
+ * Bounded cache of text widths, keyed by metrics, font and string. Entries
+ * are spread over shards by the hash of their key, each with a lock and a
+ * CLOCK of its own, so layout threads only contend when they measure
+ * within the same shard at the same time. Measuring is done outside of
+ * the lock.
+ */
+class TextWidthCache
+{
+public:
+  TextWidthCache(size_t capacity = 1 << 16, unsigned shards = 16);
+  ~TextWidthCache();
+
+  TextWidthCache(const TextWidthCache&) = delete;
+  const TextWidthCache& operator=(const TextWidthCache&) = delete;
+
+  // advance width of `length` bytes of `text`, measured on a miss
+  float width(const FontMetrics&, const FontDescriptor&, const char* text,
+              size_t length);
+
+  // summed over the shards
+  TextCacheStats stats() const;
+  size_t size() const;
+  inline size_t capacity() const { return m_shard_capacity * m_shards.size(); }
+
+  void clear();
+
+  // the one every layout tree measures through unless told otherwise
+  static TextWidthCache& shared();
+
+private:
+  struct Entry {
+    uint64_t hash;
+    unsigned metrics;
+    FontDescriptor font;
+    std::string text;
+    float width;
+    // set on every hit, cleared as the clock hand passes by
+    bool referenced;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // by hash; the entry is compared in full before it counts as a hit
+    std::unordered_map<uint64_t, unsigned> slots;
+    std::vector<Entry> entries;
+    size_t hand;
+    TextCacheStats stats;
+  };
+
+  size_t m_shard_capacity;
+  std::vector<std::unique_ptr<Shard>> m_shards;
+
+  void _insert(Shard&, Entry&&);
+};
+
+/**
+ * What layout measures text with: its metrics, in front of a cache that
+ * may be shared with other trees and threads.
+ */
+class TextMeasurer
+{
+public:
+  const FontMetrics& metrics;
+  TextWidthCache& cache;
+
+public:
+  TextMeasurer(const FontMetrics&,
+               TextWidthCache& text_cache = TextWidthCache::shared());
+
+  TextMeasurer(const TextMeasurer&) = delete;
+  const TextMeasurer& operator=(const TextMeasurer&) = delete;
+
+  // the cache is thread safe: so is measuring
+  inline float width(const FontDescriptor& font, const char* text,
+                     size_t length) const
+  {
+    return cache.width(metrics, font, text, length);
+  }
+};
+}  // ! ns layout
+}; // ! ns yabrowser
+
+#endif
@@ -1,21 +1,35 @@
 #ifndef YABROWSER__LAYOUT__LAYOUT_HH
 #define YABROWSER__LAYOUT__LAYOUT_HH
 
+#include "FontMetrics.hh"
 #include "StyleTree.hh"
 #include <memory>
+#include <ostream>
 #include <vector>
 
 namespace yabrowser
 {
+
+class ThreadPool;
+
 namespace layout
 {
 
 class LayoutBox;
+class LayoutTree;
+struct BoxRange;
 struct EdgeSizes;
 struct Rect;
 
-typedef std::shared_ptr<LayoutBox> LayoutBoxPtr;
-typedef std::vector<LayoutBoxPtr> LayoutBoxContainer;
+struct LineBuilder;
+struct ParallelLayout;
+
+typedef unsigned BoxId;
+const BoxId NO_BOX = static_cast<BoxId>(-1);
+const unsigned NO_INLINE_LAYOUT = static_cast<unsigned>(-1);
+
+// below this many boxes a subtree is not worth a task of its own
+const size_t PARALLEL_LAYOUT_THRESHOLD = 1024;
 
 struct EdgeSizes {
   float top;
@@ -71,33 +85,322 @@ struct Dimensions {
 
 enum class BoxType { BlockNode, InlineNode, AnonymousBlock };
 
+// why a box has to be laid out again
+enum LayoutDirty {
+  LAYOUT_CLEAN = 0,
+  // its declarations changed, or it is new
+  LAYOUT_STYLE = 1 << 0,
+  // children were added, removed or moved: they have to be stacked again
+  LAYOUT_CHILDREN = 1 << 1,
+  // the width of what it is laid out against changed
+  LAYOUT_CONTAINING_WIDTH = 1 << 2,
+  // some box below it is dirty
+  LAYOUT_DESCENDANTS = 1 << 3
+};
+
+struct RelayoutStats {
+  // computed again from their style
+  unsigned long laid_out;
+  // only moved vertically along with their container
+  unsigned long shifted;
+  // left untouched
+  unsigned long reused;
+
+  inline RelayoutStats() : laid_out(0), shifted(0), reused(0) {}
+};
+
+/**
+ * A node of the box tree. Boxes live in their LayoutTree's arena and refer
+ * to each other by BoxId; the children of a box are the `child_count`
+ * boxes starting at `first_child`. Geometry is kept by the tree, indexed
+ * by the same id.
+ */
 class LayoutBox
 {
 public:
   BoxType type;
-  Dimensions dimensions;
-  LayoutBoxContainer children;
-  style::StyledChild styled_node;
-  LayoutBox* parent;
+  BoxId id;
+  BoxId parent;
+  BoxId first_child;
+  unsigned child_count;
+  // index in the tree's `inline_layouts` for the block boxes whose
+  // children are inline, NO_INLINE_LAYOUT for the others
+  unsigned inline_layout;
+  // null for anonymous blocks. Owned by the tree's styled root.
+  const style::StyledNode* styled_node;
+
+public:
+  inline LayoutBox(BoxType bt, BoxId box_id, BoxId parent_id,
+                   const style::StyledNode* sn)
+      : type(bt),
+        id(box_id),
+        parent(parent_id),
+        first_child(NO_BOX),
+        child_count(0),
+        inline_layout(NO_INLINE_LAYOUT),
+        styled_node(sn)
+  {
+  }
+};
+
+/**
+ * The part of an inline box that went on one line. For text, the bytes
+ * [begin, end) of its text node. Rects are relative to the content box of
+ * the block holding the lines, so that moving the block leaves its lines
+ * alone.
+ */
+struct InlineFragment {
+  BoxId box;
+  size_t begin;
+  size_t end;
+  Rect rect;
+};
+
+// the fragments of a line are `fragment_count` starting at `first_fragment`
+struct LineBox {
+  Rect rect;
+  unsigned first_fragment;
+  unsigned fragment_count;
+};
+
+// a block in an inline box, across the whole lines its text takes
+struct InlineBlock {
+  BoxId box;
+  Rect rect;
+};
+
+/**
+ * Lines of a block box that establishes an inline formatting context.
+ * Only text produces fragments: inline elements contribute their text,
+ * but neither edges nor vertical alignment, and fragments sit at the top
+ * of their line. A block inside an inline box is no different, except
+ * that its text starts and ends lines of its own; where those lines are
+ * is kept in `blocks`, outer blocks first, for painting it.
+ */
+struct InlineLayout {
+  BoxId container;
+  std::vector<LineBox> lines;
+  std::vector<InlineFragment> fragments;
+  std::vector<InlineBlock> blocks;
+};
+
+struct BoxRange {
+  const LayoutBox* first;
+  const LayoutBox* last;
+
+  inline const LayoutBox* begin() const { return first; }
+  inline const LayoutBox* end() const { return last; }
+  inline size_t size() const { return last - first; }
+  inline bool empty() const { return first == last; }
+  inline const LayoutBox& operator[](size_t i) const { return first[i]; }
+
+  const LayoutBox& at(size_t i) const;
+};
+
+/**
+ * What laying a box tree out against one containing block produces: the
+ * dimensions and lines of every box, by BoxId, and which of them are out
+ * of date. The box tree itself is left alone, so that one tree can be
+ * laid out into several geometries at once.
+ */
+struct LayoutGeometry {
+  // what the root box is laid out against
+  Dimensions containing_block;
+  std::vector<Dimensions> dimensions;
+  // in the order of the tree's inline containers
+  std::vector<InlineLayout> inline_layouts;
+  // LayoutDirty flags
+  std::vector<unsigned char> dirty;
+  // LayoutTree::revision of the boxes this was made for
+  unsigned revision;
+
+  inline LayoutGeometry() : revision(0) {}
+
+  inline const Dimensions& containing(const LayoutBox& box) const
+  {
+    return box.parent == NO_BOX ? containing_block : dimensions[box.parent];
+  }
+
+  // null unless the children of `box` are inline
+  inline const InlineLayout* inline_layout(const LayoutBox& box) const
+  {
+    return box.inline_layout == NO_INLINE_LAYOUT
+               ? nullptr
+               : &inline_layouts[box.inline_layout];
+  }
+};
+
+/**
+ * Owner of a box tree. Boxes are emplaced breadth-first into a single
+ * arena so that siblings are contiguous in memory, and the whole tree is
+ * released at once when the LayoutTree goes away.
+ *
+ * The tree keeps a geometry of its own, which the methods without a
+ * LayoutGeometry argument work on. The others only read the tree, and may
+ * be called concurrently on distinct geometries.
+ */
+class LayoutTree
+{
+public:
+  std::vector<LayoutBox> boxes;
+  // number of boxes in the subtree, by BoxId
+  std::vector<size_t> subtree_sizes;
+  // style generation the boxes were last built from
+  unsigned generation;
+  // bumped by every update(), which renumbers the boxes
+  unsigned revision;
+  style::StyledChild styled_root;
+  LayoutGeometry geometry;
+  TextMeasurer measurer;
 
 public:
-  LayoutBox(const style::StyledChild&, Dimensions dim = Dimensions());
-  LayoutBox(const style::StyledChild&, BoxType bt, LayoutBox* lbp);
-  ~LayoutBox();
+  LayoutTree(const style::StyledChild&, Dimensions dim = Dimensions(),
+             const FontMetrics& metrics = default_font_metrics());
+  ~LayoutTree();
 
-  LayoutBox(const LayoutBox&) = delete;
-  const LayoutBox& operator=(const LayoutBox&) = delete;
+  LayoutTree(const LayoutTree&) = delete;
+  const LayoutTree& operator=(const LayoutTree&) = delete;
 
-  void calculate();
+  inline const LayoutBox& root() const { return boxes.front(); }
+
+  inline BoxRange children(const LayoutBox& box) const
+  {
+    const LayoutBox* first = boxes.data() + box.first_child;
+    return BoxRange{ first, first + box.child_count };
+  }
+
+  inline const Dimensions& dimensions(const LayoutBox& box) const
+  {
+    return geometry.dimensions[box.id];
+  }
+
+  inline const Dimensions& containing(const LayoutBox& box) const
+  {
+    return geometry.containing(box);
+  }
+
+  // null unless the children of `box` are inline
+  inline const InlineLayout* inline_layout(const LayoutBox& box) const
+  {
+    return geometry.inline_layout(box);
+  }
+
+  /**
+   * A geometry for the boxes as they are, with every box out of date.
+   * Geometries made before an update() do not fit the tree anymore: the
+   * methods below remake them, every box out of date again, except for
+   * calculate() of a box other than the root, which throws
+   * std::logic_error.
+   */
+  LayoutGeometry new_geometry(const Dimensions& containing_block) const;
+
+  inline void calculate() { calculate(geometry); }
+  inline void calculate(BoxId id) { calculate(geometry, id); }
+
+  void calculate(LayoutGeometry&) const;
+  void calculate(LayoutGeometry&, BoxId) const;
+
+  /**
+   * Same results as calculate(), split in two traversals: widths go
+   * top-down and heights bottom-up in the first one, then vertical
+   * positions are fixed up top-down. Block subtrees of at least
+   * `threshold` boxes are laid out as separate tasks on `pool`.
+   */
+  inline void calculate(ThreadPool& pool,
+                        size_t threshold = PARALLEL_LAYOUT_THRESHOLD)
+  {
+    calculate(geometry, pool, threshold);
+  }
+
+  void calculate(LayoutGeometry&, ThreadPool& pool,
+                 size_t threshold = PARALLEL_LAYOUT_THRESHOLD) const;
+
+  /**
+   * Lays the tree out into every geometry of `viewports`, one task on
+   * `pool` each. The geometries are independent: this scales with the
+   * number of viewports rather than with the shape of the tree.
+   */
+  void calculate_viewports(std::vector<LayoutGeometry>& viewports,
+                           ThreadPool& pool) const;
+
+  /**
+   * Flags a box for relayout() and lets its ancestors know that they have
+   * to look below them.
+   */
+  inline void mark_dirty(BoxId id, unsigned flags)
+  {
+    mark_dirty(geometry, id, flags);
+  }
+
+  void mark_dirty(LayoutGeometry&, BoxId, unsigned flags) const;
+
+  // changes the width of the viewport, relayout() takes it from there
+  inline void set_containing_width(float width)
+  {
+    set_containing_width(geometry, width);
+  }
+
+  void set_containing_width(LayoutGeometry&, float width) const;
+
+  /**
+   * Rebuilds the boxes after the styled tree was restyled. Boxes of styled
+   * nodes that survived keep their geometry and are only flagged when
+   * their style or their children changed. That is the tree's own
+   * geometry: others, from new_geometry(), are laid out from scratch the
+   * next time they are used.
+   */
+  void update();
+
+  /**
+   * Brings the geometry of dirty boxes up to date. Clean subtrees are not
+   * laid out again: at most their vertical position is shifted when a box
+   * before them changed height. Gives the same results as calculate().
+   */
+  inline void relayout(RelayoutStats& stats) { relayout(geometry, stats); }
+
+  void relayout(LayoutGeometry&, RelayoutStats&) const;
 
   /* // block */
-  void calculate_block_layout();
-  void calculate_block_width();
-  void calculate_block_position();
-  void calculate_block_height();
+  void calculate_block_layout(LayoutGeometry&, BoxId) const;
+  void calculate_block_width(LayoutGeometry&, BoxId) const;
+  void calculate_block_position(LayoutGeometry&, BoxId) const;
+  void calculate_block_height(LayoutGeometry&, BoxId) const;
+
+  /* // inline */
+  // breaks the inline content of a block into lines of its content width,
+  // which become its content height
+  void calculate_inline_layout(LayoutGeometry&, BoxId) const;
 private:
   void _init_tree();
+  BoxId _inline_container(BoxId) const;
+  void _add_inline_content(BoxId, LineBuilder&) const;
+
+  // remakes `viewport` if it was made before the last update()
+  void _fit(LayoutGeometry& viewport) const;
+  void _calculate_block_edges(LayoutGeometry&, BoxId) const;
+  void _calculate_block_y(LayoutGeometry&, BoxId,
+                          float preceding_height) const;
+
+  void _calculate_widths_and_heights(LayoutGeometry&, BoxId,
+                                     const ParallelLayout&) const;
+  void _calculate_positions(LayoutGeometry&, BoxId, float preceding_height,
+                            const ParallelLayout&) const;
+
+  void _relayout(LayoutGeometry&, BoxId, float preceding_height,
+                 bool containing_changed, RelayoutStats&) const;
+  void _shift(LayoutGeometry&, BoxId) const;
 };
+
+/**
+ * The box tree as JSON, one object per box with its children nested.
+ * Lines and fragments are given in the same coordinates as the boxes.
+ */
+void write_json(std::ostream&, const LayoutTree&, const LayoutGeometry&);
+
+inline void write_json(std::ostream& out, const LayoutTree& tree)
+{
+  write_json(out, tree, tree.geometry);
+}
 }  // ! ns yabrowser
 }; // ! ns layout
 
@@ -0,0 +1,145 @@
+#ifndef YABROWSER__STYLE__PROPERTIES_HH
+#define YABROWSER__STYLE__PROPERTIES_HH
+
+#include "yabrowser/Value.hh"
+#include "yacss/CSS.hh"
+
+#include <array>
+#include <bitset>
+#include <map>
+#include <string>
+
+
+namespace yabrowser { namespace style {
+
+#define YABROWSER_PROPERTIES(X)                                                \
+  X(DISPLAY, "display")                                                        \
+  X(WIDTH, "width")                                                            \
+  X(HEIGHT, "height")                                                          \
+  X(MARGIN, "margin")                                                          \
+  X(MARGIN_TOP, "margin-top")                                                  \
+  X(MARGIN_RIGHT, "margin-right")                                              \
+  X(MARGIN_BOTTOM, "margin-bottom")                                            \
+  X(MARGIN_LEFT, "margin-left")                                                \
+  X(PADDING, "padding")                                                        \
+  X(PADDING_TOP, "padding-top")                                                \
+  X(PADDING_RIGHT, "padding-right")                                            \
+  X(PADDING_BOTTOM, "padding-bottom")                                          \
+  X(PADDING_LEFT, "padding-left")                                              \
+  X(BORDER, "border")                                                          \
+  X(BORDER_TOP, "border-top")                                                  \
+  X(BORDER_RIGHT, "border-right")                                              \
+  X(BORDER_BOTTOM, "border-bottom")                                            \
+  X(BORDER_LEFT, "border-left")                                                \
+  X(BORDER_WIDTH, "border-width")                                              \
+  X(BORDER_TOP_WIDTH, "border-top-width")                                      \
+  X(BORDER_RIGHT_WIDTH, "border-right-width")                                  \
+  X(BORDER_BOTTOM_WIDTH, "border-bottom-width")                                \
+  X(BORDER_LEFT_WIDTH, "border-left-width")                                    \
+  X(BORDER_COLOR, "border-color")                                              \
+  X(BACKGROUND, "background")                                                  \
+  X(BACKGROUND_COLOR, "background-color")                                      \
+  X(COLOR, "color")                                                            \
+  X(FONT_FAMILY, "font-family")                                                \
+  X(FONT_SIZE, "font-size")                                                    \
+  X(FONT_WEIGHT, "font-weight")                                                \
+  X(LINE_HEIGHT, "line-height")                                                \
+  X(TEXT_ALIGN, "text-align")
+
+/**
+ * Every property the engine knows about gets a dense id so that lookups
+ * in the hot paths are plain array indexing. Anything else maps to
+ * PROPERTY_UNKNOWN and is kept by name.
+ */
+enum PropertyId
+{
+#define YABROWSER_PROPERTY_ID(id, name) PROPERTY_##id,
+  YABROWSER_PROPERTIES(YABROWSER_PROPERTY_ID)
+#undef YABROWSER_PROPERTY_ID
+  PROPERTY_UNKNOWN
+};
+
+const unsigned PROPERTY_COUNT = PROPERTY_UNKNOWN;
+
+PropertyId property_id (const std::string& name);
+const char* property_name (PropertyId id);
+
+/**
+ * What compute_style() falls back on when `id` is not declared, most
+ * specific first: `margin` for `margin-top`, `border-top`, `border-width`
+ * then `border` for `border-top-width`. Ends with PROPERTY_UNKNOWN.
+ */
+const PropertyId* property_fallbacks (PropertyId id);
+
+
+/**
+ * Declarations of a node indexed by PropertyId, with an escape hatch for
+ * properties not listed in YABROWSER_PROPERTIES. Values are converted
+ * from the parser's when they are stored.
+ */
+class PropertyTable
+{
+public:
+  typedef std::map<std::string, Value> UnknownProperties;
+
+  std::array<Value, PROPERTY_COUNT> values;
+  std::bitset<PROPERTY_COUNT> present;
+  UnknownProperties unknown;
+public:
+  PropertyTable();
+  explicit PropertyTable(const yacss::DeclarationContainer&);
+  ~PropertyTable();
+
+  void set (const std::string& name, const Value& value);
+  void set (PropertyId id, const Value& value);
+
+  inline void set (const std::string& name, const yacss::CSSBaseValue& value)
+  {
+    set(name, Value(value));
+  }
+
+  inline void set (PropertyId id, const yacss::CSSBaseValue& value)
+  {
+    set(id, Value(value));
+  }
+
+  // like set(), unless the property is present already. Returns whether
+  // the value was stored.
+  bool insert (const std::string& name, const Value& value);
+  bool insert (PropertyId id, const Value& value);
+
+  inline bool insert (const std::string& name,
+                      const yacss::CSSBaseValue& value)
+  {
+    return insert(name, Value(value));
+  }
+
+  // every property of `table` not present here already
+  void insert (const PropertyTable& table);
+
+  inline const Value* find (PropertyId id) const
+  {
+    if (id == PROPERTY_UNKNOWN || !present[id])
+      return nullptr;
+
+    return &values[id];
+  }
+
+  const Value* find (const std::string& name) const;
+
+  // throws std::out_of_range if the property is not present
+  const Value& at (const std::string& name) const;
+
+  bool operator== (const PropertyTable&) const;
+  inline bool operator!= (const PropertyTable& rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+  inline size_t size () const { return present.count() + unknown.size(); }
+  inline bool empty () const { return size() == 0; }
+};
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef YABROWSER__PAINT__RASTER_HH
+#define YABROWSER__PAINT__RASTER_HH
+
+#include "DisplayList.hh"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+namespace yabrowser
+{
+namespace paint
+{
+
+/**
+ * Implementations of the span kernels. They all give the same pixels,
+ * bit for bit: they only differ in how many of them they handle at once.
+ */
+enum RasterKernels {
+  RASTER_KERNELS_SCALAR,
+  // 4 pixels at a time
+  RASTER_KERNELS_SSE2,
+  // 8 pixels at a time
+  RASTER_KERNELS_AVX2
+};
+
+bool raster_kernels_supported(RasterKernels);
+
+// the widest the running CPU supports
+RasterKernels best_raster_kernels();
+
+// a pixel as laid out in memory: R, G, B and A bytes
+inline uint32_t pack_pixel(const Color& color)
+{
+  const uint8_t bytes[4] = { color.r, color.g, color.b, color.a };
+  uint32_t pixel;
+
+  std::memcpy(&pixel, bytes, sizeof(pixel));
+  return pixel;
+}
+
+inline Color unpack_pixel(uint32_t pixel)
+{
+  uint8_t bytes[4];
+
+  std::memcpy(bytes, &pixel, sizeof(pixel));
+  return Color(bytes[0], bytes[1], bytes[2], bytes[3]);
+}
+
+// nearest pixel edge, within [0, limit]
+inline unsigned snap_to_pixel(float coordinate, unsigned limit)
+{
+  const float edge = std::floor(coordinate + 0.5f);
+
+  if (!(edge > 0.0f))
+    return 0;
+
+  return edge < limit ? static_cast<unsigned>(edge) : limit;
+}
+
+// sets `count` pixels to `pixel`
+void fill_span(RasterKernels, uint32_t* pixels, size_t count, uint32_t pixel);
+
+/**
+ * Draws `color` over `count` pixels (source-over, not premultiplied). Every
+ * channel, alpha included, rounds (color * a + pixel * (255 - a)) / 255,
+ * where the alpha of `color` counts as 255.
+ */
+void blend_span(RasterKernels, uint32_t* pixels, size_t count,
+                const Color& color);
+
+/**
+ * An RGBA image, row after row. Rects are snapped to the nearest pixel
+ * edges and clipped to the canvas; there is no anti-aliasing.
+ */
+class Canvas
+{
+public:
+  unsigned width;
+  unsigned height;
+  std::vector<uint32_t> pixels;
+  RasterKernels kernels;
+
+public:
+  Canvas(unsigned w, unsigned h, const Color& background = Color(255, 255, 255),
+         RasterKernels k = best_raster_kernels());
+
+  void clear(const Color&);
+  void fill_rect(const layout::Rect&, const Color&);
+
+  // only touches the pixels within `clip`, which is in whole pixels
+  void fill_rect(const layout::Rect&, const Color&, const layout::Rect& clip);
+
+  // paints the items in order
+  void paint(const DisplayList&);
+
+  inline Color pixel(unsigned x, unsigned y) const
+  {
+    return unpack_pixel(pixels[y * width + x]);
+  }
+};
+
+// binary PPM (P6). Alpha is dropped.
+void write_ppm(std::ostream&, const Canvas&);
+}  // ! ns paint
+}; // ! ns yabrowser
+
+#endif
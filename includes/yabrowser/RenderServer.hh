@@ -0,0 +1,222 @@
+#ifndef YABROWSER__SERVER__RENDER_SERVER_HH
+#define YABROWSER__SERVER__RENDER_SERVER_HH
+
+#include "RuleIndex.hh"
+#include "Selectors.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace yabrowser
+{
+
+class ThreadPool;
+
+namespace server
+{
+
+// bigger messages are taken for garbage and end the connection
+const uint32_t MAX_MESSAGE_SIZE = 256u << 20;
+// per side. A request whose images can't fit in one response is refused
+// as well, whatever its viewport.
+const unsigned MAX_VIEWPORT_SIZE = 16384;
+
+enum RenderFormat : uint32_t {
+  // layout only, for timing
+  FORMAT_NONE = 0,
+  FORMAT_JSON = 1,
+  FORMAT_PPM = 2
+};
+
+enum RenderStatus : uint32_t {
+  RENDER_OK = 0,
+  RENDER_PARSE_ERROR = 1,
+  RENDER_BAD_REQUEST = 2,
+  // the document parsed but failed to render, the output says why
+  RENDER_ERROR = 3
+};
+
+// a batch of documents, all rendered against the same stylesheet
+struct RenderRequest {
+  RenderFormat format;
+  unsigned width;
+  unsigned height;
+  std::string css;
+  std::vector<std::string> documents;
+
+  inline RenderRequest() : format(FORMAT_JSON), width(1280), height(720) {}
+};
+
+struct RenderResult {
+  RenderStatus status;
+  // layout JSON or PPM image, as asked for
+  std::string output;
+  // spent on this document by the server
+  uint64_t micros;
+
+  inline RenderResult() : status(RENDER_OK), micros(0) {}
+};
+
+// one result per document, in the order of the request
+struct RenderResponse {
+  std::vector<RenderResult> results;
+};
+
+/**
+ * A parsed stylesheet and its rule index, ready to style any number of
+ * documents at once: both are only read once built. The UA stylesheet
+ * cascades below it.
+ */
+struct CompiledStylesheet {
+  std::string source;
+  style::ComplexStylesheet stylesheet;
+  std::unique_ptr<style::RuleIndex> index;
+};
+
+typedef std::shared_ptr<const CompiledStylesheet> CompiledStylesheetPtr;
+
+/**
+ * Compiled stylesheets by hash of their source, the least recently used
+ * dropped first. Compiling is done outside of the lock: two threads asking
+ * for the same new stylesheet may both compile it.
+ */
+class StylesheetCache
+{
+public:
+  explicit StylesheetCache(size_t capacity = 64);
+
+  StylesheetCache(const StylesheetCache&) = delete;
+  const StylesheetCache& operator=(const StylesheetCache&) = delete;
+
+  // null if `source` does not parse
+  CompiledStylesheetPtr get(const std::string& source);
+
+  size_t size() const;
+  inline unsigned long hits() const { return m_hits; }
+  inline unsigned long misses() const { return m_misses; }
+
+private:
+  struct Entry {
+    uint64_t hash;
+    CompiledStylesheetPtr stylesheet;
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  mutable std::mutex m_mutex;
+  // most recently used first
+  EntryList m_entries;
+  std::unordered_map<uint64_t, EntryList::iterator> m_by_hash;
+  size_t m_capacity;
+  std::atomic<unsigned long> m_hits;
+  std::atomic<unsigned long> m_misses;
+};
+
+/**
+ * What stays warm between requests: the pool and the stylesheets. The
+ * documents of a request are rendered as tasks of their own, each on a
+ * single thread, since a server has more documents than cores to keep
+ * busy.
+ */
+class Renderer
+{
+public:
+  ThreadPool& pool;
+  StylesheetCache stylesheets;
+
+public:
+  explicit Renderer(ThreadPool&, size_t stylesheet_capacity = 64);
+
+  Renderer(const Renderer&) = delete;
+  const Renderer& operator=(const Renderer&) = delete;
+
+  RenderResponse render(const RenderRequest&);
+};
+
+/* // protocol */
+// integers are little endian, strings and lists are prefixed by their size
+void encode(const RenderRequest&, std::string& out);
+void encode(const RenderResponse&, std::string& out);
+
+// false on a truncated or malformed message
+bool decode(const std::string& in, RenderRequest&);
+bool decode(const std::string& in, RenderResponse&);
+
+// a message is its size followed by as many bytes. False on error, or
+// without writing anything for a message over MAX_MESSAGE_SIZE.
+bool write_message(int fd, const std::string&);
+
+// false on end of stream, error or a message over MAX_MESSAGE_SIZE
+bool read_message(int fd, std::string&);
+
+/**
+ * Renders requests coming over a Unix domain socket. Every connection is
+ * served by a thread of its own, which reads requests and answers them in
+ * order; the rendering itself goes to the renderer's pool, so that it is
+ * shared by all connections.
+ */
+class RenderServer
+{
+public:
+  // binds `path`, replacing a stale socket; throws std::system_error
+  RenderServer(Renderer&, const std::string& path);
+  ~RenderServer();
+
+  RenderServer(const RenderServer&) = delete;
+  const RenderServer& operator=(const RenderServer&) = delete;
+
+  // accepts connections until stop()
+  void serve();
+
+  // from any thread: ends serve() and every connection, and waits for them
+  void stop();
+
+  inline unsigned long requests() const { return m_requests; }
+  // requests that ended their connection, each logged to stderr
+  inline unsigned long failures() const { return m_failures; }
+
+private:
+  Renderer& m_renderer;
+  std::string m_path;
+  int m_listener;
+  std::atomic<bool> m_stopping;
+  std::atomic<unsigned long> m_requests;
+  std::atomic<unsigned long> m_failures;
+
+  // open connections, each with a detached thread serving it
+  std::mutex m_mutex;
+  std::condition_variable m_closed;
+  std::vector<int> m_connections;
+
+  void _serve_connection(int fd);
+  void _fail(int fd, const std::string& why);
+};
+
+class RenderClient
+{
+public:
+  // throws std::system_error
+  explicit RenderClient(const std::string& path);
+  ~RenderClient();
+
+  RenderClient(const RenderClient&) = delete;
+  const RenderClient& operator=(const RenderClient&) = delete;
+
+  // throws std::runtime_error when the server goes away
+  RenderResponse render(const RenderRequest&);
+
+private:
+  int m_fd;
+  std::string m_buffer;
+};
+}  // ! ns server
+}; // ! ns yabrowser
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef YABROWSER__STYLE__RULEINDEX_HH
+#define YABROWSER__STYLE__RULEINDEX_HH
+
+#include "yabrowser/Atoms.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleTree.hh"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+namespace yabrowser { namespace style {
+
+enum MatchEngine
+{
+  // compares the selectors' strings against the element's
+  MATCH_ENGINE_STRINGS,
+  // compares compiled selectors against the element's atom signature
+  MATCH_ENGINE_ATOMS
+};
+
+// a selector of a rule, identified by their indices in RuleIndex
+struct CascadeEntry
+{
+  unsigned rule;
+  unsigned selector;
+};
+
+/**
+ * Precompiled view of a stylesheet that buckets every selector by its most
+ * selective key (id, then first class, then tag, then universal). Matching
+ * an element only probes the buckets for its own id, classes and tag name
+ * instead of walking every rule of the stylesheet.
+ *
+ * Every selector gets a rank in the cascade when the index is built:
+ * by specificity, then by source order. Buckets hold ranks in increasing
+ * order, so merging the few buckets an element probes yields its matches
+ * already sorted, with no per element sort.
+ *
+ * Both engines are always built, `engine` picks the one matching uses and
+ * can be switched at any time the index isn't being matched against.
+ * `user_agent_styles` likewise cascades the UA stylesheet below the rules
+ * of the index (see UserAgentStyles.hh); it is off by default, which
+ * leaves elements inline unless the stylesheet says otherwise.
+ */
+class RuleIndex
+{
+public:
+  typedef std::vector<unsigned> Bucket;
+  typedef std::unordered_map<std::string, Bucket> BucketMap;
+
+  std::vector<yacss::RulePtr> rules;
+  // the selectors of each rule, with their combinators if any
+  std::vector<std::vector<ComplexSelector>> selectors;
+  // whether some selector looks at ancestors
+  bool has_combinators;
+  // every selector, lowest precedence first; buckets hold indices in here
+  std::vector<CascadeEntry> cascade;
+  // the rank in `cascade` of each selector of each rule
+  std::vector<std::vector<unsigned>> ranks;
+  BucketMap id_buckets;
+  BucketMap class_buckets;
+  BucketMap tag_buckets;
+  Bucket universal;
+  // the declarations of each rule, converted once
+  std::vector<PropertyTable> declarations;
+  std::unordered_map<const yacss::Rule*, unsigned> rule_indices;
+
+  MatchEngine engine;
+  bool user_agent_styles;
+  AtomTable atoms;
+  // the subjects of `selectors`, compiled
+  std::vector<std::vector<CompiledSelector>> compiled;
+  // the buckets above, indexed by atom
+  std::vector<Bucket> id_atom_buckets;
+  std::vector<Bucket> class_atom_buckets;
+  std::vector<Bucket> tag_atom_buckets;
+public:
+  explicit RuleIndex(const yacss::Stylesheet& ss,
+                     MatchEngine engine = MATCH_ENGINE_ATOMS);
+  explicit RuleIndex(const ComplexStylesheet& ss,
+                     MatchEngine engine = MATCH_ENGINE_ATOMS);
+  ~RuleIndex();
+
+  /**
+   * Same ordered result as matching_rules(ss, elem) for the stylesheet the
+   * index was built from: each matching rule once, with the specificity
+   * of its most specific matching selector, ordered by that specificity
+   * and then by source order. Selectors with combinators never match
+   * here: `elem` is taken as the root.
+   */
+  std::vector<MatchedRule> matching_rules (const yahtml::Element&) const;
+
+  /**
+   * Same, for an element whose parent in the styled tree is `parent`. See
+   * complex_selector_matches() for `filter`.
+   */
+  std::vector<MatchedRule> matching_rules (const yahtml::Element&,
+                                           const StyledNode* parent,
+                                           const AncestorFilter* filter) const;
+
+  // the declarations of a rule matching_rules() handed out
+  inline const PropertyTable& declarations_of (const MatchedRule& rule) const
+  {
+    return declarations[rule_indices.at(rule.first.get())];
+  }
+private:
+  typedef std::vector<std::pair<Bucket::const_iterator,
+                                Bucket::const_iterator>> BucketRanges;
+
+  void _build ();
+  void _insert (const yacss::Selector&, unsigned rank);
+  void _insert (const CompiledSelector&, unsigned rank);
+  void _collect (const BucketMap&, const std::string&, BucketRanges&) const;
+  void _collect (const std::vector<Bucket>&, Atom, BucketRanges&) const;
+  BucketRanges _candidates (const yahtml::Element&) const;
+  BucketRanges _candidates (const ElementSignature&) const;
+
+  template<typename Matches>
+  std::vector<MatchedRule> _match (BucketRanges&, const Matches&) const;
+};
+
+// the declarations of the rules of the index only, never the UA ones
+yacss::DeclarationContainer compute_specified_values (
+    const RuleIndex&, const yahtml::Element&
+);
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef YABROWSER__STYLE__SELECTORS_HH
+#define YABROWSER__STYLE__SELECTORS_HH
+
+#include "yacss/CSS.hh"
+#include "yahtml/DOM.hh"
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace yabrowser { namespace style {
+
+class StyledNode;
+
+enum Combinator
+{
+  // `a b`
+  COMBINATOR_DESCENDANT,
+  // `a > b`
+  COMBINATOR_CHILD
+};
+
+// at most this many ancestor hashes are checked against the filter
+const unsigned MAX_ANCESTOR_HASHES = 4;
+
+/**
+ * A selector with combinators (`nav ul > li a`). yacss only knows about
+ * compound selectors, so it parses the compounds, specificity included,
+ * and they are linked right to left: `ancestors[0]` is the compound right
+ * before the subject, together with the combinator between the two.
+ */
+struct ComplexSelector
+{
+  typedef std::pair<Combinator, yacss::Selector> Ancestor;
+
+  yacss::Selector subject;
+  std::vector<Ancestor> ancestors;
+  // tag, id and class hashes that some ancestor must have, most selective
+  // first; see AncestorFilter
+  std::vector<unsigned> ancestor_hashes;
+  unsigned specificity;
+
+  ComplexSelector ();
+  explicit ComplexSelector (const yacss::Selector& subject);
+};
+
+/**
+ * Parses a single selector such as `nav > ul li.item a`. Only type, id and
+ * class selectors joined by descendant and child combinators are
+ * supported; anything else throws std::invalid_argument.
+ */
+ComplexSelector parse_complex_selector (const std::string&);
+
+unsigned tag_hash (const std::string&);
+unsigned id_hash (const std::string&);
+unsigned class_hash (const std::string&);
+
+/**
+ * Counting Bloom filter of the tags, ids and classes of the elements
+ * between the root and the element being styled. Elements are pushed and
+ * popped as the traversal goes down and back up, so that a selector whose
+ * ancestor compounds mention something none of the ancestors have is
+ * rejected without walking the ancestor chain. It may answer yes for
+ * values that are not there, never no for values that are.
+ */
+class AncestorFilter
+{
+public:
+  static const unsigned KEY_BITS = 12;
+  static const unsigned KEY_MASK = (1 << KEY_BITS) - 1;
+private:
+  std::array<unsigned char, 1 << KEY_BITS> m_counters;
+  // hashes of every pushed element, and where each element's start
+  std::vector<unsigned> m_hashes;
+  std::vector<size_t> m_marks;
+public:
+  AncestorFilter ();
+
+  void push (const yahtml::Element&);
+  void pop ();
+
+  inline bool might_contain (unsigned hash) const
+  {
+    return m_counters[hash & KEY_MASK] &&
+           m_counters[(hash >> KEY_BITS) & KEY_MASK];
+  }
+
+  inline size_t depth () const { return m_marks.size(); }
+private:
+  void _add (unsigned hash);
+};
+
+/**
+ * Matches `sel` against `elem`, whose parent in the styled tree is
+ * `parent` (null for the root). Ancestors are walked through
+ * StyledNode::parent; when given, `filter` must hold exactly those
+ * ancestors and is used to skip the walk for most selectors that can't
+ * match.
+ */
+bool complex_selector_matches (const ComplexSelector& sel,
+                               const yahtml::Element& elem,
+                               const StyledNode* parent,
+                               const AncestorFilter* filter = nullptr);
+
+// the part of complex_selector_matches() that looks at the ancestors only
+bool complex_ancestors_match (const ComplexSelector& sel,
+                              const StyledNode* parent,
+                              const AncestorFilter* filter = nullptr);
+
+/**
+ * A parsed stylesheet whose selectors may have combinators. Combinators
+ * are split off here, compounds and declaration blocks parsed by yacss,
+ * and `selectors[i]` keeps the full selectors of `stylesheet.rules[i]`,
+ * whose own selectors are their subjects. Comments are skipped; at-rules,
+ * rules with a selector parse_complex_selector() rejects and rules yacss
+ * can't parse are left out alone. Only a block left open fails the whole stylesheet.
+ */
+class ComplexStylesheet
+{
+public:
+  int result;
+  yacss::Stylesheet stylesheet;
+  std::vector<std::vector<ComplexSelector>> selectors;
+public:
+  ComplexStylesheet ();
+
+  int parse_source (const std::string& source);
+};
+
+}}; // ! ns yabrowser style
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef YABROWSER__STYLE__STYLESHARINGCACHE_HH
+#define YABROWSER__STYLE__STYLESHARINGCACHE_HH
+
+#include "yabrowser/StyleTree.hh"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+namespace yabrowser { namespace style {
+
+/**
+ * Everything that can influence the declarations an element ends up with:
+ * compound selectors only look at the tag, the id and the classes, and
+ * `parent` is the declaration block of the parent. Blocks are only handed
+ * out per key, so with combinators a block also stands for the tags, ids
+ * and classes of every ancestor, and cousins under alike ancestors share.
+ */
+struct StyleSharingKey
+{
+  std::string tag;
+  std::string id;
+  std::vector<std::string> classes;
+  const void* parent;
+
+  StyleSharingKey ();
+  StyleSharingKey (const yahtml::Element&, const void* parent);
+
+  // reuses the storage already owned by the key
+  void assign (const yahtml::Element&, const void* parent);
+
+  inline bool operator==(const StyleSharingKey& rhs) const
+  {
+    return parent == rhs.parent && tag == rhs.tag && id == rhs.id &&
+           classes == rhs.classes;
+  }
+};
+
+struct StyleSharingKeyHash
+{
+  size_t operator()(const StyleSharingKey&) const;
+};
+
+// a declaration block under the inherited style of some parent
+struct ComputedStyleKey
+{
+  const PropertyTable* specified;
+  const InheritedStyle* parent_inherited;
+
+  inline bool operator==(const ComputedStyleKey& rhs) const
+  {
+    return specified == rhs.specified &&
+           parent_inherited == rhs.parent_inherited;
+  }
+};
+
+struct ComputedStyleKeyHash
+{
+  size_t operator()(const ComputedStyleKey&) const;
+};
+
+// a block and the parent block it is keyed on, kept alive so that no
+// other block can take its address while the key is in use
+struct SharedBlock
+{
+  DeclarationBlock block;
+  DeclarationBlock parent;
+};
+
+/**
+ * Hands out one immutable, refcounted declaration block per distinct
+ * StyleSharingKey so that repeated siblings (`<li class="item">` lists)
+ * point at the same specified values instead of recomputing and copying
+ * them. Safe to share between threads styling different subtrees: the map
+ * is split in independently locked shards and blocks are computed outside
+ * of any lock.
+ *
+ * Computed styles are shared the same way, one per declaration block and
+ * parent inherited style. Both are kept alive by the cache itself, so the
+ * raw pointers in ComputedStyleKey can't be reused while it is in there.
+ */
+class StyleSharingCache
+{
+public:
+  typedef std::unordered_map<StyleSharingKey, SharedBlock,
+                             StyleSharingKeyHash> BlockMap;
+  typedef std::unordered_map<ComputedStyleKey, ComputedStylePtr,
+                             ComputedStyleKeyHash> ComputedMap;
+
+  static const unsigned SHARDS = 16;
+
+  const RuleIndex& index;
+private:
+  struct Shard
+  {
+    std::mutex mutex;
+    BlockMap blocks;
+    ComputedMap computed;
+  };
+
+  std::array<Shard, SHARDS> m_shards;
+  std::atomic<unsigned long> m_hits;
+  std::atomic<unsigned long> m_misses;
+public:
+  explicit StyleSharingCache(const RuleIndex& index);
+  ~StyleSharingCache();
+
+  StyleSharingCache(const StyleSharingCache&) = delete;
+  const StyleSharingCache& operator=(const StyleSharingCache&) = delete;
+
+  /**
+   * Declarations of `elem`, whose parent in the styled tree is `parent`.
+   * `filter`, if any, holds the ancestors of `elem`; see RuleIndex.
+   */
+  DeclarationBlock lookup (const yahtml::Element& elem,
+                           const StyledNode* parent,
+                           const AncestorFilter* filter = nullptr);
+
+  /**
+   * Computed style of a node declaring `specified` (a block handed out by
+   * lookup(), or empty_declaration_block()) under `parent`.
+   */
+  ComputedStylePtr compute (const DeclarationBlock& specified,
+                            const StyledNode* parent);
+
+  // forgets every block and computed style; trees keep theirs
+  void clear ();
+
+  inline unsigned long hits () const { return m_hits; }
+  inline unsigned long misses () const { return m_misses; }
+  size_t size ();
+};
+
+}}; // ! ns yabrowser style
+
+#endif
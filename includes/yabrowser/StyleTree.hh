@@ -1,6 +1,8 @@
 #ifndef YABROWSER__STYLE__STYLETREE_HH
 #define YABROWSER__STYLE__STYLETREE_HH
 
+#include "yabrowser/ComputedStyle.hh"
+#include "yabrowser/Properties.hh"
 #include "yacss/CSS.hh"
 #include "yahtml/DOM.hh"
 
@@ -11,17 +13,42 @@
 #include <algorithm>
 
 
-namespace yabrowser { namespace style {
+namespace yabrowser {
 
+class ThreadPool;
+
+namespace style {
+
+class AncestorFilter;
 class StyledNode;
+struct ParallelStyleBuild;
+class RuleIndex;
+class StyleSharingCache;
 
 typedef std::pair<yacss::RulePtr, unsigned> MatchedRule;
+typedef std::shared_ptr<const PropertyTable> DeclarationBlock;
 typedef std::shared_ptr<StyledNode> StyledChild;
 typedef std::vector<StyledChild> StyledChildren;
 
-enum Display
+// below this many nodes a subtree is not worth a task of its own
+const size_t PARALLEL_STYLE_THRESHOLD = 512;
+
+// what changed in the DOM since a node was last styled
+enum RestyleHint
+{
+  RESTYLE_NONE = 0,
+  // id, class or any other attribute of the element
+  RESTYLE_SELF = 1 << 0,
+  // a child was inserted or removed
+  RESTYLE_CHILDREN = 1 << 1
+};
+
+struct RestyleStats
 {
-  DISPLAY_NONE, DISPLAY_INLINE, DISPLAY_BLOCK
+  unsigned long restyled;
+  unsigned long reused;
+
+  inline RestyleStats () : restyled(0), reused(0) {}
 };
 
 
@@ -29,26 +56,111 @@ class StyledNode
 {
 public:
   yahtml::DOMChild node;
-  yacss::DeclarationContainer specified_values;
+  DeclarationBlock specified_values;
+  // what layout reads; see ComputedStyle
+  ComputedStylePtr computed;
   StyledChildren children;
   Display display;
+  StyledNode* parent;
+  // nodes in this subtree, including this one
+  size_t subtree_size;
+  // RestyleHint flags of this node
+  unsigned dirty;
+  bool dirty_descendants;
+  // style generation in which this node was built, and in which its
+  // declaration block last changed. See current_style_generation().
+  unsigned generation;
+  unsigned style_generation;
 public:
   StyledNode(const yahtml::DOMChild root, const yacss::Stylesheet& ss);
+  StyledNode(const yahtml::DOMChild root, const RuleIndex& index);
+
+  /**
+   * Styles `root` as a child of `parent`. `filter` holds the ancestors of
+   * `root` when the caller is already walking down the tree, otherwise one
+   * is set up when the stylesheet has combinators.
+   */
+  StyledNode(const yahtml::DOMChild root, StyleSharingCache& cache,
+             StyledNode* parent = nullptr, AncestorFilter* filter = nullptr);
+
+  /**
+   * Same tree as the sequential constructors, but sibling subtrees of at
+   * least `threshold` nodes are styled as separate tasks on `pool`.
+   */
+  StyledNode(const yahtml::DOMChild root, StyleSharingCache& cache,
+             ThreadPool& pool, size_t threshold = PARALLEL_STYLE_THRESHOLD);
   ~StyledNode();
 
-  template<typename T>
-  inline const T* get_value (const std::string& name) const
+  // nodes are built in place and shared through StyledChild; copying one
+  // would deep copy the whole subtree
+  StyledNode(const StyledNode&) = delete;
+  const StyledNode& operator=(const StyledNode&) = delete;
+
+  // null when the node does not declare the property
+  inline const Value* get_value (PropertyId id) const
   {
-    yacss::DeclarationContainer::const_iterator it = specified_values.find(name);
-    if (it == specified_values.end())
-      return nullptr;
+    return specified_values->find(id);
+  }
 
-    return &it->second.get<T>();
+  inline const Value* get_value (const std::string& name) const
+  {
+    return specified_values->find(name);
   }
 
-  yacss::CSSBaseValue decl_lookup (const std::initializer_list<std::string>, const yacss::CSSBaseValue&) const;
+  /**
+   * First declared value among `keys` (most specific property first), or
+   * `def` if none of them is declared.
+   */
+  inline const Value& decl_lookup (
+      const std::initializer_list<PropertyId> keys, const Value& def) const
+  {
+    for (const auto& key : keys) {
+      const Value* value = specified_values->find(key);
+      if (value)
+        return *value;
+    }
+
+    return def;
+  }
+
+  const Value& decl_lookup (const std::initializer_list<std::string>,
+                            const Value&) const;
+
+  /**
+   * Flags this node as out of date with its DOM node and lets every
+   * ancestor know that restyle() has to look below it.
+   */
+  void mark_dirty (unsigned hints);
+
+  /**
+   * Brings the dirty parts of the subtree up to date with the DOM. Nodes
+   * are only restyled when they were marked or when the style of their
+   * parent changed; everything else, and every child that survived a
+   * RESTYLE_CHILDREN, is reused as is. `cache` must be the one the tree
+   * was built with.
+   */
+  void restyle (StyleSharingCache& cache, RestyleStats& stats);
+private:
+  StyledNode(const yahtml::DOMChild root, StyleSharingCache& cache,
+             StyledNode* parent, const ParallelStyleBuild& build,
+             size_t preorder_index);
+
+  void _resolve (StyleSharingCache&, const AncestorFilter*);
+  void _build (StyleSharingCache&, AncestorFilter*);
+  void _build_parallel (StyleSharingCache&, const ParallelStyleBuild&,
+                        size_t preorder_index, AncestorFilter*);
+  void _restyle (StyleSharingCache&, RestyleStats&, bool force,
+                 AncestorFilter*);
+  void _update_subtree_size ();
 };
 
+/**
+ * Bumped by every restyle(). Anything built or restyled after a given
+ * generation carries a larger one, which lets the layout tell which nodes
+ * changed since it last looked at the tree.
+ */
+unsigned current_style_generation ();
+
 inline float to_px (const yacss::CSSBaseValue& value)
 {
   if (value.type == yacss::ValueType::Length) {
@@ -58,6 +170,14 @@ inline float to_px (const yacss::CSSBaseValue& value)
   return 0.0;
 }
 
+inline float to_px (const Value& value)
+{
+  return value.is_length() ? value.length : 0.0;
+}
+
+// shared by every node that has no declarations (text nodes, mostly)
+const DeclarationBlock& empty_declaration_block ();
+
 bool selector_matches(const yacss::Selector&, const yahtml::Element&);
 
 MatchedRule rule_matches (const yacss::RulePtr&, const yahtml::Element&);
@@ -0,0 +1,103 @@
+#ifndef YABROWSER__THREADPOOL_HH
+#define YABROWSER__THREADPOOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace yabrowser {
+
+class TaskGroup;
+
+/**
+ * Work-stealing pool. Every worker owns a deque: tasks spawned from a
+ * worker go to the back of its own deque and are popped LIFO by it, while
+ * idle workers steal from the front of the others'. Tasks submitted from
+ * outside the pool go through a shared queue.
+ */
+class ThreadPool
+{
+public:
+  typedef std::function<void()> Task;
+private:
+  struct Job
+  {
+    Task task;
+    TaskGroup* group;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  Queue m_injector;
+  std::vector<std::thread> m_threads;
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_wake;
+  std::atomic<unsigned> m_queued;
+  std::atomic<bool> m_stop;
+public:
+  // 0 threads means that every task runs on the thread waiting for it
+  explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+  // runs whatever is still queued first
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  const ThreadPool& operator=(const ThreadPool&) = delete;
+
+  inline unsigned size () const { return m_threads.size(); }
+
+  void submit (Task task, TaskGroup* group);
+
+  // runs at most one pending task on the calling thread
+  bool run_one ();
+private:
+  bool _pop (Job& job);
+  void _execute (Job& job);
+  void _work (unsigned index);
+};
+
+/**
+ * Set of tasks that can be waited on together. The waiting thread executes
+ * pending tasks while there are any queued, so groups can be nested from
+ * inside tasks without starving the pool, then sleeps until the last task
+ * of the group is done.
+ */
+class TaskGroup
+{
+  friend class ThreadPool;
+private:
+  ThreadPool& m_pool;
+  std::atomic<unsigned> m_pending;
+  // guards the error, and the last task's notification
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::exception_ptr m_error;
+public:
+  explicit TaskGroup(ThreadPool& pool);
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup&) = delete;
+  const TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void run (ThreadPool::Task task);
+
+  // rethrows the first exception thrown by a task of the group
+  void wait ();
+private:
+  void _wait_pending ();
+};
+
+}; // ! ns yabrowser
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef YABROWSER__PAINT__TILES_HH
+#define YABROWSER__PAINT__TILES_HH
+
+#include "Raster.hh"
+
+#include <cstdint>
+#include <vector>
+
+namespace yabrowser
+{
+
+class ThreadPool;
+
+namespace paint
+{
+
+const unsigned DEFAULT_TILE_SIZE = 256;
+
+struct TileStats {
+  // rasterized again
+  unsigned long painted;
+  // left as they were in the previous frame
+  unsigned long reused;
+
+  inline TileStats() : painted(0), reused(0) {}
+};
+
+/**
+ * A canvas split into square tiles, rasterized independently. Display
+ * items are binned by the tiles their bounds touch, so a tile only walks
+ * the items that can paint it. A tile is only rasterized again when the
+ * items binned to it, or the background, differ from the previous frame.
+ */
+class TileGrid
+{
+public:
+  Canvas canvas;
+  const unsigned tile_size;
+  const unsigned columns;
+  const unsigned rows;
+  // painted before any item
+  Color background;
+
+public:
+  TileGrid(unsigned width, unsigned height,
+           unsigned tile = DEFAULT_TILE_SIZE,
+           RasterKernels kernels = best_raster_kernels());
+
+  TileGrid(const TileGrid&) = delete;
+  const TileGrid& operator=(const TileGrid&) = delete;
+
+  // brings the canvas up to date with `list`, damaged tiles in parallel
+  void paint(const DisplayList& list, ThreadPool&, TileStats&);
+
+  // the next paint() rasterizes every tile
+  void invalidate();
+
+  // pixels of a tile; the last row and column may be cut short
+  layout::Rect tile_rect(unsigned tile) const;
+
+  // indices in the last painted list of the items binned to `tile`
+  inline const std::vector<unsigned>& bin(unsigned tile) const
+  {
+    return m_bins[tile];
+  }
+
+private:
+  std::vector<std::vector<unsigned>> m_bins;
+  // of the items, in order, and of the background of every tile
+  std::vector<uint64_t> m_fingerprints;
+  // no tile holds anything worth reusing
+  bool m_stale;
+
+  void _bin(const DisplayList&);
+  uint64_t _fingerprint(const DisplayList&, unsigned tile) const;
+  void _paint_tile(const DisplayList&, unsigned tile);
+};
+}  // ! ns paint
+}; // ! ns yabrowser
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef YABROWSER__TRACE_HH
+#define YABROWSER__TRACE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// 0 compiles every TRACE_SPAN out. See the `tracing` CMake option.
+#ifndef YABROWSER_TRACING
+#define YABROWSER_TRACING 1
+#endif
+
+namespace yabrowser { namespace trace {
+
+// a finished span. Names and categories are string literals.
+struct Event
+{
+  const char* name;
+  const char* category;
+  // nanoseconds since start()
+  uint64_t begin;
+  uint64_t duration;
+  // small and stable per thread, in the order threads first recorded
+  unsigned thread;
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled ()
+{
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+// nanoseconds since start()
+uint64_t now ();
+
+// about 40 MB of events; a long-running server would otherwise grow forever
+const size_t MAX_EVENTS = 1 << 20;
+
+/**
+ * Drops what was recorded so far and starts recording spans, the first
+ * `max_events` of them: spans past those are only counted, by dropped().
+ */
+void start (size_t max_events = MAX_EVENTS);
+void stop ();
+
+// spans that ended after the buffers were full, since start()
+size_t dropped ();
+
+// what every thread recorded since start(), ordered by beginning
+std::vector<Event> events ();
+
+/**
+ * Chrome's trace event format (complete "X" events, microseconds), as
+ * loaded by chrome://tracing or Perfetto.
+ */
+void write_json (std::ostream&, const std::vector<Event>&);
+
+// appends to a buffer of the calling thread, unless they are all full;
+// only taken while enabled()
+void record (const char* category, const char* name, uint64_t begin,
+             uint64_t end);
+
+/**
+ * Records the time between its construction and destruction. While
+ * tracing is off this is a relaxed load and a branch; a null `name`
+ * records nothing either.
+ */
+class Span
+{
+private:
+  const char* m_category;
+  const char* m_name;
+  uint64_t m_begin;
+public:
+  inline Span (const char* category, const char* name)
+    : m_category(category), m_name(enabled() ? name : nullptr), m_begin(0)
+  {
+    if (m_name)
+      m_begin = now();
+  }
+
+  inline ~Span ()
+  {
+    if (m_name)
+      record(m_category, m_name, m_begin, now());
+  }
+
+  Span(const Span&) = delete;
+  const Span& operator=(const Span&) = delete;
+};
+
+}}; // ! ns yabrowser trace
+
+#define YABROWSER_TRACE_CONCAT2(a, b) a##b
+#define YABROWSER_TRACE_CONCAT(a, b) YABROWSER_TRACE_CONCAT2(a, b)
+
+#if YABROWSER_TRACING
+// a span covering the rest of the enclosing scope
+#define TRACE_SPAN(category, name)                                       \
+  ::yabrowser::trace::Span YABROWSER_TRACE_CONCAT(trace_span_, __LINE__)( \
+      category, name)
+#else
+#define TRACE_SPAN(category, name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef YABROWSER__STYLE__USERAGENTSTYLES_HH
+#define YABROWSER__STYLE__USERAGENTSTYLES_HH
+
+#include "yabrowser/Properties.hh"
+#include "yabrowser/Value.hh"
+
+#include <string>
+
+
+namespace yabrowser { namespace style {
+
+struct UADeclaration
+{
+  PropertyId property;
+  Value value;
+};
+
+// the declarations every `tag` element gets from the UA stylesheet
+struct UARule
+{
+  const char* tag;
+  // a range of UA_DECLARATIONS
+  unsigned first;
+  unsigned count;
+};
+
+/**
+ * The user agent stylesheet (src/ua/html.css), compiled by uagen when the
+ * library is built. Its selectors are all type selectors, so the sheet is
+ * cascaded ahead of time into one block of declarations per tag, in the
+ * form PropertyTable stores them. The tables are constant-initialized:
+ * nothing is parsed, converted or allocated at startup.
+ */
+extern const UADeclaration UA_DECLARATIONS[];
+// sorted by tag
+extern const UARule UA_RULES[];
+extern const unsigned UA_RULE_COUNT;
+// what the tables were generated from
+extern const char UA_STYLESHEET_SOURCE[];
+
+// null when the UA stylesheet has nothing for `tag`
+const UARule* user_agent_rule (const std::string& tag);
+
+/**
+ * Adds the UA declarations of `tag` below those of `author`, which come
+ * from the author stylesheet: an author declaration wins over the UA one
+ * whatever their specificity, and a shorthand such as `margin` wins over
+ * the UA longhands it sets (`margin-top`).
+ */
+void insert_user_agent_declarations (PropertyTable& author,
+                                     const std::string& tag);
+
+}}; // ! ns yabrowser style
+
+#endif
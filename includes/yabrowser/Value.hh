@@ -0,0 +1,139 @@
+#ifndef YABROWSER__STYLE__VALUE_HH
+#define YABROWSER__STYLE__VALUE_HH
+
+#include "yacss/CSS.hh"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+
+namespace yabrowser { namespace style {
+
+#define YABROWSER_KEYWORDS(X)                                                  \
+  X(AUTO, "auto")                                                              \
+  X(NONE, "none")                                                              \
+  X(INLINE, "inline")                                                          \
+  X(BLOCK, "block")                                                            \
+  X(NORMAL, "normal")                                                          \
+  X(BOLD, "bold")                                                              \
+  X(BOLDER, "bolder")                                                          \
+  X(LIGHTER, "lighter")                                                        \
+  X(SMALLER, "smaller")                                                        \
+  X(LARGER, "larger")                                                          \
+  X(XX_SMALL, "xx-small")                                                      \
+  X(X_SMALL, "x-small")                                                        \
+  X(SMALL, "small")                                                            \
+  X(MEDIUM, "medium")                                                          \
+  X(LARGE, "large")                                                            \
+  X(X_LARGE, "x-large")                                                        \
+  X(XX_LARGE, "xx-large")                                                      \
+  X(LEFT, "left")                                                              \
+  X(RIGHT, "right")                                                            \
+  X(CENTER, "center")                                                          \
+  X(JUSTIFY, "justify")                                                        \
+  X(SERIF, "serif")                                                            \
+  X(MONOSPACE, "monospace")
+
+/**
+ * Interned keyword. The ones in YABROWSER_KEYWORDS have fixed ids so that
+ * the style code can compare against them; any other keyword gets an id
+ * the first time it is interned, and keeps it for the life of the process.
+ */
+typedef uint32_t Keyword;
+
+enum : Keyword
+{
+  KEYWORD_NULL = 0,
+#define YABROWSER_KEYWORD_ID(id, name) KEYWORD_##id,
+  YABROWSER_KEYWORDS(YABROWSER_KEYWORD_ID)
+#undef YABROWSER_KEYWORD_ID
+};
+
+// thread safe; only the first call for a string allocates
+Keyword intern_keyword (const std::string&);
+
+// the string `keyword` was interned from; takes no lock
+const std::string& keyword_name (Keyword keyword);
+
+enum ValueKind : uint8_t
+{
+  VALUE_NONE, VALUE_KEYWORD, VALUE_LENGTH
+};
+
+/**
+ * A declared value, as the styled tree keeps it: what the parser hands
+ * over is converted once, when a stylesheet is indexed, into this
+ * trivially copyable tagged union. Copying, comparing and reading one
+ * never allocates.
+ */
+struct Value
+{
+  ValueKind kind;
+  // a yacss::Unit, for lengths
+  uint8_t unit;
+  union
+  {
+    float length;
+    Keyword keyword;
+  };
+
+  constexpr Value () : kind(VALUE_NONE), unit(0), length(0.0) {}
+
+  // interns keywords
+  explicit Value (const yacss::CSSBaseValue&);
+
+  // constant expressions, so that tables of values need no initialization
+  // at startup; see UserAgentStyles.hh
+  static constexpr Value from_keyword (Keyword keyword)
+  {
+    return Value(keyword);
+  }
+
+  static constexpr Value from_length (float length,
+                                      yacss::Unit unit = yacss::UNIT_PX)
+  {
+    return Value(length, unit);
+  }
+
+  inline bool is_keyword (Keyword k) const
+  {
+    return kind == VALUE_KEYWORD && keyword == k;
+  }
+
+  inline bool is_length () const { return kind == VALUE_LENGTH; }
+
+  // what the parser would have handed over
+  yacss::CSSBaseValue to_css () const;
+
+  inline bool operator== (const Value& rhs) const
+  {
+    if (kind != rhs.kind)
+      return false;
+
+    switch (kind) {
+      case VALUE_KEYWORD:
+        return keyword == rhs.keyword;
+      case VALUE_LENGTH:
+        return length == rhs.length && unit == rhs.unit;
+      default:
+        return true;
+    }
+  }
+
+  inline bool operator!= (const Value& rhs) const { return !(*this == rhs); }
+private:
+  constexpr explicit Value (Keyword k)
+    : kind(VALUE_KEYWORD), unit(0), keyword(k) {}
+
+  constexpr Value (float l, yacss::Unit u)
+    : kind(VALUE_LENGTH), unit(u), length(l) {}
+};
+
+static_assert(sizeof(Value) <= 16, "values are copied around by the dozen");
+static_assert(std::is_trivially_copyable<Value>::value,
+              "values must not own anything");
+
+}}; // ! ns yabrowser style
+
+#endif
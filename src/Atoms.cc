@@ -0,0 +1,128 @@
+#include "yabrowser/Atoms.hh"
+
+#include <algorithm>
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+using namespace yahtml;
+
+// FNV-1a
+static unsigned hash_string (const std::string& str)
+{
+  unsigned hash = 2166136261u;
+
+  for (const auto& c : str)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+
+  return hash;
+}
+
+AtomTable::AtomTable ()
+  : m_slots(16), m_size(0)
+{ }
+
+size_t AtomTable::_probe (const std::string& str, unsigned hash) const
+{
+  const size_t mask = m_slots.size() - 1;
+  size_t i = hash & mask;
+
+  while (m_slots[i].atom != NULL_ATOM &&
+         (m_slots[i].hash != hash || m_slots[i].str != str))
+    i = (i + 1) & mask;
+
+  return i;
+}
+
+void AtomTable::_grow ()
+{
+  std::vector<Slot> old (m_slots.size() * 2);
+
+  old.swap(m_slots);
+  for (auto& slot : old) {
+    if (slot.atom != NULL_ATOM)
+      m_slots[_probe(slot.str, slot.hash)] = std::move(slot);
+  }
+}
+
+Atom AtomTable::intern (const std::string& str)
+{
+  const unsigned hash = hash_string(str);
+  size_t i = _probe(str, hash);
+
+  if (m_slots[i].atom != NULL_ATOM)
+    return m_slots[i].atom;
+
+  if (2 * (m_size + 1) > m_slots.size()) {
+    _grow();
+    i = _probe(str, hash);
+  }
+
+  m_slots[i].hash = hash;
+  m_slots[i].atom = ++m_size;
+  m_slots[i].str = str;
+
+  return m_slots[i].atom;
+}
+
+Atom AtomTable::find (const std::string& str) const
+{
+  return m_slots[_probe(str, hash_string(str))].atom;
+}
+
+static void sort_atoms (std::vector<Atom>& atoms)
+{
+  std::sort(atoms.begin(), atoms.end());
+  atoms.erase(std::unique(atoms.begin(), atoms.end()), atoms.end());
+}
+
+CompiledSelector::CompiledSelector ()
+  : tag(NULL_ATOM), id(NULL_ATOM)
+{ }
+
+ElementSignature::ElementSignature ()
+  : tag(NULL_ATOM), id(NULL_ATOM)
+{ }
+
+CompiledSelector compile_selector (AtomTable& atoms, const Selector& sel)
+{
+  CompiledSelector compiled;
+
+  if (!sel.tag.empty() && sel.tag != "*")
+    compiled.tag = atoms.intern(sel.tag);
+
+  if (!sel.id.empty())
+    compiled.id = atoms.intern(sel.id);
+
+  compiled.classes.reserve(sel.classes.size());
+  for (const auto& klass : sel.classes)
+    compiled.classes.push_back(atoms.intern(klass));
+  sort_atoms(compiled.classes);
+
+  return compiled;
+}
+
+ElementSignature element_signature (const AtomTable& atoms,
+                                    const Element& elem)
+{
+  ElementSignature signature;
+  AttrMap::const_iterator it = elem.attr_map.find("id");
+
+  signature.tag = atoms.find(elem.tag_name);
+
+  if (it != elem.attr_map.end())
+    signature.id = atoms.find(it->second);
+
+  signature.classes.reserve(elem.classes.size());
+  for (const auto& klass : elem.classes) {
+    const Atom atom = atoms.find(klass);
+
+    if (atom != NULL_ATOM)
+      signature.classes.push_back(atom);
+  }
+  sort_atoms(signature.classes);
+
+  return signature;
+}
+
+}}; // ! ns yabrowser style
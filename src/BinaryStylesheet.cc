@@ -0,0 +1,522 @@
+#include "yabrowser/BinaryStylesheet.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace yabrowser { namespace style {
+
+using namespace binary;
+
+static const char MAGIC[8] = "YABCSS";
+
+static const size_t RECORD_SIZES[SECTIONS] = {
+  sizeof(Rule), sizeof(Selector), sizeof(Compound), sizeof(String),
+  sizeof(Ancestor), sizeof(uint32_t), sizeof(Declaration), 1
+};
+
+// the last of the units yacss parses lengths in
+static const uint32_t LAST_UNIT = yacss::UNIT_EM;
+
+static_assert(sizeof(Header) == 104 && sizeof(Compound) == 28 &&
+              sizeof(Selector) == 24 && sizeof(Declaration) == 28,
+              "binary stylesheet records must have no padding");
+
+uint64_t stylesheet_hash (const std::string& source)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (const auto& c : source)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+
+  return hash;
+}
+
+// MurmurHash64A, in native byte order like the rest of the file
+static uint64_t murmur_hash (const std::string& source)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const size_t tail = source.size() % 8;
+  const char* data = source.data();
+  const char* end = data + source.size() - tail;
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ (source.size() * m);
+  uint64_t k;
+
+  for (; data != end; data += 8) {
+    std::memcpy(&k, data, 8);
+    k *= m;
+    k ^= k >> 47;
+    k *= m;
+    hash = (hash ^ k) * m;
+  }
+
+  if (tail) {
+    k = 0;
+    std::memcpy(&k, data, tail);
+    hash = (hash ^ k) * m;
+  }
+
+  hash ^= hash >> 47;
+  hash *= m;
+  hash ^= hash >> 47;
+
+  return hash;
+}
+
+SourceKey source_key (const std::string& source)
+{
+  return SourceKey{ stylesheet_hash(source), source.size(),
+                    murmur_hash(source) };
+}
+
+// WRITING
+struct BinaryWriter
+{
+  std::vector<Rule> rules;
+  std::vector<Selector> selectors;
+  std::vector<Compound> compounds;
+  std::vector<String> classes;
+  std::vector<Ancestor> ancestors;
+  std::vector<uint32_t> hashes;
+  std::vector<Declaration> declarations;
+  std::string strings;
+  // property names, tags and classes come back over and over
+  std::unordered_map<std::string, String> pool;
+};
+
+static String write_string (BinaryWriter& w, const std::string& str)
+{
+  auto it = w.pool.find(str);
+
+  if (it != w.pool.end())
+    return it->second;
+
+  const String ref = { static_cast<uint32_t>(w.strings.size()),
+                       static_cast<uint32_t>(str.size()) };
+
+  w.strings += str;
+  w.pool.emplace(str, ref);
+
+  return ref;
+}
+
+static uint32_t write_compound (BinaryWriter& w, const yacss::Selector& sel)
+{
+  Compound compound;
+
+  compound.tag = write_string(w, sel.tag);
+  compound.id = write_string(w, sel.id);
+  compound.first_class = w.classes.size();
+  compound.class_count = sel.classes.size();
+  compound.specificity = sel.specificity;
+
+  for (const auto& klass : sel.classes)
+    w.classes.push_back(write_string(w, klass));
+
+  w.compounds.push_back(compound);
+
+  return w.compounds.size() - 1;
+}
+
+template<typename Record>
+static void write_section (std::string& out, Header& header, SectionId id,
+                           const std::vector<Record>& records)
+{
+  out.append((4 - out.size() % 4) % 4, '\0');
+  header.sections[id].offset = out.size();
+  header.sections[id].count = records.size();
+  out.append(reinterpret_cast<const char*>(records.data()),
+             records.size() * sizeof(Record));
+}
+
+bool write_binary_stylesheet (std::string& out, const ComplexStylesheet& ss,
+                              const SourceKey& key)
+{
+  const auto& rules = ss.stylesheet.rules;
+  BinaryWriter w;
+
+  if (ss.result || ss.selectors.size() != rules.size())
+    return false;
+
+  for (size_t i = 0; i < rules.size(); i++) {
+    Rule rule;
+
+    rule.first_selector = w.selectors.size();
+    rule.selector_count = ss.selectors[i].size();
+    rule.first_declaration = w.declarations.size();
+    rule.declaration_count = rules[i]->declarations.size();
+
+    for (const auto& complex : ss.selectors[i]) {
+      Selector sel;
+
+      sel.subject = write_compound(w, complex.subject);
+      sel.first_ancestor = w.ancestors.size();
+      sel.ancestor_count = complex.ancestors.size();
+      sel.first_hash = w.hashes.size();
+      sel.hash_count = complex.ancestor_hashes.size();
+      sel.specificity = complex.specificity;
+
+      // compounds first, so that ancestor records stay contiguous
+      std::vector<Ancestor> ancestors;
+      for (const auto& ancestor : complex.ancestors)
+        ancestors.push_back({ static_cast<uint32_t>(ancestor.first),
+                              write_compound(w, ancestor.second) });
+
+      w.ancestors.insert(w.ancestors.end(), ancestors.begin(),
+                         ancestors.end());
+      w.hashes.insert(w.hashes.end(), complex.ancestor_hashes.begin(),
+                      complex.ancestor_hashes.end());
+      w.selectors.push_back(sel);
+    }
+
+    for (const auto& decl : rules[i]->declarations) {
+      const yacss::CSSBaseValue& value = decl.second;
+      Declaration record;
+
+      record.property = write_string(w, decl.first);
+      record.type = static_cast<uint32_t>(value.type);
+      record.unit = 0;
+      record.length = 0;
+      record.keyword = { 0, 0 };
+
+      if (value.type == yacss::ValueType::Keyword) {
+        record.keyword =
+            write_string(w, value.get<yacss::KeywordValue>().val);
+      } else if (value.type == yacss::ValueType::Length &&
+                 value.get<yacss::LengthValue>().unit <= LAST_UNIT) {
+        record.unit = value.get<yacss::LengthValue>().unit;
+        record.length = value.get<yacss::LengthValue>().val;
+      } else {
+        return false;
+      }
+
+      w.declarations.push_back(record);
+    }
+
+    w.rules.push_back(rule);
+  }
+
+  Header header;
+  std::string image (sizeof(Header), '\0');
+
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.source_hash = key.hash;
+  header.source_size = key.size;
+  header.source_check = key.check;
+
+  write_section(image, header, SECTION_RULES, w.rules);
+  write_section(image, header, SECTION_SELECTORS, w.selectors);
+  write_section(image, header, SECTION_COMPOUNDS, w.compounds);
+  write_section(image, header, SECTION_CLASSES, w.classes);
+  write_section(image, header, SECTION_ANCESTORS, w.ancestors);
+  write_section(image, header, SECTION_HASHES, w.hashes);
+  write_section(image, header, SECTION_DECLARATIONS, w.declarations);
+  write_section(image, header, SECTION_STRINGS,
+                std::vector<char>(w.strings.begin(), w.strings.end()));
+
+  if (image.size() > std::numeric_limits<uint32_t>::max())
+    return false;
+
+  header.size = image.size();
+  std::memcpy(&image[0], &header, sizeof(Header));
+  out.swap(image);
+
+  return true;
+}
+
+// READING
+MappedStylesheet::MappedStylesheet (const char* data, size_t size,
+                                    bool mapped)
+  : m_data(data), m_size(size), m_mapped(mapped)
+{ }
+
+MappedStylesheet::~MappedStylesheet ()
+{
+  if (m_mapped)
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+std::unique_ptr<MappedStylesheet>
+MappedStylesheet::open (const std::string& path, const SourceKey& key)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  if (fd < 0)
+    return nullptr;
+
+  if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    return nullptr;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  std::unique_ptr<MappedStylesheet> ss (new MappedStylesheet(
+      static_cast<const char*>(data), st.st_size, true));
+
+  if (!ss->_valid(key))
+    return nullptr;
+
+  return ss;
+}
+
+std::unique_ptr<MappedStylesheet>
+MappedStylesheet::view (const char* data, size_t size, const SourceKey& key)
+{
+  // records are read in place, so they must be aligned as they were written
+  if (reinterpret_cast<uintptr_t>(data) % alignof(Header))
+    return nullptr;
+
+  std::unique_ptr<MappedStylesheet> ss (
+      new MappedStylesheet(data, size, false));
+
+  if (!ss->_valid(key))
+    return nullptr;
+
+  return ss;
+}
+
+static bool in_range (uint64_t first, uint64_t count, uint64_t size)
+{
+  return first <= size && count <= size - first;
+}
+
+bool MappedStylesheet::_valid (const SourceKey& key) const
+{
+  if (m_size < sizeof(Header))
+    return false;
+
+  const Header& h = header();
+
+  if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION ||
+      h.size != m_size || h.source_hash != key.hash ||
+      h.source_size != key.size || h.source_check != key.check)
+    return false;
+
+  for (unsigned id = 0; id < SECTIONS; id++) {
+    const Section& section = h.sections[id];
+
+    if (section.offset % 4 || section.offset < sizeof(Header) ||
+        !in_range(section.offset,
+                  uint64_t(section.count) * RECORD_SIZES[id], m_size))
+      return false;
+  }
+
+  // every index and string of every record, so that using the records
+  // needs no checks
+  const size_t n_selectors = count(SECTION_SELECTORS);
+  const size_t n_compounds = count(SECTION_COMPOUNDS);
+  const size_t n_classes = count(SECTION_CLASSES);
+  const size_t n_ancestors = count(SECTION_ANCESTORS);
+  const size_t n_hashes = count(SECTION_HASHES);
+  const size_t n_declarations = count(SECTION_DECLARATIONS);
+  const size_t n_strings = count(SECTION_STRINGS);
+
+  const auto valid_string = [n_strings](const String& str) {
+    return in_range(str.offset, str.size, n_strings);
+  };
+
+  for (size_t i = 0; i < rule_count(); i++) {
+    const Rule& r = rule(i);
+
+    if (!in_range(r.first_selector, r.selector_count, n_selectors) ||
+        !in_range(r.first_declaration, r.declaration_count, n_declarations))
+      return false;
+  }
+
+  const Selector* selectors = records<Selector>(SECTION_SELECTORS);
+  for (size_t i = 0; i < n_selectors; i++) {
+    const Selector& sel = selectors[i];
+
+    if (sel.subject >= n_compounds ||
+        !in_range(sel.first_ancestor, sel.ancestor_count, n_ancestors) ||
+        !in_range(sel.first_hash, sel.hash_count, n_hashes))
+      return false;
+  }
+
+  const Compound* compounds = records<Compound>(SECTION_COMPOUNDS);
+  for (size_t i = 0; i < n_compounds; i++) {
+    const Compound& compound = compounds[i];
+
+    if (!valid_string(compound.tag) || !valid_string(compound.id) ||
+        !in_range(compound.first_class, compound.class_count, n_classes))
+      return false;
+  }
+
+  const String* classes = records<String>(SECTION_CLASSES);
+  for (size_t i = 0; i < n_classes; i++)
+    if (!valid_string(classes[i]))
+      return false;
+
+  const Ancestor* ancestors = records<Ancestor>(SECTION_ANCESTORS);
+  for (size_t i = 0; i < n_ancestors; i++)
+    if (ancestors[i].combinator > COMBINATOR_CHILD ||
+        ancestors[i].compound >= n_compounds)
+      return false;
+
+  const Declaration* declarations =
+      records<Declaration>(SECTION_DECLARATIONS);
+  for (size_t i = 0; i < n_declarations; i++) {
+    const Declaration& decl = declarations[i];
+    const auto type = static_cast<yacss::ValueType>(decl.type);
+
+    if (!valid_string(decl.property) || !valid_string(decl.keyword) ||
+        (type != yacss::ValueType::Keyword &&
+         type != yacss::ValueType::Length) ||
+        decl.unit > LAST_UNIT)
+      return false;
+  }
+
+  return true;
+}
+
+yacss::Selector MappedStylesheet::_compound (uint32_t index) const
+{
+  const Compound& compound = records<Compound>(SECTION_COMPOUNDS)[index];
+  const String* classes =
+      records<String>(SECTION_CLASSES) + compound.first_class;
+  yacss::Selector sel;
+
+  sel.tag = string(compound.tag);
+  sel.id = string(compound.id);
+  sel.specificity = compound.specificity;
+  sel.classes.reserve(compound.class_count);
+  for (uint32_t i = 0; i < compound.class_count; i++)
+    sel.classes.push_back(string(classes[i]));
+
+  return sel;
+}
+
+void MappedStylesheet::to_stylesheet (ComplexStylesheet& ss) const
+{
+  const Selector* selectors = records<Selector>(SECTION_SELECTORS);
+  const Ancestor* ancestors = records<Ancestor>(SECTION_ANCESTORS);
+  const uint32_t* hashes = records<uint32_t>(SECTION_HASHES);
+  const Declaration* declarations =
+      records<Declaration>(SECTION_DECLARATIONS);
+
+  ss.result = 0;
+  ss.stylesheet = yacss::Stylesheet();
+  ss.stylesheet.rules.reserve(rule_count());
+  ss.selectors.clear();
+  ss.selectors.resize(rule_count());
+
+  for (size_t i = 0; i < rule_count(); i++) {
+    const Rule& r = rule(i);
+    yacss::RulePtr parsed = std::make_shared<yacss::Rule>();
+    std::vector<ComplexSelector>& complex = ss.selectors[i];
+
+    complex.resize(r.selector_count);
+    parsed->selectors.reserve(r.selector_count);
+
+    for (uint32_t j = 0; j < r.selector_count; j++) {
+      const Selector& record = selectors[r.first_selector + j];
+      ComplexSelector& sel = complex[j];
+
+      sel.subject = _compound(record.subject);
+      sel.specificity = record.specificity;
+      sel.ancestors.reserve(record.ancestor_count);
+      for (uint32_t k = 0; k < record.ancestor_count; k++) {
+        const Ancestor& ancestor = ancestors[record.first_ancestor + k];
+
+        sel.ancestors.emplace_back(
+            static_cast<Combinator>(ancestor.combinator),
+            _compound(ancestor.compound));
+      }
+      sel.ancestor_hashes.assign(hashes + record.first_hash,
+                                 hashes + record.first_hash +
+                                     record.hash_count);
+
+      parsed->selectors.push_back(sel.subject);
+    }
+
+    // written in the map's order, so every insertion goes at the end
+    for (uint32_t j = 0; j < r.declaration_count; j++) {
+      const Declaration& decl = declarations[r.first_declaration + j];
+      yacss::CSSBaseValue value;
+
+      if (static_cast<yacss::ValueType>(decl.type) ==
+          yacss::ValueType::Keyword)
+        value = yacss::KeywordValue(string(decl.keyword));
+      else
+        value = yacss::LengthValue(decl.length,
+                                   static_cast<yacss::Unit>(decl.unit));
+
+      parsed->declarations.emplace_hint(parsed->declarations.end(),
+                                        string(decl.property), value);
+    }
+
+    ss.stylesheet.rules.push_back(std::move(parsed));
+  }
+}
+
+// CACHE
+BinaryStylesheetCache::BinaryStylesheetCache (const std::string& directory)
+  : directory(directory), m_hits(0), m_misses(0)
+{ }
+
+std::string BinaryStylesheetCache::path (uint64_t source_hash) const
+{
+  char name[32];
+
+  std::snprintf(name, sizeof(name), "%016llx.yabcss",
+                static_cast<unsigned long long>(source_hash));
+
+  return directory + "/" + name;
+}
+
+int BinaryStylesheetCache::load (const std::string& source,
+                                 ComplexStylesheet& ss)
+{
+  const SourceKey key = source_key(source);
+  const std::string file = path(key.hash);
+
+  if (auto mapped = MappedStylesheet::open(file, key)) {
+    m_hits++;
+    mapped->to_stylesheet(ss);
+    return ss.result;
+  }
+
+  m_misses++;
+  if (ss.parse_source(source))
+    return ss.result;
+
+  std::string image;
+  if (!write_binary_stylesheet(image, ss, key))
+    return ss.result;
+
+  // written aside and renamed over, so that readers never see half a file
+  const std::string tmp = file + ".tmp" + std::to_string(getpid());
+
+  if (mkdir(directory.c_str(), 0755) && errno != EEXIST)
+    return ss.result;
+
+  std::ofstream out (tmp, std::ios::binary | std::ios::trunc);
+  if (!(out << image) || !out.flush()) {
+    std::remove(tmp.c_str());
+    return ss.result;
+  }
+  out.close();
+
+  if (std::rename(tmp.c_str(), file.c_str()))
+    std::remove(tmp.c_str());
+
+  return ss.result;
+}
+
+}}; // ! ns yabrowser style
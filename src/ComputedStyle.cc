@@ -0,0 +1,299 @@
+#include "yabrowser/ComputedStyle.hh"
+
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace yabrowser { namespace style {
+
+InheritedStyle::InheritedStyle ()
+  : color(0, 0, 0), font_family(KEYWORD_SERIF), font_size(16.0),
+    font_weight(400), line_height(0.0), line_height_normal(true),
+    text_align(TEXT_ALIGN_LEFT)
+{ }
+
+bool InheritedStyle::operator== (const InheritedStyle& rhs) const
+{
+  return color == rhs.color && font_family == rhs.font_family &&
+         font_size == rhs.font_size && font_weight == rhs.font_weight &&
+         line_height == rhs.line_height &&
+         line_height_normal == rhs.line_height_normal &&
+         text_align == rhs.text_align;
+}
+
+ComputedStyle::ComputedStyle ()
+  : display(DISPLAY_INLINE), width(0.0, true), height(0.0, true),
+    margin(), border(), padding(), background_color(COLOR_TRANSPARENT),
+    border_color()
+{ }
+
+const InheritedStylePtr& initial_inherited_style ()
+{
+  static const InheritedStylePtr initial =
+      std::make_shared<const InheritedStyle>();
+
+  return initial;
+}
+
+static int hex_digit (char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
+}
+
+Color resolve_color (const Value& value, const Color& fallback)
+{
+  static const std::pair<const char*, Color> named[] = {
+    { "transparent", COLOR_TRANSPARENT }, { "black", Color(0, 0, 0) },
+    { "silver", Color(192, 192, 192) }, { "gray", Color(128, 128, 128) },
+    { "white", Color(255, 255, 255) }, { "maroon", Color(128, 0, 0) },
+    { "red", Color(255, 0, 0) }, { "purple", Color(128, 0, 128) },
+    { "fuchsia", Color(255, 0, 255) }, { "green", Color(0, 128, 0) },
+    { "lime", Color(0, 255, 0) }, { "olive", Color(128, 128, 0) },
+    { "yellow", Color(255, 255, 0) }, { "navy", Color(0, 0, 128) },
+    { "blue", Color(0, 0, 255) }, { "teal", Color(0, 128, 128) },
+    { "aqua", Color(0, 255, 255) }, { "orange", Color(255, 165, 0) }
+  };
+
+  if (value.kind != VALUE_KEYWORD)
+    return fallback;
+
+  const std::string& keyword = keyword_name(value.keyword);
+  if (keyword.empty())
+    return fallback;
+
+  if (keyword[0] == '#' && (keyword.size() == 4 || keyword.size() == 7)) {
+    const size_t digits = (keyword.size() - 1) / 3;
+    int channels[3];
+
+    for (unsigned i = 0; i < 3; i++) {
+      const int high = hex_digit(keyword[1 + i * digits]);
+      const int low = hex_digit(keyword[digits * (i + 1)]);
+
+      if (high < 0 || low < 0)
+        return fallback;
+
+      // #rgb is #rrggbb
+      channels[i] = high * 16 + (digits == 1 ? high : low);
+    }
+
+    return Color(channels[0], channels[1], channels[2]);
+  }
+
+  for (const auto& color : named)
+    if (keyword == color.first)
+      return color.second;
+
+  return fallback;
+}
+
+// first of `ids` the node declares, most specific property first
+static const Value* first_of (const PropertyTable& specified,
+                              std::initializer_list<PropertyId> ids)
+{
+  for (const auto& id : ids) {
+    const Value* value = specified.find(id);
+    if (value)
+      return value;
+  }
+
+  return nullptr;
+}
+
+// lengths are taken as px; any keyword but `auto` counts as 0
+static ComputedLength length_or_auto (const Value* value,
+                                      const ComputedLength& initial)
+{
+  if (!value)
+    return initial;
+
+  if (value->is_length())
+    return ComputedLength(value->length);
+
+  return ComputedLength(0.0, value->is_keyword(KEYWORD_AUTO));
+}
+
+static float length (const Value* value)
+{
+  if (value && value->is_length())
+    return value->length;
+
+  return 0.0;
+}
+
+static Display compute_display (const PropertyTable& specified)
+{
+  const Value* value = specified.find(PROPERTY_DISPLAY);
+
+  if (!value || value->is_keyword(KEYWORD_INLINE))
+    return DISPLAY_INLINE;
+  if (value->is_keyword(KEYWORD_BLOCK))
+    return DISPLAY_BLOCK;
+  if (value->is_keyword(KEYWORD_NONE))
+    return DISPLAY_NONE;
+
+  throw std::runtime_error("Unknown Display value.");
+}
+
+static float compute_font_size (const Value& value, float parent)
+{
+  static const std::pair<Keyword, float> keywords[] = {
+    { KEYWORD_XX_SMALL, 9.0 }, { KEYWORD_X_SMALL, 10.0 },
+    { KEYWORD_SMALL, 13.0 }, { KEYWORD_MEDIUM, 16.0 },
+    { KEYWORD_LARGE, 18.0 }, { KEYWORD_X_LARGE, 24.0 },
+    { KEYWORD_XX_LARGE, 32.0 }
+  };
+
+  if (value.is_length())
+    return value.length;
+
+  if (value.is_keyword(KEYWORD_SMALLER))
+    return parent / 1.2;
+  if (value.is_keyword(KEYWORD_LARGER))
+    return parent * 1.2;
+
+  for (const auto& keyword : keywords)
+    if (value.is_keyword(keyword.first))
+      return keyword.second;
+
+  return parent;
+}
+
+static unsigned compute_font_weight (const Value& value, unsigned parent)
+{
+  if (value.is_length())
+    return std::min(std::max(value.length, 1.0f), 1000.0f);
+
+  if (value.is_keyword(KEYWORD_NORMAL))
+    return 400;
+  if (value.is_keyword(KEYWORD_BOLD))
+    return 700;
+  if (value.is_keyword(KEYWORD_BOLDER))
+    return parent < 600 ? 700 : 900;
+  if (value.is_keyword(KEYWORD_LIGHTER))
+    return parent > 500 ? 400 : 100;
+
+  return parent;
+}
+
+static TextAlign compute_text_align (const Value& value, TextAlign parent)
+{
+  if (value.is_keyword(KEYWORD_LEFT))
+    return TEXT_ALIGN_LEFT;
+  if (value.is_keyword(KEYWORD_RIGHT))
+    return TEXT_ALIGN_RIGHT;
+  if (value.is_keyword(KEYWORD_CENTER))
+    return TEXT_ALIGN_CENTER;
+  if (value.is_keyword(KEYWORD_JUSTIFY))
+    return TEXT_ALIGN_JUSTIFY;
+
+  return parent;
+}
+
+static InheritedStylePtr compute_inherited (const PropertyTable& specified,
+                                            const InheritedStylePtr& parent)
+{
+  const Value* value;
+
+  if (!specified.find(PROPERTY_COLOR) &&
+      !specified.find(PROPERTY_FONT_FAMILY) &&
+      !specified.find(PROPERTY_FONT_SIZE) &&
+      !specified.find(PROPERTY_FONT_WEIGHT) &&
+      !specified.find(PROPERTY_LINE_HEIGHT) &&
+      !specified.find(PROPERTY_TEXT_ALIGN))
+    return parent;
+
+  InheritedStyle inherited (*parent);
+
+  if ((value = specified.find(PROPERTY_COLOR)))
+    inherited.color = resolve_color(*value, parent->color);
+  if ((value = specified.find(PROPERTY_FONT_FAMILY)) &&
+      value->kind == VALUE_KEYWORD)
+    inherited.font_family = value->keyword;
+  if ((value = specified.find(PROPERTY_FONT_SIZE)))
+    inherited.font_size = compute_font_size(*value, parent->font_size);
+  if ((value = specified.find(PROPERTY_FONT_WEIGHT)))
+    inherited.font_weight = compute_font_weight(*value, parent->font_weight);
+  if ((value = specified.find(PROPERTY_TEXT_ALIGN)))
+    inherited.text_align = compute_text_align(*value, parent->text_align);
+
+  if ((value = specified.find(PROPERTY_LINE_HEIGHT))) {
+    if (value->is_length()) {
+      inherited.line_height = value->length;
+      inherited.line_height_normal = false;
+    } else if (value->is_keyword(KEYWORD_NORMAL)) {
+      inherited.line_height = 0.0;
+      inherited.line_height_normal = true;
+    }
+  }
+
+  // declared, but to what the parent has already
+  if (inherited == *parent)
+    return parent;
+
+  return std::make_shared<const InheritedStyle>(inherited);
+}
+
+ComputedStylePtr compute_style (const PropertyTable& specified,
+                                const InheritedStylePtr& parent_inherited)
+{
+  std::shared_ptr<ComputedStyle> style = std::make_shared<ComputedStyle>();
+  const ComputedLength zero;
+  const ComputedLength automatic (0.0, true);
+
+  style->display = compute_display(specified);
+  style->width = length_or_auto(specified.find(PROPERTY_WIDTH), automatic);
+  style->height = length_or_auto(specified.find(PROPERTY_HEIGHT), automatic);
+
+  style->margin.top = length_or_auto(
+      first_of(specified, { PROPERTY_MARGIN_TOP, PROPERTY_MARGIN }), zero);
+  style->margin.right = length_or_auto(
+      first_of(specified, { PROPERTY_MARGIN_RIGHT, PROPERTY_MARGIN }), zero);
+  style->margin.bottom = length_or_auto(
+      first_of(specified, { PROPERTY_MARGIN_BOTTOM, PROPERTY_MARGIN }), zero);
+  style->margin.left = length_or_auto(
+      first_of(specified, { PROPERTY_MARGIN_LEFT, PROPERTY_MARGIN }), zero);
+
+  style->padding.top = length(
+      first_of(specified, { PROPERTY_PADDING_TOP, PROPERTY_PADDING }));
+  style->padding.right = length(
+      first_of(specified, { PROPERTY_PADDING_RIGHT, PROPERTY_PADDING }));
+  style->padding.bottom = length(
+      first_of(specified, { PROPERTY_PADDING_BOTTOM, PROPERTY_PADDING }));
+  style->padding.left = length(
+      first_of(specified, { PROPERTY_PADDING_LEFT, PROPERTY_PADDING }));
+
+  style->border.top = length(first_of(
+      specified, { PROPERTY_BORDER_TOP_WIDTH, PROPERTY_BORDER_TOP,
+                   PROPERTY_BORDER_WIDTH, PROPERTY_BORDER }));
+  style->border.right = length(first_of(
+      specified, { PROPERTY_BORDER_RIGHT_WIDTH, PROPERTY_BORDER_RIGHT,
+                   PROPERTY_BORDER_WIDTH, PROPERTY_BORDER }));
+  style->border.bottom = length(first_of(
+      specified, { PROPERTY_BORDER_BOTTOM_WIDTH, PROPERTY_BORDER_BOTTOM,
+                   PROPERTY_BORDER_WIDTH, PROPERTY_BORDER }));
+  style->border.left = length(first_of(
+      specified, { PROPERTY_BORDER_LEFT_WIDTH, PROPERTY_BORDER_LEFT,
+                   PROPERTY_BORDER_WIDTH, PROPERTY_BORDER }));
+
+  style->inherited = compute_inherited(specified, parent_inherited);
+
+  const Value* value;
+  if ((value = first_of(specified, { PROPERTY_BACKGROUND_COLOR,
+                                     PROPERTY_BACKGROUND })))
+    style->background_color = resolve_color(*value, COLOR_TRANSPARENT);
+
+  style->border_color = style->inherited->color;
+  if ((value = specified.find(PROPERTY_BORDER_COLOR)))
+    style->border_color = resolve_color(*value, style->border_color);
+
+  return style;
+}
+
+}}; // ! ns yabrowser style
@@ -0,0 +1,79 @@
+#include "yabrowser/DisplayList.hh"
+
+namespace yabrowser
+{
+namespace paint
+{
+
+using namespace layout;
+using namespace style;
+
+static void push_rect(DisplayList& list, const Rect& rect, const Color& color,
+                      BoxId box)
+{
+  if (color.a == 0 || rect.width <= 0.0 || rect.height <= 0.0)
+    return;
+
+  list.items.push_back(DisplayItem{ rect, color, box });
+}
+
+static void paint_block(DisplayList& list, const ComputedStyle& style,
+                        const Dimensions& dimensions, BoxId box)
+{
+  const Rect border = dimensions.border_box();
+  const Rect padding = dimensions.padding_box();
+
+  push_rect(list, border, style.background_color, box);
+
+  // top and bottom span the whole border box, the sides fit in between
+  push_rect(list, Rect(border.x, border.y, border.width, dimensions.border.top),
+            style.border_color, box);
+  push_rect(list,
+            Rect(border.x, padding.y + padding.height, border.width,
+                 dimensions.border.bottom),
+            style.border_color, box);
+  push_rect(list,
+            Rect(border.x, padding.y, dimensions.border.left, padding.height),
+            style.border_color, box);
+  push_rect(list,
+            Rect(padding.x + padding.width, padding.y,
+                 dimensions.border.right, padding.height),
+            style.border_color, box);
+}
+
+static void paint_box(DisplayList& list, const LayoutTree& tree,
+                      const LayoutGeometry& geometry, const LayoutBox& box)
+{
+  if (box.type == BoxType::BlockNode)
+    paint_block(list, *box.styled_node->computed,
+                geometry.dimensions[box.id], box.id);
+
+  // blocks in inline boxes have no geometry but the lines they take,
+  // and no edges
+  if (const InlineLayout* layout = geometry.inline_layout(box)) {
+    const Rect& content = geometry.dimensions[box.id].content;
+
+    for (const auto& block : layout->blocks)
+      paint_block(list, *tree.boxes[block.box].styled_node->computed,
+                  Dimensions(Rect(content.x + block.rect.x,
+                                  content.y + block.rect.y, block.rect.width,
+                                  block.rect.height)),
+                  block.box);
+    return;
+  }
+
+  for (const auto& child : tree.children(box))
+    paint_box(list, tree, geometry, child);
+}
+
+DisplayList build_display_list(const LayoutTree& tree,
+                               const LayoutGeometry& geometry)
+{
+  DisplayList list;
+
+  paint_box(list, tree, geometry, tree.root());
+
+  return list;
+}
+}  // ! ns paint
+}; // ! ns yabrowser
@@ -0,0 +1,193 @@
+#include "yabrowser/FontMetrics.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+namespace yabrowser
+{
+namespace layout
+{
+
+using namespace style;
+
+size_t FontDescriptor::hash() const
+{
+  size_t seed = std::hash<Keyword>()(family);
+
+  seed ^= std::hash<float>()(size) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  seed ^= std::hash<unsigned>()(weight) + 0x9e3779b9 + (seed << 6) +
+          (seed >> 2);
+
+  return seed;
+}
+
+FontDescriptor font_of(const InheritedStyle& inherited)
+{
+  return FontDescriptor(inherited.font_family, inherited.font_size,
+                        inherited.font_weight);
+}
+
+static std::atomic<unsigned> font_metrics_counter(0);
+
+FontMetrics::FontMetrics() : id(font_metrics_counter.fetch_add(1)) {}
+
+FontMetrics::~FontMetrics() {}
+
+float FixedAdvanceMetrics::text_width(const FontDescriptor& font,
+                                      const char*, size_t length) const
+{
+  return length * font.size * advance;
+}
+
+const FontMetrics& default_font_metrics()
+{
+  static const FixedAdvanceMetrics metrics;
+
+  return metrics;
+}
+
+// FNV-1a over the text, mixed with what it is measured with
+static uint64_t text_hash(unsigned metrics, const FontDescriptor& font,
+                          const char* text, size_t length)
+{
+  uint64_t hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(text[i]);
+    hash *= 1099511628211ull;
+  }
+
+  hash ^= font.hash() + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  hash ^= metrics + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+
+  return hash;
+}
+
+TextWidthCache::TextWidthCache(size_t capacity, unsigned shards)
+    : m_shard_capacity(std::max<size_t>(capacity / std::max(shards, 1u), 1))
+{
+  m_shards.reserve(std::max(shards, 1u));
+  for (unsigned i = 0; i < std::max(shards, 1u); i++)
+    m_shards.emplace_back(new Shard());
+}
+
+TextWidthCache::~TextWidthCache() {}
+
+TextWidthCache& TextWidthCache::shared()
+{
+  static TextWidthCache cache;
+
+  return cache;
+}
+
+float TextWidthCache::width(const FontMetrics& metrics,
+                            const FontDescriptor& font, const char* text,
+                            size_t length)
+{
+  const uint64_t hash = text_hash(metrics.id, font, text, length);
+  Shard& shard = *m_shards[(hash >> 32) % m_shards.size()];
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.slots.find(hash);
+
+    if (it != shard.slots.end()) {
+      Entry& entry = shard.entries[it->second];
+
+      if (entry.metrics == metrics.id && entry.font == font &&
+          entry.text.compare(0, std::string::npos, text, length) == 0) {
+        entry.referenced = true;
+        shard.stats.hits++;
+        return entry.width;
+      }
+    }
+
+    shard.stats.misses++;
+  }
+
+  const float width = metrics.text_width(font, text, length);
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  _insert(shard, Entry{ hash, metrics.id, font, std::string(text, length),
+                        width, false });
+
+  return width;
+}
+
+void TextWidthCache::_insert(Shard& shard, Entry&& entry)
+{
+  // another thread measured the same text meanwhile, or two keys share a
+  // hash: the newest one takes the slot
+  auto it = shard.slots.find(entry.hash);
+  if (it != shard.slots.end()) {
+    shard.entries[it->second] = std::move(entry);
+    return;
+  }
+
+  if (shard.entries.size() < m_shard_capacity) {
+    shard.slots.emplace(entry.hash, shard.entries.size());
+    shard.entries.push_back(std::move(entry));
+    return;
+  }
+
+  // second chance: recently hit entries survive one more turn of the hand
+  while (shard.entries[shard.hand].referenced) {
+    shard.entries[shard.hand].referenced = false;
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+  }
+
+  const unsigned slot = shard.hand;
+  shard.slots.erase(shard.entries[slot].hash);
+  shard.slots.emplace(entry.hash, slot);
+  shard.entries[slot] = std::move(entry);
+  shard.hand = (shard.hand + 1) % shard.entries.size();
+  shard.stats.evictions++;
+}
+
+TextCacheStats TextWidthCache::stats() const
+{
+  TextCacheStats total;
+
+  for (const auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+
+    total.hits += shard->stats.hits;
+    total.misses += shard->stats.misses;
+    total.evictions += shard->stats.evictions;
+  }
+
+  return total;
+}
+
+size_t TextWidthCache::size() const
+{
+  size_t size = 0;
+
+  for (const auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    size += shard->entries.size();
+  }
+
+  return size;
+}
+
+void TextWidthCache::clear()
+{
+  for (const auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+
+    shard->slots.clear();
+    shard->entries.clear();
+    shard->hand = 0;
+    shard->stats = TextCacheStats();
+  }
+}
+
+TextMeasurer::TextMeasurer(const FontMetrics& font_metrics,
+                           TextWidthCache& text_cache)
+    : metrics(font_metrics), cache(text_cache)
+{
+}
+}  // ! ns layout
+}; // ! ns yabrowser
@@ -0,0 +1,205 @@
+#include "yabrowser/Layout.hh"
+
+#include <algorithm>
+
+namespace yabrowser
+{
+namespace layout
+{
+
+using namespace style;
+
+static inline bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/**
+ * Greedy line breaking: words are appended to the current line and the
+ * line is closed as soon as the next one doesn't fit, so every word is
+ * looked at once. A word wider than the whole line gets a line of its
+ * own and overflows it.
+ */
+struct LineBuilder {
+  InlineLayout& layout;
+  const TextMeasurer& measurer;
+  const float width;
+  // the line height of the block itself, which no line goes below
+  const float strut;
+  const TextAlign align;
+
+  // where the current line starts and how far it got
+  float y;
+  float x;
+  float line_height;
+  unsigned first_fragment;
+  // whitespace was seen since the last word, and how wide it is in the
+  // font of the text it was seen in
+  bool space;
+  float space_width;
+
+  LineBuilder(InlineLayout& inline_layout, const TextMeasurer& text_measurer,
+              float line_width, const InheritedStyle& container)
+      : layout(inline_layout),
+        measurer(text_measurer),
+        width(line_width),
+        strut(container.used_line_height()),
+        align(container.text_align),
+        y(0.0),
+        x(0.0),
+        line_height(strut),
+        first_fragment(0),
+        space(false),
+        space_width(0.0)
+  {
+  }
+
+  void add_text(BoxId box, const std::string& text,
+                const InheritedStyle& inherited)
+  {
+    const FontDescriptor font = font_of(inherited);
+    const float height = inherited.used_line_height();
+    size_t i = 0;
+
+    while (i < text.size()) {
+      if (is_space(text[i])) {
+        if (!space)
+          space_width = measurer.width(font, " ", 1);
+
+        space = true;
+        i++;
+        continue;
+      }
+
+      const size_t begin = i;
+      while (i < text.size() && !is_space(text[i]))
+        i++;
+
+      add_word(box, begin, i, measurer.width(font, &text[begin], i - begin),
+               height);
+    }
+  }
+
+  void add_word(BoxId box, size_t begin, size_t end, float word_width,
+                float height)
+  {
+    const bool empty = first_fragment == layout.fragments.size();
+    float advance = !empty && space ? space_width : 0.0;
+
+    if (!empty && x + advance + word_width > width) {
+      break_line();
+      advance = 0.0;
+    }
+
+    space = false;
+
+    // the previous word of the same box, on the same line, just grows
+    if (first_fragment < layout.fragments.size() &&
+        layout.fragments.back().box == box) {
+      InlineFragment& fragment = layout.fragments.back();
+
+      fragment.end = end;
+      fragment.rect.width = x + advance + word_width - fragment.rect.x;
+    } else {
+      layout.fragments.push_back(InlineFragment{
+          box, begin, end, Rect(x + advance, y, word_width, height) });
+    }
+
+    x += advance + word_width;
+    line_height = std::max(line_height, height);
+  }
+
+  void break_line()
+  {
+    const unsigned count = layout.fragments.size() - first_fragment;
+    float offset = 0.0;
+
+    if (!count)
+      return;
+
+    // `justify` is laid out as `left`
+    if (align == TEXT_ALIGN_RIGHT)
+      offset = std::max(width - x, 0.0f);
+    else if (align == TEXT_ALIGN_CENTER)
+      offset = std::max(width - x, 0.0f) / 2;
+
+    for (unsigned i = first_fragment; i < layout.fragments.size(); i++)
+      layout.fragments[i].rect.x += offset;
+
+    layout.lines.push_back(
+        LineBox{ Rect(offset, y, x, line_height), first_fragment, count });
+
+    y += line_height;
+    x = 0.0;
+    line_height = strut;
+    first_fragment = layout.fragments.size();
+  }
+};
+
+// the box whose lines an inline box is laid out in
+BoxId LayoutTree::_inline_container(BoxId id) const
+{
+  while (boxes[id].type == BoxType::InlineNode)
+    id = boxes[id].parent;
+
+  return id;
+}
+
+void LayoutTree::_add_inline_content(BoxId id, LineBuilder& lines) const
+{
+  for (const auto& child : children(boxes[id])) {
+    // a block in an inline box, or the anonymous block around the inline
+    // content next to one: its lines are lines of their own
+    if (child.type != BoxType::InlineNode) {
+      std::vector<InlineBlock>& blocks = lines.layout.blocks;
+      const size_t block = blocks.size();
+
+      lines.break_line();
+      if (child.type == BoxType::BlockNode)
+        blocks.push_back(InlineBlock{ child.id, Rect(0.0, lines.y, 0.0, 0.0) });
+
+      _add_inline_content(child.id, lines);
+      lines.break_line();
+
+      if (child.type == BoxType::BlockNode) {
+        blocks[block].rect.width = lines.width;
+        blocks[block].rect.height = lines.y - blocks[block].rect.y;
+      }
+      continue;
+    }
+
+    const StyledNode& styled = *child.styled_node;
+
+    if (styled.node->type == yahtml::NodeType::Text) {
+      const yahtml::Text& text =
+          *static_cast<const yahtml::Text*>(styled.node.get());
+      lines.add_text(child.id, text.text, *styled.computed->inherited);
+    }
+
+    _add_inline_content(child.id, lines);
+  }
+}
+
+void LayoutTree::calculate_inline_layout(LayoutGeometry& viewport,
+                                         BoxId id) const
+{
+  InlineLayout& layout = viewport.inline_layouts[boxes[id].inline_layout];
+  // anonymous blocks take the inherited style of the block they are in
+  const StyledNode* container = boxes[id].styled_node
+                                    ? boxes[id].styled_node
+                                    : boxes[boxes[id].parent].styled_node;
+
+  layout.lines.clear();
+  layout.fragments.clear();
+  layout.blocks.clear();
+
+  LineBuilder lines(layout, measurer, viewport.dimensions[id].content.width,
+                    *container->computed->inherited);
+
+  _add_inline_content(id, lines);
+  lines.break_line();
+
+  viewport.dimensions[id].content.height = lines.y;
+}
+}  // ! ns layout
+}; // ! ns yabrowser
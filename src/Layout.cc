@@ -1,250 +1,713 @@
 #include "yabrowser/Layout.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Trace.hh"
+
+#include <stdexcept>
+#include <utility>
 
 namespace yabrowser
 {
 namespace layout
 {
 
-inline float to_px(const yacss::CSSBaseValue& value)
-{
-  if (value.type == yacss::ValueType::Length) {
-    return value.get<yacss::LengthValue>().val;
-  }
+using namespace style;
+using namespace yacss;
 
-  return 0.0;
+struct ParallelLayout {
+  ThreadPool& pool;
+  size_t threshold;
+};
+
+// anonymous blocks have no declarations of their own
+static const ComputedStyle& anonymous_style()
+{
+  static const ComputedStyle style = []() {
+    ComputedStyle anonymous;
+    anonymous.display = DISPLAY_BLOCK;
+    anonymous.inherited = initial_inherited_style();
+    return anonymous;
+  }();
+
+  return style;
 }
 
-using namespace style;
-using namespace yacss;
+static inline const ComputedStyle& style_of(const LayoutBox& box)
+{
+  return box.styled_node ? *box.styled_node->computed : anonymous_style();
+}
 
+// blocks and anonymous blocks are laid out as blocks, inline boxes only
+// within the lines of one of them
+static inline bool is_block_level(const LayoutBox& box)
+{
+  return box.type != BoxType::InlineNode;
+}
 
-// ROOT
-LayoutBox::LayoutBox(const StyledChild& sn, Dimensions initial_dimensions)
-    : type(BoxType::BlockNode),
-      dimensions(initial_dimensions),
-      children(LayoutBoxContainer()),
-      styled_node(sn),
-      parent(this)
+// visible, non-anonymous boxes are at most one per styled node
+static size_t count_styled_nodes(const StyledNode& sn)
 {
-  dimensions.content.height = 0.0;
+  size_t count = 1;
 
-  _init_tree();
+  for (const auto& child : sn.children)
+    count += count_styled_nodes(*child);
+
+  return count;
 }
 
-// NODE or LEAF
-LayoutBox::LayoutBox(const StyledChild& sn, const BoxType bt, LayoutBox* lbp)
-    : type(bt),
-      dimensions(Dimensions()),
-      children(LayoutBoxContainer()),
-      parent(lbp)
+const LayoutBox& BoxRange::at(size_t i) const
 {
-  if (type == BoxType::AnonymousBlock)
-    return;
+  if (i >= size())
+    throw std::out_of_range("BoxRange::at");
 
-  styled_node = sn;
+  return first[i];
+}
+
+LayoutTree::LayoutTree(const StyledChild& sn, Dimensions initial_dimensions,
+                       const FontMetrics& metrics)
+    : generation(current_style_generation()),
+      revision(1),
+      styled_root(sn),
+      measurer(metrics)
+{
   _init_tree();
+  geometry = new_geometry(initial_dimensions);
 }
 
+LayoutTree::~LayoutTree() {}
+
 // BUILD
-void LayoutBox::_init_tree()
+void LayoutTree::_init_tree()
 {
-  bool has_block = false;
-  bool constructed_anon = false;
-  LayoutBoxContainer::const_iterator last_anon_it;
+  TRACE_SPAN("layout", "_init_tree");
+
+  // which styled children each box is built from: [begin, end) of
+  // `source->children`. Anonymous blocks wrap a run of their parent's.
+  struct Source {
+    const StyledNode* node;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Source> sources;
+
+  const size_t capacity = count_styled_nodes(*styled_root);
+  boxes.reserve(capacity);
+  sources.reserve(capacity);
+
+  boxes.emplace_back(BoxType::BlockNode, 0, NO_BOX, styled_root.get());
+  sources.push_back(
+      Source{ styled_root.get(), 0, styled_root->children.size() });
+
+  // breadth-first, so that the children of every box are emplaced next to
+  // each other
+  for (BoxId id = 0; id < boxes.size(); id++) {
+    const Source source = sources[id];
+    const StyledChildren& styled_children = source.node->children;
+    const BoxId first_child = boxes.size();
+    bool has_block = false;
+    bool constructed_anon = false;
+    BoxId last_anon = NO_BOX;
+
+    for (size_t i = source.begin; i < source.end; i++) {
+      if (styled_children[i]->display == DISPLAY_BLOCK) {
+        has_block = true;
+        break;
+      }
+    }
 
-  for (const auto& child : styled_node->children) {
-    if (child->display == DISPLAY_BLOCK) {
-      has_block = true;
-      break;
+    for (size_t i = source.begin; i < source.end; i++) {
+      const StyledNode* child = styled_children[i].get();
+
+      switch (child->display) {
+        case DISPLAY_INLINE:
+          if (!has_block) {
+            boxes.emplace_back(BoxType::InlineNode, boxes.size(), id, child);
+            sources.push_back(Source{ child, 0, child->children.size() });
+            continue;
+          }
+
+          if (!constructed_anon) {
+            last_anon = boxes.size();
+            boxes.emplace_back(BoxType::AnonymousBlock, last_anon, id, nullptr);
+            sources.push_back(Source{ source.node, i, i });
+            constructed_anon = true;
+          }
+
+          sources[last_anon].end = i + 1;
+          break;
+
+        case DISPLAY_BLOCK:
+          boxes.emplace_back(BoxType::BlockNode, boxes.size(), id, child);
+          sources.push_back(Source{ child, 0, child->children.size() });
+          constructed_anon = false;
+          break;
+
+        case DISPLAY_NONE:
+          continue;
+      }
     }
+
+    boxes[id].first_child = first_child;
+    boxes[id].child_count = boxes.size() - first_child;
   }
 
-  for (const auto& child : styled_node->children) {
-    switch (child->display) {
-      case DISPLAY_INLINE:
-        if (!has_block) {
-          children.push_back(
-              std::make_shared<LayoutBox>(child, BoxType::InlineNode, this));
+  // a block holds either blocks or inline boxes, never both. Blocks
+  // within an inline box are laid out in the lines of its container.
+  std::vector<bool> in_inline(boxes.size(), false);
+  unsigned inline_layouts = 0;
+  for (auto& box : boxes) {
+    if (box.parent != NO_BOX)
+      in_inline[box.id] = in_inline[box.parent] ||
+                          boxes[box.parent].type == BoxType::InlineNode;
+
+    if (is_block_level(box) && !in_inline[box.id] && box.child_count &&
+        boxes[box.first_child].type == BoxType::InlineNode)
+      box.inline_layout = inline_layouts++;
+  }
 
-          continue;
-        }
+  // boxes are stored breadth-first, so every child comes after its parent
+  subtree_sizes.assign(boxes.size(), 1);
+  for (BoxId id = boxes.size(); id-- > 1;)
+    subtree_sizes[boxes[id].parent] += subtree_sizes[id];
+}
 
-        if (!constructed_anon) {
-          children.push_back(std::make_shared<LayoutBox>(
-              child, BoxType::AnonymousBlock, this));
-          last_anon_it = children.end() - 1;
-          constructed_anon = true;
-        }
+LayoutGeometry LayoutTree::new_geometry(
+    const Dimensions& containing_block) const
+{
+  LayoutGeometry viewport;
 
-        (*last_anon_it)
-            ->children.push_back(
-                std::make_shared<LayoutBox>(child, BoxType::InlineNode, this));
-        break;
+  // the root box is stacked right at the top of what it is laid out in
+  viewport.containing_block = containing_block;
+  viewport.containing_block.content.height = 0.0;
+  viewport.revision = revision;
 
-      case DISPLAY_BLOCK:
-        children.push_back(
-            std::make_shared<LayoutBox>(child, BoxType::BlockNode, this));
-        constructed_anon = false;
-        break;
+  viewport.dimensions.assign(boxes.size(), Dimensions());
+  viewport.dimensions.front() = viewport.containing_block;
 
-      case DISPLAY_NONE:
-        continue;
-    }
+  // inline boxes are laid out by their container, they never get dirty
+  viewport.dirty.resize(boxes.size());
+  for (const auto& box : boxes) {
+    viewport.dirty[box.id] =
+        is_block_level(box) ? LAYOUT_STYLE : LAYOUT_CLEAN;
+
+    // ids and inline layouts are handed out in the same order
+    if (box.inline_layout != NO_INLINE_LAYOUT)
+      viewport.inline_layouts.push_back(InlineLayout{ box.id, {}, {}, {} });
+  }
+
+  return viewport;
+}
+
+void LayoutTree::_fit(LayoutGeometry& viewport) const
+{
+  if (viewport.revision != revision)
+    viewport = new_geometry(viewport.containing_block);
+}
+
+void LayoutTree::calculate(LayoutGeometry& viewport) const
+{
+  calculate(viewport, 0);
+}
+
+void LayoutTree::calculate(LayoutGeometry& viewport, BoxId id) const
+{
+  // a remade geometry has nothing around the box to lay it out against
+  if (id != 0 && viewport.revision != revision)
+    throw std::logic_error("LayoutTree::calculate: stale geometry");
+
+  _fit(viewport);
+  const LayoutBox& box = boxes[id];
+
+  // inline boxes are laid out along with the lines of their container
+  if (!is_block_level(box)) {
+    calculate_inline_layout(viewport, _inline_container(id));
+    return;
   }
+
+  viewport.dirty[id] = LAYOUT_CLEAN;
+  calculate_block_layout(viewport, id);
+}
+
+void LayoutTree::calculate(LayoutGeometry& viewport, ThreadPool& pool,
+                           size_t threshold) const
+{
+  // calculate_block_layout() is not used on this path
+  TRACE_SPAN("layout", "calculate (parallel)");
+  ParallelLayout layout{ pool, threshold };
+
+  _fit(viewport);
+
+  if (!is_block_level(boxes[0]))
+    return;
+
+  _calculate_widths_and_heights(viewport, 0, layout);
+  _calculate_positions(viewport, 0, viewport.containing_block.content.height,
+                       layout);
 }
 
-LayoutBox::~LayoutBox() {}
+void LayoutTree::calculate_viewports(std::vector<LayoutGeometry>& viewports,
+                                     ThreadPool& pool) const
+{
+  TRACE_SPAN("layout", "calculate_viewports");
+  TaskGroup group(pool);
+
+  // each viewport on its own, sequentially: they share nothing but the
+  // boxes, which are only read
+  for (auto& viewport : viewports) {
+    LayoutGeometry* target = &viewport;
+    group.run([this, target]() {
+      TRACE_SPAN("layout", "viewport (task)");
+      calculate(*target);
+    });
+  }
+
+  group.wait();
+}
 
-void LayoutBox::calculate()
+void LayoutTree::_calculate_widths_and_heights(
+    LayoutGeometry& viewport, BoxId id, const ParallelLayout& layout) const
 {
-  if (this->type == BoxType::BlockNode) {
-    calculate_block_layout();
-  } else if (this->type == BoxType::InlineNode) {
-    std::cerr << "LayoutBox::calculate - inlinenode unsupported" << std::endl;
-  } else if (this->type == BoxType::AnonymousBlock) {
-    std::cerr << "LayoutBox::calculate - anonblock unsupported" << std::endl;
+  TaskGroup group(layout.pool);
+  Dimensions& dimensions = viewport.dimensions[id];
+
+  // top-down: a box only needs the width of its containing block
+  viewport.dirty[id] = LAYOUT_CLEAN;
+  calculate_block_width(viewport, id);
+  _calculate_block_edges(viewport, id);
+
+  for (const auto& child : children(boxes[id])) {
+    if (!is_block_level(child))
+      continue;
+
+    if (subtree_sizes[child.id] < layout.threshold) {
+      _calculate_widths_and_heights(viewport, child.id, layout);
+    } else {
+      const BoxId child_id = child.id;
+      LayoutGeometry* target = &viewport;
+      group.run([this, target, child_id, &layout]() {
+        TRACE_SPAN("layout", "widths and heights (task)");
+        _calculate_widths_and_heights(*target, child_id, layout);
+      });
+    }
+  }
+
+  group.wait();
+
+  // bottom-up: stack the children, same order as calculate_block_layout
+  dimensions.content.height = 0.0;
+  if (boxes[id].inline_layout != NO_INLINE_LAYOUT) {
+    calculate_inline_layout(viewport, id);
   } else {
-    std::cerr << "LayoutBox::calculate - unsupported" << std::endl;
+    for (const auto& child : children(boxes[id]))
+      dimensions.content.height +=
+          viewport.dimensions[child.id].margin_box().height;
   }
+
+  calculate_block_height(viewport, id);
 }
 
-void LayoutBox::calculate_block_layout()
+void LayoutTree::_calculate_positions(LayoutGeometry& viewport, BoxId id,
+                                      float preceding_height,
+                                      const ParallelLayout& layout) const
 {
-  calculate_block_width();
-  calculate_block_position();
+  TaskGroup group(layout.pool);
+
+  _calculate_block_y(viewport, id, preceding_height);
+
+  preceding_height = 0.0;
+  for (const auto& child : children(boxes[id])) {
+    const BoxId child_id = child.id;
+
+    if (is_block_level(child)) {
+      if (subtree_sizes[child_id] < layout.threshold) {
+        _calculate_positions(viewport, child_id, preceding_height, layout);
+      } else {
+        LayoutGeometry* target = &viewport;
+        group.run([this, target, child_id, preceding_height, &layout]() {
+          TRACE_SPAN("layout", "positions (task)");
+          _calculate_positions(*target, child_id, preceding_height, layout);
+        });
+      }
+    }
 
-  for (const auto& child : children) {
-    child->calculate();
-    this->dimensions.content.height += child->dimensions.margin_box().height;
+    preceding_height += viewport.dimensions[child_id].margin_box().height;
   }
 
-  calculate_block_height();
+  group.wait();
 }
 
-void LayoutBox::calculate_block_width()
+void LayoutTree::mark_dirty(LayoutGeometry& viewport, BoxId id,
+                            unsigned flags) const
 {
-  const CSSBaseValue zero_length = LengthValue(0, yacss::UNIT_PX);
-  const CSSBaseValue auto_keyword = KeywordValue("auto");
+  _fit(viewport);
+  std::vector<unsigned char>& dirty = viewport.dirty;
+  dirty[id] |= flags;
+
+  for (BoxId parent = boxes[id].parent;
+       parent != NO_BOX && !(dirty[parent] & LAYOUT_DESCENDANTS);
+       parent = boxes[parent].parent)
+    dirty[parent] |= LAYOUT_DESCENDANTS;
+}
 
-  CSSBaseValue width = styled_node->decl_lookup({ "width" }, auto_keyword);
-  CSSBaseValue margin_left =
-      styled_node->decl_lookup({ "margin-left", "margin" }, zero_length);
-  CSSBaseValue margin_right =
-      styled_node->decl_lookup({ "margin-right", "margin" }, zero_length);
+void LayoutTree::set_containing_width(LayoutGeometry& viewport,
+                                      float width) const
+{
+  _fit(viewport);
+  if (width == viewport.containing_block.content.width)
+    return;
 
-  const CSSBaseValue& border_left =
-      styled_node->decl_lookup({ "border-left", "border" }, zero_length);
-  const CSSBaseValue& border_right =
-      styled_node->decl_lookup({ "border-right", "border" }, zero_length);
+  viewport.containing_block.content.width = width;
+  mark_dirty(viewport, 0, LAYOUT_CONTAINING_WIDTH);
+}
 
-  const CSSBaseValue& padding_left =
-      styled_node->decl_lookup({ "padding-left", "padding" }, zero_length);
-  const CSSBaseValue& padding_right =
-      styled_node->decl_lookup({ "padding-right", "padding" }, zero_length);
+// UPDATE
+void LayoutTree::update()
+{
+  std::vector<LayoutBox> old_boxes;
+  LayoutGeometry old_geometry;
 
-  float total = to_px(width) + to_px(margin_left) + to_px(margin_right) +
-                to_px(border_left) + to_px(border_right) + to_px(padding_left) +
-                to_px(border_right);
+  old_boxes.swap(boxes);
+  std::swap(old_geometry, geometry);
 
-  bool auto_width = width == auto_keyword;
-  bool auto_margin_left = margin_left == auto_keyword;
-  bool auto_margin_right = margin_right == auto_keyword;
+  _init_tree();
+  revision++;
+  geometry = new_geometry(old_geometry.containing_block);
+
+  std::vector<unsigned char>& dirty = geometry.dirty;
+
+  // the box each box was built as last time. Nodes built since then are
+  // never looked up: they may sit where a dropped node used to be.
+  std::vector<BoxId> previous(boxes.size(), NO_BOX);
+  previous[0] = 0;
+
+  for (BoxId id = 0; id < boxes.size(); id++) {
+    const BoxId old_id = previous[id];
+    if (old_id == NO_BOX)
+      continue;
+
+    const LayoutBox& box = boxes[id];
+    const LayoutBox& old = old_boxes[old_id];
+    unsigned flags = old_geometry.dirty[old_id] & ~LAYOUT_DESCENDANTS;
+
+    if (box.type != old.type ||
+        (box.styled_node && box.styled_node->style_generation > generation))
+      flags |= LAYOUT_STYLE;
+    if (box.child_count != old.child_count)
+      flags |= LAYOUT_CHILDREN;
+
+    size_t cursor = 0;
+    for (size_t i = 0; i < box.child_count; i++) {
+      const LayoutBox& child = boxes[box.first_child + i];
+      size_t match = old.child_count;
+
+      if (!child.styled_node) {
+        // anonymous blocks are matched by position
+        if (i < old.child_count &&
+            old_boxes[old.first_child + i].type == BoxType::AnonymousBlock)
+          match = i;
+      } else if (child.styled_node->generation <= generation) {
+        for (size_t n = 0; n < old.child_count; n++) {
+          const size_t j = (cursor + n) % old.child_count;
+          if (old_boxes[old.first_child + j].styled_node == child.styled_node) {
+            match = j;
+            break;
+          }
+        }
+      }
 
-  // if width is set to auto and there's an overflow,
-  // any other 'auto' values become 0px
-  if (auto_width && total > parent->dimensions.content.width) {
-    if (margin_left.type == ValueType::Keyword)
-      margin_left = zero_length;
+      if (match == old.child_count) {
+        flags |= LAYOUT_CHILDREN;
+        continue;
+      }
+
+      if (match != i)
+        flags |= LAYOUT_CHILDREN;
+
+      previous[child.id] = old.first_child + match;
+      cursor = match + 1;
+    }
+
+    geometry.dimensions[id] = old_geometry.dimensions[old_id];
+
+    if (is_block_level(box)) {
+      dirty[id] = flags;
+    } else {
+      dirty[id] = LAYOUT_CLEAN;
+      // ids are handed out breadth-first: the container was seen already
+      if (flags != LAYOUT_CLEAN)
+        dirty[_inline_container(id)] |= LAYOUT_CHILDREN;
+    }
+  }
+
+  // lines that can be kept only need their boxes renamed
+  std::vector<BoxId> renamed(old_boxes.size(), NO_BOX);
+  for (BoxId id = 0; id < boxes.size(); id++) {
+    if (previous[id] != NO_BOX)
+      renamed[previous[id]] = id;
+  }
+
+  for (auto& layout : geometry.inline_layouts) {
+    const BoxId old_id = previous[layout.container];
+    const unsigned old_layout =
+        old_id == NO_BOX ? NO_INLINE_LAYOUT : old_boxes[old_id].inline_layout;
+
+    if (old_layout == NO_INLINE_LAYOUT) {
+      dirty[layout.container] |= LAYOUT_CHILDREN;
+      continue;
+    }
+
+    layout.lines.swap(old_geometry.inline_layouts[old_layout].lines);
+    layout.fragments.swap(old_geometry.inline_layouts[old_layout].fragments);
+    layout.blocks.swap(old_geometry.inline_layouts[old_layout].blocks);
+
+    for (auto& fragment : layout.fragments) {
+      fragment.box = renamed[fragment.box];
+      if (fragment.box == NO_BOX)
+        dirty[layout.container] |= LAYOUT_CHILDREN;
+    }
+
+    for (auto& block : layout.blocks) {
+      block.box = renamed[block.box];
+      if (block.box == NO_BOX)
+        dirty[layout.container] |= LAYOUT_CHILDREN;
+    }
+  }
 
-    if (margin_right.type == ValueType::Keyword)
-      margin_right = zero_length;
+  for (BoxId id = boxes.size(); id-- > 1;) {
+    if (dirty[id] != LAYOUT_CLEAN)
+      dirty[boxes[id].parent] |= LAYOUT_DESCENDANTS;
   }
 
-  float underflow = parent->dimensions.content.width - total;
+  generation = current_style_generation();
+}
+
+// RELAYOUT
+void LayoutTree::relayout(LayoutGeometry& viewport,
+                          RelayoutStats& stats) const
+{
+  TRACE_SPAN("layout", "relayout");
+
+  _fit(viewport);
+  if (!is_block_level(boxes[0]))
+    return;
+
+  _relayout(viewport, 0, viewport.containing_block.content.height, false,
+            stats);
+}
+
+void LayoutTree::_relayout(LayoutGeometry& viewport, BoxId id,
+                           float preceding_height, bool containing_changed,
+                           RelayoutStats& stats) const
+{
+  Dimensions& dimensions = viewport.dimensions[id];
+  const unsigned flags = viewport.dirty[id];
+  const float previous_y = dimensions.content.y;
+
+  _calculate_block_y(viewport, id, preceding_height);
+
+  if (!containing_changed && flags == LAYOUT_CLEAN) {
+    if (dimensions.content.y == previous_y) {
+      stats.reused += subtree_sizes[id];
+    } else {
+      _shift(viewport, id);
+      stats.shifted += subtree_sizes[id];
+    }
+
+    return;
+  }
+
+  // widths only depend on the containing block and on the box's own
+  // style, children only need them again if they changed
+  bool width_changed = false;
+  if (containing_changed ||
+      (flags & (LAYOUT_STYLE | LAYOUT_CONTAINING_WIDTH))) {
+    const float previous_x = dimensions.content.x;
+    const float previous_width = dimensions.content.width;
+
+    calculate_block_width(viewport, id);
+    _calculate_block_edges(viewport, id);
+    _calculate_block_y(viewport, id, preceding_height);
+
+    width_changed = dimensions.content.x != previous_x ||
+                    dimensions.content.width != previous_width;
+  }
+
+  stats.laid_out++;
+  viewport.dirty[id] = LAYOUT_CLEAN;
+
+  // lines are only broken again when what they are broken against changed
+  if (boxes[id].inline_layout != NO_INLINE_LAYOUT) {
+    if (width_changed || (flags & ~LAYOUT_DESCENDANTS)) {
+      calculate_inline_layout(viewport, id);
+      stats.laid_out += subtree_sizes[id] - 1;
+    } else {
+      dimensions.content.height = 0.0;
+      for (const auto& line : viewport.inline_layout(boxes[id])->lines)
+        dimensions.content.height += line.rect.height;
+      stats.reused += subtree_sizes[id] - 1;
+    }
+
+    calculate_block_height(viewport, id);
+    return;
+  }
+
+  float height = 0.0;
+  for (const auto& child : children(boxes[id])) {
+    _relayout(viewport, child.id, height, width_changed, stats);
+    height += viewport.dimensions[child.id].margin_box().height;
+  }
+
+  dimensions.content.height = height;
+  calculate_block_height(viewport, id);
+}
+
+void LayoutTree::_shift(LayoutGeometry& viewport, BoxId id) const
+{
+  // heights are still valid, only the positions below them moved
+  float height = 0.0;
+  for (const auto& child : children(boxes[id])) {
+    if (is_block_level(child)) {
+      _calculate_block_y(viewport, child.id, height);
+      _shift(viewport, child.id);
+    }
+
+    height += viewport.dimensions[child.id].margin_box().height;
+  }
+}
+
+void LayoutTree::calculate_block_layout(LayoutGeometry& viewport,
+                                        BoxId id) const
+{
+  TRACE_SPAN("layout", "calculate_block_layout");
+  Dimensions& dimensions = viewport.dimensions[id];
+  dimensions.content.height = 0.0;
+
+  calculate_block_width(viewport, id);
+  calculate_block_position(viewport, id);
+
+  if (boxes[id].inline_layout != NO_INLINE_LAYOUT) {
+    calculate_inline_layout(viewport, id);
+  } else {
+    for (const auto& child : children(boxes[id])) {
+      calculate(viewport, child.id);
+      dimensions.content.height +=
+          viewport.dimensions[child.id].margin_box().height;
+    }
+  }
+
+  calculate_block_height(viewport, id);
+}
+
+void LayoutTree::calculate_block_width(LayoutGeometry& viewport,
+                                       BoxId id) const
+{
+  const ComputedStyle& style = style_of(boxes[id]);
+  const Dimensions& parent = viewport.containing(boxes[id]);
+  Dimensions& dimensions = viewport.dimensions[id];
+
+  // `auto` values are 0px here
+  float width = style.width.px;
+  float margin_left = style.margin.left.px;
+  float margin_right = style.margin.right.px;
+
+  float total = width + margin_left + margin_right + style.border.left +
+                style.border.right + style.padding.left + style.padding.right;
+
+  bool auto_width = style.width.is_auto;
+  bool auto_margin_left = style.margin.left.is_auto;
+  bool auto_margin_right = style.margin.right.is_auto;
+
+  float underflow = parent.content.width - total;
 
   // =auto: (w : false, mr: false, ml: false)
   if (!auto_width && !auto_margin_right && !auto_margin_left) {
-    margin_right = LengthValue(to_px(margin_right) + underflow, yacss::UNIT_PX);
+    margin_right = margin_right + underflow;
   }
 
   // =auto: (w : false, mr: false, ml: true)
   else if (!auto_width && !auto_margin_right && auto_margin_left) {
-    margin_left = LengthValue(underflow, yacss::UNIT_PX);
+    margin_left = underflow;
   }
 
   // =auto: (w : false, mr: true, ml: false)
   else if (!auto_width && auto_margin_right && !auto_margin_left) {
-    margin_right = LengthValue(underflow, yacss::UNIT_PX);
+    margin_right = underflow;
   }
 
   // =auto: (w: true, mr: any, ml: any)
+  // any other 'auto' values are already 0px
   if (auto_width) {
-    if (auto_margin_left)
-      margin_left = zero_length;
-    if (auto_margin_right)
-      margin_right = zero_length;
-
     if (underflow >= 0) {
-      width = LengthValue(underflow, yacss::UNIT_PX);
+      width = underflow;
     } else {
-      width = zero_length;
-      margin_right =
-          LengthValue(to_px(margin_right) + underflow, yacss::UNIT_PX);
+      width = 0;
+      margin_right = margin_right + underflow;
     }
   }
 
   // =auto: (w : false, mr: true, ml: true)
   if (!auto_width && auto_margin_left && auto_margin_right) {
-    margin_left = LengthValue(underflow / 2, yacss::UNIT_PX);
-    margin_right = LengthValue(underflow / 2, yacss::UNIT_PX);
+    margin_left = underflow / 2;
+    margin_right = underflow / 2;
   }
 
-  dimensions.content.width = to_px(width);
-  dimensions.padding.left = to_px(padding_left);
-  dimensions.padding.right = to_px(padding_right);
+  dimensions.content.width = width;
+  dimensions.padding.left = style.padding.left;
+  dimensions.padding.right = style.padding.right;
 
-  dimensions.border.left = to_px(border_left);
-  dimensions.border.right = to_px(border_right);
+  dimensions.border.left = style.border.left;
+  dimensions.border.right = style.border.right;
 
-  dimensions.margin.left = to_px(margin_left);
-  dimensions.margin.right = to_px(margin_right);
+  dimensions.margin.left = margin_left;
+  dimensions.margin.right = margin_right;
 }
 
-void LayoutBox::calculate_block_position()
+void LayoutTree::calculate_block_position(LayoutGeometry& viewport,
+                                          BoxId id) const
 {
-  const CSSBaseValue zero_length = LengthValue(0, yacss::UNIT_PX);
+  _calculate_block_edges(viewport, id);
+  _calculate_block_y(viewport, id,
+                     viewport.containing(boxes[id]).content.height);
+}
 
-  dimensions.margin.top =
-      to_px(styled_node->decl_lookup({ "margin-top", "margin" }, zero_length));
+void LayoutTree::_calculate_block_edges(LayoutGeometry& viewport,
+                                        BoxId id) const
+{
+  const ComputedStyle& style = style_of(boxes[id]);
+  const Dimensions& parent = viewport.containing(boxes[id]);
+  Dimensions& dimensions = viewport.dimensions[id];
 
-  dimensions.margin.bottom = to_px(
-      styled_node->decl_lookup({ "margin-bottom", "margin" }, zero_length));
+  dimensions.margin.top = style.margin.top.px;
+  dimensions.margin.bottom = style.margin.bottom.px;
 
-  dimensions.border.top = to_px(styled_node->decl_lookup(
-      { "border-top-width", "border-width" }, zero_length));
-  dimensions.border.top = to_px(styled_node->decl_lookup(
-      { "border-bottom-width", "border-width" }, zero_length));
+  dimensions.border.top = style.border.top;
+  dimensions.border.bottom = style.border.bottom;
 
-  dimensions.border.top = to_px(
-      styled_node->decl_lookup({ "padding-top", "padding" }, zero_length));
-  dimensions.border.top = to_px(
-      styled_node->decl_lookup({ "padding-bottom", "padding" }, zero_length));
+  dimensions.padding.top = style.padding.top;
+  dimensions.padding.bottom = style.padding.bottom;
 
-  dimensions.content.x = parent->dimensions.content.x + dimensions.margin.left +
+  dimensions.content.x = parent.content.x + dimensions.margin.left +
                          dimensions.border.left + dimensions.padding.left;
+}
+
+void LayoutTree::_calculate_block_y(LayoutGeometry& viewport, BoxId id,
+                                    float preceding_height) const
+{
+  const Dimensions& parent = viewport.containing(boxes[id]);
+  Dimensions& dimensions = viewport.dimensions[id];
 
   // Position the box below all the previous boxes in the container.
-  dimensions.content.y = parent->dimensions.content.height +
-                         parent->dimensions.content.y + dimensions.margin.top +
-                         dimensions.border.top + dimensions.padding.top;
+  dimensions.content.y = preceding_height + parent.content.y +
+                         dimensions.margin.top + dimensions.border.top +
+                         dimensions.padding.top;
 }
 
-void LayoutBox::calculate_block_height()
+void LayoutTree::calculate_block_height(LayoutGeometry& viewport,
+                                        BoxId id) const
 {
-  const LengthValue* height = this->styled_node->get_value<LengthValue>("height");
+  const ComputedLength& height = style_of(boxes[id]).height;
 
-  if (height) {
-    this->dimensions.content.height = height->val;
+  if (!height.is_auto) {
+    viewport.dimensions[id].content.height = height.px;
   }
 }
 
@@ -0,0 +1,146 @@
+#include "yabrowser/Layout.hh"
+
+namespace yabrowser
+{
+namespace layout
+{
+
+using namespace style;
+
+static void write_string(std::ostream& out, const std::string& str)
+{
+  static const char HEX[] = "0123456789abcdef";
+
+  out << '"';
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (c == '\n')
+      out << "\\n";
+    else if (c < 0x20)
+      out << "\\u00" << HEX[c >> 4] << HEX[c & 0xf];
+    else
+      out << c;
+  }
+  out << '"';
+}
+
+static void write_rect(std::ostream& out, const Rect& rect)
+{
+  out << "{\"x\":" << rect.x << ",\"y\":" << rect.y
+      << ",\"width\":" << rect.width << ",\"height\":" << rect.height << '}';
+}
+
+static void write_edges(std::ostream& out, const EdgeSizes& edges)
+{
+  out << '[' << edges.top << ',' << edges.right << ',' << edges.bottom << ','
+      << edges.left << ']';
+}
+
+static const char* type_name(BoxType type)
+{
+  switch (type) {
+    case BoxType::BlockNode:
+      return "block";
+    case BoxType::InlineNode:
+      return "inline";
+    case BoxType::AnonymousBlock:
+      return "anonymous";
+  }
+
+  return "";
+}
+
+static const yahtml::Text* text_of(const LayoutBox& box)
+{
+  if (!box.styled_node || box.styled_node->node->type != yahtml::NodeType::Text)
+    return nullptr;
+
+  return static_cast<const yahtml::Text*>(box.styled_node->node.get());
+}
+
+static void write_lines(std::ostream& out, const LayoutTree& tree,
+                        const InlineLayout& layout, const Rect& content)
+{
+  out << ",\"lines\":[";
+
+  for (size_t i = 0; i < layout.lines.size(); i++) {
+    const LineBox& line = layout.lines[i];
+
+    out << (i ? "," : "") << "{\"rect\":";
+    write_rect(out, Rect(line.rect.x + content.x, line.rect.y + content.y,
+                         line.rect.width, line.rect.height));
+    out << ",\"fragments\":[";
+
+    for (unsigned j = 0; j < line.fragment_count; j++) {
+      const InlineFragment& fragment =
+          layout.fragments[line.first_fragment + j];
+      const yahtml::Text* text = text_of(tree.boxes[fragment.box]);
+
+      out << (j ? "," : "") << "{\"box\":" << fragment.box << ",\"rect\":";
+      write_rect(out,
+                 Rect(fragment.rect.x + content.x, fragment.rect.y + content.y,
+                      fragment.rect.width, fragment.rect.height));
+      if (text) {
+        out << ",\"text\":";
+        write_string(out, text->text.substr(fragment.begin,
+                                            fragment.end - fragment.begin));
+      }
+      out << '}';
+    }
+
+    out << "]}";
+  }
+
+  out << ']';
+}
+
+static void write_box(std::ostream& out, const LayoutTree& tree,
+                      const LayoutGeometry& geometry, const LayoutBox& box)
+{
+  const Dimensions& dim = geometry.dimensions[box.id];
+
+  out << "{\"id\":" << box.id << ",\"type\":\"" << type_name(box.type)
+      << "\",\"node\":";
+
+  if (!box.styled_node)
+    out << "null";
+  else if (text_of(box))
+    out << "\"#text\"";
+  else
+    write_string(out, static_cast<const yahtml::Element*>(
+                          box.styled_node->node.get())->tag_name);
+
+  // inline boxes only have geometry through the fragments of their text
+  if (box.type != BoxType::InlineNode) {
+    out << ",\"content\":";
+    write_rect(out, dim.content);
+    out << ",\"padding\":";
+    write_edges(out, dim.padding);
+    out << ",\"border\":";
+    write_edges(out, dim.border);
+    out << ",\"margin\":";
+    write_edges(out, dim.margin);
+  }
+
+  if (const InlineLayout* layout = geometry.inline_layout(box))
+    write_lines(out, tree, *layout, dim.content);
+
+  out << ",\"children\":[";
+  const BoxRange children = tree.children(box);
+  for (size_t i = 0; i < children.size(); i++) {
+    if (i)
+      out << ',';
+    write_box(out, tree, geometry, children[i]);
+  }
+  out << "]}";
+}
+
+void write_json(std::ostream& out, const LayoutTree& tree,
+                const LayoutGeometry& geometry)
+{
+  write_box(out, tree, geometry, tree.root());
+  out << '\n';
+}
+}  // ! ns layout
+}; // ! ns yabrowser
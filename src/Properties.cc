@@ -0,0 +1,195 @@
+#include "yabrowser/Properties.hh"
+
+#include <stdexcept>
+#include <unordered_map>
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+
+static const char* const PROPERTY_NAMES[] = {
+#define YABROWSER_PROPERTY_NAME(id, name) name,
+  YABROWSER_PROPERTIES(YABROWSER_PROPERTY_NAME)
+#undef YABROWSER_PROPERTY_NAME
+  "unknown"
+};
+
+PropertyId property_id (const std::string& name)
+{
+  static const std::unordered_map<std::string, PropertyId> ids = []() {
+    std::unordered_map<std::string, PropertyId> table;
+
+    for (unsigned i = 0; i < PROPERTY_COUNT; i++)
+      table.emplace(PROPERTY_NAMES[i], static_cast<PropertyId>(i));
+
+    return table;
+  }();
+
+  const auto it = ids.find(name);
+  if (it == ids.end())
+    return PROPERTY_UNKNOWN;
+
+  return it->second;
+}
+
+const char* property_name (PropertyId id)
+{
+  return PROPERTY_NAMES[id];
+}
+
+const PropertyId* property_fallbacks (PropertyId id)
+{
+  static const PropertyId none[] = { PROPERTY_UNKNOWN };
+  static const PropertyId margin[] = { PROPERTY_MARGIN, PROPERTY_UNKNOWN };
+  static const PropertyId padding[] = { PROPERTY_PADDING, PROPERTY_UNKNOWN };
+  static const PropertyId border[] = { PROPERTY_BORDER, PROPERTY_UNKNOWN };
+  static const PropertyId border_side[] = {
+    PROPERTY_BORDER_WIDTH, PROPERTY_BORDER, PROPERTY_UNKNOWN
+  };
+  static const PropertyId background[] = {
+    PROPERTY_BACKGROUND, PROPERTY_UNKNOWN
+  };
+  static const PropertyId border_top_width[] = {
+    PROPERTY_BORDER_TOP, PROPERTY_BORDER_WIDTH, PROPERTY_BORDER,
+    PROPERTY_UNKNOWN
+  };
+  static const PropertyId border_right_width[] = {
+    PROPERTY_BORDER_RIGHT, PROPERTY_BORDER_WIDTH, PROPERTY_BORDER,
+    PROPERTY_UNKNOWN
+  };
+  static const PropertyId border_bottom_width[] = {
+    PROPERTY_BORDER_BOTTOM, PROPERTY_BORDER_WIDTH, PROPERTY_BORDER,
+    PROPERTY_UNKNOWN
+  };
+  static const PropertyId border_left_width[] = {
+    PROPERTY_BORDER_LEFT, PROPERTY_BORDER_WIDTH, PROPERTY_BORDER,
+    PROPERTY_UNKNOWN
+  };
+
+  switch (id) {
+    case PROPERTY_MARGIN_TOP: case PROPERTY_MARGIN_RIGHT:
+    case PROPERTY_MARGIN_BOTTOM: case PROPERTY_MARGIN_LEFT:
+      return margin;
+    case PROPERTY_PADDING_TOP: case PROPERTY_PADDING_RIGHT:
+    case PROPERTY_PADDING_BOTTOM: case PROPERTY_PADDING_LEFT:
+      return padding;
+    case PROPERTY_BORDER_TOP_WIDTH:
+      return border_top_width;
+    case PROPERTY_BORDER_RIGHT_WIDTH:
+      return border_right_width;
+    case PROPERTY_BORDER_BOTTOM_WIDTH:
+      return border_bottom_width;
+    case PROPERTY_BORDER_LEFT_WIDTH:
+      return border_left_width;
+    case PROPERTY_BORDER_TOP: case PROPERTY_BORDER_RIGHT:
+    case PROPERTY_BORDER_BOTTOM: case PROPERTY_BORDER_LEFT:
+      return border_side;
+    case PROPERTY_BORDER_WIDTH:
+      return border;
+    case PROPERTY_BACKGROUND_COLOR:
+      return background;
+    default:
+      return none;
+  }
+}
+
+PropertyTable::PropertyTable ()
+{ }
+
+PropertyTable::PropertyTable (const DeclarationContainer& decls)
+{
+  for (const auto& decl : decls)
+    set(decl.first, decl.second);
+}
+
+PropertyTable::~PropertyTable ()
+{ }
+
+void PropertyTable::set (const std::string& name, const Value& value)
+{
+  PropertyId id = property_id(name);
+
+  if (id == PROPERTY_UNKNOWN) {
+    unknown[name] = value;
+    return;
+  }
+
+  set(id, value);
+}
+
+void PropertyTable::set (PropertyId id, const Value& value)
+{
+  values[id] = value;
+  present.set(id);
+}
+
+bool PropertyTable::insert (const std::string& name, const Value& value)
+{
+  PropertyId id = property_id(name);
+
+  if (id == PROPERTY_UNKNOWN)
+    return unknown.emplace(name, value).second;
+
+  return insert(id, value);
+}
+
+bool PropertyTable::insert (PropertyId id, const Value& value)
+{
+  if (present[id])
+    return false;
+
+  set(id, value);
+  return true;
+}
+
+void PropertyTable::insert (const PropertyTable& table)
+{
+  const std::bitset<PROPERTY_COUNT> added = table.present & ~present;
+
+  if (added.any())
+    for (unsigned i = 0; i < PROPERTY_COUNT; i++)
+      if (added[i])
+        values[i] = table.values[i];
+  present |= added;
+
+  for (const auto& property : table.unknown)
+    unknown.insert(property);
+}
+
+const Value* PropertyTable::find (const std::string& name) const
+{
+  PropertyId id = property_id(name);
+
+  if (id != PROPERTY_UNKNOWN)
+    return find(id);
+
+  UnknownProperties::const_iterator it = unknown.find(name);
+  if (it == unknown.end())
+    return nullptr;
+
+  return &it->second;
+}
+
+const Value& PropertyTable::at (const std::string& name) const
+{
+  const Value* value = find(name);
+
+  if (!value)
+    throw std::out_of_range("PropertyTable::at - " + name);
+
+  return *value;
+}
+
+bool PropertyTable::operator== (const PropertyTable& rhs) const
+{
+  if (present != rhs.present || unknown != rhs.unknown)
+    return false;
+
+  for (unsigned i = 0; i < PROPERTY_COUNT; i++)
+    if (present[i] && values[i] != rhs.values[i])
+      return false;
+
+  return true;
+}
+
+}}; // ! ns yabrowser style
@@ -0,0 +1,283 @@
+#include "yabrowser/Raster.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YABROWSER_RASTER_X86
+#include <immintrin.h>
+#endif
+
+namespace yabrowser
+{
+namespace paint
+{
+
+using namespace layout;
+
+/**
+ * Blending works on 16 bit channels. With `a` the source alpha, every
+ * channel is
+ *
+ *   t = source * a + 128 + pixel * (255 - a)     (at most 65153)
+ *   (t + (t >> 8)) >> 8
+ *
+ * which is the rounded division by 255, exactly, for every t in range.
+ * `source * a + 128` only depends on the color, so it is computed once
+ * per span.
+ */
+struct BlendTerms {
+  uint16_t source[4];
+  uint16_t inverse;
+
+  BlendTerms(const Color& color)
+  {
+    const uint8_t channels[4] = { color.r, color.g, color.b, 255 };
+
+    for (unsigned i = 0; i < 4; i++)
+      source[i] = channels[i] * color.a + 128;
+    inverse = 255 - color.a;
+  }
+};
+
+static void fill_span_scalar(uint32_t* pixels, size_t count, uint32_t pixel)
+{
+  std::fill(pixels, pixels + count, pixel);
+}
+
+static void blend_span_scalar(uint32_t* pixels, size_t count,
+                              const BlendTerms& terms)
+{
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(pixels);
+
+  for (size_t i = 0; i < count * 4; i++) {
+    const unsigned t = terms.source[i % 4] + bytes[i] * terms.inverse;
+    bytes[i] = (t + (t >> 8)) >> 8;
+  }
+}
+
+#ifdef YABROWSER_RASTER_X86
+
+__attribute__((target("sse2"))) static inline __m128i
+blend_sse2(__m128i pixels, __m128i source, __m128i inverse)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+  __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+
+  lo = _mm_add_epi16(_mm_mullo_epi16(lo, inverse), source);
+  hi = _mm_add_epi16(_mm_mullo_epi16(hi, inverse), source);
+  lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+  hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+  return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("sse2"))) static void
+fill_span_sse2(uint32_t* pixels, size_t count, uint32_t pixel)
+{
+  const __m128i value = _mm_set1_epi32(pixel);
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), value);
+
+  fill_span_scalar(pixels + i, count - i, pixel);
+}
+
+__attribute__((target("sse2"))) static void
+blend_span_sse2(uint32_t* pixels, size_t count, const BlendTerms& terms)
+{
+  // two pixels per register once widened to 16 bits
+  const __m128i source = _mm_set_epi16(
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0],
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0]);
+  const __m128i inverse = _mm_set1_epi16(terms.inverse);
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m128i* at = reinterpret_cast<__m128i*>(pixels + i);
+    _mm_storeu_si128(at, blend_sse2(_mm_loadu_si128(at), source, inverse));
+  }
+
+  blend_span_scalar(pixels + i, count - i, terms);
+}
+
+__attribute__((target("avx2"))) static void
+fill_span_avx2(uint32_t* pixels, size_t count, uint32_t pixel)
+{
+  const __m256i value = _mm256_set1_epi32(pixel);
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8)
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), value);
+
+  fill_span_scalar(pixels + i, count - i, pixel);
+}
+
+__attribute__((target("avx2"))) static void
+blend_span_avx2(uint32_t* pixels, size_t count, const BlendTerms& terms)
+{
+  // unpacking and packing stay within 128 bit lanes, so pixels keep their
+  // order
+  const __m256i source = _mm256_set_epi16(
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0],
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0],
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0],
+      terms.source[3], terms.source[2], terms.source[1], terms.source[0]);
+  const __m256i inverse = _mm256_set1_epi16(terms.inverse);
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i* at = reinterpret_cast<__m256i*>(pixels + i);
+    const __m256i value = _mm256_loadu_si256(at);
+    __m256i lo = _mm256_unpacklo_epi8(value, zero);
+    __m256i hi = _mm256_unpackhi_epi8(value, zero);
+
+    lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, inverse), source);
+    hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, inverse), source);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+    _mm256_storeu_si256(at, _mm256_packus_epi16(lo, hi));
+  }
+
+  blend_span_sse2(pixels + i, count - i, terms);
+}
+
+#endif
+
+bool raster_kernels_supported(RasterKernels kernels)
+{
+  switch (kernels) {
+    case RASTER_KERNELS_SCALAR:
+      return true;
+#ifdef YABROWSER_RASTER_X86
+    case RASTER_KERNELS_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case RASTER_KERNELS_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+RasterKernels best_raster_kernels()
+{
+  static const RasterKernels best =
+      raster_kernels_supported(RASTER_KERNELS_AVX2)
+          ? RASTER_KERNELS_AVX2
+          : raster_kernels_supported(RASTER_KERNELS_SSE2)
+                ? RASTER_KERNELS_SSE2
+                : RASTER_KERNELS_SCALAR;
+
+  return best;
+}
+
+void fill_span(RasterKernels kernels, uint32_t* pixels, size_t count,
+               uint32_t pixel)
+{
+  switch (kernels) {
+#ifdef YABROWSER_RASTER_X86
+    case RASTER_KERNELS_AVX2:
+      fill_span_avx2(pixels, count, pixel);
+      return;
+    case RASTER_KERNELS_SSE2:
+      fill_span_sse2(pixels, count, pixel);
+      return;
+#endif
+    default:
+      fill_span_scalar(pixels, count, pixel);
+  }
+}
+
+void blend_span(RasterKernels kernels, uint32_t* pixels, size_t count,
+                const Color& color)
+{
+  const BlendTerms terms(color);
+
+  switch (kernels) {
+#ifdef YABROWSER_RASTER_X86
+    case RASTER_KERNELS_AVX2:
+      blend_span_avx2(pixels, count, terms);
+      return;
+    case RASTER_KERNELS_SSE2:
+      blend_span_sse2(pixels, count, terms);
+      return;
+#endif
+    default:
+      blend_span_scalar(pixels, count, terms);
+  }
+}
+
+Canvas::Canvas(unsigned w, unsigned h, const Color& background,
+               RasterKernels k)
+    : width(w), height(h), pixels(static_cast<size_t>(w) * h), kernels(k)
+{
+  clear(background);
+}
+
+void Canvas::clear(const Color& color)
+{
+  fill_span(kernels, pixels.data(), pixels.size(), pack_pixel(color));
+}
+
+void Canvas::fill_rect(const Rect& rect, const Color& color)
+{
+  fill_rect(rect, color, Rect(0.0, 0.0, width, height));
+}
+
+void Canvas::fill_rect(const Rect& rect, const Color& color, const Rect& clip)
+{
+  const unsigned x0 =
+      std::max(snap_to_pixel(rect.x, width), snap_to_pixel(clip.x, width));
+  const unsigned x1 = std::min(snap_to_pixel(rect.x + rect.width, width),
+                               snap_to_pixel(clip.x + clip.width, width));
+  const unsigned y0 =
+      std::max(snap_to_pixel(rect.y, height), snap_to_pixel(clip.y, height));
+  const unsigned y1 = std::min(snap_to_pixel(rect.y + rect.height, height),
+                               snap_to_pixel(clip.y + clip.height, height));
+
+  if (color.a == 0 || x0 >= x1 || y0 >= y1)
+    return;
+
+  const uint32_t pixel = pack_pixel(color);
+
+  for (unsigned y = y0; y < y1; y++) {
+    uint32_t* row = pixels.data() + static_cast<size_t>(y) * width + x0;
+
+    if (color.a == 255)
+      fill_span(kernels, row, x1 - x0, pixel);
+    else
+      blend_span(kernels, row, x1 - x0, color);
+  }
+}
+
+void Canvas::paint(const DisplayList& list)
+{
+  for (const auto& item : list.items)
+    fill_rect(item.rect, item.color);
+}
+
+void write_ppm(std::ostream& out, const Canvas& canvas)
+{
+  std::vector<char> row(canvas.width * 3);
+
+  out << "P6\n" << canvas.width << " " << canvas.height << "\n255\n";
+
+  for (unsigned y = 0; y < canvas.height; y++) {
+    for (unsigned x = 0; x < canvas.width; x++) {
+      const Color color = canvas.pixel(x, y);
+
+      row[x * 3] = color.r;
+      row[x * 3 + 1] = color.g;
+      row[x * 3 + 2] = color.b;
+    }
+
+    out.write(row.data(), row.size());
+  }
+}
+}  // ! ns paint
+}; // ! ns yabrowser
@@ -0,0 +1,571 @@
+#include "yabrowser/RenderServer.hh"
+#include "yabrowser/BinaryStylesheet.hh"
+#include "yabrowser/DisplayList.hh"
+#include "yabrowser/Layout.hh"
+#include "yabrowser/Raster.hh"
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Trace.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace yabrowser
+{
+namespace server
+{
+
+using namespace layout;
+using namespace paint;
+using namespace style;
+
+// STYLESHEETS
+StylesheetCache::StylesheetCache(size_t capacity)
+    : m_capacity(std::max<size_t>(capacity, 1)), m_hits(0), m_misses(0)
+{
+}
+
+CompiledStylesheetPtr StylesheetCache::get(const std::string& source)
+{
+  const uint64_t hash = stylesheet_hash(source);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_by_hash.find(hash);
+
+    // a colliding source is compiled again, and takes the slot over
+    if (it != m_by_hash.end() && it->second->stylesheet->source == source) {
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      m_hits++;
+      return m_entries.front().stylesheet;
+    }
+  }
+
+  TRACE_SPAN("server", "compile stylesheet");
+  std::shared_ptr<CompiledStylesheet> compiled =
+      std::make_shared<CompiledStylesheet>();
+
+  m_misses++;
+  compiled->source = source;
+  if (compiled->stylesheet.parse_source(source))
+    return nullptr;
+  compiled->index.reset(new RuleIndex(compiled->stylesheet));
+  compiled->index->user_agent_styles = true;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_by_hash.find(hash);
+
+  if (it != m_by_hash.end())
+    m_entries.erase(it->second);
+
+  m_entries.push_front(Entry{ hash, compiled });
+  m_by_hash[hash] = m_entries.begin();
+
+  if (m_entries.size() > m_capacity) {
+    m_by_hash.erase(m_entries.back().hash);
+    m_entries.pop_back();
+  }
+
+  return compiled;
+}
+
+size_t StylesheetCache::size() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  return m_entries.size();
+}
+
+// RENDERING
+Renderer::Renderer(ThreadPool& thread_pool, size_t stylesheet_capacity)
+    : pool(thread_pool), stylesheets(stylesheet_capacity)
+{
+}
+
+static void render_document(const CompiledStylesheet& css,
+                            const RenderRequest& request,
+                            const std::string& html, RenderResult& result)
+{
+  TRACE_SPAN("server", "render_document");
+  const auto start = std::chrono::steady_clock::now();
+  yahtml::HTMLDriver driver;
+
+  if (driver.parse_source(html)) {
+    result.status = RENDER_PARSE_ERROR;
+  } else {
+    // a document that can't be rendered (an unsupported `display`) only
+    // fails itself, not its batch nor the server
+    try {
+      // the cache is only valid for one traversal, see StyleSharingCache
+      StyleSharingCache cache(*css.index);
+      LayoutTree tree(
+          std::make_shared<StyledNode>(driver.dom, cache),
+          Dimensions(Rect(0.0, 0.0, request.width, request.height)));
+      std::ostringstream out;
+
+      tree.calculate();
+
+      if (request.format == FORMAT_JSON) {
+        write_json(out, tree);
+      } else if (request.format == FORMAT_PPM) {
+        Canvas canvas(request.width, request.height);
+        canvas.paint(build_display_list(tree));
+        write_ppm(out, canvas);
+      }
+
+      result.status = RENDER_OK;
+      result.output = out.str();
+    } catch (const std::exception& e) {
+      result.status = RENDER_ERROR;
+      result.output = e.what();
+    }
+  }
+
+  result.micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+}
+
+// the encoded response can't be any smaller: images all have the size of
+// the viewport, while layout JSON is only known once rendered
+static uint64_t min_response_size(const RenderRequest& request)
+{
+  const uint64_t image =
+      request.format == FORMAT_PPM
+          ? static_cast<uint64_t>(request.width) * request.height * 3
+          : 0;
+
+  return 4 + request.documents.size() * (16 + image);
+}
+
+RenderResponse Renderer::render(const RenderRequest& request)
+{
+  TRACE_SPAN("server", "render");
+  RenderResponse response;
+
+  response.results.resize(request.documents.size());
+
+  const bool valid = request.width && request.height &&
+                     request.width <= MAX_VIEWPORT_SIZE &&
+                     request.height <= MAX_VIEWPORT_SIZE &&
+                     request.format <= FORMAT_PPM &&
+                     min_response_size(request) <= MAX_MESSAGE_SIZE;
+  const CompiledStylesheetPtr css =
+      valid ? stylesheets.get(request.css) : nullptr;
+
+  if (!css) {
+    for (auto& result : response.results)
+      result.status = valid ? RENDER_PARSE_ERROR : RENDER_BAD_REQUEST;
+    return response;
+  }
+
+  TaskGroup group(pool);
+
+  for (size_t i = 0; i < request.documents.size(); i++) {
+    RenderResult* result = &response.results[i];
+    const std::string* html = &request.documents[i];
+
+    group.run([&css, &request, html, result]() {
+      render_document(*css, request, *html, *result);
+    });
+  }
+
+  group.wait();
+  return response;
+}
+
+// PROTOCOL
+static void put_u32(std::string& out, uint32_t value)
+{
+  const char bytes[4] = { static_cast<char>(value),
+                          static_cast<char>(value >> 8),
+                          static_cast<char>(value >> 16),
+                          static_cast<char>(value >> 24) };
+
+  out.append(bytes, 4);
+}
+
+static void put_u64(std::string& out, uint64_t value)
+{
+  put_u32(out, static_cast<uint32_t>(value));
+  put_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static void put_string(std::string& out, const std::string& str)
+{
+  put_u32(out, str.size());
+  out += str;
+}
+
+// reads what put_*() wrote, and remembers whether it ran past the end
+struct Reader {
+  const std::string& in;
+  size_t offset;
+  bool ok;
+
+  inline explicit Reader(const std::string& input)
+      : in(input), offset(0), ok(true)
+  {
+  }
+
+  uint32_t u32()
+  {
+    if (in.size() - offset < 4) {
+      ok = false;
+      return 0;
+    }
+
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(in.data() + offset);
+    offset += 4;
+
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+           static_cast<uint32_t>(bytes[3]) << 24;
+  }
+
+  uint64_t u64()
+  {
+    const uint64_t low = u32();
+    return low | static_cast<uint64_t>(u32()) << 32;
+  }
+
+  void string(std::string& str)
+  {
+    const uint32_t size = u32();
+
+    if (in.size() - offset < size) {
+      ok = false;
+      return;
+    }
+
+    str.assign(in, offset, size);
+    offset += size;
+  }
+
+  // a list can't have more items than there are bytes left to hold them
+  uint32_t count(size_t item_size)
+  {
+    const uint32_t n = u32();
+
+    if (n > (in.size() - offset) / item_size)
+      ok = false;
+    return ok ? n : 0;
+  }
+
+  inline bool done() const { return ok && offset == in.size(); }
+};
+
+void encode(const RenderRequest& request, std::string& out)
+{
+  out.clear();
+  put_u32(out, request.format);
+  put_u32(out, request.width);
+  put_u32(out, request.height);
+  put_string(out, request.css);
+  put_u32(out, request.documents.size());
+  for (const auto& document : request.documents)
+    put_string(out, document);
+}
+
+void encode(const RenderResponse& response, std::string& out)
+{
+  out.clear();
+  put_u32(out, response.results.size());
+  for (const auto& result : response.results) {
+    put_u32(out, result.status);
+    put_u64(out, result.micros);
+    put_string(out, result.output);
+  }
+}
+
+bool decode(const std::string& in, RenderRequest& request)
+{
+  Reader reader(in);
+
+  request.format = static_cast<RenderFormat>(reader.u32());
+  request.width = reader.u32();
+  request.height = reader.u32();
+  reader.string(request.css);
+  request.documents.resize(reader.count(4));
+  for (auto& document : request.documents)
+    reader.string(document);
+
+  return reader.done();
+}
+
+bool decode(const std::string& in, RenderResponse& response)
+{
+  Reader reader(in);
+
+  response.results.resize(reader.count(16));
+  for (auto& result : response.results) {
+    result.status = static_cast<RenderStatus>(reader.u32());
+    result.micros = reader.u64();
+    reader.string(result.output);
+  }
+
+  return reader.done();
+}
+
+static bool write_all(int fd, const char* data, size_t size)
+{
+  while (size) {
+    // a client going away must not take the server with it on SIGPIPE
+    const ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+
+    data += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+static bool read_all(int fd, char* data, size_t size)
+{
+  while (size) {
+    const ssize_t got = ::read(fd, data, size);
+
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+
+    data += got;
+    size -= got;
+  }
+
+  return true;
+}
+
+bool write_message(int fd, const std::string& message)
+{
+  std::string header;
+
+  // which read_message() would take for garbage, if its size fit at all
+  if (message.size() > MAX_MESSAGE_SIZE)
+    return false;
+
+  put_u32(header, message.size());
+  return write_all(fd, header.data(), header.size()) &&
+         write_all(fd, message.data(), message.size());
+}
+
+bool read_message(int fd, std::string& message)
+{
+  std::string header(4, '\0');
+
+  if (!read_all(fd, &header[0], header.size()))
+    return false;
+
+  Reader reader(header);
+  const uint32_t size = reader.u32();
+  if (size > MAX_MESSAGE_SIZE)
+    return false;
+
+  message.resize(size);
+  return read_all(fd, &message[0], size);
+}
+
+// SOCKETS
+static sockaddr_un socket_address(const std::string& path)
+{
+  sockaddr_un address;
+
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::system_error(ENAMETOOLONG, std::generic_category(), path);
+
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+RenderServer::RenderServer(Renderer& renderer, const std::string& path)
+    : m_renderer(renderer),
+      m_path(path),
+      m_listener(-1),
+      m_stopping(false),
+      m_requests(0),
+      m_failures(0)
+{
+  const sockaddr_un address = socket_address(path);
+
+  m_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listener < 0)
+    throw std::system_error(errno, std::generic_category(), "socket");
+
+  // left behind by a server that did not shut down cleanly
+  ::unlink(path.c_str());
+
+  if (::bind(m_listener, reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) < 0 ||
+      ::listen(m_listener, SOMAXCONN) < 0) {
+    const int error = errno;
+    ::close(m_listener);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+}
+
+RenderServer::~RenderServer()
+{
+  stop();
+  ::close(m_listener);
+  ::unlink(m_path.c_str());
+}
+
+void RenderServer::serve()
+{
+  while (!m_stopping) {
+    const int fd = ::accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      // the listener was shut down by stop(), or is unusable
+      break;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping) {
+      ::close(fd);
+      break;
+    }
+
+    m_connections.push_back(fd);
+    std::thread(&RenderServer::_serve_connection, this, fd).detach();
+  }
+}
+
+void RenderServer::stop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  m_stopping = true;
+  // wakes accept() and the reads of every connection up
+  ::shutdown(m_listener, SHUT_RDWR);
+  for (int fd : m_connections)
+    ::shutdown(fd, SHUT_RDWR);
+
+  m_closed.wait(lock, [this]() { return m_connections.empty(); });
+}
+
+// a response in which every document failed for the same reason
+static RenderResponse failed(size_t documents, RenderStatus status,
+                             const std::string& why)
+{
+  RenderResponse response;
+
+  response.results.resize(documents);
+  for (auto& result : response.results) {
+    result.status = status;
+    result.output = why;
+  }
+
+  return response;
+}
+
+void RenderServer::_fail(int fd, const std::string& why)
+{
+  m_failures++;
+  std::cerr << "yabrowser: dropped connection " << fd << ": " << why << "\n";
+}
+
+void RenderServer::_serve_connection(int fd)
+{
+  std::string message;
+  RenderRequest request;
+
+  // one request at a time: the documents of a request are what runs in
+  // parallel, and responses come back in order. Whatever goes wrong with
+  // a request only ends its own connection, after telling the client why
+  // when the stream is still in step.
+  try {
+    while (!m_stopping && read_message(fd, message)) {
+      if (!decode(message, request)) {
+        _fail(fd, "malformed request");
+        encode(failed(1, RENDER_BAD_REQUEST, "malformed request"), message);
+        write_message(fd, message);
+        break;
+      }
+
+      m_requests++;
+      try {
+        encode(m_renderer.render(request), message);
+      } catch (const std::exception& e) {
+        // out of memory, most likely: documents fail on their own
+        _fail(fd, e.what());
+        encode(failed(request.documents.size(), RENDER_ERROR, e.what()),
+               message);
+        write_message(fd, message);
+        break;
+      }
+
+      // too much layout JSON
+      if (message.size() > MAX_MESSAGE_SIZE)
+        encode(failed(request.documents.size(), RENDER_ERROR,
+                      "response over MAX_MESSAGE_SIZE"),
+               message);
+      if (!write_message(fd, message))
+        break;
+    }
+  } catch (const std::exception& e) {
+    _fail(fd, e.what());
+  }
+
+  // closed under the lock, so that stop() never shuts a reused fd down
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_connections.erase(
+      std::find(m_connections.begin(), m_connections.end(), fd));
+  ::close(fd);
+  m_closed.notify_all();
+}
+
+RenderClient::RenderClient(const std::string& path) : m_fd(-1)
+{
+  const sockaddr_un address = socket_address(path);
+
+  m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_fd < 0)
+    throw std::system_error(errno, std::generic_category(), "socket");
+
+  if (::connect(m_fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof(address)) < 0) {
+    const int error = errno;
+    ::close(m_fd);
+    throw std::system_error(error, std::generic_category(), path);
+  }
+}
+
+RenderClient::~RenderClient() { ::close(m_fd); }
+
+RenderResponse RenderClient::render(const RenderRequest& request)
+{
+  RenderResponse response;
+
+  encode(request, m_buffer);
+  if (!write_message(m_fd, m_buffer) || !read_message(m_fd, m_buffer) ||
+      !decode(m_buffer, response))
+    throw std::runtime_error("render server closed the connection");
+
+  return response;
+}
+}  // ! ns server
+}; // ! ns yabrowser
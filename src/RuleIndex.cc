@@ -0,0 +1,248 @@
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Trace.hh"
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+using namespace yahtml;
+
+RuleIndex::RuleIndex (const Stylesheet& ss, MatchEngine engine)
+  : rules(ss.rules), has_combinators(false), engine(engine),
+    user_agent_styles(false)
+{
+  selectors.resize(rules.size());
+
+  for (unsigned i = 0; i < rules.size(); i++)
+    for (const auto& selector : rules[i]->selectors)
+      selectors[i].push_back(ComplexSelector(selector));
+
+  _build();
+}
+
+RuleIndex::RuleIndex (const ComplexStylesheet& ss, MatchEngine engine)
+  : rules(ss.stylesheet.rules), selectors(ss.selectors),
+    has_combinators(false), engine(engine), user_agent_styles(false)
+{
+  for (const auto& rule_selectors : selectors)
+    for (const auto& selector : rule_selectors)
+      has_combinators |= !selector.ancestors.empty();
+
+  _build();
+}
+
+RuleIndex::~RuleIndex ()
+{ }
+
+void RuleIndex::_build ()
+{
+  ranks.resize(selectors.size());
+  compiled.resize(selectors.size());
+  declarations.reserve(rules.size());
+
+  for (unsigned i = 0; i < rules.size(); i++) {
+    declarations.emplace_back(rules[i]->declarations);
+    rule_indices.emplace(rules[i].get(), i);
+  }
+
+  for (unsigned i = 0; i < selectors.size(); i++) {
+    ranks[i].resize(selectors[i].size());
+
+    for (unsigned j = 0; j < selectors[i].size(); j++) {
+      cascade.push_back(CascadeEntry {i, j});
+      compiled[i].push_back(compile_selector(atoms, selectors[i][j].subject));
+    }
+  }
+
+  // `cascade` is in source order already, which settles equal specificities
+  std::stable_sort(cascade.begin(), cascade.end(),
+                   [this](const CascadeEntry& lhs, const CascadeEntry& rhs) {
+                     return selectors[lhs.rule][lhs.selector].specificity <
+                            selectors[rhs.rule][rhs.selector].specificity;
+                   });
+
+  // every atom is known now: size the buckets once
+  id_atom_buckets.resize(atoms.size() + 1);
+  class_atom_buckets.resize(atoms.size() + 1);
+  tag_atom_buckets.resize(atoms.size() + 1);
+
+  // rules are only ever matched by their subject, so that is what they
+  // are bucketed by. Inserting by rank keeps every bucket sorted.
+  for (unsigned rank = 0; rank < cascade.size(); rank++) {
+    const CascadeEntry& entry = cascade[rank];
+
+    ranks[entry.rule][entry.selector] = rank;
+    _insert(selectors[entry.rule][entry.selector].subject, rank);
+    _insert(compiled[entry.rule][entry.selector], rank);
+  }
+}
+
+void RuleIndex::_insert (const Selector& sel, unsigned rank)
+{
+  if (!sel.id.empty())
+    id_buckets[sel.id].push_back(rank);
+  else if (!sel.classes.empty())
+    class_buckets[sel.classes.front()].push_back(rank);
+  else if (!sel.tag.empty() && sel.tag != "*")
+    tag_buckets[sel.tag].push_back(rank);
+  else
+    universal.push_back(rank);
+}
+
+// same bucket choice as for the strings, so that `universal` is shared
+void RuleIndex::_insert (const CompiledSelector& sel, unsigned rank)
+{
+  if (sel.id != NULL_ATOM)
+    id_atom_buckets[sel.id].push_back(rank);
+  else if (!sel.classes.empty())
+    class_atom_buckets[sel.classes.front()].push_back(rank);
+  else if (sel.tag != NULL_ATOM)
+    tag_atom_buckets[sel.tag].push_back(rank);
+}
+
+void RuleIndex::_collect (const BucketMap& buckets, const std::string& key,
+                          BucketRanges& candidates) const
+{
+  BucketMap::const_iterator it = buckets.find(key);
+
+  if (it != buckets.end())
+    candidates.emplace_back(it->second.begin(), it->second.end());
+}
+
+void RuleIndex::_collect (const std::vector<Bucket>& buckets, Atom key,
+                          BucketRanges& candidates) const
+{
+  if (key != NULL_ATOM && !buckets[key].empty())
+    candidates.emplace_back(buckets[key].begin(), buckets[key].end());
+}
+
+RuleIndex::BucketRanges RuleIndex::_candidates (const Element& elem) const
+{
+  BucketRanges candidates;
+
+  if (!universal.empty())
+    candidates.emplace_back(universal.begin(), universal.end());
+
+  AttrMap::const_iterator id_it = elem.attr_map.find("id");
+  if (id_it != elem.attr_map.end())
+    _collect(id_buckets, id_it->second, candidates);
+
+  for (const auto& klass : elem.classes)
+    _collect(class_buckets, klass, candidates);
+
+  _collect(tag_buckets, elem.tag_name, candidates);
+
+  return candidates;
+}
+
+RuleIndex::BucketRanges RuleIndex::_candidates (const ElementSignature& elem)
+    const
+{
+  BucketRanges candidates;
+
+  if (!universal.empty())
+    candidates.emplace_back(universal.begin(), universal.end());
+
+  _collect(id_atom_buckets, elem.id, candidates);
+  for (const auto& klass : elem.classes)
+    _collect(class_atom_buckets, klass, candidates);
+  _collect(tag_atom_buckets, elem.tag, candidates);
+
+  return candidates;
+}
+
+/**
+ * Merges the candidate buckets, which are few, by picking the smallest
+ * head each time, and matches every rank as it comes out. `matches` is
+ * called with a rule and a selector index.
+ */
+template<typename Matches>
+std::vector<MatchedRule> RuleIndex::_match (BucketRanges& candidates,
+                                            const Matches& matches) const
+{
+  std::vector<MatchedRule> rules_matched;
+  // an element listing a class twice probes its bucket twice
+  unsigned previous = cascade.size();
+
+  while (!candidates.empty()) {
+    size_t min = 0;
+
+    for (size_t i = 1; i < candidates.size(); i++)
+      if (*candidates[i].first < *candidates[min].first)
+        min = i;
+
+    const unsigned rank = *candidates[min].first++;
+    if (candidates[min].first == candidates[min].second) {
+      candidates[min] = candidates.back();
+      candidates.pop_back();
+    }
+
+    if (rank == previous)
+      continue;
+    previous = rank;
+
+    const CascadeEntry& entry = cascade[rank];
+    if (!matches(entry.rule, entry.selector))
+      continue;
+
+    // a rule counts once, at its highest matching rank. Any selector that
+    // matches is in some probed bucket, so a later one will come out too.
+    bool later = false;
+    for (unsigned i = 0; !later && i < ranks[entry.rule].size(); i++)
+      later = ranks[entry.rule][i] > rank && matches(entry.rule, i);
+
+    if (!later)
+      rules_matched.push_back(MatchedRule {
+          rules[entry.rule], selectors[entry.rule][entry.selector].specificity
+      });
+  }
+
+  return rules_matched;
+}
+
+std::vector<MatchedRule> RuleIndex::matching_rules (const Element& elem) const
+{
+  return matching_rules(elem, nullptr, nullptr);
+}
+
+std::vector<MatchedRule> RuleIndex::matching_rules (
+    const Element& elem, const StyledNode* parent,
+    const AncestorFilter* filter) const
+{
+  TRACE_SPAN("style", "matching_rules");
+
+  if (engine == MATCH_ENGINE_ATOMS) {
+    const ElementSignature signature = element_signature(atoms, elem);
+    BucketRanges candidates = _candidates(signature);
+
+    return _match(candidates, [&](unsigned rule_idx, unsigned sel_idx) {
+      return compiled_selector_matches(compiled[rule_idx][sel_idx],
+                                       signature) &&
+             complex_ancestors_match(selectors[rule_idx][sel_idx], parent,
+                                     filter);
+    });
+  }
+
+  BucketRanges candidates = _candidates(elem);
+
+  return _match(candidates, [&](unsigned rule_idx, unsigned sel_idx) {
+    return complex_selector_matches(selectors[rule_idx][sel_idx], elem,
+                                    parent, filter);
+  });
+}
+
+DeclarationContainer compute_specified_values (const RuleIndex& index,
+                                               const Element& elem)
+{
+  TRACE_SPAN("style", "compute_specified_values");
+  const std::vector<MatchedRule> matched = index.matching_rules(elem);
+  DeclarationContainer spec_values;
+
+  // highest precedence first: the first value seen for a property wins
+  for (auto it = matched.rbegin(); it != matched.rend(); ++it)
+    for (const auto& decl : it->first->declarations)
+      spec_values.insert(decl);
+
+  return spec_values;
+}
+
+}}; // ! ns yabrowser style
@@ -0,0 +1,533 @@
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleTree.hh"
+#include "yacss/parser/driver.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+using namespace yahtml;
+
+// FNV-1a, salted with the kind of value so that `.a` and `#a` differ
+static unsigned salted_hash (char kind, const std::string& value)
+{
+  unsigned hash = 2166136261u;
+
+  hash = (hash ^ static_cast<unsigned char>(kind)) * 16777619u;
+  for (const auto& c : value)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+
+  // the filter takes its keys from the low bits: spread the high ones
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6d;
+  hash ^= hash >> 12;
+
+  return hash;
+}
+
+unsigned tag_hash (const std::string& tag)
+{
+  return salted_hash('t', tag);
+}
+
+unsigned id_hash (const std::string& id)
+{
+  return salted_hash('#', id);
+}
+
+unsigned class_hash (const std::string& klass)
+{
+  return salted_hash('.', klass);
+}
+
+static void add_hash (std::vector<unsigned>& hashes, unsigned hash)
+{
+  if (hashes.size() < MAX_ANCESTOR_HASHES &&
+      std::find(hashes.begin(), hashes.end(), hash) == hashes.end())
+    hashes.push_back(hash);
+}
+
+static void collect_ancestor_hashes (ComplexSelector& sel)
+{
+  sel.ancestor_hashes.clear();
+
+  // ids are the rarest, tags the most common
+  for (const auto& ancestor : sel.ancestors)
+    if (!ancestor.second.id.empty())
+      add_hash(sel.ancestor_hashes, id_hash(ancestor.second.id));
+
+  for (const auto& ancestor : sel.ancestors)
+    for (const auto& klass : ancestor.second.classes)
+      add_hash(sel.ancestor_hashes, class_hash(klass));
+
+  for (const auto& ancestor : sel.ancestors)
+    if (!ancestor.second.tag.empty() && ancestor.second.tag != "*")
+      add_hash(sel.ancestor_hashes, tag_hash(ancestor.second.tag));
+}
+
+static void compute_specificity (ComplexSelector& sel)
+{
+  sel.specificity = sel.subject.specificity;
+
+  for (const auto& ancestor : sel.ancestors)
+    sel.specificity += ancestor.second.specificity;
+}
+
+ComplexSelector::ComplexSelector ()
+  : specificity(0)
+{ }
+
+ComplexSelector::ComplexSelector (const Selector& sel)
+  : subject(sel), specificity(sel.specificity)
+{ }
+
+static inline bool is_ident_char (char c)
+{
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+}
+
+static void skip_ident (const std::string& text, size_t& i)
+{
+  const size_t start = i;
+
+  while (i < text.size() && is_ident_char(text[i]))
+    i++;
+
+  if (i == start)
+    throw std::invalid_argument("expected an identifier in: " + text);
+}
+
+// a selector split into the text of its compounds, left to right
+struct SplitSelector
+{
+  std::vector<std::string> compounds;
+  // combinators[k] links compounds[k] to compounds[k + 1]
+  std::vector<Combinator> combinators;
+};
+
+// only checks the compound at `i` and steps over it: yacss parses it
+static void skip_compound (const std::string& text, size_t& i)
+{
+  if (text[i] == '*')
+    i++;
+  else if (is_ident_char(text[i]))
+    skip_ident(text, i);
+
+  while (i < text.size() && (text[i] == '#' || text[i] == '.'))
+    skip_ident(text, ++i);
+}
+
+static SplitSelector split_complex_selector (const std::string& text)
+{
+  SplitSelector split;
+  bool child = false;
+  size_t i = 0;
+
+  while (i < text.size()) {
+    const char c = text[i];
+
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      i++;
+      continue;
+    }
+
+    if (c == '>') {
+      if (split.compounds.empty() || child)
+        throw std::invalid_argument("misplaced combinator in: " + text);
+
+      child = true;
+      i++;
+      continue;
+    }
+
+    if (c != '*' && c != '#' && c != '.' && !is_ident_char(c))
+      throw std::invalid_argument("unsupported selector: " + text);
+
+    if (!split.compounds.empty())
+      split.combinators.push_back(child ? COMBINATOR_CHILD
+                                        : COMBINATOR_DESCENDANT);
+
+    const size_t start = i;
+    skip_compound(text, i);
+    split.compounds.push_back(text.substr(start, i - start));
+    child = false;
+
+    if (i < text.size() && text[i] != '>' &&
+        !std::isspace(static_cast<unsigned char>(text[i])))
+      throw std::invalid_argument("unsupported selector: " + text);
+  }
+
+  if (split.compounds.empty() || child)
+    throw std::invalid_argument("incomplete selector: " + text);
+
+  return split;
+}
+
+// `compounds` are those of `split` as yacss parsed them
+static ComplexSelector join_complex_selector (const SplitSelector& split,
+                                              const Selector* compounds)
+{
+  const size_t last = split.compounds.size() - 1;
+  ComplexSelector sel (compounds[last]);
+
+  for (size_t k = last; k-- > 0;)
+    sel.ancestors.push_back(ComplexSelector::Ancestor(split.combinators[k],
+                                                      compounds[k]));
+
+  collect_ancestor_hashes(sel);
+  compute_specificity(sel);
+
+  return sel;
+}
+
+// the compounds of a rule's selectors, as a yacss selector list
+static std::string compound_list (const std::vector<SplitSelector>& list)
+{
+  std::string out;
+
+  for (const auto& split : list)
+    for (const auto& compound : split.compounds) {
+      if (!out.empty())
+        out += ", ";
+      out += compound;
+    }
+
+  return out;
+}
+
+static size_t compound_count (const std::vector<SplitSelector>& list)
+{
+  size_t count = 0;
+
+  for (const auto& split : list)
+    count += split.compounds.size();
+
+  return count;
+}
+
+// the selectors of `list` from the compounds yacss parsed for them
+static std::vector<ComplexSelector> join_selector_list (
+    const std::vector<SplitSelector>& list,
+    const std::vector<Selector>& compounds)
+{
+  std::vector<ComplexSelector> joined;
+  size_t next = 0;
+
+  for (const auto& split : list) {
+    joined.push_back(join_complex_selector(split, &compounds[next]));
+    next += split.compounds.size();
+  }
+
+  return joined;
+}
+
+// the one rule yacss makes of `list` and `block`, if it parses them
+static RulePtr parse_rule (const std::vector<SplitSelector>& list,
+                           const std::string& block)
+{
+  CSSDriver driver;
+
+  if (driver.parse_source(compound_list(list) + " {" + block + "}") ||
+      driver.stylesheet.rules.size() != 1 ||
+      driver.stylesheet.rules.front()->selectors.size() !=
+          compound_count(list))
+    return nullptr;
+
+  return driver.stylesheet.rules.front();
+}
+
+ComplexSelector parse_complex_selector (const std::string& text)
+{
+  const std::vector<SplitSelector> list (1, split_complex_selector(text));
+  RulePtr rule = parse_rule(list, "");
+
+  if (!rule)
+    throw std::invalid_argument("yacss rejects selector: " + text);
+
+  return join_selector_list(list, rule->selectors).front();
+}
+
+AncestorFilter::AncestorFilter ()
+{
+  m_counters.fill(0);
+}
+
+void AncestorFilter::_add (unsigned hash)
+{
+  m_hashes.push_back(hash);
+
+  // saturated counters stay put: better a false positive than a negative
+  for (unsigned key : { hash & KEY_MASK, (hash >> KEY_BITS) & KEY_MASK })
+    if (m_counters[key] != 0xff)
+      m_counters[key]++;
+}
+
+void AncestorFilter::push (const Element& elem)
+{
+  AttrMap::const_iterator it = elem.attr_map.find("id");
+
+  m_marks.push_back(m_hashes.size());
+  _add(tag_hash(elem.tag_name));
+
+  if (it != elem.attr_map.end())
+    _add(id_hash(it->second));
+
+  for (const auto& klass : elem.classes)
+    _add(class_hash(klass));
+}
+
+void AncestorFilter::pop ()
+{
+  for (size_t i = m_marks.back(); i < m_hashes.size(); i++) {
+    const unsigned hash = m_hashes[i];
+
+    for (unsigned key : { hash & KEY_MASK, (hash >> KEY_BITS) & KEY_MASK })
+      if (m_counters[key] != 0xff)
+        m_counters[key]--;
+  }
+
+  m_hashes.resize(m_marks.back());
+  m_marks.pop_back();
+}
+
+static inline const Element* element_of (const StyledNode* node)
+{
+  if (node->node->type != NodeType::Element)
+    return nullptr;
+
+  return static_cast<const Element*>(node->node.get());
+}
+
+enum AncestorMatch
+{
+  ANCESTORS_MATCHED,
+  // a higher ancestor may still match the compound that was being tried
+  ANCESTORS_NOT_MATCHED_RESTART,
+  // the chain ran out: starting any higher can't do better
+  ANCESTORS_NOT_MATCHED_GLOBALLY
+};
+
+// right to left, backtracking over descendant combinators only as far as
+// it can help; without the early exit `.a div div a` would go quadratic
+// in the depth of the tree
+static AncestorMatch ancestors_match (const ComplexSelector& sel, size_t i,
+                                      const StyledNode* node)
+{
+  if (i == sel.ancestors.size())
+    return ANCESTORS_MATCHED;
+
+  const ComplexSelector::Ancestor& ancestor = sel.ancestors[i];
+
+  for (; node; node = node->parent) {
+    const Element* elem = element_of(node);
+
+    if (elem && selector_matches(ancestor.second, *elem)) {
+      const AncestorMatch result = ancestors_match(sel, i + 1, node->parent);
+
+      if (result != ANCESTORS_NOT_MATCHED_RESTART)
+        return result;
+    }
+
+    if (ancestor.first == COMBINATOR_CHILD)
+      return ANCESTORS_NOT_MATCHED_RESTART;
+  }
+
+  return ANCESTORS_NOT_MATCHED_GLOBALLY;
+}
+
+bool complex_selector_matches (const ComplexSelector& sel,
+                               const Element& elem, const StyledNode* parent,
+                               const AncestorFilter* filter)
+{
+  return selector_matches(sel.subject, elem) &&
+         complex_ancestors_match(sel, parent, filter);
+}
+
+bool complex_ancestors_match (const ComplexSelector& sel,
+                              const StyledNode* parent,
+                              const AncestorFilter* filter)
+{
+  if (sel.ancestors.empty())
+    return true;
+
+  if (filter) {
+    for (const auto& hash : sel.ancestor_hashes)
+      if (!filter->might_contain(hash))
+        return false;
+  }
+
+  return ancestors_match(sel, 0, parent) == ANCESTORS_MATCHED;
+}
+
+// STYLESHEETS
+/**
+ * Copies `source` from `pos` into `out` up to the first of `stops` that
+ * is outside of strings, comments and nested blocks, and returns where
+ * it is (npos when the source ends first). Comments are copied as a
+ * space, since they separate tokens.
+ */
+static size_t scan (const std::string& source, size_t pos, const char* stops,
+                    std::string& out)
+{
+  unsigned depth = 0;
+  // the start of what is still to be copied
+  size_t copied = pos;
+
+  for (; pos < source.size(); pos++) {
+    const char c = source[pos];
+
+    if (c == '/' && pos + 1 < source.size() && source[pos + 1] == '*') {
+      const size_t end = source.find("*/", pos + 2);
+
+      out.append(source, copied, pos - copied);
+      out += ' ';
+      pos = end == std::string::npos ? source.size() : end + 1;
+      copied = pos + 1;
+    } else if (c == '"' || c == '\'') {
+      pos++;
+      while (pos < source.size() && source[pos] != c && source[pos] != '\n')
+        pos += source[pos] == '\\' ? 2 : 1;
+    } else if (!depth && c && std::strchr(stops, c)) {
+      out.append(source, copied, pos - copied);
+      return pos;
+    } else if (c == '{') {
+      depth++;
+    } else if (c == '}' && depth) {
+      depth--;
+    }
+  }
+
+  return std::string::npos;
+}
+
+static bool is_blank (const std::string& text)
+{
+  for (const auto& c : text)
+    if (!std::isspace(static_cast<unsigned char>(c)))
+      return false;
+
+  return true;
+}
+
+// the selectors of a rule's prelude, empty if any of them is unsupported
+static std::vector<SplitSelector> split_selector_list (
+    const std::string& prelude)
+{
+  std::vector<SplitSelector> list;
+  size_t start = 0;
+
+  try {
+    while (start <= prelude.size()) {
+      size_t comma = prelude.find(',', start);
+      if (comma == std::string::npos)
+        comma = prelude.size();
+
+      list.push_back(
+          split_complex_selector(prelude.substr(start, comma - start)));
+      start = comma + 1;
+    }
+  } catch (const std::invalid_argument&) {
+    list.clear();
+  }
+
+  return list;
+}
+
+ComplexStylesheet::ComplexStylesheet ()
+  : result(0)
+{ }
+
+int ComplexStylesheet::parse_source (const std::string& source)
+{
+  std::vector<std::vector<SplitSelector>> lists;
+  std::vector<std::string> blocks;
+  // the rules as one stylesheet, for yacss to parse in one go
+  std::string rules;
+  size_t pos = 0;
+
+  selectors.clear();
+  stylesheet = Stylesheet();
+  result = 0;
+
+  while (pos < source.size()) {
+    std::string prelude;
+    std::string block;
+
+    pos = scan(source, pos, "{;}", prelude);
+    if (pos == std::string::npos)
+      break;
+
+    // a statement at-rule (`@import`, `@charset`) or a stray token
+    if (source[pos] != '{') {
+      pos++;
+      continue;
+    }
+
+    pos = scan(source, pos + 1, "}", block);
+    if (pos == std::string::npos)
+      return result = 1;
+    pos++;
+
+    // at-rules and rules with a selector that can't be matched are left
+    // out on their own, as a browser would
+    if (is_blank(prelude) || prelude.find('@') != std::string::npos)
+      continue;
+
+    std::vector<SplitSelector> list = split_selector_list(prelude);
+    if (list.empty())
+      continue;
+
+    // yacss gets the compounds of every selector as a plain list: it
+    // has no combinators, but parses each compound as it would a subject
+    rules += compound_list(list) + " {" + block + "}\n";
+    lists.push_back(std::move(list));
+    blocks.push_back(std::move(block));
+  }
+
+  CSSDriver driver;
+  bool parsed = !driver.parse_source(rules) &&
+                driver.stylesheet.rules.size() == blocks.size();
+
+  for (size_t i = 0; parsed && i < blocks.size(); i++)
+    parsed = driver.stylesheet.rules[i]->selectors.size() ==
+             compound_count(lists[i]);
+
+  if (parsed) {
+    stylesheet.rules = std::move(driver.stylesheet.rules);
+  } else {
+    // some rule yacss can't parse: it goes, and only it
+    size_t kept = 0;
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+      RulePtr rule = parse_rule(lists[i], blocks[i]);
+
+      if (!rule)
+        continue;
+
+      stylesheet.rules.push_back(rule);
+      if (kept != i)
+        lists[kept] = std::move(lists[i]);
+      kept++;
+    }
+
+    lists.resize(kept);
+  }
+
+  for (size_t i = 0; i < lists.size(); i++) {
+    std::vector<Selector>& subjects = stylesheet.rules[i]->selectors;
+
+    selectors.push_back(join_selector_list(lists[i], subjects));
+
+    subjects.clear();
+    for (const auto& sel : selectors.back())
+      subjects.push_back(sel.subject);
+  }
+
+  return result;
+}
+
+}}; // ! ns yabrowser style
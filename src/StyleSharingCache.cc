@@ -0,0 +1,162 @@
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/UserAgentStyles.hh"
+
+#include <functional>
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+using namespace yahtml;
+
+StyleSharingKey::StyleSharingKey ()
+  : parent(nullptr)
+{ }
+
+StyleSharingKey::StyleSharingKey (const Element& elem, const void* parent_key)
+{
+  assign(elem, parent_key);
+}
+
+void StyleSharingKey::assign (const Element& elem, const void* parent_key)
+{
+  AttrMap::const_iterator it = elem.attr_map.find("id");
+
+  tag = elem.tag_name;
+  classes.assign(elem.classes.begin(), elem.classes.end());
+  parent = parent_key;
+
+  if (it != elem.attr_map.end())
+    id = it->second;
+  else
+    id.clear();
+
+  // `class="a b"` and `class="b a a"` match exactly the same selectors
+  std::sort(classes.begin(), classes.end());
+  classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+}
+
+static inline void hash_combine (size_t& seed, size_t value)
+{
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t StyleSharingKeyHash::operator() (const StyleSharingKey& key) const
+{
+  std::hash<std::string> str_hash;
+  size_t seed = std::hash<const void*>()(key.parent);
+
+  hash_combine(seed, str_hash(key.tag));
+  hash_combine(seed, str_hash(key.id));
+  for (const auto& klass : key.classes)
+    hash_combine(seed, str_hash(klass));
+
+  return seed;
+}
+
+size_t ComputedStyleKeyHash::operator() (const ComputedStyleKey& key) const
+{
+  size_t seed = std::hash<const void*>()(key.specified);
+
+  hash_combine(seed, std::hash<const void*>()(key.parent_inherited));
+
+  return seed;
+}
+
+StyleSharingCache::StyleSharingCache (const RuleIndex& idx)
+  : index(idx), m_hits(0), m_misses(0)
+{ }
+
+StyleSharingCache::~StyleSharingCache ()
+{ }
+
+DeclarationBlock StyleSharingCache::lookup (const Element& elem,
+                                            const StyledNode* parent,
+                                            const AncestorFilter* filter)
+{
+  // reused between lookups of the same thread so hits never allocate
+  static thread_local StyleSharingKey scratch;
+
+  // a root matches as the child of a node without declarations would
+  const DeclarationBlock& parent_block =
+      parent ? parent->specified_values : empty_declaration_block();
+
+  scratch.assign(elem, parent_block.get());
+
+  const size_t hash = StyleSharingKeyHash()(scratch);
+  Shard& shard = m_shards[hash % SHARDS];
+
+  {
+    std::lock_guard<std::mutex> lock (shard.mutex);
+    BlockMap::const_iterator it = shard.blocks.find(scratch);
+
+    if (it != shard.blocks.end()) {
+      m_hits++;
+      return it->second.block;
+    }
+  }
+
+  m_misses++;
+  std::shared_ptr<PropertyTable> table = std::make_shared<PropertyTable>();
+  const std::vector<MatchedRule> matched =
+      index.matching_rules(elem, parent, filter);
+
+  // highest precedence first, so each property is written once
+  for (auto it = matched.rbegin(); it != matched.rend(); ++it)
+    table->insert(index.declarations_of(*it));
+
+  // the UA origin comes below every author rule
+  if (index.user_agent_styles)
+    insert_user_agent_declarations(*table, elem.tag_name);
+
+  // another thread may have raced us to the same key: keep theirs so that
+  // equal keys always end up sharing one block
+  std::lock_guard<std::mutex> lock (shard.mutex);
+  const SharedBlock shared { table, parent_block };
+  return shard.blocks.emplace(scratch, shared).first->second.block;
+}
+
+ComputedStylePtr StyleSharingCache::compute (const DeclarationBlock& specified,
+                                              const StyledNode* parent)
+{
+  const InheritedStylePtr& parent_inherited =
+      parent ? parent->computed->inherited : initial_inherited_style();
+  const ComputedStyleKey key { specified.get(), parent_inherited.get() };
+  Shard& shard = m_shards[ComputedStyleKeyHash()(key) % SHARDS];
+
+  {
+    std::lock_guard<std::mutex> lock (shard.mutex);
+    ComputedMap::const_iterator it = shard.computed.find(key);
+
+    if (it != shard.computed.end())
+      return it->second;
+  }
+
+  ComputedStylePtr style = compute_style(*specified, parent_inherited);
+
+  std::lock_guard<std::mutex> lock (shard.mutex);
+  return shard.computed.emplace(key, style).first->second;
+}
+
+void StyleSharingCache::clear ()
+{
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock (shard.mutex);
+    shard.blocks.clear();
+    shard.computed.clear();
+  }
+}
+
+size_t StyleSharingCache::size ()
+{
+  size_t blocks = 0;
+
+  for (auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock (shard.mutex);
+    blocks += shard.blocks.size();
+  }
+
+  return blocks;
+}
+
+}}; // ! ns yabrowser style
@@ -1,49 +1,320 @@
 #include "yabrowser/StyleTree.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Trace.hh"
+
+#include <atomic>
+#include <unordered_map>
 
 namespace yabrowser { namespace style {
 
 using namespace yacss;
 using namespace yahtml;
 
+struct ParallelStyleBuild
+{
+  ThreadPool& pool;
+  size_t threshold;
+  // size of the subtree rooted at each DOM node, in pre-order
+  std::vector<size_t> subtree_sizes;
+};
+
+static std::atomic<unsigned> style_generation_counter (0);
+
+unsigned current_style_generation ()
+{
+  return style_generation_counter.load(std::memory_order_relaxed);
+}
+
+static size_t count_preorder (const DOMChild& root, std::vector<size_t>& sizes)
+{
+  const size_t index = sizes.size();
+  size_t size = 1;
+
+  sizes.push_back(0);
+  for (const auto& child : root->children)
+    size += count_preorder(child, sizes);
+  sizes[index] = size;
+
+  return size;
+}
+
+// the elements from the root down to `node`, for a traversal starting below
+static void push_ancestors (AncestorFilter& filter, const StyledNode* node)
+{
+  if (!node)
+    return;
+
+  push_ancestors(filter, node->parent);
+  if (node->node->type == NodeType::Element)
+    filter.push(*static_cast<const Element*>(node->node.get()));
+}
+
+// makes `sn` an ancestor of the children about to be styled
+static bool enter (AncestorFilter* filter, const StyledNode& sn)
+{
+  if (!filter || sn.node->type != NodeType::Element ||
+      sn.node->children.empty())
+    return false;
+
+  filter->push(*static_cast<const Element*>(sn.node.get()));
+  return true;
+}
+
 StyledNode::StyledNode (const DOMChild root, const Stylesheet& ss)
+  : StyledNode(root, RuleIndex(ss))
+{ }
+
+StyledNode::StyledNode (const DOMChild root, const RuleIndex& index)
+  : node(root), parent(nullptr), dirty(RESTYLE_NONE), dirty_descendants(false)
+{
+  TRACE_SPAN("style", "StyledNode");
+  StyleSharingCache cache (index);
+  AncestorFilter ancestors;
+
+  _build(cache, index.has_combinators ? &ancestors : nullptr);
+}
+
+StyledNode::StyledNode (const DOMChild root, StyleSharingCache& cache,
+                        StyledNode* parent_node, AncestorFilter* filter)
+  : node(root), parent(parent_node), dirty(RESTYLE_NONE),
+    dirty_descendants(false)
+{
+  // one span for the whole tree, not one per node
+  TRACE_SPAN("style", parent ? nullptr : "StyledNode");
+
+  if (filter || !cache.index.has_combinators) {
+    _build(cache, filter);
+    return;
+  }
+
+  AncestorFilter ancestors;
+  push_ancestors(ancestors, parent);
+  _build(cache, &ancestors);
+}
+
+StyledNode::StyledNode (const DOMChild root, StyleSharingCache& cache,
+                        ThreadPool& pool, size_t threshold)
+  : node(root), parent(nullptr), dirty(RESTYLE_NONE), dirty_descendants(false)
+{
+  TRACE_SPAN("style", "StyledNode (parallel)");
+  ParallelStyleBuild build { pool, threshold, std::vector<size_t>() };
+  AncestorFilter ancestors;
+
+  count_preorder(root, build.subtree_sizes);
+
+  if (!cache.index.has_combinators) {
+    _build_parallel(cache, build, 0, nullptr);
+    return;
+  }
+
+  _build_parallel(cache, build, 0, &ancestors);
+}
+
+StyledNode::StyledNode (const DOMChild root, StyleSharingCache& cache,
+                        StyledNode* parent_node,
+                        const ParallelStyleBuild& build, size_t index)
+  : node(root), parent(parent_node), dirty(RESTYLE_NONE),
+    dirty_descendants(false)
+{
+  TRACE_SPAN("style", "StyledNode (task)");
+
+  if (!cache.index.has_combinators) {
+    _build_parallel(cache, build, index, nullptr);
+    return;
+  }
+
+  // every task walks down with a filter of its own
+  AncestorFilter ancestors;
+  push_ancestors(ancestors, parent);
+  _build_parallel(cache, build, index, &ancestors);
+}
+
+void StyledNode::_resolve (StyleSharingCache& cache,
+                          const AncestorFilter* filter)
+{
+  if (node->type == NodeType::Element) {
+    Element* elem = static_cast<yahtml::Element*>(node.get());
+    specified_values = cache.lookup(*elem, parent, filter);
+  } else {
+    specified_values = empty_declaration_block();
+  }
+
+  computed = cache.compute(specified_values, parent);
+  display = computed->display;
+}
+
+void StyledNode::_update_subtree_size ()
 {
-  node = root;
+  subtree_size = 1;
 
-  if (root->type == NodeType::Element) {
-    Element* elem = static_cast<yahtml::Element*>(root.get());
-    specified_values = compute_specified_values(ss, *elem);
-    const auto it = specified_values.find("display");
+  for (const auto& child : children)
+    subtree_size += child->subtree_size;
+}
+
+void StyledNode::_build (StyleSharingCache& cache, AncestorFilter* filter)
+{
+  generation = style_generation = current_style_generation();
+  _resolve(cache, filter);
+
+  // recursively construct the styled tree, each child in place
+  const bool entered = enter(filter, *this);
+  children.reserve(node->children.size());
+  for (const auto& child : node->children)
+    children.push_back(
+        std::make_shared<StyledNode>(child, cache, this, filter));
+
+  if (entered)
+    filter->pop();
+
+  _update_subtree_size();
+}
+
+void StyledNode::_build_parallel (StyleSharingCache& cache,
+                                  const ParallelStyleBuild& build,
+                                  size_t index, AncestorFilter* filter)
+{
+  if (build.subtree_sizes[index] < build.threshold) {
+    _build(cache, filter);
+    return;
+  }
+
+  generation = style_generation = current_style_generation();
+  _resolve(cache, filter);
+  const bool entered = enter(filter, *this);
+
+  // every slot is written by exactly one task, so siblings keep their
+  // document order no matter which thread styles them
+  TaskGroup group (build.pool);
+  size_t child_index = index + 1;
+
+  children.resize(node->children.size());
+  for (size_t i = 0; i < node->children.size(); i++) {
+    const DOMChild& child = node->children[i];
+    StyledChild& slot = children[i];
 
-    if (it == specified_values.end()) {
-      display = DISPLAY_INLINE;
+    if (build.subtree_sizes[child_index] < build.threshold) {
+      slot = std::make_shared<StyledNode>(child, cache, this, filter);
     } else {
-      std::string disp = it->second.get<KeywordValue>().val;
-
-      if (disp == "inline") {
-        display = DISPLAY_INLINE;
-      } else if (disp == "block") {
-        display = DISPLAY_BLOCK;
-      } else if (disp == "none") {
-        display = DISPLAY_NONE;
-      } else {
-        throw std::runtime_error("Unknown Display value.");
-      }
+      group.run([this, &child, &slot, &cache, &build, child_index]() {
+        slot = StyledChild(new StyledNode(child, cache, this, build,
+                                          child_index));
+      });
     }
+
+    child_index += build.subtree_sizes[child_index];
+  }
+
+  group.wait();
+  if (entered)
+    filter->pop();
+
+  _update_subtree_size();
+}
+
+void StyledNode::mark_dirty (unsigned hints)
+{
+  dirty |= hints;
+
+  for (StyledNode* ancestor = parent;
+       ancestor && !ancestor->dirty_descendants; ancestor = ancestor->parent)
+    ancestor->dirty_descendants = true;
+}
+
+void StyledNode::restyle (StyleSharingCache& cache, RestyleStats& stats)
+{
+  style_generation_counter.fetch_add(1, std::memory_order_relaxed);
+
+  if (!cache.index.has_combinators) {
+    _restyle(cache, stats, false, nullptr);
+    return;
+  }
+
+  AncestorFilter ancestors;
+  push_ancestors(ancestors, parent);
+  _restyle(cache, stats, false, &ancestors);
+}
+
+void StyledNode::_restyle (StyleSharingCache& cache, RestyleStats& stats,
+                           bool force, AncestorFilter* filter)
+{
+  if (!force && dirty == RESTYLE_NONE && !dirty_descendants) {
+    stats.reused += subtree_size;
+    return;
+  }
+
+  const ComputedStyle* previous = computed.get();
+  const bool resolve = force || (dirty & RESTYLE_SELF);
+
+  if (resolve) {
+    _resolve(cache, filter);
+    stats.restyled++;
   } else {
-    specified_values = DeclarationContainer {};
-    display = DISPLAY_INLINE;
+    stats.reused++;
   }
 
-  // recursively construct the styled tree
-  for (const auto& child : root->children) {
-    StyledNode sn (child, ss);
-    children.push_back(std::make_shared<StyledNode>(sn));
+  // children are keyed on the identity of our style and inherit from it,
+  // so they have to be looked up again as soon as it changes. With
+  // combinators, anything below may depend on whatever changed about this
+  // node.
+  if (computed.get() != previous)
+    style_generation = current_style_generation();
+
+  const bool force_children = computed.get() != previous ||
+                              (resolve && cache.index.has_combinators);
+  const bool entered = enter(filter, *this);
+
+  if (dirty & RESTYLE_CHILDREN) {
+    StyledChildren previous_children;
+    previous_children.swap(children);
+    children.reserve(node->children.size());
+
+    // by DOM node, so that wide lists are not restyled in quadratic time
+    std::unordered_map<const yahtml::Node*, StyledChild*> previous_of;
+    previous_of.reserve(previous_children.size());
+    for (auto& sn : previous_children)
+      previous_of.emplace(sn->node.get(), &sn);
+
+    for (const auto& child : node->children) {
+      auto it = previous_of.find(child.get());
+
+      if (it == previous_of.end()) {
+        children.push_back(
+            std::make_shared<StyledNode>(child, cache, this, filter));
+        stats.restyled += children.back()->subtree_size;
+        continue;
+      }
+
+      // a node can only be reused once
+      children.push_back(std::move(*it->second));
+      previous_of.erase(it);
+      children.back()->_restyle(cache, stats, force_children, filter);
+    }
+  } else {
+    for (const auto& child : children)
+      child->_restyle(cache, stats, force_children, filter);
   }
+
+  if (entered)
+    filter->pop();
+
+  dirty = RESTYLE_NONE;
+  dirty_descendants = false;
+  _update_subtree_size();
 }
 
 StyledNode::~StyledNode ()
 { }
 
+const DeclarationBlock& empty_declaration_block ()
+{
+  static const DeclarationBlock empty = std::make_shared<const PropertyTable>();
+
+  return empty;
+}
+
 bool selector_matches (const yacss::Selector& sel, const yahtml::Element& elem)
 {
   yahtml::AttrMap::const_iterator it;
@@ -74,16 +345,22 @@ bool selector_matches (const yacss::Selector& sel, const yahtml::Element& elem)
 
 MatchedRule rule_matches (const yacss::RulePtr& rule, const yahtml::Element& elem)
 {
-  for (const auto& selector : rule->selectors)
-    if (selector_matches(selector, elem))
-      return MatchedRule {rule, selector.specificity};
+  MatchedRule matched {nullptr, 0};
 
-  return MatchedRule {nullptr, 0};
+  // a rule applies with its most specific matching selector
+  for (const auto& selector : rule->selectors) {
+    if (selector_matches(selector, elem) &&
+        (!matched.first || selector.specificity > matched.second))
+      matched = MatchedRule {rule, selector.specificity};
+  }
+
+  return matched;
 }
 
 std::vector<MatchedRule> matching_rules (const Stylesheet& ss,
                                          const yahtml::Element& elem)
 {
+  TRACE_SPAN("style", "matching_rules");
   std::vector<MatchedRule> rules_matched;
 
   for (const auto& rule : ss.rules) {
@@ -95,7 +372,9 @@ std::vector<MatchedRule> matching_rules (const Stylesheet& ss,
     rules_matched.push_back(matched_rule);
   }
 
-  std::sort(rules_matched.begin(), rules_matched.end(), MatchedRuleLesser());
+  // equal specificities keep their source order
+  std::stable_sort(rules_matched.begin(), rules_matched.end(),
+                   MatchedRuleLesser());
 
   return rules_matched;
 }
@@ -103,6 +382,7 @@ std::vector<MatchedRule> matching_rules (const Stylesheet& ss,
 DeclarationContainer compute_specified_values (const Stylesheet& ss,
                                                const Element& elem)
 {
+  TRACE_SPAN("style", "compute_specified_values");
   DeclarationContainer spec_values;
 
   for (const auto& matched_rule : matching_rules(ss, elem))
@@ -112,18 +392,16 @@ DeclarationContainer compute_specified_values (const Stylesheet& ss,
   return spec_values;
 }
 
-CSSBaseValue StyledNode::decl_lookup (
-const std::initializer_list<std::string> keys, const CSSBaseValue& def) const
+const Value& StyledNode::decl_lookup (
+const std::initializer_list<std::string> keys, const Value& def) const
 {
-  DeclarationContainer::const_iterator it;
-
   for (const auto& key : keys) {
-    it = specified_values.find(key);
-    if (it != specified_values.end())
-      return it->second;
+    const Value* value = specified_values->find(key);
+    if (value)
+      return *value;
   }
 
-  return CSSBaseValue(def);
+  return def;
 }
 
 }}; // ! ns yabrowser style
@@ -0,0 +1,186 @@
+#include "yabrowser/ThreadPool.hh"
+
+namespace yabrowser {
+
+// queue owned by the current thread, if it is a worker
+static thread_local ThreadPool* tl_pool = nullptr;
+static thread_local unsigned tl_index = 0;
+
+ThreadPool::ThreadPool (unsigned threads)
+  : m_queued(0), m_stop(false)
+{
+  for (unsigned i = 0; i < threads; i++)
+    m_queues.emplace_back(new Queue());
+
+  for (unsigned i = 0; i < threads; i++)
+    m_threads.emplace_back(&ThreadPool::_work, this, i);
+}
+
+ThreadPool::~ThreadPool ()
+{
+  {
+    std::lock_guard<std::mutex> lock (m_sleep_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+
+  // submitted while the workers were stopping: a group may be waiting on
+  // them still
+  while (run_one())
+    ;
+}
+
+void ThreadPool::submit (Task task, TaskGroup* group)
+{
+  Queue& queue = tl_pool == this ? *m_queues[tl_index] : m_injector;
+
+  {
+    std::lock_guard<std::mutex> lock (queue.mutex);
+    queue.jobs.push_back(Job{ std::move(task), group });
+  }
+
+  m_queued++;
+  {
+    // pairs with the predicate check in _work so no wakeup is lost
+    std::lock_guard<std::mutex> lock (m_sleep_mutex);
+  }
+  m_wake.notify_one();
+}
+
+bool ThreadPool::_pop (Job& job)
+{
+  const unsigned queues = m_queues.size();
+
+  // own work first, newest first
+  if (tl_pool == this) {
+    Queue& own = *m_queues[tl_index];
+    std::lock_guard<std::mutex> lock (own.mutex);
+
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      return true;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock (m_injector.mutex);
+
+    if (!m_injector.jobs.empty()) {
+      job = std::move(m_injector.jobs.front());
+      m_injector.jobs.pop_front();
+      return true;
+    }
+  }
+
+  // steal the oldest (largest, usually) task of somebody else
+  const unsigned start = tl_pool == this ? tl_index + 1 : 0;
+  for (unsigned i = 0; i < queues; i++) {
+    Queue& victim = *m_queues[(start + i) % queues];
+    std::lock_guard<std::mutex> lock (victim.mutex);
+
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::_execute (Job& job)
+{
+  TaskGroup& group = *job.group;
+
+  m_queued--;
+
+  try {
+    job.task();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock (group.m_mutex);
+    if (!group.m_error)
+      group.m_error = std::current_exception();
+  }
+
+  // under the lock: the waiter can't return, and destroy the group, before
+  // this is done with it
+  std::lock_guard<std::mutex> lock (group.m_mutex);
+  if (--group.m_pending == 0)
+    group.m_done.notify_all();
+}
+
+bool ThreadPool::run_one ()
+{
+  Job job;
+
+  if (!_pop(job))
+    return false;
+
+  _execute(job);
+  return true;
+}
+
+void ThreadPool::_work (unsigned index)
+{
+  tl_pool = this;
+  tl_index = index;
+
+  while (true) {
+    if (run_one())
+      continue;
+
+    std::unique_lock<std::mutex> lock (m_sleep_mutex);
+    m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+
+    // not before the queues are empty, or the groups waiting on what is
+    // left would wait forever
+    if (m_stop && m_queued == 0)
+      return;
+  }
+}
+
+TaskGroup::TaskGroup (ThreadPool& pool)
+  : m_pool(pool), m_pending(0)
+{ }
+
+TaskGroup::~TaskGroup ()
+{
+  // never leave tasks running against a dead group
+  _wait_pending();
+}
+
+void TaskGroup::run (ThreadPool::Task task)
+{
+  m_pending++;
+  m_pool.submit(std::move(task), this);
+}
+
+void TaskGroup::_wait_pending ()
+{
+  // help while there is work queued, any work: the tasks of this group
+  // may be waiting on nested groups
+  while (m_pending > 0 && m_pool.run_one())
+    ;
+
+  // what is left of the group runs on other threads
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_done.wait(lock, [this]() { return m_pending == 0; });
+}
+
+void TaskGroup::wait ()
+{
+  _wait_pending();
+
+  std::lock_guard<std::mutex> lock (m_mutex);
+  if (m_error) {
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+}; // ! ns yabrowser
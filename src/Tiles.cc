@@ -0,0 +1,179 @@
+#include "yabrowser/Tiles.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Trace.hh"
+
+#include <algorithm>
+
+namespace yabrowser
+{
+namespace paint
+{
+
+using namespace layout;
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static inline uint64_t mix(uint64_t hash, const void* data, size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  return hash;
+}
+
+static inline uint64_t mix(uint64_t hash, const Color& color)
+{
+  return mix(hash, &color, sizeof(color));
+}
+
+static inline uint64_t mix(uint64_t hash, const Rect& rect)
+{
+  const float edges[4] = { rect.x, rect.y, rect.width, rect.height };
+
+  return mix(hash, edges, sizeof(edges));
+}
+
+TileGrid::TileGrid(unsigned width, unsigned height, unsigned tile,
+                   RasterKernels kernels)
+    : canvas(width, height, Color(255, 255, 255), kernels),
+      tile_size(std::max(tile, 1u)),
+      columns((width + tile_size - 1) / tile_size),
+      rows((height + tile_size - 1) / tile_size),
+      background(255, 255, 255),
+      m_bins(columns * rows),
+      m_fingerprints(columns * rows),
+      m_stale(true)
+{
+}
+
+void TileGrid::invalidate()
+{
+  m_stale = true;
+}
+
+Rect TileGrid::tile_rect(unsigned tile) const
+{
+  const unsigned x = (tile % columns) * tile_size;
+  const unsigned y = (tile / columns) * tile_size;
+
+  return Rect(x, y, std::min(tile_size, canvas.width - x),
+              std::min(tile_size, canvas.height - y));
+}
+
+void TileGrid::_bin(const DisplayList& list)
+{
+  for (auto& bin : m_bins)
+    bin.clear();
+
+  for (unsigned i = 0; i < list.items.size(); i++) {
+    const DisplayItem& item = list.items[i];
+    const Rect& rect = item.rect;
+
+    // most of a long document is below the canvas
+    if (rect.y >= canvas.height || rect.x >= canvas.width)
+      continue;
+
+    // the pixels fill_rect() would touch, culled when there are none
+    const unsigned x0 = snap_to_pixel(rect.x, canvas.width);
+    const unsigned x1 = snap_to_pixel(rect.x + rect.width, canvas.width);
+    const unsigned y0 = snap_to_pixel(rect.y, canvas.height);
+    const unsigned y1 = snap_to_pixel(rect.y + rect.height, canvas.height);
+
+    if (item.color.a == 0 || x0 >= x1 || y0 >= y1)
+      continue;
+
+    for (unsigned row = y0 / tile_size; row <= (y1 - 1) / tile_size; row++)
+      for (unsigned column = x0 / tile_size;
+           column <= (x1 - 1) / tile_size; column++)
+        m_bins[row * columns + column].push_back(i);
+  }
+}
+
+uint64_t TileGrid::_fingerprint(const DisplayList& list, unsigned tile) const
+{
+  uint64_t hash = mix(FNV_OFFSET, background);
+
+  for (unsigned i : m_bins[tile]) {
+    hash = mix(hash, list.items[i].rect);
+    hash = mix(hash, list.items[i].color);
+  }
+
+  return hash;
+}
+
+// whether fill_rect() would paint every pixel of `tile` with `rect`
+static bool covers(const Rect& rect, const Rect& tile, const Canvas& canvas)
+{
+  return snap_to_pixel(rect.x, canvas.width) <= tile.x &&
+         snap_to_pixel(rect.y, canvas.height) <= tile.y &&
+         snap_to_pixel(rect.x + rect.width, canvas.width) >=
+             tile.x + tile.width &&
+         snap_to_pixel(rect.y + rect.height, canvas.height) >=
+             tile.y + tile.height;
+}
+
+void TileGrid::_paint_tile(const DisplayList& list, unsigned tile)
+{
+  TRACE_SPAN("paint", "tile");
+  const Rect clip = tile_rect(tile);
+  const std::vector<unsigned>& bin = m_bins[tile];
+  size_t first = bin.size();
+
+  // everything beneath the last opaque item covering the tile is hidden
+  while (first > 0) {
+    const DisplayItem& item = list.items[bin[first - 1]];
+
+    if (item.color.a == 255 && covers(item.rect, clip, canvas))
+      break;
+    first--;
+  }
+
+  if (first == 0) {
+    // as Canvas::clear() would, even when the background is translucent
+    const unsigned x = clip.x, y = clip.y, width = clip.width;
+    const uint32_t pixel = pack_pixel(background);
+    uint32_t* row =
+        canvas.pixels.data() + static_cast<size_t>(y) * canvas.width + x;
+
+    for (unsigned i = 0; i < clip.height; i++, row += canvas.width)
+      fill_span(canvas.kernels, row, width, pixel);
+  } else {
+    first--;
+  }
+
+  for (size_t i = first; i < bin.size(); i++)
+    canvas.fill_rect(list.items[bin[i]].rect, list.items[bin[i]].color, clip);
+}
+
+void TileGrid::paint(const DisplayList& list, ThreadPool& pool,
+                     TileStats& stats)
+{
+  TRACE_SPAN("paint", "TileGrid::paint");
+  std::vector<unsigned> damaged;
+
+  _bin(list);
+
+  for (unsigned tile = 0; tile < m_bins.size(); tile++) {
+    const uint64_t fingerprint = _fingerprint(list, tile);
+
+    if (m_stale || fingerprint != m_fingerprints[tile]) {
+      m_fingerprints[tile] = fingerprint;
+      damaged.push_back(tile);
+    }
+  }
+
+  m_stale = false;
+  stats.painted += damaged.size();
+  stats.reused += m_bins.size() - damaged.size();
+
+  // tiles cover disjoint pixels, so they need no synchronization
+  TaskGroup group(pool);
+
+  for (unsigned tile : damaged)
+    group.run([this, &list, tile]() { _paint_tile(list, tile); });
+  group.wait();
+}
+}  // ! ns paint
+}; // ! ns yabrowser
@@ -0,0 +1,165 @@
+#include "yabrowser/Trace.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace yabrowser { namespace trace {
+
+typedef std::chrono::steady_clock Clock;
+
+std::atomic<bool> g_enabled (false);
+
+/**
+ * Events of one thread. Only its thread appends to it, so the mutex is
+ * uncontended but for events() and start(). Buffers outlive their
+ * threads: pool workers come and go between traces.
+ */
+struct ThreadBuffer
+{
+  std::mutex mutex;
+  std::vector<Event> events;
+  unsigned thread;
+};
+
+static std::mutex g_buffers_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+static std::atomic<Clock::rep> g_epoch (0);
+// spans that ended since start(), recorded or not
+static std::atomic<size_t> g_ended (0);
+static std::atomic<size_t> g_max_events (MAX_EVENTS);
+
+static thread_local ThreadBuffer* tl_buffer = nullptr;
+
+static ThreadBuffer& thread_buffer ()
+{
+  if (!tl_buffer) {
+    std::lock_guard<std::mutex> lock (g_buffers_mutex);
+
+    g_buffers.emplace_back(new ThreadBuffer());
+    tl_buffer = g_buffers.back().get();
+    tl_buffer->thread = g_buffers.size();
+  }
+
+  return *tl_buffer;
+}
+
+uint64_t now ()
+{
+  const Clock::rep ticks = Clock::now().time_since_epoch().count() -
+                           g_epoch.load(std::memory_order_relaxed);
+
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::duration(ticks)).count();
+}
+
+void start (size_t max_events)
+{
+  {
+    std::lock_guard<std::mutex> lock (g_buffers_mutex);
+
+    for (auto& buffer : g_buffers) {
+      std::lock_guard<std::mutex> buffer_lock (buffer->mutex);
+      // and give the memory back: the last trace may have filled them
+      std::vector<Event>().swap(buffer->events);
+    }
+  }
+
+  g_max_events = max_events;
+  g_ended = 0;
+  g_epoch = Clock::now().time_since_epoch().count();
+  g_enabled = true;
+}
+
+void stop ()
+{
+  g_enabled = false;
+}
+
+size_t dropped ()
+{
+  const size_t ended = g_ended.load(std::memory_order_relaxed);
+  const size_t max_events = g_max_events.load(std::memory_order_relaxed);
+
+  return ended > max_events ? ended - max_events : 0;
+}
+
+void record (const char* category, const char* name, uint64_t begin,
+             uint64_t end)
+{
+  if (g_ended.fetch_add(1, std::memory_order_relaxed) >=
+      g_max_events.load(std::memory_order_relaxed))
+    return;
+
+  ThreadBuffer& buffer = thread_buffer();
+  std::lock_guard<std::mutex> lock (buffer.mutex);
+
+  buffer.events.push_back(
+      Event{ name, category, begin, end > begin ? end - begin : 0,
+             buffer.thread });
+}
+
+std::vector<Event> events ()
+{
+  std::vector<Event> all;
+
+  {
+    std::lock_guard<std::mutex> lock (g_buffers_mutex);
+
+    for (auto& buffer : g_buffers) {
+      std::lock_guard<std::mutex> buffer_lock (buffer->mutex);
+      all.insert(all.end(), buffer->events.begin(), buffer->events.end());
+    }
+  }
+
+  // spans are recorded when they end: put parents before their children
+  std::stable_sort(all.begin(), all.end(),
+                   [](const Event& a, const Event& b) {
+                     return a.begin < b.begin ||
+                            (a.begin == b.begin && a.duration > b.duration);
+                   });
+
+  return all;
+}
+
+static void write_micros (std::ostream& out, uint64_t nanos)
+{
+  const char fraction[4] = { static_cast<char>('0' + nanos / 100 % 10),
+                             static_cast<char>('0' + nanos / 10 % 10),
+                             static_cast<char>('0' + nanos % 10), 0 };
+
+  out << nanos / 1000 << '.' << fraction;
+}
+
+void write_json (std::ostream& out, const std::vector<Event>& events)
+{
+  std::vector<unsigned> threads;
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  for (size_t i = 0; i < events.size(); i++) {
+    const Event& event = events[i];
+
+    out << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name
+        << "\",\"cat\":\"" << event.category
+        << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":";
+    write_micros(out, event.begin);
+    out << ",\"dur\":";
+    write_micros(out, event.duration);
+    out << '}';
+
+    if (std::find(threads.begin(), threads.end(), event.thread) ==
+        threads.end())
+      threads.push_back(event.thread);
+  }
+
+  // so that the viewer does not show bare thread ids
+  for (unsigned thread : threads)
+    out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << thread << ",\"args\":{\"name\":\"thread " << thread << "\"}}";
+
+  out << "\n]}\n";
+}
+
+}}; // ! ns yabrowser trace
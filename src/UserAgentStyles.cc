@@ -0,0 +1,46 @@
+#include "yabrowser/UserAgentStyles.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace yabrowser { namespace style {
+
+const UARule* user_agent_rule (const std::string& tag)
+{
+  const UARule* end = UA_RULES + UA_RULE_COUNT;
+  const UARule* rule = std::lower_bound(
+      UA_RULES, end, tag.c_str(), [](const UARule& rule, const char* tag) {
+        return std::strcmp(rule.tag, tag) < 0;
+      });
+
+  if (rule == end || tag != rule->tag)
+    return nullptr;
+
+  return rule;
+}
+
+void insert_user_agent_declarations (PropertyTable& author,
+                                     const std::string& tag)
+{
+  const UARule* rule = user_agent_rule(tag);
+
+  if (!rule)
+    return;
+
+  // what the author declared, before any UA declaration joins it
+  const std::bitset<PROPERTY_COUNT> declared = author.present;
+
+  for (unsigned i = rule->first; i < rule->first + rule->count; i++) {
+    const UADeclaration& decl = UA_DECLARATIONS[i];
+    bool shadowed = false;
+
+    for (const PropertyId* fallback = property_fallbacks(decl.property);
+         !shadowed && *fallback != PROPERTY_UNKNOWN; fallback++)
+      shadowed = declared[*fallback];
+
+    if (!shadowed)
+      author.insert(decl.property, decl.value);
+  }
+}
+
+}}; // ! ns yabrowser style
@@ -0,0 +1,145 @@
+#include "yabrowser/Value.hh"
+#include "yabrowser/Atoms.hh"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace yabrowser { namespace style {
+
+using namespace yacss;
+
+static const char* const PREDEFINED_KEYWORDS[] = {
+#define YABROWSER_KEYWORD_NAME(id, name) name,
+  YABROWSER_KEYWORDS(YABROWSER_KEYWORD_NAME)
+#undef YABROWSER_KEYWORD_NAME
+};
+
+/**
+ * Keywords are interned while stylesheets are indexed, under a lock, but
+ * looked up by id while styling, from any number of threads at once; so
+ * lookups take no lock. Names live in chunks that are never moved, each
+ * twice the size of the previous one, and a name is published by storing
+ * the new size last: a reader that sees an id below `size` sees its name.
+ */
+struct KeywordTable
+{
+  static const size_t FIRST_CHUNK = 64;
+  // enough for every Keyword
+  static const size_t CHUNKS = 27;
+
+  std::mutex mutex;
+  AtomTable atoms;
+  std::unique_ptr<std::string[]> chunks[CHUNKS];
+  std::atomic<size_t> size;
+
+  KeywordTable ()
+    : size(0)
+  {
+    // "" is KEYWORD_NULL
+    push_back(std::string());
+
+    for (const char* name : PREDEFINED_KEYWORDS) {
+      atoms.intern(name);
+      push_back(name);
+    }
+  }
+
+  // chunk c holds the names from FIRST_CHUNK * (2^c - 1)
+  static inline size_t chunk_of (size_t index)
+  {
+    size_t chunk = 0;
+
+    for (size_t n = index / FIRST_CHUNK + 1; n > 1; n >>= 1)
+      chunk++;
+
+    return chunk;
+  }
+
+  static inline size_t chunk_start (size_t chunk)
+  {
+    return FIRST_CHUNK * ((size_t(1) << chunk) - 1);
+  }
+
+  inline std::string& slot (size_t index) const
+  {
+    const size_t chunk = chunk_of(index);
+
+    return chunks[chunk][index - chunk_start(chunk)];
+  }
+
+  // with `mutex` held, but for the constructor
+  void push_back (const std::string& name)
+  {
+    const size_t index = size.load(std::memory_order_relaxed);
+    const size_t chunk = chunk_of(index);
+
+    if (!chunks[chunk])
+      chunks[chunk].reset(new std::string[FIRST_CHUNK << chunk]);
+
+    slot(index) = name;
+    size.store(index + 1, std::memory_order_release);
+  }
+};
+
+static KeywordTable& keyword_table ()
+{
+  static KeywordTable table;
+
+  return table;
+}
+
+Keyword intern_keyword (const std::string& str)
+{
+  KeywordTable& table = keyword_table();
+  std::lock_guard<std::mutex> lock (table.mutex);
+  const Keyword keyword = table.atoms.intern(str);
+
+  if (keyword == table.size.load(std::memory_order_relaxed))
+    table.push_back(str);
+
+  return keyword;
+}
+
+const std::string& keyword_name (Keyword keyword)
+{
+  const KeywordTable& table = keyword_table();
+
+  if (keyword >= table.size.load(std::memory_order_acquire))
+    throw std::out_of_range("keyword_name: unknown keyword");
+
+  return table.slot(keyword);
+}
+
+Value::Value (const CSSBaseValue& value)
+  : kind(VALUE_NONE), unit(0), length(0.0)
+{
+  switch (value.type) {
+    case ValueType::Keyword:
+      kind = VALUE_KEYWORD;
+      keyword = intern_keyword(value.get<KeywordValue>().val);
+      break;
+    case ValueType::Length:
+      kind = VALUE_LENGTH;
+      unit = value.get<LengthValue>().unit;
+      length = value.get<LengthValue>().val;
+      break;
+    default:
+      break;
+  }
+}
+
+CSSBaseValue Value::to_css () const
+{
+  switch (kind) {
+    case VALUE_KEYWORD:
+      return KeywordValue(keyword_name(keyword));
+    case VALUE_LENGTH:
+      return LengthValue(length, static_cast<Unit>(unit));
+    default:
+      return CSSBaseValue();
+  }
+}
+
+}}; // ! ns yabrowser style
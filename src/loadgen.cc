@@ -0,0 +1,293 @@
+#include "yabrowser/RenderServer.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace yabrowser::server;
+
+static const char USAGE[] =
+    "usage: yabrowser-load --socket SOCKET [options] <page.html ...>\n"
+    "\n"
+    "Sends render requests to a `yabrowser --serve` server from several\n"
+    "connections at once and reports their latency and throughput. The\n"
+    "pages are sent in turn, each request a batch of them.\n"
+    "\n"
+    "  --socket PATH     where the server listens\n"
+    "  --css FILE        stylesheet of every request; may be repeated\n"
+    "  --connections N   concurrent clients (default 4)\n"
+    "  --requests N      requests per connection (default 100)\n"
+    "  --batch N         documents per request (default 1)\n"
+    "  --width W         viewport width in px (default 1280)\n"
+    "  --height H        viewport height in px (default 720)\n"
+    "  --format F        json, ppm or none (default json)\n";
+
+struct Options {
+  std::string socket;
+  std::vector<std::string> pages;
+  std::vector<std::string> stylesheets;
+  unsigned long connections;
+  unsigned long requests;
+  unsigned long batch;
+  unsigned long width;
+  unsigned long height;
+  RenderFormat format;
+
+  inline Options()
+      : connections(4),
+        requests(100),
+        batch(1),
+        width(1280),
+        height(720),
+        format(FORMAT_JSON)
+  {
+  }
+};
+
+// what every connection saw, merged once they are done
+struct Results {
+  std::mutex mutex;
+  // round trip of every request, in milliseconds
+  std::vector<double> latencies;
+  unsigned long documents;
+  unsigned long failed;
+  uint64_t server_micros;
+  std::string error;
+
+  inline Results() : documents(0), failed(0), server_micros(0) {}
+};
+
+static bool parse_number(const char* arg, unsigned long& number)
+{
+  char* end;
+
+  if (!*arg || *arg == '-')
+    return false;
+
+  number = std::strtoul(arg, &end, 10);
+  return !*end && number;
+}
+
+static bool parse_format(const char* arg, RenderFormat& format)
+{
+  if (!std::strcmp(arg, "json"))
+    format = FORMAT_JSON;
+  else if (!std::strcmp(arg, "ppm"))
+    format = FORMAT_PPM;
+  else if (!std::strcmp(arg, "none"))
+    format = FORMAT_NONE;
+  else
+    return false;
+
+  return true;
+}
+
+// 0 when the options are good, otherwise the exit status
+static int parse_options(int argc, char* argv[], Options& options)
+{
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+
+    if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help")) {
+      std::cout << USAGE;
+      return -1;
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      if (i + 1 == argc) {
+        std::cerr << "yabrowser-load: " << arg << " needs a value\n";
+        return 2;
+      }
+
+      const char* value = argv[++i];
+      bool good = true;
+
+      if (!std::strcmp(arg, "--socket"))
+        options.socket = value;
+      else if (!std::strcmp(arg, "--css"))
+        options.stylesheets.push_back(value);
+      else if (!std::strcmp(arg, "--connections"))
+        good = parse_number(value, options.connections);
+      else if (!std::strcmp(arg, "--requests"))
+        good = parse_number(value, options.requests);
+      else if (!std::strcmp(arg, "--batch"))
+        good = parse_number(value, options.batch);
+      else if (!std::strcmp(arg, "--width"))
+        good = parse_number(value, options.width);
+      else if (!std::strcmp(arg, "--height"))
+        good = parse_number(value, options.height);
+      else if (!std::strcmp(arg, "--format"))
+        good = parse_format(value, options.format);
+      else
+        good = false;
+
+      if (!good) {
+        std::cerr << "yabrowser-load: bad option " << arg << " " << value
+                  << "\n";
+        return 2;
+      }
+    } else {
+      options.pages.push_back(arg);
+    }
+  }
+
+  if (options.socket.empty() || options.pages.empty()) {
+    std::cerr << USAGE;
+    return 2;
+  }
+
+  return 0;
+}
+
+static bool read_file(const std::string& path, std::string& contents)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+
+  contents.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+static void run_connection(const Options& options,
+                           const std::vector<std::string>& pages,
+                           const std::string& css, unsigned index,
+                           Results& results)
+{
+  typedef std::chrono::steady_clock Clock;
+  std::vector<double> latencies;
+  unsigned long documents = 0;
+  unsigned long failed = 0;
+  uint64_t server_micros = 0;
+  std::string error;
+  RenderRequest request;
+
+  request.format = options.format;
+  request.width = options.width;
+  request.height = options.height;
+  request.css = css;
+  latencies.reserve(options.requests);
+
+  try {
+    RenderClient client(options.socket);
+    // connections start at different pages, so that batches differ
+    size_t next = index;
+
+    for (unsigned long i = 0; i < options.requests; i++) {
+      request.documents.clear();
+      for (unsigned long j = 0; j < options.batch; j++)
+        request.documents.push_back(pages[next++ % pages.size()]);
+
+      const Clock::time_point start = Clock::now();
+      const RenderResponse response = client.render(request);
+      latencies.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+
+      for (const auto& result : response.results) {
+        documents++;
+        server_micros += result.micros;
+        if (result.status != RENDER_OK)
+          failed++;
+      }
+    }
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+
+  std::lock_guard<std::mutex> lock(results.mutex);
+  results.latencies.insert(results.latencies.end(), latencies.begin(),
+                           latencies.end());
+  results.documents += documents;
+  results.failed += failed;
+  results.server_micros += server_micros;
+  if (!error.empty())
+    results.error = error;
+}
+
+// nearest rank of a sorted sample
+static double percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0.0;
+
+  const size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+int main(int argc, char* argv[])
+{
+  typedef std::chrono::steady_clock Clock;
+  Options options;
+  Results results;
+  std::vector<std::string> pages;
+  std::string css;
+
+  if (int status = parse_options(argc, argv, options))
+    return status < 0 ? 0 : status;
+
+  for (const auto& path : options.pages) {
+    pages.emplace_back();
+    if (!read_file(path, pages.back())) {
+      std::cerr << "yabrowser-load: can't read " << path << "\n";
+      return 1;
+    }
+  }
+
+  // the stylesheets cascade in the order they were given
+  for (const auto& path : options.stylesheets) {
+    std::string source;
+
+    if (!read_file(path, source)) {
+      std::cerr << "yabrowser-load: can't read " << path << "\n";
+      return 1;
+    }
+    css += source;
+    css += '\n';
+  }
+
+  std::vector<std::thread> connections;
+  const Clock::time_point start = Clock::now();
+
+  for (unsigned i = 0; i < options.connections; i++)
+    connections.emplace_back(run_connection, std::cref(options),
+                             std::cref(pages), std::cref(css), i,
+                             std::ref(results));
+  for (auto& connection : connections)
+    connection.join();
+
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  if (!results.error.empty()) {
+    std::cerr << "yabrowser-load: " << results.error << "\n";
+    if (results.latencies.empty())
+      return 1;
+  }
+
+  std::sort(results.latencies.begin(), results.latencies.end());
+
+  std::printf("requests     %12zu\n", results.latencies.size());
+  std::printf("documents    %12lu (%lu failed)\n", results.documents,
+              results.failed);
+  std::printf("seconds      %12.3f\n", seconds);
+  std::printf("docs/s       %12.1f\n", results.documents / seconds);
+  std::printf("p50 ms       %12.3f\n", percentile(results.latencies, 50));
+  std::printf("p99 ms       %12.3f\n", percentile(results.latencies, 99));
+  std::printf("max ms       %12.3f\n",
+              results.latencies.empty() ? 0.0 : results.latencies.back());
+  if (results.documents)
+    std::printf("server ms    %12.3f per document\n",
+                results.server_micros / 1000.0 / results.documents);
+
+  return results.error.empty() && !results.failed ? 0 : 1;
+}
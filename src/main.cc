@@ -1,8 +1,467 @@
+#include "yabrowser/BinaryStylesheet.hh"
+#include "yabrowser/DisplayList.hh"
+#include "yabrowser/Layout.hh"
+#include "yabrowser/Raster.hh"
+#include "yabrowser/RenderServer.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/StyleTree.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Tiles.hh"
+#include "yabrowser/Trace.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+
+using namespace yabrowser;
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+using namespace yabrowser::paint;
+
+static const char USAGE[] =
+    "usage: yabrowser [options] <page.html | -> [style.css ...]\n"
+    "       yabrowser --serve SOCKET [--threads N] [--trace FILE]\n"
+    "\n"
+    "Renders a page headlessly: parse, style, layout and, when an image\n"
+    "is asked for, paint. `-` reads the page from stdin.\n"
+    "\n"
+    "  --serve SOCKET  render the requests of yabrowser-load clients on a\n"
+    "                  Unix domain socket, until SIGINT or SIGTERM\n"
+    "  --width W       viewport width in px (default 1280)\n"
+    "  --height H      viewport height in px (default 720)\n"
+    "  --json FILE     layout boxes as JSON, `-` for stdout\n"
+    "  --ppm FILE      rasterized viewport as binary PPM, `-` for stdout\n"
+    "  --repeat N      run the whole pipeline N times (default 1)\n"
+    "  --trace FILE    spans of every run as Chrome trace events, `-` for\n"
+    "                  stdout (see chrome://tracing or ui.perfetto.dev);\n"
+    "                  keeps the first 2^20 spans\n"
+    "  --threads N     worker threads, 0 to run on this thread alone\n"
+    "                  (default: one per core)\n"
+    "  --css-cache DIR load stylesheets compiled by earlier runs from DIR,\n"
+    "                  and leave the ones it had to parse there\n"
+    "  --no-ua-styles  leave the built-in user agent stylesheet out: every\n"
+    "                  element is inline unless the page's CSS says otherwise\n"
+    "  --quiet         no timings on exit\n";
+
+enum Stage { STAGE_PARSE, STAGE_STYLE, STAGE_LAYOUT, STAGE_PAINT, STAGES };
+
+static const char* STAGE_NAMES[STAGES] = { "parse", "style", "layout",
+                                           "paint" };
+
+struct Options {
+  std::string serve;
+  std::string page;
+  std::vector<std::string> stylesheets;
+  unsigned width;
+  unsigned height;
+  std::string json;
+  std::string ppm;
+  std::string trace;
+  std::string css_cache;
+  unsigned long repeat;
+  unsigned threads;
+  bool user_agent_styles;
+  bool quiet;
+
+  inline Options()
+      : width(1280),
+        height(720),
+        repeat(1),
+        threads(std::thread::hardware_concurrency()),
+        user_agent_styles(true),
+        quiet(false)
+  {
+  }
+};
+
+// milliseconds spent in each stage, over every run
+struct Timings {
+  double total[STAGES];
+  double min[STAGES];
+  unsigned long samples[STAGES];
+  unsigned long runs;
+
+  inline Timings() : runs(0)
+  {
+    for (unsigned i = 0; i < STAGES; i++) {
+      total[i] = min[i] = 0.0;
+      samples[i] = 0;
+    }
+  }
+
+  inline void add(Stage stage, double ms)
+  {
+    if (!samples[stage]++ || ms < min[stage])
+      min[stage] = ms;
+    total[stage] += ms;
+  }
+};
+
+class StageTimer
+{
+  typedef std::chrono::steady_clock Clock;
+
+  Timings& m_timings;
+  Stage m_stage;
+  Clock::time_point m_start;
+
+public:
+  inline StageTimer(Timings& timings, Stage stage)
+      : m_timings(timings), m_stage(stage), m_start(Clock::now())
+  {
+  }
+
+  inline ~StageTimer()
+  {
+    m_timings.add(m_stage, std::chrono::duration<double, std::milli>(
+                               Clock::now() - m_start)
+                               .count());
+  }
+};
+
+static bool parse_number(const char* arg, unsigned long& number)
+{
+  char* end;
 
-int main(int argc, char *argv[])
+  if (!*arg || *arg == '-')
+    return false;
+
+  number = std::strtoul(arg, &end, 10);
+  return !*end;
+}
+
+// 0 when the options are good, otherwise the exit status
+static int parse_options(int argc, char* argv[], Options& options)
 {
-  std::cout << "LOL" << std::endl;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    unsigned long number = 0;
+
+    if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help")) {
+      std::cout << USAGE;
+      return -1;
+    } else if (!std::strcmp(arg, "--quiet")) {
+      options.quiet = true;
+    } else if (!std::strcmp(arg, "--no-ua-styles")) {
+      options.user_agent_styles = false;
+    } else if (arg[0] == '-' && arg[1] == '-') {
+      if (i + 1 == argc) {
+        std::cerr << "yabrowser: " << arg << " needs a value\n";
+        return 2;
+      }
+
+      const char* value = argv[++i];
+      const bool numeric = parse_number(value, number);
+
+      if (!std::strcmp(arg, "--serve")) {
+        options.serve = value;
+      } else if (!std::strcmp(arg, "--json")) {
+        options.json = value;
+      } else if (!std::strcmp(arg, "--ppm")) {
+        options.ppm = value;
+      } else if (!std::strcmp(arg, "--trace")) {
+        options.trace = value;
+      } else if (!std::strcmp(arg, "--css-cache")) {
+        options.css_cache = value;
+      } else if (!std::strcmp(arg, "--width") && numeric && number) {
+        options.width = number;
+      } else if (!std::strcmp(arg, "--height") && numeric && number) {
+        options.height = number;
+      } else if (!std::strcmp(arg, "--repeat") && numeric && number) {
+        options.repeat = number;
+      } else if (!std::strcmp(arg, "--threads") && numeric) {
+        options.threads = number;
+      } else {
+        std::cerr << "yabrowser: bad option " << arg << " " << value << "\n";
+        return 2;
+      }
+    } else if (options.page.empty()) {
+      options.page = arg;
+    } else {
+      options.stylesheets.push_back(arg);
+    }
+  }
+
+  if (options.page.empty() && options.serve.empty()) {
+    std::cerr << USAGE;
+    return 2;
+  }
+
   return 0;
 }
 
+static bool read_file(const std::string& path, std::string& contents)
+{
+  if (path == "-") {
+    contents.assign(std::istreambuf_iterator<char>(std::cin),
+                    std::istreambuf_iterator<char>());
+    return !std::cin.bad();
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+
+  contents.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+// `body` into `path`, or to stdout for `-`
+template<typename Writer>
+static bool write_output(const std::string& path, Writer body)
+{
+  if (path == "-") {
+    body(std::cout);
+    return static_cast<bool>(std::cout.flush());
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out)
+    return false;
+
+  body(out);
+  return static_cast<bool>(out.flush());
+}
+
+static bool write_trace(const std::string& path)
+{
+  trace::stop();
+
+  if (trace::dropped())
+    std::cerr << "yabrowser: trace full, dropped the last "
+              << trace::dropped() << " spans\n";
+
+  return write_output(path, [](std::ostream& out) {
+    trace::write_json(out, trace::events());
+  });
+}
+
+// SERVER
+static int serve(const Options& options)
+{
+  // taken by a thread of their own, which stops the server. Blocked before
+  // any other thread starts, so that every thread inherits the mask.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  ThreadPool pool(options.threads);
+  server::Renderer renderer(pool);
+  std::unique_ptr<server::RenderServer> render_server;
+
+  try {
+    render_server.reset(new server::RenderServer(renderer, options.serve));
+  } catch (const std::system_error& error) {
+    std::cerr << "yabrowser: can't listen on " << error.what() << "\n";
+    return 1;
+  }
+
+  std::thread stopper([&]() {
+    int signal;
+    sigwait(&signals, &signal);
+    render_server->stop();
+  });
+
+  if (!options.trace.empty())
+    trace::start();
+
+  render_server->serve();
+
+  // serve() only returns on its own when the socket broke
+  pthread_kill(stopper.native_handle(), SIGTERM);
+  stopper.join();
+
+  if (!options.quiet)
+    std::cerr << "yabrowser: served " << render_server->requests()
+              << " requests, " << render_server->failures()
+              << " failed, " << renderer.stylesheets.misses()
+              << " stylesheets compiled\n";
+
+  if (!options.trace.empty() && !write_trace(options.trace)) {
+    std::cerr << "yabrowser: can't write " << options.trace << "\n";
+    return 1;
+  }
+
+  return 0;
+}
+
+static void print_timings(const Timings& timings)
+{
+  double total = 0.0;
+
+  std::fprintf(stderr, "%-8s %12s %12s %12s   (%lu runs)\n", "stage",
+               "total ms", "mean ms", "min ms", timings.runs);
+
+  // stages that never ran, such as paint without an image, are left out
+  for (unsigned i = 0; i < STAGES; i++) {
+    if (!timings.samples[i])
+      continue;
+
+    total += timings.total[i];
+    std::fprintf(stderr, "%-8s %12.3f %12.3f %12.3f\n", STAGE_NAMES[i],
+                 timings.total[i], timings.total[i] / timings.samples[i],
+                 timings.min[i]);
+  }
+
+  std::fprintf(stderr, "%-8s %12.3f %12.3f\n", "all", total,
+               total / timings.runs);
+}
+
+// RENDERING
+// throws what the engine throws on a document it can't render
+static int render(const Options& options, const std::string& html,
+                  const std::string& css)
+{
+  Timings timings;
+  ThreadPool pool(options.threads);
+  std::unique_ptr<TileGrid> tiles;
+  std::unique_ptr<LayoutTree> tree;
+  std::unique_ptr<BinaryStylesheetCache> css_cache;
+  const Dimensions viewport(Rect(0.0, 0.0, options.width, options.height));
+
+  if (!options.ppm.empty())
+    tiles.reset(new TileGrid(options.width, options.height));
+
+  if (!options.css_cache.empty())
+    css_cache.reset(new BinaryStylesheetCache(options.css_cache));
+
+  if (!options.trace.empty())
+    trace::start();
+
+  for (unsigned long run = 0; run < options.repeat; run++) {
+    yahtml::HTMLDriver html_driver;
+    ComplexStylesheet stylesheet;
+    StyledChild styled;
+
+    {
+      StageTimer timer(timings, STAGE_PARSE);
+      TRACE_SPAN("render", STAGE_NAMES[STAGE_PARSE]);
+
+      const int css_result = css_cache ? css_cache->load(css, stylesheet)
+                                       : stylesheet.parse_source(css);
+
+      if (html_driver.parse_source(html) || css_result) {
+        std::cerr << "yabrowser: parse error\n";
+        return 1;
+      }
+    }
+
+    {
+      StageTimer timer(timings, STAGE_STYLE);
+      TRACE_SPAN("render", STAGE_NAMES[STAGE_STYLE]);
+
+      RuleIndex index(stylesheet);
+      index.user_agent_styles = options.user_agent_styles;
+      StyleSharingCache cache(index);
+
+      if (options.threads)
+        styled = std::make_shared<StyledNode>(html_driver.dom, cache, pool);
+      else
+        styled = std::make_shared<StyledNode>(html_driver.dom, cache);
+    }
+
+    {
+      StageTimer timer(timings, STAGE_LAYOUT);
+      TRACE_SPAN("render", STAGE_NAMES[STAGE_LAYOUT]);
+
+      tree.reset(new LayoutTree(styled, viewport));
+      if (options.threads)
+        tree->calculate(pool);
+      else
+        tree->calculate();
+    }
+
+    if (tiles) {
+      StageTimer timer(timings, STAGE_PAINT);
+      TRACE_SPAN("render", STAGE_NAMES[STAGE_PAINT]);
+      TileStats stats;
+
+      // every run paints from scratch, as a first frame would
+      tiles->invalidate();
+      tiles->paint(build_display_list(*tree), pool, stats);
+    }
+
+    timings.runs++;
+  }
+
+  if (!options.trace.empty() && !write_trace(options.trace)) {
+    std::cerr << "yabrowser: can't write " << options.trace << "\n";
+    return 1;
+  }
+
+  if (!options.json.empty() &&
+      !write_output(options.json,
+                    [&](std::ostream& out) { write_json(out, *tree); })) {
+    std::cerr << "yabrowser: can't write " << options.json << "\n";
+    return 1;
+  }
+
+  if (!options.ppm.empty() &&
+      !write_output(options.ppm, [&](std::ostream& out) {
+        write_ppm(out, tiles->canvas);
+      })) {
+    std::cerr << "yabrowser: can't write " << options.ppm << "\n";
+    return 1;
+  }
+
+  if (!options.quiet)
+    print_timings(timings);
+
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  std::string html;
+  std::string css;
+
+  if (int status = parse_options(argc, argv, options))
+    return status < 0 ? 0 : status;
+
+  if (!options.serve.empty())
+    return serve(options);
+
+  if (!read_file(options.page, html)) {
+    std::cerr << "yabrowser: can't read " << options.page << "\n";
+    return 1;
+  }
+
+  // the stylesheets cascade in the order they were given
+  for (const auto& path : options.stylesheets) {
+    std::string source;
+
+    if (!read_file(path, source)) {
+      std::cerr << "yabrowser: can't read " << path << "\n";
+      return 1;
+    }
+    css += source;
+    css += '\n';
+  }
+
+  // an unsupported document fails the run, as unreadable files do
+  try {
+    return render(options, html, css);
+  } catch (const std::exception& error) {
+    std::cerr << "yabrowser: " << error.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,219 @@
+// Compiles the user agent stylesheet into the C++ tables declared in
+// yabrowser/UserAgentStyles.hh. Run by the build:
+//
+//   uagen html.css UserAgentSheet.cc
+#include "yabrowser/Properties.hh"
+#include "yabrowser/Value.hh"
+#include "yacss/parser/driver.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace yabrowser::style;
+
+// the C++ names of what the generated code refers to
+static const std::map<std::string, std::string> KEYWORD_IDS = {
+#define YABROWSER_KEYWORD_ID(id, name) { name, "KEYWORD_" #id },
+  YABROWSER_KEYWORDS(YABROWSER_KEYWORD_ID)
+#undef YABROWSER_KEYWORD_ID
+};
+
+static const char* const PROPERTY_IDS[] = {
+#define YABROWSER_PROPERTY_ID(id, name) "PROPERTY_" #id,
+  YABROWSER_PROPERTIES(YABROWSER_PROPERTY_ID)
+#undef YABROWSER_PROPERTY_ID
+};
+
+// declarations of a tag, with their values as C++ expressions
+typedef std::vector<std::pair<PropertyId, std::string>> Block;
+
+static void fail(const std::string& message)
+{
+  std::cerr << "uagen: " << message << "\n";
+  std::exit(1);
+}
+
+static std::string strip_comments(const std::string& source)
+{
+  std::string stripped;
+  size_t pos = 0;
+
+  while (pos < source.size()) {
+    const size_t start = source.find("/*", pos);
+
+    stripped.append(source, pos, start - pos);
+    if (start == std::string::npos)
+      break;
+
+    const size_t end = source.find("*/", start + 2);
+    if (end == std::string::npos)
+      fail("unterminated comment");
+
+    // comments separate tokens
+    stripped += ' ';
+    pos = end + 2;
+  }
+
+  return stripped;
+}
+
+// the C++ expression of a value, as Value would hold it
+static std::string value_expression(const std::string& property,
+                                    const yacss::CSSBaseValue& value)
+{
+  std::ostringstream out;
+
+  if (value.type == yacss::ValueType::Keyword) {
+    const std::string& keyword = value.get<yacss::KeywordValue>().val;
+    const auto it = KEYWORD_IDS.find(keyword);
+
+    // any other keyword would have to be interned at startup
+    if (it == KEYWORD_IDS.end())
+      fail(property + ": `" + keyword +
+           "` is not in YABROWSER_KEYWORDS (Value.hh)");
+
+    out << "Value::from_keyword(" << it->second << ")";
+  } else if (value.type == yacss::ValueType::Length) {
+    const yacss::LengthValue& length = value.get<yacss::LengthValue>();
+
+    if (length.unit != yacss::UNIT_PX)
+      fail(property + ": only px lengths are supported");
+
+    out.precision(9);
+    out << "Value::from_length(" << length.val << ")";
+  } else {
+    fail(property + ": only keywords and lengths are supported");
+  }
+
+  return out.str();
+}
+
+// as a later rule would: a shorthand also overrides the longhands it sets
+static void declare(Block& block, PropertyId id, const std::string& value)
+{
+  block.erase(
+      std::remove_if(block.begin(), block.end(),
+                     [id](const Block::value_type& decl) {
+                       const PropertyId* fallback =
+                           property_fallbacks(decl.first);
+
+                       while (*fallback != PROPERTY_UNKNOWN &&
+                              *fallback != id)
+                         fallback++;
+                       return *fallback == id;
+                     }),
+      block.end());
+
+  for (auto& decl : block) {
+    if (decl.first == id) {
+      decl.second = value;
+      return;
+    }
+  }
+
+  block.emplace_back(id, value);
+}
+
+static std::string string_literal(const std::string& str)
+{
+  std::string literal = "  \"";
+
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      literal += '\\';
+
+    if (c == '\n')
+      literal += "\\n\"\n  \"";
+    else
+      literal += c;
+  }
+
+  return literal + "\"";
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3)
+    fail("usage: uagen html.css UserAgentSheet.cc");
+
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in)
+    fail(std::string("can't read ") + argv[1]);
+
+  const std::string source((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  yacss::CSSDriver driver;
+
+  if (driver.parse_source(strip_comments(source)))
+    fail(std::string("can't parse ") + argv[1]);
+
+  // every selector being a type selector, the specificities are all the
+  // same: the cascade is source order
+  std::map<std::string, Block> blocks;
+
+  for (const auto& rule : driver.stylesheet.rules) {
+    for (const auto& selector : rule->selectors) {
+      if (!selector.id.empty() || !selector.classes.empty() ||
+          selector.tag.empty() || selector.tag == "*")
+        fail("only type selectors are supported");
+
+      Block& block = blocks[selector.tag];
+
+      for (const auto& decl : rule->declarations) {
+        const PropertyId id = property_id(decl.first);
+
+        if (id == PROPERTY_UNKNOWN)
+          fail("unknown property " + decl.first);
+        declare(block, id, value_expression(decl.first, decl.second));
+      }
+    }
+  }
+
+  std::ostringstream out;
+  std::ostringstream rules;
+  unsigned first = 0;
+
+  // the directory is left out, so that builds are reproducible
+  const std::string path = argv[1];
+  const std::string name = path.substr(path.find_last_of('/') + 1);
+
+  out << "// generated by uagen from " << name << ", do not edit\n"
+      << "#include \"yabrowser/UserAgentStyles.hh\"\n\n"
+      << "namespace yabrowser { namespace style {\n\n"
+      << "const UADeclaration UA_DECLARATIONS[] = {\n";
+
+  for (auto& tag : blocks) {
+    Block& block = tag.second;
+
+    std::sort(block.begin(), block.end());
+    for (const auto& decl : block)
+      out << "  { " << PROPERTY_IDS[decl.first] << ", " << decl.second
+          << " },\n";
+
+    rules << "  { \"" << tag.first << "\", " << first << ", " << block.size()
+          << " },\n";
+    first += block.size();
+  }
+
+  out << "};\n\n"
+      << "const UARule UA_RULES[] = {\n"
+      << rules.str() << "};\n\n"
+      << "const unsigned UA_RULE_COUNT = " << blocks.size() << ";\n\n"
+      << "const char UA_STYLESHEET_SOURCE[] =\n"
+      << string_literal(source) << ";\n\n"
+      << "}}; // ! ns yabrowser style\n";
+
+  std::ofstream generated(argv[2], std::ios::binary);
+  if (!(generated << out.str()) || !generated.flush())
+    fail(std::string("can't write ") + argv[2]);
+
+  return 0;
+}
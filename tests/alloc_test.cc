@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "yabrowser/Layout.hh"
+#include "yacss/parser/driver.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+
+// every allocation of the process goes through here
+static std::atomic<unsigned long> g_allocations (0);
+
+// kept out of line: gcc warns about free() on memory from `new` otherwise
+#if defined(__GNUC__)
+#define ALLOC_TEST_NOINLINE __attribute__((noinline))
+#else
+#define ALLOC_TEST_NOINLINE
+#endif
+
+ALLOC_TEST_NOINLINE void* operator new (std::size_t size)
+{
+  g_allocations++;
+
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+ALLOC_TEST_NOINLINE void operator delete (void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+struct LayoutFixture
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+  std::unique_ptr<LayoutTree> tree;
+
+  LayoutFixture (const char* html, const char* css)
+  {
+    htmldriver.parse_source(html);
+    cssdriver.parse_source(css);
+
+    tree.reset(new LayoutTree(
+        std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+        Dimensions(Rect(0.0, 0.0, 800.0, 600.0))));
+  }
+};
+
+static const char* HTML_SOURCE = "<body>"
+                                   "<h1>Title</h1>"
+                                   "<div class=\"box\">"
+                                     "<p>some text to break in lines</p>"
+                                     "<p>and some more</p>"
+                                   "</div>"
+                                 "</body>";
+
+static const char* CSS_SOURCE = "body, h1, div, p { display: block; }"
+                                "body { margin: 8px; font-size: 16px; }"
+                                "h1 { font-size: 32px; font-weight: bold;"
+                                "     margin: 10px auto; }"
+                                ".box { width: 300px; margin: auto;"
+                                "       padding: 4px; border: 1px; }"
+                                "p { line-height: 20px; text-align: center; }";
+
+TEST(Allocations, LayoutOfABuiltTreeAllocatesNothing)
+{
+  LayoutFixture fixture (HTML_SOURCE, CSS_SOURCE);
+  LayoutTree& tree = *fixture.tree;
+
+  // the first layout sizes the line buffers and fills the width cache
+  tree.calculate();
+  const float height = tree.dimensions(tree.root()).content.height;
+
+  const unsigned long before = g_allocations;
+  tree.calculate();
+  const unsigned long allocations = g_allocations - before;
+
+  EXPECT_EQ(allocations, 0);
+  EXPECT_EQ(tree.dimensions(tree.root()).content.height, height);
+}
+
+TEST(Allocations, ComputedStylesAreReadInPlace)
+{
+  LayoutFixture fixture (HTML_SOURCE, CSS_SOURCE);
+  LayoutTree& tree = *fixture.tree;
+
+  tree.calculate();
+
+  const unsigned long before = g_allocations;
+  for (unsigned i = 0; i < 10; i++)
+    tree.calculate_block_width(tree.geometry, 0);
+
+  EXPECT_EQ(g_allocations - before, 0);
+}
@@ -0,0 +1,260 @@
+#include "gtest/gtest.h"
+#include "yabrowser/BinaryStylesheet.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace yabrowser::style;
+
+static const char* CSS_SOURCE =
+    "* { display: block }"
+    "h1 { margin: auto; width: 10px }"
+    "nav > ul li.item.big a, #main p { padding: 2em }"
+    "div#main.header { color: red; height: 0px }"
+    "section .header > h2 { font-weight: bold }";
+
+static const SourceKey KEY = source_key(CSS_SOURCE);
+
+static void expect_same_compound (const yacss::Selector& a,
+                                  const yacss::Selector& b)
+{
+  EXPECT_EQ(a.tag, b.tag);
+  EXPECT_EQ(a.id, b.id);
+  EXPECT_EQ(a.classes, b.classes);
+  EXPECT_EQ(a.specificity, b.specificity);
+}
+
+static void expect_same_stylesheet (const ComplexStylesheet& a,
+                                    const ComplexStylesheet& b)
+{
+  EXPECT_EQ(a.result, b.result);
+  ASSERT_EQ(a.stylesheet.rules.size(), b.stylesheet.rules.size());
+  ASSERT_EQ(a.selectors.size(), b.selectors.size());
+
+  for (size_t i = 0; i < a.selectors.size(); i++) {
+    const yacss::Rule& rule_a = *a.stylesheet.rules[i];
+    const yacss::Rule& rule_b = *b.stylesheet.rules[i];
+
+    EXPECT_TRUE(rule_a.declarations == rule_b.declarations) << i;
+    ASSERT_EQ(rule_a.selectors.size(), rule_b.selectors.size());
+    for (size_t j = 0; j < rule_a.selectors.size(); j++)
+      expect_same_compound(rule_a.selectors[j], rule_b.selectors[j]);
+
+    ASSERT_EQ(a.selectors[i].size(), b.selectors[i].size());
+    for (size_t j = 0; j < a.selectors[i].size(); j++) {
+      const ComplexSelector& sel_a = a.selectors[i][j];
+      const ComplexSelector& sel_b = b.selectors[i][j];
+
+      expect_same_compound(sel_a.subject, sel_b.subject);
+      EXPECT_EQ(sel_a.specificity, sel_b.specificity);
+      EXPECT_EQ(sel_a.ancestor_hashes, sel_b.ancestor_hashes);
+      ASSERT_EQ(sel_a.ancestors.size(), sel_b.ancestors.size());
+      for (size_t k = 0; k < sel_a.ancestors.size(); k++) {
+        EXPECT_EQ(sel_a.ancestors[k].first, sel_b.ancestors[k].first);
+        expect_same_compound(sel_a.ancestors[k].second,
+                             sel_b.ancestors[k].second);
+      }
+    }
+  }
+}
+
+TEST(BinaryStylesheet, RoundTrip)
+{
+  ComplexStylesheet parsed;
+  ComplexStylesheet loaded;
+  std::string image;
+
+  ASSERT_EQ(0, parsed.parse_source(CSS_SOURCE));
+  ASSERT_TRUE(write_binary_stylesheet(image, parsed, KEY));
+
+  auto mapped = MappedStylesheet::view(image.data(), image.size(), KEY);
+  ASSERT_TRUE(mapped != nullptr);
+  EXPECT_EQ(5u, mapped->rule_count());
+  EXPECT_EQ(2u, mapped->rule(2).selector_count);
+
+  mapped->to_stylesheet(loaded);
+  expect_same_stylesheet(parsed, loaded);
+}
+
+// `image` in a buffer aligned as view() needs it, which a std::string's
+// data is not guaranteed to be: a misaligned buffer is refused as well
+struct AlignedImage
+{
+  std::vector<uint64_t> words;
+  size_t size;
+
+  explicit AlignedImage (const std::string& image)
+    : words((image.size() + 7) / 8), size(image.size())
+  {
+    std::memcpy(words.data(), image.data(), size);
+  }
+
+  inline char* data ()
+  {
+    return reinterpret_cast<char*>(words.data());
+  }
+
+  template<typename Record>
+  inline Record* records (binary::SectionId id)
+  {
+    const binary::Header* header =
+        reinterpret_cast<const binary::Header*>(data());
+
+    return reinterpret_cast<Record*>(data() +
+                                     header->sections[id].offset);
+  }
+
+  inline bool valid (const SourceKey& key = KEY)
+  {
+    return MappedStylesheet::view(data(), size, key) != nullptr;
+  }
+};
+
+TEST(BinaryStylesheet, RejectsStaleOrCorruptImages)
+{
+  ComplexStylesheet parsed;
+  std::string image;
+
+  ASSERT_EQ(0, parsed.parse_source(CSS_SOURCE));
+  ASSERT_TRUE(write_binary_stylesheet(image, parsed, KEY));
+
+  AlignedImage good (image);
+  ASSERT_TRUE(good.valid());
+
+  // written for another source, even one that collides with it
+  SourceKey other = KEY;
+  other.hash++;
+  EXPECT_FALSE(good.valid(other));
+  other = KEY;
+  other.size++;
+  EXPECT_FALSE(good.valid(other));
+  other = KEY;
+  other.check++;
+  EXPECT_FALSE(good.valid(other));
+
+  // truncated
+  EXPECT_EQ(nullptr, MappedStylesheet::view(good.data(), good.size - 4, KEY));
+  EXPECT_EQ(nullptr, MappedStylesheet::view(good.data(), 16, KEY));
+
+  // a rule pointing past the selectors
+  AlignedImage corrupt (image);
+  corrupt.records<binary::Rule>(binary::SECTION_RULES)->selector_count = 1000;
+  EXPECT_FALSE(corrupt.valid());
+
+  // a length in a unit yacss does not have
+  corrupt = AlignedImage(image);
+  binary::Declaration* decls =
+      corrupt.records<binary::Declaration>(binary::SECTION_DECLARATIONS);
+  while (decls->type != static_cast<uint32_t>(yacss::ValueType::Length))
+    decls++;
+  decls->unit = yacss::UNIT_EM + 1;
+  EXPECT_FALSE(corrupt.valid());
+
+  // not a binary stylesheet
+  corrupt = AlignedImage(image);
+  corrupt.data()[0] = 'X';
+  EXPECT_FALSE(corrupt.valid());
+
+  // none of the above was refused for being misaligned
+  EXPECT_TRUE(good.valid());
+  corrupt = AlignedImage(image);
+  EXPECT_TRUE(corrupt.valid());
+}
+
+TEST(BinaryStylesheet, RefusesFailedParses)
+{
+  ComplexStylesheet parsed;
+  std::string image = "untouched";
+
+  parsed.parse_source("div { width: 1px");
+  ASSERT_NE(0, parsed.result);
+  EXPECT_FALSE(write_binary_stylesheet(image, parsed, KEY));
+  EXPECT_EQ("untouched", image);
+}
+
+TEST(BinaryStylesheetCache, ParsesOnce)
+{
+  BinaryStylesheetCache cache (testing::TempDir());
+  const uint64_t hash = stylesheet_hash(CSS_SOURCE);
+  ComplexStylesheet parsed;
+  ComplexStylesheet first;
+  ComplexStylesheet second;
+
+  std::remove(cache.path(hash).c_str());
+  ASSERT_EQ(0, parsed.parse_source(CSS_SOURCE));
+
+  EXPECT_EQ(0, cache.load(CSS_SOURCE, first));
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+
+  // as another process would
+  BinaryStylesheetCache other (testing::TempDir());
+  EXPECT_EQ(0, other.load(CSS_SOURCE, second));
+  EXPECT_EQ(1u, other.hits());
+  EXPECT_EQ(0u, other.misses());
+
+  expect_same_stylesheet(parsed, first);
+  expect_same_stylesheet(parsed, second);
+
+  auto mapped = MappedStylesheet::open(cache.path(hash), KEY);
+  ASSERT_TRUE(mapped != nullptr);
+  EXPECT_EQ(parsed.stylesheet.rules.size(), mapped->rule_count());
+  EXPECT_EQ(nullptr, MappedStylesheet::open(cache.path(hash),
+                                            source_key("* { }")));
+
+  std::remove(cache.path(hash).c_str());
+}
+
+TEST(BinaryStylesheetCache, ReplacesCorruptFiles)
+{
+  BinaryStylesheetCache cache (testing::TempDir());
+  const uint64_t hash = stylesheet_hash(CSS_SOURCE);
+  ComplexStylesheet parsed;
+  ComplexStylesheet loaded;
+
+  {
+    std::ofstream out (cache.path(hash), std::ios::binary);
+    out << "YABCSS but not quite";
+  }
+
+  ASSERT_EQ(0, parsed.parse_source(CSS_SOURCE));
+  EXPECT_EQ(0, cache.load(CSS_SOURCE, loaded));
+  EXPECT_EQ(1u, cache.misses());
+  expect_same_stylesheet(parsed, loaded);
+
+  EXPECT_EQ(0, cache.load(CSS_SOURCE, loaded));
+  EXPECT_EQ(1u, cache.hits());
+  expect_same_stylesheet(parsed, loaded);
+
+  std::remove(cache.path(hash).c_str());
+}
+
+TEST(BinaryStylesheetCache, IgnoresFilesOfCollidingSources)
+{
+  BinaryStylesheetCache cache (testing::TempDir());
+  const std::string other_source = "p { color: blue }";
+  ComplexStylesheet parsed;
+  ComplexStylesheet other;
+  ComplexStylesheet loaded;
+  std::string image;
+
+  // as if `other_source` had the same FNV-1a as CSS_SOURCE
+  SourceKey forged = source_key(other_source);
+  forged.hash = KEY.hash;
+  ASSERT_EQ(0, other.parse_source(other_source));
+  ASSERT_TRUE(write_binary_stylesheet(image, other, forged));
+  {
+    std::ofstream out (cache.path(KEY.hash), std::ios::binary);
+    out << image;
+  }
+
+  ASSERT_EQ(0, parsed.parse_source(CSS_SOURCE));
+  EXPECT_EQ(0, cache.load(CSS_SOURCE, loaded));
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(1u, cache.misses());
+  expect_same_stylesheet(parsed, loaded);
+
+  std::remove(cache.path(KEY.hash).c_str());
+}
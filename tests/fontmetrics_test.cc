@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "yabrowser/FontMetrics.hh"
+#include "yabrowser/ThreadPool.hh"
+
+#include <atomic>
+#include <string>
+
+using namespace yabrowser;
+using namespace yabrowser::layout;
+
+// counts what reaches the metrics past the cache
+class CountingMetrics : public FixedAdvanceMetrics
+{
+public:
+  mutable std::atomic<unsigned> measured;
+
+  CountingMetrics() : measured(0) {}
+
+  float text_width(const FontDescriptor& font, const char* text,
+                   size_t length) const
+  {
+    measured++;
+    return FixedAdvanceMetrics::text_width(font, text, length);
+  }
+};
+
+TEST(FixedAdvanceMetrics, AdvancesByTheFontSize)
+{
+  FixedAdvanceMetrics metrics(0.5);
+
+  const FontDescriptor small(style::KEYWORD_SERIF, 10.0);
+  const FontDescriptor medium(style::KEYWORD_SERIF, 16.0);
+
+  EXPECT_EQ(metrics.text_width(small, "abcd", 4), 20);
+  EXPECT_EQ(metrics.text_width(medium, "abcd", 2), 16);
+}
+
+TEST(TextWidthCache, HitsAndMisses)
+{
+  TextWidthCache cache(64, 4);
+  CountingMetrics metrics;
+  const FontDescriptor serif(style::KEYWORD_SERIF, 10.0);
+  const FontDescriptor bold(style::KEYWORD_SERIF, 10.0, 700);
+
+  EXPECT_EQ(cache.width(metrics, serif, "the", 3), 15);
+  EXPECT_EQ(cache.width(metrics, serif, "the", 3), 15);
+  EXPECT_EQ(cache.width(metrics, serif, "then", 3), 15);
+  EXPECT_EQ(metrics.measured, 1);
+
+  // same text in another font, or with other metrics
+  CountingMetrics other;
+  cache.width(metrics, bold, "the", 3);
+  cache.width(other, serif, "the", 3);
+  EXPECT_EQ(metrics.measured, 2);
+  EXPECT_EQ(other.measured, 1);
+
+  const TextCacheStats stats = cache.stats();
+  EXPECT_EQ(stats.hits, 2);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_DOUBLE_EQ(stats.hit_rate(), 0.4);
+  EXPECT_EQ(cache.size(), 3);
+
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_EQ(cache.stats().hits, 0);
+}
+
+TEST(TextWidthCache, StaysWithinItsCapacity)
+{
+  TextWidthCache cache(32, 1);
+  FixedAdvanceMetrics metrics;
+  const FontDescriptor font;
+
+  for (unsigned i = 0; i < 1000; i++) {
+    const std::string word = "w" + std::to_string(i);
+    EXPECT_EQ(cache.width(metrics, font, word.data(), word.size()),
+              word.size() * 8);
+  }
+
+  EXPECT_EQ(cache.capacity(), 32);
+  EXPECT_EQ(cache.size(), 32);
+  EXPECT_EQ(cache.stats().evictions, 1000 - 32);
+}
+
+TEST(TextWidthCache, FrequentWordsSurviveEviction)
+{
+  TextWidthCache cache(16, 1);
+  CountingMetrics metrics;
+  const FontDescriptor font;
+
+  // "the" is hit between every new word, so the clock always spares it
+  for (unsigned i = 0; i < 200; i++) {
+    const std::string word = "w" + std::to_string(i);
+
+    cache.width(metrics, font, "the", 3);
+    cache.width(metrics, font, word.data(), word.size());
+  }
+
+  EXPECT_EQ(metrics.measured, 201);
+  EXPECT_EQ(cache.stats().hits, 199);
+}
+
+TEST(TextWidthCache, ConcurrentMeasurements)
+{
+  TextWidthCache cache(256, 8);
+  CountingMetrics metrics;
+  const FontDescriptor font;
+  ThreadPool pool(4);
+  TaskGroup group(pool);
+  std::atomic<unsigned> wrong(0);
+
+  for (unsigned task = 0; task < 16; task++) {
+    group.run([&cache, &metrics, &font, &wrong, task]() {
+      for (unsigned i = 0; i < 2000; i++) {
+        const std::string word = "w" + std::to_string((i * 7 + task) % 500);
+
+        if (cache.width(metrics, font, word.data(), word.size()) !=
+            word.size() * 8)
+          wrong++;
+      }
+    });
+  }
+
+  group.wait();
+
+  const TextCacheStats stats = cache.stats();
+  EXPECT_EQ(wrong, 0);
+  EXPECT_EQ(stats.hits + stats.misses, 16 * 2000);
+  EXPECT_EQ(stats.misses, metrics.measured);
+  EXPECT_LE(cache.size(), cache.capacity());
+}
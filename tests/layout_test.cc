@@ -1,8 +1,14 @@
 #include "gtest/gtest.h"
 #include "yabrowser/Layout.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/StyleSharingCache.hh"
+#include "yabrowser/ThreadPool.hh"
 #include "yacss/parser/driver.hh"
 #include "yahtml/parser/driver.hh"
 
+#include <sstream>
+#include <stdexcept>
+
 using namespace yabrowser;
 using namespace yabrowser::style;
 using namespace yacss;
@@ -26,12 +32,13 @@ TEST(Layout, SingleBlockElement)
 
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox layout(
+  LayoutTree layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+  const BoxRange root_children = layout.children(layout.root());
 
-  EXPECT_EQ(layout.type, BoxType::BlockNode);
-  EXPECT_EQ(layout.children.size(), 1);
-  EXPECT_EQ(layout.children.at(0)->type, BoxType::InlineNode);
+  EXPECT_EQ(layout.root().type, BoxType::BlockNode);
+  EXPECT_EQ(root_children.size(), 1);
+  EXPECT_EQ(root_children.at(0).type, BoxType::InlineNode);
 }
 
 TEST(Layout, BlockWithInlineList)
@@ -58,24 +65,25 @@ TEST(Layout, BlockWithInlineList)
 
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox ul_layout(
+  LayoutTree ul_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+  const BoxRange root_children = ul_layout.children(ul_layout.root());
 
-  EXPECT_EQ(ul_layout.type, BoxType::BlockNode);
-  EXPECT_EQ(ul_layout.children.size(), 2);
-  EXPECT_EQ(ul_layout.children.at(0)->type, BoxType::InlineNode);
-  EXPECT_EQ(ul_layout.children.at(1)->type, BoxType::InlineNode);
+  EXPECT_EQ(ul_layout.root().type, BoxType::BlockNode);
+  EXPECT_EQ(root_children.size(), 2);
+  EXPECT_EQ(root_children.at(0).type, BoxType::InlineNode);
+  EXPECT_EQ(root_children.at(1).type, BoxType::InlineNode);
 
-  LayoutBoxPtr& li0_layout = ul_layout.children.at(0);
-  LayoutBoxPtr& li1_layout = ul_layout.children.at(1);
+  const LayoutBox& li0_layout = root_children.at(0);
+  const LayoutBox& li1_layout = root_children.at(1);
 
-  EXPECT_EQ(li0_layout->type, BoxType::InlineNode);
-  EXPECT_EQ(li1_layout->type, BoxType::InlineNode);
-  EXPECT_EQ(li0_layout->children.size(), 1);
-  EXPECT_EQ(li1_layout->children.size(), 1);
+  EXPECT_EQ(li0_layout.type, BoxType::InlineNode);
+  EXPECT_EQ(li1_layout.type, BoxType::InlineNode);
+  EXPECT_EQ(ul_layout.children(li0_layout).size(), 1);
+  EXPECT_EQ(ul_layout.children(li1_layout).size(), 1);
 
-  EXPECT_EQ(li0_layout->children.at(0)->type, BoxType::InlineNode);
-  EXPECT_EQ(li1_layout->children.at(0)->type, BoxType::InlineNode);
+  EXPECT_EQ(ul_layout.children(li0_layout).at(0).type, BoxType::InlineNode);
+  EXPECT_EQ(ul_layout.children(li1_layout).at(0).type, BoxType::InlineNode);
 }
 
 TEST(Layout, SimpleAnonymous)
@@ -99,24 +107,25 @@ TEST(Layout, SimpleAnonymous)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+  const BoxRange root_children = body_layout.children(body_layout.root());
 
-  ASSERT_EQ(body_layout.type, BoxType::BlockNode);
-  ASSERT_EQ(body_layout.children.size(), 2);
+  ASSERT_EQ(body_layout.root().type, BoxType::BlockNode);
+  ASSERT_EQ(root_children.size(), 2);
 
-  LayoutBoxPtr& span_layout = body_layout.children.at(0);
-  LayoutBoxPtr& h1_layout = body_layout.children.at(1);
+  const LayoutBox& span_layout = root_children.at(0);
+  const LayoutBox& h1_layout = root_children.at(1);
 
   // span
-  EXPECT_EQ(span_layout->type, BoxType::AnonymousBlock);
-  EXPECT_EQ(span_layout->children.size(), 1);
-  EXPECT_EQ(span_layout->children.at(0)->type, BoxType::InlineNode);
+  EXPECT_EQ(span_layout.type, BoxType::AnonymousBlock);
+  EXPECT_EQ(body_layout.children(span_layout).size(), 1);
+  EXPECT_EQ(body_layout.children(span_layout).at(0).type, BoxType::InlineNode);
 
   // h1
-  EXPECT_EQ(h1_layout->type, BoxType::BlockNode);
-  EXPECT_EQ(h1_layout->children.size(), 1);
-  EXPECT_EQ(h1_layout->children.at(0)->type, BoxType::InlineNode);
+  EXPECT_EQ(h1_layout.type, BoxType::BlockNode);
+  EXPECT_EQ(body_layout.children(h1_layout).size(), 1);
+  EXPECT_EQ(body_layout.children(h1_layout).at(0).type, BoxType::InlineNode);
 }
 
 TEST(Layout, AnonymousWithListInside)
@@ -137,27 +146,28 @@ TEST(Layout, AnonymousWithListInside)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+  const BoxRange root_children = body_layout.children(body_layout.root());
 
   // body will have 2 blocks and 1 anonymous
-  ASSERT_EQ(body_layout.children.size(), 3);
-  LayoutBoxPtr& h1_layout = body_layout.children.at(0);
-  LayoutBoxPtr& h2_layout = body_layout.children.at(1);
-  LayoutBoxPtr& text_layout = body_layout.children.at(2);
-
-  EXPECT_EQ(h1_layout->type, BoxType::BlockNode);
-  EXPECT_EQ(h2_layout->type, BoxType::BlockNode);
-  EXPECT_EQ(text_layout->type, BoxType::AnonymousBlock);
-
-  ASSERT_EQ(text_layout->children.size(), 3);
-  LayoutBoxPtr& txt1_layout = text_layout->children.at(0);
-  LayoutBoxPtr& strong_layout = text_layout->children.at(1);
-  LayoutBoxPtr& txt2_layout = text_layout->children.at(2);
-
-  EXPECT_EQ(txt1_layout->type, BoxType::InlineNode);
-  EXPECT_EQ(strong_layout->type, BoxType::InlineNode);
-  EXPECT_EQ(txt2_layout->type, BoxType::InlineNode);
+  ASSERT_EQ(root_children.size(), 3);
+  const LayoutBox& h1_layout = root_children.at(0);
+  const LayoutBox& h2_layout = root_children.at(1);
+  const LayoutBox& text_layout = root_children.at(2);
+
+  EXPECT_EQ(h1_layout.type, BoxType::BlockNode);
+  EXPECT_EQ(h2_layout.type, BoxType::BlockNode);
+  EXPECT_EQ(text_layout.type, BoxType::AnonymousBlock);
+
+  ASSERT_EQ(body_layout.children(text_layout).size(), 3);
+  const LayoutBox& txt1_layout = body_layout.children(text_layout).at(0);
+  const LayoutBox& strong_layout = body_layout.children(text_layout).at(1);
+  const LayoutBox& txt2_layout = body_layout.children(text_layout).at(2);
+
+  EXPECT_EQ(txt1_layout.type, BoxType::InlineNode);
+  EXPECT_EQ(strong_layout.type, BoxType::InlineNode);
+  EXPECT_EQ(txt2_layout.type, BoxType::InlineNode);
 }
 
 TEST(Layout, DisplayNone)
@@ -182,18 +192,19 @@ TEST(Layout, DisplayNone)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox html_layout(
+  LayoutTree html_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+  const BoxRange root_children = html_layout.children(html_layout.root());
 
   // DOM structure contains head elem
   ASSERT_EQ(htmldriver.dom->children.size(), 2);
 
   // head will get out of the layouttree
-  ASSERT_EQ(html_layout.children.size(), 1);
-  LayoutBoxPtr& body_layout = html_layout.children.at(0);
-  EXPECT_EQ(body_layout->type, BoxType::BlockNode);
-  ASSERT_EQ(body_layout->children.size(), 1);
-  EXPECT_EQ(body_layout->children.at(0)->type, BoxType::InlineNode);
+  ASSERT_EQ(root_children.size(), 1);
+  const LayoutBox& body_layout = root_children.at(0);
+  EXPECT_EQ(body_layout.type, BoxType::BlockNode);
+  ASSERT_EQ(html_layout.children(body_layout).size(), 1);
+  EXPECT_EQ(html_layout.children(body_layout).at(0).type, BoxType::InlineNode);
 }
 
 TEST(BlockLayout, SingleFlatBodyWidth)
@@ -212,14 +223,15 @@ TEST(BlockLayout, SingleFlatBodyWidth)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
       Dimensions(Rect(0.0, 0.0, 200.0, 200.0)));
   body_layout.calculate();
+  const Dimensions& root_dims = body_layout.dimensions(body_layout.root());
 
-  EXPECT_EQ(body_layout.dimensions.content.width, 200);
-  EXPECT_EQ(body_layout.dimensions.content.x, 0.0);
-  EXPECT_EQ(body_layout.dimensions.content.y, 0.0);
+  EXPECT_EQ(root_dims.content.width, 200);
+  EXPECT_EQ(root_dims.content.x, 0.0);
+  EXPECT_EQ(root_dims.content.y, 0.0);
 }
 
 TEST(BlockLayout, SingleFlatBodyFixedWidthAutoMargin)
@@ -240,16 +252,17 @@ TEST(BlockLayout, SingleFlatBodyFixedWidthAutoMargin)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
       Dimensions(Rect(0.0, 0.0, 200.0, 0.0)));
   body_layout.calculate();
+  const Dimensions& root_dims = body_layout.dimensions(body_layout.root());
 
-  EXPECT_EQ(body_layout.dimensions.content.width, 100);
-  EXPECT_EQ(body_layout.dimensions.margin.left, 50);
-  EXPECT_EQ(body_layout.dimensions.margin.right, 50);
-  EXPECT_EQ(body_layout.dimensions.content.x, 50);
-  EXPECT_EQ(body_layout.dimensions.content.y, 0);
+  EXPECT_EQ(root_dims.content.width, 100);
+  EXPECT_EQ(root_dims.margin.left, 50);
+  EXPECT_EQ(root_dims.margin.right, 50);
+  EXPECT_EQ(root_dims.content.x, 50);
+  EXPECT_EQ(root_dims.content.y, 0);
 }
 
 TEST(BlockLayout, SingleFlatBodyFixedWidthAutoMarginLeft)
@@ -270,14 +283,15 @@ TEST(BlockLayout, SingleFlatBodyFixedWidthAutoMarginLeft)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
       Dimensions(Rect(0.0, 0.0, 200.0, 0.0)));
   body_layout.calculate();
+  const Dimensions& root_dims = body_layout.dimensions(body_layout.root());
 
-  EXPECT_EQ(body_layout.dimensions.content.width, 100);
-  EXPECT_EQ(body_layout.dimensions.margin.left, 100);
-  EXPECT_EQ(body_layout.dimensions.margin.right, 0);
+  EXPECT_EQ(root_dims.content.width, 100);
+  EXPECT_EQ(root_dims.margin.left, 100);
+  EXPECT_EQ(root_dims.margin.right, 0);
 }
 
 TEST(BlockLayout, SingleFlatBodyOverflows)
@@ -297,14 +311,15 @@ TEST(BlockLayout, SingleFlatBodyOverflows)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
       Dimensions(Rect(0.0, 0.0, 200.0, 0.0)));
   body_layout.calculate();
+  const Dimensions& root_dims = body_layout.dimensions(body_layout.root());
 
-  EXPECT_EQ(body_layout.dimensions.content.width, 400);
-  EXPECT_EQ(body_layout.dimensions.margin.left, 0);
-  EXPECT_EQ(body_layout.dimensions.margin.right, -200);
+  EXPECT_EQ(root_dims.content.width, 400);
+  EXPECT_EQ(root_dims.margin.left, 0);
+  EXPECT_EQ(root_dims.margin.right, -200);
 }
 
 TEST(BlockLayout, FlatBodyChildrenFixedWidthAutoMargin)
@@ -330,36 +345,603 @@ TEST(BlockLayout, FlatBodyChildrenFixedWidthAutoMargin)
   cssdriver.parse_source(css_source);
   ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  LayoutBox body_layout(
+  LayoutTree body_layout(
       std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
       Dimensions(Rect(0.0, 0.0, 200.0, 200.0)));
+  const BoxRange root_children = body_layout.children(body_layout.root());
   body_layout.calculate();
+  const Dimensions& root_dims = body_layout.dimensions(body_layout.root());
+
+  EXPECT_EQ(root_dims.content.width, 100);
+  EXPECT_EQ(root_dims.margin.left, 0);
+  EXPECT_EQ(root_dims.margin.right, 90);
+  EXPECT_EQ(root_dims.content.x, 10);
+  EXPECT_EQ(root_dims.content.y, 10);
+  EXPECT_EQ(root_dims.padding.top, 10);
+
+  ASSERT_EQ(root_children.size(), 3);
+  const LayoutBox& h1_1 = root_children.at(0);
+  const LayoutBox& h1_2 = root_children.at(1);
+  const LayoutBox& h1_3 = root_children.at(2);
+
+  ASSERT_EQ(h1_1.styled_node->specified_values->size(), 2);
+  ASSERT_EQ(h1_1.styled_node->get_value("height")->kind, VALUE_LENGTH);
+  ASSERT_EQ(h1_1.styled_node->get_value("height")->length, 10.0);
+  EXPECT_EQ(body_layout.dimensions(h1_1).content.width, 100);
+  EXPECT_EQ(body_layout.dimensions(h1_1).content.height, 10);
+  EXPECT_EQ(body_layout.dimensions(h1_1).content.x, 10);
+  EXPECT_EQ(body_layout.dimensions(h1_1).content.y, 10);
+
+  EXPECT_EQ(body_layout.dimensions(h1_2).content.x, 10);
+  EXPECT_EQ(body_layout.dimensions(h1_2).content.y, 20);
+
+  EXPECT_EQ(body_layout.dimensions(h1_3).content.x, 10);
+  EXPECT_EQ(body_layout.dimensions(h1_3).content.y, 30);
+
+  EXPECT_EQ(root_dims.content.height, 30);
+}
+
+TEST(LayoutTree, SiblingsAreContiguous)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<div><p></p><p></p></div>"
+                            "<div><p></p></div>"
+                            "<span></span>"
+                            "</body>";
+
+  const char* css_source = "body, div, p { display: block; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet));
+
+  // body, 2 divs + anon, 3 p + span, 4 texts
+  ASSERT_EQ(tree.boxes.size(), 12);
+  ASSERT_EQ(tree.geometry.dimensions.size(), tree.boxes.size());
+
+  const LayoutBox& body = tree.root();
+  EXPECT_EQ(body.id, 0);
+  EXPECT_EQ(body.parent, NO_BOX);
+  EXPECT_EQ(body.first_child, 1);
+  EXPECT_EQ(body.child_count, 3);
+
+  const BoxRange body_children = tree.children(body);
+  EXPECT_EQ(body_children.at(0).type, BoxType::BlockNode);
+  EXPECT_EQ(body_children.at(1).type, BoxType::BlockNode);
+  EXPECT_EQ(body_children.at(2).type, BoxType::AnonymousBlock);
+  EXPECT_EQ(body_children.at(2).styled_node, nullptr);
+  EXPECT_THROW(body_children.at(3), std::out_of_range);
+
+  // breadth-first: the children of the first div come right after the
+  // children of body, followed by the ones of the second div
+  const BoxRange div1_children = tree.children(body_children.at(0));
+  const BoxRange div2_children = tree.children(body_children.at(1));
+  const BoxRange anon_children = tree.children(body_children.at(2));
+
+  EXPECT_EQ(div1_children.begin()->id, 4);
+  EXPECT_EQ(div1_children.size(), 2);
+  EXPECT_EQ(div2_children.begin(), div1_children.end());
+  EXPECT_EQ(div2_children.size(), 1);
+  EXPECT_EQ(anon_children.begin(), div2_children.end());
+  EXPECT_EQ(anon_children.size(), 1);
+
+  for (const auto& box : tree.boxes)
+    for (const auto& child : tree.children(box))
+      EXPECT_EQ(child.parent, box.id);
+}
+
+static void expect_same_geometry(const LayoutGeometry& lhs,
+                                 const LayoutGeometry& rhs)
+{
+  ASSERT_EQ(lhs.dimensions.size(), rhs.dimensions.size());
+
+  for (size_t i = 0; i < lhs.dimensions.size(); i++) {
+    const Dimensions& l = lhs.dimensions[i];
+    const Dimensions& r = rhs.dimensions[i];
+
+    EXPECT_EQ(l.content.x, r.content.x) << "box " << i;
+    EXPECT_EQ(l.content.y, r.content.y) << "box " << i;
+    EXPECT_EQ(l.content.width, r.content.width) << "box " << i;
+    EXPECT_EQ(l.content.height, r.content.height) << "box " << i;
+    EXPECT_EQ(l.margin_box().x, r.margin_box().x) << "box " << i;
+    EXPECT_EQ(l.margin_box().y, r.margin_box().y) << "box " << i;
+    EXPECT_EQ(l.margin_box().width, r.margin_box().width) << "box " << i;
+    EXPECT_EQ(l.margin_box().height, r.margin_box().height) << "box " << i;
+  }
+
+  ASSERT_EQ(lhs.inline_layouts.size(), rhs.inline_layouts.size());
+
+  for (size_t i = 0; i < lhs.inline_layouts.size(); i++) {
+    const InlineLayout& l = lhs.inline_layouts[i];
+    const InlineLayout& r = rhs.inline_layouts[i];
+
+    ASSERT_EQ(l.lines.size(), r.lines.size()) << "box " << l.container;
+    ASSERT_EQ(l.fragments.size(), r.fragments.size()) << "box " << l.container;
+
+    for (size_t j = 0; j < l.fragments.size(); j++) {
+      EXPECT_EQ(l.fragments[j].box, r.fragments[j].box);
+      EXPECT_EQ(l.fragments[j].rect.x, r.fragments[j].rect.x);
+      EXPECT_EQ(l.fragments[j].rect.y, r.fragments[j].rect.y);
+      EXPECT_EQ(l.fragments[j].rect.width, r.fragments[j].rect.width);
+    }
+  }
+}
+
+static void expect_same_geometry(const LayoutTree& lhs, const LayoutTree& rhs)
+{
+  expect_same_geometry(lhs.geometry, rhs.geometry);
+}
+
+TEST(BlockLayout, ParallelMatchesSequential)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  std::string html_source = "<body>";
+  for (unsigned i = 0; i < 40; i++) {
+    html_source += "<div class=\"d" + std::to_string(i % 3) + "\">";
+    for (unsigned j = 0; j < 10; j++)
+      html_source += "<p class=\"p" + std::to_string(j % 4) +
+                     "\"><span>lorem ipsum dolor sit amet</span></p>";
+    html_source += "</div>";
+  }
+  html_source += "</body>";
+
+  const char* css_source = "body, div, p { display: block; }"
+                           "body { width: 700.3px; padding-left: 3.1px; }"
+                           ".d0 { margin: auto; width: 333.3px; }"
+                           ".d1 { margin-top: 7.7px; padding: 1.3px; }"
+                           ".d2 { margin-left: 11.1px; border: 2px; }"
+                           ".p0 { height: 10.1px; }"
+                           ".p1 { height: 0.7px; margin-bottom: 3.3px; }"
+                           ".p2 { width: 1000px; }"
+                           ".p3 { padding-top: 1.9px; height: 1.1px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const StyledChild styled =
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet);
+  const Dimensions viewport(Rect(0.0, 0.0, 800.0, 600.0));
+
+  LayoutTree sequential(styled, viewport);
+  sequential.calculate();
+
+  for (unsigned threads : { 0, 1, 4 }) {
+    yabrowser::ThreadPool pool(threads);
+
+    // small threshold so that every div becomes a task
+    LayoutTree parallel(styled, viewport);
+    parallel.calculate(pool, 4);
+    expect_same_geometry(sequential, parallel);
+
+    // and laying out again gives the same results
+    parallel.calculate(pool, 4);
+    expect_same_geometry(sequential, parallel);
+  }
+
+  sequential.calculate();
+  LayoutTree fresh(styled, viewport);
+  fresh.calculate();
+  expect_same_geometry(sequential, fresh);
+}
+
+TEST(LayoutTree, LaysOutManyViewportsAtOnce)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  std::string html_source = "<body>";
+  for (unsigned i = 0; i < 20; i++)
+    html_source += "<div class=\"d" + std::to_string(i % 2) +
+                   "\"><p>lorem ipsum dolor sit amet, consectetur</p>"
+                   "<p><span>adipiscing</span> elit</p></div>";
+  html_source += "</body>";
+
+  const char* css_source = "body, div, p { display: block; }"
+                           ".d0 { margin: auto; width: 300px; padding: 3px; }"
+                           ".d1 { margin-left: 20px; border: 1px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const StyledChild styled =
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet);
+  const float widths[] = { 120.0, 320.0, 768.0, 1280.0 };
+
+  LayoutTree tree(styled);
+  const size_t box_count = tree.boxes.size();
+
+  for (unsigned threads : { 0, 1, 4 }) {
+    yabrowser::ThreadPool pool(threads);
+    std::vector<LayoutGeometry> viewports;
+
+    for (float width : widths)
+      viewports.push_back(
+          tree.new_geometry(Dimensions(Rect(0.0, 0.0, width, 600.0))));
+
+    tree.calculate_viewports(viewports, pool);
+
+    // the same as a tree of its own at every width
+    for (size_t i = 0; i < viewports.size(); i++) {
+      LayoutTree fresh(styled, Dimensions(Rect(0.0, 0.0, widths[i], 600.0)));
+      fresh.calculate();
+      expect_same_geometry(fresh.geometry, viewports[i]);
+    }
+
+    // and each can be taken to another width on its own
+    RelayoutStats stats;
+    tree.set_containing_width(viewports[0], widths[3]);
+    tree.relayout(viewports[0], stats);
+    expect_same_geometry(viewports[3], viewports[0]);
+  }
+
+  // laying out viewports leaves the boxes alone
+  EXPECT_EQ(tree.boxes.size(), box_count);
+  EXPECT_EQ(tree.dimensions(tree.root()).content.width, 0);
+}
+
+TEST(BlockLayout, IncrementalRelayout)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  std::string html_source = "<body>";
+  for (unsigned i = 0; i < 12; i++) {
+    html_source += "<div class=\"d" + std::to_string(i % 3) + "\">";
+    for (unsigned j = 0; j < 5; j++)
+      html_source += "<p class=\"p" + std::to_string(j % 4) +
+                     "\"><span>lorem ipsum dolor sit amet</span></p>";
+    html_source += "</div>";
+  }
+  html_source += "</body>";
+
+  const char* css_source = "body, div, p { display: block; }"
+                           "body { padding-left: 3.1px; }"
+                           ".d0 { margin: auto; width: 333.3px; }"
+                           ".d1 { margin-top: 7.7px; padding: 1.3px; }"
+                           ".d2 { margin-left: 11.1px; border: 2px; }"
+                           ".p0 { height: 10.1px; }"
+                           ".p1 { height: 0.7px; margin-bottom: 3.3px; }"
+                           ".p2 { width: 1000px; }"
+                           ".p3 { padding-top: 1.9px; height: 1.1px; }"
+                           ".tall { height: 99.9px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
 
-  EXPECT_EQ(body_layout.dimensions.content.width, 100);
-  EXPECT_EQ(body_layout.dimensions.margin.left, 0);
-  EXPECT_EQ(body_layout.dimensions.margin.right, 90);
-  EXPECT_EQ(body_layout.dimensions.content.x, 10);
-  EXPECT_EQ(body_layout.dimensions.content.y, 0);
-
-  ASSERT_EQ(body_layout.children.size(), 3);
-  const LayoutBoxPtr& h1_1 = body_layout.children.at(0);
-  const LayoutBoxPtr& h1_2 = body_layout.children.at(1);
-  const LayoutBoxPtr& h1_3 = body_layout.children.at(2);
-
-  ASSERT_EQ(h1_1->styled_node->specified_values.size(), 2);
-  ASSERT_EQ(h1_1->styled_node->get_value<LengthValue>("height")->type,
-            ValueType::Length);
-  ASSERT_EQ(h1_1->styled_node->get_value<LengthValue>("height")->val, 10.0);
-  EXPECT_EQ(h1_1->dimensions.content.width, 100);
-  EXPECT_EQ(h1_1->dimensions.content.height, 10);
-  EXPECT_EQ(h1_1->dimensions.content.x, 10);
-  EXPECT_EQ(h1_1->dimensions.content.y, 0);
-
-  EXPECT_EQ(h1_2->dimensions.content.x, 10);
-  EXPECT_EQ(h1_2->dimensions.content.y, 10);
-
-  EXPECT_EQ(h1_3->dimensions.content.x, 10);
-  EXPECT_EQ(h1_3->dimensions.content.y, 20);
-
-  EXPECT_EQ(body_layout.dimensions.content.height, 30);
+  RuleIndex index(cssdriver.stylesheet);
+  StyleSharingCache cache(index);
+  const StyledChild styled = std::make_shared<StyledNode>(htmldriver.dom, cache);
+
+  LayoutTree tree(styled, Dimensions(Rect(0.0, 0.0, 800.0, 600.0)));
+  tree.calculate();
+
+  // nothing changed: nothing is touched
+  RelayoutStats idle;
+  tree.relayout(idle);
+  EXPECT_EQ(idle.laid_out, 0);
+  EXPECT_EQ(idle.reused, tree.boxes.size());
+
+  // resizing lays out every block again
+  tree.set_containing_width(640.5);
+  RelayoutStats resize;
+  tree.relayout(resize);
+  EXPECT_GT(resize.laid_out, 12);
+  {
+    LayoutTree fresh(styled, Dimensions(Rect(0.0, 0.0, 640.5, 600.0)));
+    fresh.calculate();
+    expect_same_geometry(fresh, tree);
+  }
+
+  // a taller paragraph in the fifth div: the paragraphs after it and the
+  // divs below are only shifted, the ones before are reused. The lines of
+  // the paragraph are broken again, its span and text count as laid out.
+  StyledNode& paragraph = *styled->children[4]->children[1];
+  static_cast<yahtml::Element*>(paragraph.node.get())->classes = { "tall" };
+  paragraph.mark_dirty(RESTYLE_SELF);
+
+  RestyleStats restyled;
+  styled->restyle(cache, restyled);
+  tree.update();
+
+  RelayoutStats edit;
+  tree.relayout(edit);
+  EXPECT_EQ(edit.laid_out, 5);
+  EXPECT_GT(edit.shifted, 0);
+  EXPECT_EQ(edit.laid_out + edit.shifted + edit.reused, tree.boxes.size());
+  {
+    LayoutTree fresh(styled, Dimensions(Rect(0.0, 0.0, 640.5, 600.0)));
+    fresh.calculate();
+    expect_same_geometry(fresh, tree);
+  }
+
+  // geometries of the tree's caller, which update() does not know about
+  LayoutGeometry other =
+      tree.new_geometry(Dimensions(Rect(0.0, 0.0, 640.5, 600.0)));
+  LayoutGeometry stale = other;
+  tree.calculate(other);
+
+  // the second div goes away
+  yahtml::DOMChildren& divs = htmldriver.dom->children;
+  divs.erase(divs.begin() + 1);
+  styled->mark_dirty(RESTYLE_CHILDREN);
+
+  styled->restyle(cache, restyled);
+  tree.update();
+
+  RelayoutStats removal;
+  tree.relayout(removal);
+  EXPECT_EQ(removal.laid_out, 1);
+  {
+    LayoutTree fresh(styled, Dimensions(Rect(0.0, 0.0, 640.5, 600.0)));
+    fresh.calculate();
+    expect_same_geometry(fresh, tree);
+  }
+
+  // are laid out from scratch
+  EXPECT_THROW(tree.calculate(stale, 1), std::logic_error);
+  RelayoutStats remade;
+  tree.relayout(other, remade);
+  EXPECT_EQ(other.dimensions.size(), tree.boxes.size());
+  EXPECT_EQ(remade.reused, 0);
+  for (const auto& box : tree.boxes) {
+    EXPECT_EQ(other.dimensions[box.id].content.y,
+              tree.dimensions(box).content.y);
+    EXPECT_EQ(other.dimensions[box.id].content.height,
+              tree.dimensions(box).content.height);
+  }
+}
+
+TEST(InlineLayout, BreaksLinesAtTheContainingWidth)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<p>aaaa bb   cc dddddd</p>";
+
+  // 5px per byte with the default metrics, lines are 12px high
+  const char* css_source = "p { display: block; width: 60px; font-size: 10px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+      Dimensions(Rect(0.0, 0.0, 800.0, 600.0)));
+  tree.calculate();
+
+  const InlineLayout* layout = tree.inline_layout(tree.root());
+  ASSERT_NE(layout, nullptr);
+  ASSERT_EQ(layout->lines.size(), 2);
+  ASSERT_EQ(layout->fragments.size(), 2);
+
+  const BoxId text = tree.children(tree.root()).at(0).id;
+
+  // "aaaa bb cc" fits in 60px, collapsing the spaces
+  EXPECT_EQ(layout->lines[0].fragment_count, 1);
+  EXPECT_EQ(layout->lines[0].rect.width, 50);
+  EXPECT_EQ(layout->lines[0].rect.height, 12);
+  EXPECT_EQ(layout->fragments[0].box, text);
+  EXPECT_EQ(layout->fragments[0].begin, 0);
+  EXPECT_EQ(layout->fragments[0].end, 12);
+
+  EXPECT_EQ(layout->lines[1].rect.y, 12);
+  EXPECT_EQ(layout->lines[1].rect.width, 30);
+  EXPECT_EQ(layout->fragments[1].begin, 13);
+  EXPECT_EQ(layout->fragments[1].end, 19);
+  EXPECT_EQ(layout->fragments[1].rect.x, 0);
+  EXPECT_EQ(layout->fragments[1].rect.y, 12);
+
+  EXPECT_EQ(tree.dimensions(tree.root()).content.height, 24);
+
+  // the paragraph has a width of its own, a wider viewport changes nothing
+  tree.set_containing_width(500.0);
+  tree.calculate();
+  EXPECT_EQ(layout->lines.size(), 2);
+}
+
+TEST(InlineLayout, AnonymousBlockAlignsItsLines)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<h1>title</h1>"
+                            "huehue <strong>brbr</strong> hue"
+                            "</body>";
+
+  const char* css_source = "body, h1 { display: block; }"
+                           "body { text-align: right; font-size: 10px; "
+                           "       line-height: 20px; }"
+                           "strong { font-size: 20px; line-height: 30px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+      Dimensions(Rect(0.0, 0.0, 200.0, 600.0)));
+  tree.calculate();
+
+  const BoxRange root_children = tree.children(tree.root());
+  ASSERT_EQ(root_children.size(), 2);
+
+  const LayoutBox& h1 = root_children.at(0);
+  const LayoutBox& anonymous = root_children.at(1);
+  ASSERT_EQ(anonymous.type, BoxType::AnonymousBlock);
+
+  EXPECT_EQ(tree.dimensions(h1).content.height, 20);
+  EXPECT_EQ(tree.dimensions(anonymous).content.y, 20);
+  EXPECT_EQ(tree.dimensions(anonymous).content.width, 200);
+
+  const InlineLayout* layout = tree.inline_layout(anonymous);
+  ASSERT_NE(layout, nullptr);
+  ASSERT_EQ(layout->lines.size(), 1);
+  ASSERT_EQ(layout->fragments.size(), 3);
+
+  // "huehue" + " " + "brbr" at 10px per byte + " " + "hue": spaces take
+  // the font of the text they are in
+  const LineBox& line = layout->lines[0];
+  EXPECT_EQ(line.rect.width, 30 + 5 + 40 + 5 + 15);
+  EXPECT_EQ(line.rect.x, 200 - line.rect.width);
+  EXPECT_EQ(line.rect.height, 30);
+
+  EXPECT_EQ(layout->fragments[0].rect.x, line.rect.x);
+  EXPECT_EQ(layout->fragments[1].rect.x, line.rect.x + 35);
+  EXPECT_EQ(layout->fragments[1].rect.height, 30);
+  EXPECT_EQ(layout->fragments[2].rect.x, line.rect.x + 80);
+
+  EXPECT_EQ(tree.dimensions(anonymous).content.height, 30);
+  EXPECT_EQ(tree.dimensions(tree.root()).content.height, 50);
+}
+
+TEST(InlineLayout, BlockInInline)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source =
+      "<body><p><a>link text<div>block in inline</div>tail</a></p></body>";
+  const char* css_source = "body, p, div { display: block; }"
+                           "p { font-size: 10px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const StyledChild styled =
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet);
+  LayoutTree tree(styled, Dimensions(Rect(0.0, 0.0, 800.0, 600.0)));
+  tree.calculate();
+
+  const LayoutBox& p = tree.children(tree.root()).at(0);
+  const LayoutBox& a = tree.children(p).at(0);
+  ASSERT_EQ(a.type, BoxType::InlineNode);
+
+  // the text before the block, the block's and the text after it
+  const BoxRange a_children = tree.children(a);
+  ASSERT_EQ(a_children.size(), 3);
+  EXPECT_EQ(a_children.at(0).type, BoxType::AnonymousBlock);
+  EXPECT_EQ(a_children.at(1).type, BoxType::BlockNode);
+  EXPECT_EQ(a_children.at(2).type, BoxType::AnonymousBlock);
+  EXPECT_EQ(tree.inline_layout(a_children.at(1)), nullptr);
+
+  const InlineLayout* layout = tree.inline_layout(p);
+  ASSERT_NE(layout, nullptr);
+  ASSERT_EQ(layout->lines.size(), 3);
+  EXPECT_EQ(layout->lines[0].rect.width, 45);
+  EXPECT_EQ(layout->lines[1].rect.y, 12);
+  EXPECT_EQ(layout->lines[1].rect.width, 75);
+  EXPECT_EQ(layout->lines[2].rect.y, 24);
+  EXPECT_EQ(layout->lines[2].rect.width, 20);
+  EXPECT_EQ(tree.dimensions(p).content.height, 36);
+
+  ThreadPool pool(2);
+  LayoutTree parallel(styled, Dimensions(Rect(0.0, 0.0, 800.0, 600.0)));
+  parallel.calculate(pool, 1);
+  ASSERT_NE(parallel.inline_layout(p), nullptr);
+  EXPECT_EQ(parallel.inline_layout(p)->lines.size(), 3);
+  EXPECT_EQ(parallel.dimensions(p).content.height, 36);
+
+  std::ostringstream json;
+  write_json(json, tree);
+  EXPECT_NE(json.str().find("\"lines\""), std::string::npos);
+}
+
+// counts what reaches the metrics past the cache
+class CountingMetrics : public FixedAdvanceMetrics
+{
+public:
+  mutable unsigned measured = 0;
+
+  float text_width(const FontDescriptor& font, const char* text,
+                   size_t length) const
+  {
+    measured++;
+    return FixedAdvanceMetrics::text_width(font, text, length);
+  }
+};
+
+TEST(InlineLayout, WordsAreMeasuredOnce)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<p>the cat and the dog</p>"
+                            "<p>the dog and the cat</p>"
+                            "</body>";
+  const char* css_source = "body, p { display: block; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const StyledChild styled =
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet);
+  CountingMetrics metrics;
+
+  LayoutTree tree(styled, Dimensions(Rect(0.0, 0.0, 800.0, 600.0)), metrics);
+  tree.calculate();
+  tree.calculate();
+
+  // four words and a space
+  EXPECT_EQ(metrics.measured, 5);
+
+  // the cache is shared: another document measures nothing new
+  LayoutTree other(styled, Dimensions(Rect(0.0, 0.0, 300.0, 600.0)), metrics);
+  other.calculate();
+  EXPECT_EQ(metrics.measured, 5);
+}
+
+TEST(LayoutTree, WritesJSON)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body><p>say \"hi\"</p></body>";
+  const char* css_source = "body, p { display: block; }"
+                           "body { padding: 5px; }"
+                           "p { font-size: 10px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+      Dimensions(Rect(0.0, 0.0, 100.0, 100.0)));
+  tree.calculate();
+
+  std::ostringstream out;
+  write_json(out, tree);
+
+  // lines and fragments are moved into the coordinates of the boxes
+  EXPECT_EQ(out.str(),
+            "{\"id\":0,\"type\":\"block\",\"node\":\"body\","
+            "\"content\":{\"x\":5,\"y\":5,\"width\":90,\"height\":12},"
+            "\"padding\":[5,5,5,5],\"border\":[0,0,0,0],"
+            "\"margin\":[0,0,0,0],\"children\":["
+            "{\"id\":1,\"type\":\"block\",\"node\":\"p\","
+            "\"content\":{\"x\":5,\"y\":5,\"width\":90,\"height\":12},"
+            "\"padding\":[0,0,0,0],\"border\":[0,0,0,0],"
+            "\"margin\":[0,0,0,0],\"lines\":["
+            "{\"rect\":{\"x\":5,\"y\":5,\"width\":40,\"height\":12},"
+            "\"fragments\":[{\"box\":2,"
+            "\"rect\":{\"x\":5,\"y\":5,\"width\":40,\"height\":12},"
+            "\"text\":\"say \\\"hi\\\"\"}]}],"
+            "\"children\":[{\"id\":2,\"type\":\"inline\",\"node\":\"#text\","
+            "\"children\":[]}]}]}\n");
 }
@@ -0,0 +1,344 @@
+#include "gtest/gtest.h"
+#include "yabrowser/DisplayList.hh"
+#include "yabrowser/Raster.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Tiles.hh"
+#include "yacss/parser/driver.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <random>
+#include <sstream>
+
+using namespace yabrowser;
+using namespace yabrowser::style;
+using namespace yabrowser::layout;
+using namespace yabrowser::paint;
+using namespace yacss;
+
+static const RasterKernels ALL_KERNELS[] = { RASTER_KERNELS_SCALAR,
+                                             RASTER_KERNELS_SSE2,
+                                             RASTER_KERNELS_AVX2 };
+
+static Value keyword (const char* name)
+{
+  return Value::from_keyword(intern_keyword(name));
+}
+
+TEST(ComputedStyle, Colors)
+{
+  EXPECT_EQ(resolve_color(keyword("red"), Color()), Color(255, 0, 0));
+  EXPECT_EQ(resolve_color(keyword("#0a0B0c"), Color()), Color(10, 11, 12));
+  EXPECT_EQ(resolve_color(keyword("#f80"), Color()), Color(255, 136, 0));
+  EXPECT_EQ(resolve_color(keyword("transparent"), Color()), COLOR_TRANSPARENT);
+  EXPECT_EQ(resolve_color(keyword("#ggg"), Color(1, 2, 3)), Color(1, 2, 3));
+  EXPECT_EQ(resolve_color(keyword("bogus"), Color(1, 2, 3)), Color(1, 2, 3));
+  EXPECT_EQ(resolve_color(Value::from_length(3), Color(1, 2, 3)),
+            Color(1, 2, 3));
+}
+
+TEST(DisplayList, BackgroundsAndBorders)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<div></div>"
+                            "<p></p>"
+                            "</body>";
+
+  const char* css_source = "body, div, p { display: block; }"
+                           "body { background-color: white; }"
+                           "div { height: 10px; padding: 5px; border: 2px;"
+                           "      border-color: red; background: blue; }"
+                           "p { height: 10px; color: green; border: 1px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+      Dimensions(Rect(0.0, 0.0, 100.0, 100.0)));
+  tree.calculate();
+
+  const DisplayList list = build_display_list(tree);
+  const BoxRange children = tree.children(tree.root());
+  ASSERT_EQ(list.size(), 1 + 5 + 4);
+
+  // body's background first, then the div's, then its borders
+  EXPECT_EQ(list.items[0].box, tree.root().id);
+  EXPECT_EQ(list.items[0].color, Color(255, 255, 255));
+  EXPECT_EQ(list.items[0].rect.height, 10 + 10 + 4 + 10 + 2);
+
+  const Rect div = tree.dimensions(children.at(0)).border_box();
+  EXPECT_EQ(list.items[1].box, children.at(0).id);
+  EXPECT_EQ(list.items[1].color, Color(0, 0, 255));
+  EXPECT_EQ(list.items[1].rect.width, div.width);
+  EXPECT_EQ(list.items[1].rect.height, 24);
+
+  // top, bottom, left and right
+  EXPECT_EQ(list.items[2].rect.y, div.y);
+  EXPECT_EQ(list.items[2].rect.height, 2);
+  EXPECT_EQ(list.items[3].rect.y, div.y + 22);
+  EXPECT_EQ(list.items[4].rect.x, div.x);
+  EXPECT_EQ(list.items[4].rect.height, 20);
+  EXPECT_EQ(list.items[5].rect.x, div.x + div.width - 2);
+  for (unsigned i = 2; i < 6; i++)
+    EXPECT_EQ(list.items[i].color, Color(255, 0, 0));
+
+  // no background, borders take the color of the text
+  for (unsigned i = 6; i < 10; i++) {
+    EXPECT_EQ(list.items[i].box, children.at(1).id);
+    EXPECT_EQ(list.items[i].color, Color(0, 128, 0));
+  }
+}
+
+TEST(DisplayList, BlocksInInlineBoxes)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source =
+      "<body><p><a>link text<div>block in inline</div>tail</a></p></body>";
+  const char* css_source = "body, p, div { display: block; }"
+                           "p { font-size: 10px; }"
+                           "div { background: blue; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  LayoutTree tree(
+      std::make_shared<StyledNode>(htmldriver.dom, cssdriver.stylesheet),
+      Dimensions(Rect(0.0, 0.0, 800.0, 600.0)));
+  tree.calculate();
+
+  const LayoutBox& p = tree.children(tree.root()).at(0);
+  const LayoutBox& div = tree.children(tree.children(p).at(0)).at(1);
+  const Rect& content = tree.dimensions(p).content;
+  const DisplayList list = build_display_list(tree);
+
+  // across the second of the three lines of the paragraph
+  ASSERT_EQ(list.size(), 1);
+  EXPECT_EQ(list.items[0].box, div.id);
+  EXPECT_EQ(list.items[0].color, Color(0, 0, 255));
+  EXPECT_EQ(list.items[0].rect.x, content.x);
+  EXPECT_EQ(list.items[0].rect.y, content.y + 12);
+  EXPECT_EQ(list.items[0].rect.width, content.width);
+  EXPECT_EQ(list.items[0].rect.height, 12);
+}
+
+TEST(Canvas, FillsAndClipsRects)
+{
+  for (RasterKernels kernels : ALL_KERNELS) {
+    if (!raster_kernels_supported(kernels))
+      continue;
+
+    Canvas canvas(20, 10, Color(255, 255, 255), kernels);
+
+    // snapped to [2, 5) x [1, 3), and then clipped
+    canvas.fill_rect(Rect(1.6, 0.7, 3.2, 2.0), Color(255, 0, 0));
+    canvas.fill_rect(Rect(-5.0, 8.0, 100.0, 100.0), Color(0, 0, 255));
+
+    EXPECT_EQ(canvas.pixel(1, 1), Color(255, 255, 255));
+    EXPECT_EQ(canvas.pixel(2, 1), Color(255, 0, 0));
+    EXPECT_EQ(canvas.pixel(4, 2), Color(255, 0, 0));
+    EXPECT_EQ(canvas.pixel(5, 2), Color(255, 255, 255));
+    EXPECT_EQ(canvas.pixel(4, 3), Color(255, 255, 255));
+    EXPECT_EQ(canvas.pixel(0, 8), Color(0, 0, 255));
+    EXPECT_EQ(canvas.pixel(19, 9), Color(0, 0, 255));
+    EXPECT_EQ(canvas.pixel(19, 7), Color(255, 255, 255));
+
+    // translucent colors are blended
+    canvas.fill_rect(Rect(0.0, 0.0, 20.0, 10.0), Color(0, 0, 0, 128));
+    EXPECT_EQ(canvas.pixel(1, 1), Color(127, 127, 127));
+    EXPECT_EQ(canvas.pixel(2, 1), Color(127, 0, 0));
+  }
+}
+
+TEST(Canvas, KernelsAgreeWithScalar)
+{
+  std::mt19937 random(42);
+  std::uniform_int_distribution<unsigned> byte(0, 255);
+
+  for (RasterKernels kernels : ALL_KERNELS) {
+    if (!raster_kernels_supported(kernels))
+      continue;
+
+    // every length up to a few vectors, at every offset from alignment
+    for (unsigned length = 0; length < 40; length++) {
+      for (unsigned offset = 0; offset < 8; offset++) {
+        std::vector<uint32_t> expected(offset + length + 8);
+        const Color color(byte(random), byte(random), byte(random),
+                          byte(random));
+
+        for (auto& pixel : expected)
+          pixel = pack_pixel(Color(byte(random), byte(random), byte(random),
+                                   byte(random)));
+
+        std::vector<uint32_t> blended = expected;
+        std::vector<uint32_t> filled = expected;
+
+        blend_span(kernels, blended.data() + offset, length, color);
+        fill_span(kernels, filled.data() + offset, length, pack_pixel(color));
+
+        // the pixels around the span are left alone
+        std::vector<uint32_t> reference = expected;
+        blend_span(RASTER_KERNELS_SCALAR, reference.data() + offset, length,
+                   color);
+        EXPECT_EQ(blended, reference) << kernels << " " << length;
+
+        fill_span(RASTER_KERNELS_SCALAR, expected.data() + offset, length,
+                  pack_pixel(color));
+        EXPECT_EQ(filled, expected) << kernels << " " << length;
+      }
+    }
+  }
+}
+
+TEST(Canvas, BlendRoundsEveryChannel)
+{
+  // every pixel value against a few alphas, against the exact formula
+  for (unsigned alpha : { 0, 1, 127, 128, 254, 255 }) {
+    std::vector<uint32_t> pixels(256);
+    for (unsigned i = 0; i < 256; i++)
+      pixels[i] = pack_pixel(Color(i, 255 - i, i / 2, i));
+
+    blend_span(best_raster_kernels(), pixels.data(), pixels.size(),
+               Color(200, 10, 99, alpha));
+
+    for (unsigned i = 0; i < 256; i++) {
+      const Color color = unpack_pixel(pixels[i]);
+      const auto blend = [alpha](unsigned source, unsigned pixel) {
+        return static_cast<unsigned>(
+            (source * alpha + pixel * (255 - alpha)) / 255.0 + 0.5);
+      };
+
+      EXPECT_EQ(color.r, blend(200, i));
+      EXPECT_EQ(color.g, blend(10, 255 - i));
+      EXPECT_EQ(color.b, blend(99, i / 2));
+      EXPECT_EQ(color.a, blend(255, i));
+    }
+  }
+}
+
+TEST(Canvas, WritesPPM)
+{
+  Canvas canvas(2, 1, Color(1, 2, 3));
+  canvas.fill_rect(Rect(1.0, 0.0, 1.0, 1.0), Color(4, 5, 6));
+
+  std::ostringstream out;
+  write_ppm(out, canvas);
+
+  EXPECT_EQ(out.str(), std::string("P6\n2 1\n255\n\x01\x02\x03\x04\x05\x06"));
+}
+
+// overlapping, translucent and off-canvas rects, none on pixel edges
+static DisplayList scattered_items(unsigned count, unsigned seed)
+{
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> position(-20.0f, 220.0f);
+  std::uniform_real_distribution<float> size(0.0f, 80.0f);
+  std::uniform_int_distribution<unsigned> byte(0, 255);
+  DisplayList list;
+
+  for (unsigned i = 0; i < count; i++)
+    list.items.push_back(DisplayItem{
+        Rect(position(random), position(random), size(random), size(random)),
+        Color(byte(random), byte(random), byte(random),
+              i % 3 ? 255 : byte(random)),
+        static_cast<BoxId>(i) });
+
+  return list;
+}
+
+TEST(TileGrid, PaintsLikeTheCanvas)
+{
+  const DisplayList list = scattered_items(200, 7);
+  Canvas expected(200, 150);
+  expected.paint(list);
+
+  // tiles that do and do not divide the canvas
+  for (unsigned threads : { 0, 1, 4 }) {
+    for (unsigned tile : { 50, 64, 256 }) {
+      ThreadPool pool(threads);
+      TileGrid grid(200, 150, tile);
+      TileStats stats;
+
+      grid.paint(list, pool, stats);
+      EXPECT_EQ(stats.painted, grid.columns * grid.rows);
+      EXPECT_EQ(grid.canvas.pixels, expected.pixels) << threads << " " << tile;
+    }
+  }
+}
+
+TEST(TileGrid, BinsOnlyTheTilesAnItemCovers)
+{
+  ThreadPool pool(0);
+  TileGrid grid(100, 100, 32);
+  TileStats stats;
+  DisplayList list;
+
+  // [30, 70) x [0, 10): columns 0 to 2 of the first row
+  list.items.push_back(
+      DisplayItem{ Rect(30.0, 0.0, 40.0, 10.0), Color(1, 2, 3), 0 });
+  // culled: transparent, empty, and off the canvas
+  list.items.push_back(
+      DisplayItem{ Rect(0.0, 0.0, 100.0, 100.0), COLOR_TRANSPARENT, 0 });
+  list.items.push_back(
+      DisplayItem{ Rect(10.0, 10.0, 0.2, 50.0), Color(1, 2, 3), 0 });
+  list.items.push_back(
+      DisplayItem{ Rect(-50.0, 10.0, 40.0, 50.0), Color(1, 2, 3), 0 });
+  grid.paint(list, pool, stats);
+
+  ASSERT_EQ(grid.columns, 4);
+  for (unsigned tile = 0; tile < grid.columns * grid.rows; tile++)
+    EXPECT_EQ(grid.bin(tile).size(), tile < 3 ? 1 : 0) << tile;
+}
+
+TEST(TileGrid, RepaintsOnlyDamagedTiles)
+{
+  ThreadPool pool(2);
+  TileGrid grid(200, 150, 50);
+  DisplayList list = scattered_items(50, 11);
+  const unsigned tiles = grid.columns * grid.rows;
+
+  TileStats first;
+  grid.paint(list, pool, first);
+  EXPECT_EQ(first.painted, tiles);
+
+  // the same frame again
+  TileStats same;
+  grid.paint(list, pool, same);
+  EXPECT_EQ(same.painted, 0);
+  EXPECT_EQ(same.reused, tiles);
+
+  // a small item moves from the first tile to the last one
+  list.items.push_back(
+      DisplayItem{ Rect(10.0, 10.0, 5.0, 5.0), Color(1, 2, 3), 0 });
+  grid.paint(list, pool, first);
+  list.items.back().rect = Rect(190.0, 140.0, 5.0, 5.0);
+
+  TileStats moved;
+  grid.paint(list, pool, moved);
+  EXPECT_EQ(moved.painted, 2);
+  EXPECT_EQ(moved.reused, tiles - 2);
+
+  Canvas expected(200, 150);
+  expected.paint(list);
+  EXPECT_EQ(grid.canvas.pixels, expected.pixels);
+
+  // everything, once invalidated or on a new background
+  TileStats invalidated;
+  grid.invalidate();
+  grid.paint(list, pool, invalidated);
+  EXPECT_EQ(invalidated.painted, tiles);
+
+  TileStats background;
+  grid.background = Color(0, 0, 0);
+  grid.paint(list, pool, background);
+  EXPECT_EQ(background.painted, tiles);
+  expected.clear(Color(0, 0, 0));
+  expected.paint(list);
+  EXPECT_EQ(grid.canvas.pixels, expected.pixels);
+}
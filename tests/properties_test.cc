@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+#include "yabrowser/Properties.hh"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace yabrowser::style;
+using namespace yacss;
+
+TEST(Properties, InternedNames)
+{
+  EXPECT_EQ(property_id("display"), PROPERTY_DISPLAY);
+  EXPECT_EQ(property_id("margin-left"), PROPERTY_MARGIN_LEFT);
+  EXPECT_EQ(property_id("border-bottom-width"), PROPERTY_BORDER_BOTTOM_WIDTH);
+  EXPECT_EQ(property_id("-webkit-lol"), PROPERTY_UNKNOWN);
+
+  for (unsigned i = 0; i < PROPERTY_COUNT; i++) {
+    PropertyId id = static_cast<PropertyId>(i);
+    EXPECT_EQ(property_id(property_name(id)), id);
+  }
+}
+
+TEST(PropertyTable, KnownAndUnknownProperties)
+{
+  DeclarationContainer decls;
+  decls["width"] = LengthValue(10, yacss::UNIT_PX);
+  decls["margin"] = KeywordValue("auto");
+  decls["-webkit-lol"] = KeywordValue("hue");
+
+  PropertyTable table (decls);
+
+  EXPECT_EQ(table.size(), 3);
+  EXPECT_EQ(table.unknown.size(), 1);
+
+  ASSERT_NE(table.find(PROPERTY_WIDTH), nullptr);
+  EXPECT_EQ(table.find(PROPERTY_WIDTH)->length, 10);
+  EXPECT_EQ(table.find(PROPERTY_HEIGHT), nullptr);
+  EXPECT_EQ(table.find(PROPERTY_UNKNOWN), nullptr);
+
+  EXPECT_EQ(keyword_name(table.at("margin").keyword), "auto");
+  EXPECT_EQ(keyword_name(table.at("-webkit-lol").keyword), "hue");
+  EXPECT_EQ(table.find("-webkit-nope"), nullptr);
+  EXPECT_THROW(table.at("height"), std::out_of_range);
+
+  // later declarations overwrite earlier ones
+  table.set("width", LengthValue(20, yacss::UNIT_PX));
+  EXPECT_EQ(table.size(), 3);
+  EXPECT_EQ(table.find(PROPERTY_WIDTH)->length, 20);
+}
+
+TEST(Value, InternedKeywords)
+{
+  EXPECT_EQ(intern_keyword("auto"), KEYWORD_AUTO);
+  EXPECT_EQ(intern_keyword("xx-large"), KEYWORD_XX_LARGE);
+  EXPECT_EQ(keyword_name(KEYWORD_SERIF), "serif");
+
+  const Keyword hue = intern_keyword("hue");
+  EXPECT_GT(hue, KEYWORD_SERIF);
+  EXPECT_EQ(intern_keyword("hue"), hue);
+  EXPECT_EQ(keyword_name(hue), "hue");
+}
+
+TEST(Value, LooksUpKeywordsWhileInterning)
+{
+  std::thread interner ([] {
+    for (unsigned i = 0; i < 5000; i++)
+      intern_keyword("interned-" + std::to_string(i));
+  });
+
+  for (unsigned i = 0; i < 20000; i++)
+    ASSERT_EQ(keyword_name(KEYWORD_SERIF), "serif");
+  interner.join();
+
+  const Keyword last = intern_keyword("interned-4999");
+  EXPECT_EQ(keyword_name(last), "interned-4999");
+  EXPECT_EQ(keyword_name(last - 4999), "interned-0");
+  EXPECT_THROW(keyword_name(last + 1000), std::out_of_range);
+}
+
+TEST(Value, ConvertsParserValues)
+{
+  const Value length (LengthValue(12, yacss::UNIT_EM));
+  const Value keyword (KeywordValue("auto"));
+
+  EXPECT_TRUE(length.is_length());
+  EXPECT_EQ(length.length, 12);
+  EXPECT_EQ(length.unit, yacss::UNIT_EM);
+  EXPECT_TRUE(keyword.is_keyword(KEYWORD_AUTO));
+  EXPECT_EQ(keyword, Value::from_keyword(KEYWORD_AUTO));
+  EXPECT_NE(length, Value::from_length(12));
+
+  EXPECT_EQ(length.to_css().get<LengthValue>().val, 12);
+  EXPECT_EQ(keyword.to_css().get<KeywordValue>().val, "auto");
+  EXPECT_EQ(Value().kind, VALUE_NONE);
+}
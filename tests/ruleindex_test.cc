@@ -0,0 +1,247 @@
+#include "gtest/gtest.h"
+#include "yahtml/parser/driver.hh"
+#include "yacss/parser/driver.hh"
+#include "yabrowser/RuleIndex.hh"
+
+using namespace yabrowser::style;
+using namespace yacss;
+using namespace yahtml;
+
+static void expect_same_matches (const Stylesheet& ss, const RuleIndex& index,
+                                 const DOMChild& node)
+{
+  if (node->type != NodeType::Element)
+    return;
+
+  const Element& elem = *static_cast<Element*>(node.get());
+  std::vector<MatchedRule> linear = matching_rules(ss, elem);
+  std::vector<MatchedRule> indexed = index.matching_rules(elem);
+
+  ASSERT_EQ(linear.size(), indexed.size()) << elem.tag_name;
+  for (unsigned i = 0; i < linear.size(); i++) {
+    EXPECT_EQ(linear[i].first, indexed[i].first) << elem.tag_name;
+    EXPECT_EQ(linear[i].second, indexed[i].second) << elem.tag_name;
+  }
+
+  for (const auto& child : node->children)
+    expect_same_matches(ss, index, child);
+}
+
+TEST(RuleIndex, Buckets)
+{
+  yacss::CSSDriver cssdriver;
+
+  const char* css_source = "* { display: block }"
+                           "h1 { color: black }"
+                           ".header { color: green }"
+                           "h1.header.big { color: red }"
+                           "#main { width: 10px }"
+                           "h2, .header, #main { margin: auto }";
+
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+
+  ASSERT_EQ(index.rules.size(), 6);
+  ASSERT_EQ(index.cascade.size(), 8);
+
+  // by specificity, then source order; buckets hold these ranks
+  const unsigned order[][2] = { {0, 0}, {1, 0}, {5, 0}, {2, 0}, {5, 1},
+                                {3, 0}, {4, 0}, {5, 2} };
+  for (unsigned rank = 0; rank < 8; rank++) {
+    EXPECT_EQ(index.cascade[rank].rule, order[rank][0]);
+    EXPECT_EQ(index.cascade[rank].selector, order[rank][1]);
+    EXPECT_EQ(index.ranks[order[rank][0]][order[rank][1]], rank);
+  }
+
+  ASSERT_EQ(index.universal.size(), 1);
+  EXPECT_EQ(index.universal[0], 0);
+
+  ASSERT_EQ(index.tag_buckets.size(), 2);
+  EXPECT_EQ(index.tag_buckets.at("h1"), RuleIndex::Bucket({ 1 }));
+  EXPECT_EQ(index.tag_buckets.at("h2"), RuleIndex::Bucket({ 2 }));
+
+  // compound selectors are bucketed by their first class only
+  ASSERT_EQ(index.class_buckets.size(), 1);
+  EXPECT_EQ(index.class_buckets.at("header"), RuleIndex::Bucket({ 3, 4, 5 }));
+
+  ASSERT_EQ(index.id_buckets.size(), 1);
+  EXPECT_EQ(index.id_buckets.at("main"), RuleIndex::Bucket({ 6, 7 }));
+}
+
+TEST(RuleIndex, SameOrderAsLinearMatching)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body id=\"main\">"
+                            "<h1 class=\"header big\">"
+                            "<span class=\"big\"></span>"
+                            "</h1>"
+                            "<h2 class=\"header\"></h2>"
+                            "<div class=\"other header\"></div>"
+                            "</body>";
+
+  const char* css_source = "* { display: block }"
+                           "h1, h2 { color: red }"
+                           ".big { width: 10px }"
+                           ".header { margin: auto }"
+                           "h1.header, .header.big { color: blue }"
+                           "#main { width: 100px }"
+                           "span, #main, .other { height: 10px }"
+                           "h2 { display: inline }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  expect_same_matches(cssdriver.stylesheet, index, htmldriver.dom);
+
+  index.engine = MATCH_ENGINE_STRINGS;
+  expect_same_matches(cssdriver.stylesheet, index, htmldriver.dom);
+}
+
+TEST(RuleIndex, CompiledSelectors)
+{
+  yacss::CSSDriver cssdriver;
+  yahtml::Element h1 ("h1");
+  yahtml::Element unknown ("article");
+
+  cssdriver.parse_source("h1.big.header.big, *.header { color: red }"
+                         "#main { color: blue }");
+  ASSERT_EQ(cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  const CompiledSelector& compound = index.compiled[0][0];
+  const CompiledSelector& universal = index.compiled[0][1];
+
+  // h1, big, header, main
+  EXPECT_EQ(index.atoms.size(), 4);
+  EXPECT_EQ(compound.tag, index.atoms.find("h1"));
+  EXPECT_EQ(compound.id, NULL_ATOM);
+  ASSERT_EQ(compound.classes.size(), 2);
+  EXPECT_LT(compound.classes[0], compound.classes[1]);
+  EXPECT_EQ(universal.tag, NULL_ATOM);
+  EXPECT_EQ(index.compiled[1][0].id, index.atoms.find("main"));
+
+  h1.classes = { "unused", "header", "big" };
+  ElementSignature signature = element_signature(index.atoms, h1);
+  EXPECT_EQ(signature.tag, index.atoms.find("h1"));
+  EXPECT_EQ(signature.id, NULL_ATOM);
+  EXPECT_EQ(signature.classes.size(), 2);
+
+  EXPECT_TRUE(compiled_selector_matches(compound, signature));
+  EXPECT_TRUE(compiled_selector_matches(universal, signature));
+  EXPECT_FALSE(compiled_selector_matches(index.compiled[1][0], signature));
+
+  h1.attr_map["id"] = "main";
+  h1.classes = { "big" };
+  signature = element_signature(index.atoms, h1);
+  EXPECT_FALSE(compiled_selector_matches(compound, signature));
+  EXPECT_TRUE(compiled_selector_matches(index.compiled[1][0], signature));
+
+  unknown.classes = { "header" };
+  signature = element_signature(index.atoms, unknown);
+  EXPECT_EQ(signature.tag, NULL_ATOM);
+  EXPECT_FALSE(compiled_selector_matches(compound, signature));
+  EXPECT_TRUE(compiled_selector_matches(universal, signature));
+}
+
+// enough rules of equal specificity for an unstable sort to reorder them
+TEST(RuleIndex, SourceOrderBreaksTies)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+  std::string css_source;
+
+  for (unsigned i = 0; i < 64; i++)
+    css_source += (i % 2 ? "p" : ".a") + std::string(" { color: c") +
+                  std::to_string(i % 2 ? 0 : i) + " }";
+
+  htmldriver.parse_source("<body><p class=\"a\"></p></body>");
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const Element& p = *static_cast<Element*>(htmldriver.dom->children[0].get());
+
+  for (auto engine : { MATCH_ENGINE_STRINGS, MATCH_ENGINE_ATOMS }) {
+    RuleIndex index (cssdriver.stylesheet, engine);
+    std::vector<MatchedRule> matched = index.matching_rules(p);
+
+    ASSERT_EQ(matched.size(), 64);
+    for (unsigned i = 0; i < 32; i++)
+      EXPECT_EQ(matched[i].first, cssdriver.stylesheet.rules[2 * i + 1]);
+    for (unsigned i = 32; i < 64; i++)
+      EXPECT_EQ(matched[i].first, cssdriver.stylesheet.rules[2 * (i - 32)]);
+
+    EXPECT_EQ(compute_specified_values(index, p)["color"]
+                  .get<KeywordValue>().val, "c62");
+  }
+
+  EXPECT_EQ(compute_specified_values(cssdriver.stylesheet, p)["color"]
+                .get<KeywordValue>().val, "c62");
+}
+
+// `h1, #main` applies as `#main` to an h1#main, even though `h1` comes first
+TEST(RuleIndex, MostSpecificSelectorOfARule)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  htmldriver.parse_source("<body><h1 id=\"main\" class=\"big\"></h1></body>");
+  cssdriver.parse_source("h1, #main { color: red }"
+                         ".big { color: blue }"
+                         "h1 { width: 10px }");
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  const Element& h1 = *static_cast<Element*>(htmldriver.dom->children[0].get());
+  RuleIndex index (cssdriver.stylesheet);
+  std::vector<MatchedRule> matched = index.matching_rules(h1);
+
+  // listed once, last
+  ASSERT_EQ(matched.size(), 3);
+  EXPECT_EQ(matched[2].first, cssdriver.stylesheet.rules[0]);
+  EXPECT_EQ(matched[2].second, 100);
+
+  EXPECT_EQ(compute_specified_values(index, h1)["color"]
+                .get<KeywordValue>().val, "red");
+  EXPECT_EQ(rule_matches(cssdriver.stylesheet.rules[0], h1).second, 100);
+  expect_same_matches(cssdriver.stylesheet, index, htmldriver.dom);
+}
+
+TEST(RuleIndex, SpecifiedValues)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<h1 class=\"header\">"
+                            "</h1>"
+                            "</body>";
+
+  const char* css_source = "h1 {"
+                           " color: black;"
+                           " width: 300px;"
+                           "}"
+
+                           ".header {"
+                           "color: green;"
+                           "}";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  Element* body = dynamic_cast<Element*>(htmldriver.dom.get());
+  Element* h1 = dynamic_cast<Element*>(body->children[0].get());
+
+  EXPECT_EQ(compute_specified_values(index, *body).size(), 0);
+
+  DeclarationContainer h1_decls = compute_specified_values(index, *h1);
+  EXPECT_EQ(h1_decls.size(), 2);
+  EXPECT_EQ(h1_decls["color"].get<KeywordValue>().val, "green");
+  EXPECT_EQ(h1_decls["width"].get<LengthValue>().val, 300);
+}
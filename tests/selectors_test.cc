@@ -0,0 +1,315 @@
+#include "gtest/gtest.h"
+#include "yahtml/parser/driver.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleSharingCache.hh"
+
+#include <stdexcept>
+
+using namespace yabrowser::style;
+using namespace yacss;
+
+static const std::string& color_of (const StyledNode& sn)
+{
+  return keyword_name(sn.specified_values->at("color").keyword);
+}
+
+TEST(ComplexSelector, Parse)
+{
+  ComplexSelector sel = parse_complex_selector("nav > ul li.item a");
+
+  EXPECT_EQ(sel.subject.tag, "a");
+  ASSERT_EQ(sel.ancestors.size(), 3);
+
+  EXPECT_EQ(sel.ancestors[0].first, COMBINATOR_DESCENDANT);
+  EXPECT_EQ(sel.ancestors[0].second.tag, "li");
+  ASSERT_EQ(sel.ancestors[0].second.classes.size(), 1);
+  EXPECT_EQ(sel.ancestors[0].second.classes[0], "item");
+
+  EXPECT_EQ(sel.ancestors[1].first, COMBINATOR_DESCENDANT);
+  EXPECT_EQ(sel.ancestors[1].second.tag, "ul");
+
+  EXPECT_EQ(sel.ancestors[2].first, COMBINATOR_CHILD);
+  EXPECT_EQ(sel.ancestors[2].second.tag, "nav");
+
+  EXPECT_EQ(sel.specificity, 14);
+
+  // the class first, then the tags closest to the subject
+  ASSERT_EQ(sel.ancestor_hashes.size(), 4);
+  EXPECT_EQ(sel.ancestor_hashes[0], class_hash("item"));
+  EXPECT_EQ(sel.ancestor_hashes[1], tag_hash("li"));
+
+  ComplexSelector compound = parse_complex_selector(" h1#main.big ");
+  EXPECT_EQ(compound.subject.tag, "h1");
+  EXPECT_EQ(compound.subject.id, "main");
+  EXPECT_TRUE(compound.ancestors.empty());
+  EXPECT_EQ(compound.specificity, 111);
+
+  EXPECT_THROW(parse_complex_selector("a + b"), std::invalid_argument);
+  EXPECT_THROW(parse_complex_selector("> a"), std::invalid_argument);
+  EXPECT_THROW(parse_complex_selector("a >"), std::invalid_argument);
+  EXPECT_THROW(parse_complex_selector("a > > b"), std::invalid_argument);
+  EXPECT_THROW(parse_complex_selector("a:hover"), std::invalid_argument);
+  EXPECT_THROW(parse_complex_selector(""), std::invalid_argument);
+}
+
+TEST(AncestorFilter, PushAndPop)
+{
+  yahtml::Element nav ("nav");
+  yahtml::Element ul ("ul");
+  nav.classes.push_back("menu");
+  ul.attr_map["id"] = "links";
+
+  AncestorFilter filter;
+  EXPECT_FALSE(filter.might_contain(tag_hash("nav")));
+
+  filter.push(nav);
+  filter.push(ul);
+  EXPECT_EQ(filter.depth(), 2);
+  EXPECT_TRUE(filter.might_contain(tag_hash("nav")));
+  EXPECT_TRUE(filter.might_contain(class_hash("menu")));
+  EXPECT_TRUE(filter.might_contain(tag_hash("ul")));
+  EXPECT_TRUE(filter.might_contain(id_hash("links")));
+  EXPECT_FALSE(filter.might_contain(tag_hash("footer")));
+
+  filter.pop();
+  EXPECT_TRUE(filter.might_contain(tag_hash("nav")));
+  EXPECT_FALSE(filter.might_contain(id_hash("links")));
+
+  filter.pop();
+  EXPECT_EQ(filter.depth(), 0);
+  EXPECT_FALSE(filter.might_contain(class_hash("menu")));
+}
+
+TEST(ComplexStylesheet, DescendantAndChildCombinators)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet css;
+
+  const char* html_source = "<body>"
+                              "<nav class=\"menu\">"
+                                "<a>top</a>"
+                                "<ul><li><a>nested</a></li></ul>"
+                              "</nav>"
+                              "<div><ul><li><a>other</a></li></ul></div>"
+                            "</body>";
+
+  const char* css_source = "a { color: black; }"
+                           "nav ul li a { color: red; }"
+                           ".menu > a, #none a { color: blue; }"
+                           "body > ul a { color: green; }";
+
+  htmldriver.parse_source(html_source);
+  css.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + css.result, 0);
+
+  ASSERT_EQ(css.stylesheet.rules.size(), 4);
+  ASSERT_EQ(css.selectors[2].size(), 2);
+  // yacss only sees the subjects
+  EXPECT_EQ(css.stylesheet.rules[2]->selectors[0].tag, "a");
+  EXPECT_TRUE(css.stylesheet.rules[2]->selectors[0].classes.empty());
+  EXPECT_EQ(css.selectors[2][0].ancestors[0].second.classes[0], "menu");
+  EXPECT_EQ(css.selectors[2][0].specificity, 11);
+
+  RuleIndex index (css);
+  EXPECT_TRUE(index.has_combinators);
+
+  StyledNode body (htmldriver.dom, index);
+  const StyledNode& nav = *body.children[0];
+  const StyledNode& div = *body.children[1];
+
+  EXPECT_EQ(color_of(*nav.children[0]), "blue");
+  EXPECT_EQ(color_of(*nav.children[1]->children[0]->children[0]), "red");
+  EXPECT_EQ(color_of(*div.children[0]->children[0]->children[0]), "black");
+}
+
+// the nearest `p` is not a child of a `div`, the one above it is
+TEST(ComplexSelector, BacktracksOverChildCombinators)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet css;
+
+  htmldriver.parse_source("<div><p><section><p><span>x</span></p>"
+                          "</section></p></div>");
+  css.parse_source("span { color: black; } div > p span { color: red; }"
+                   "section > div span { color: blue; }");
+  ASSERT_EQ(htmldriver.result + css.result, 0);
+
+  RuleIndex index (css);
+  StyledNode div (htmldriver.dom, index);
+  const StyledNode& span = *div.children[0]->children[0]->children[0]
+                                ->children[0];
+
+  EXPECT_EQ(color_of(span), "red");
+}
+
+TEST(ComplexStylesheet, UnsupportedSelectorsOnlyDropTheirRule)
+{
+  ComplexStylesheet css;
+
+  EXPECT_EQ(css.parse_source("a ~ b { color: red; }"), 0);
+  EXPECT_EQ(css.stylesheet.rules.size(), 0);
+
+  EXPECT_EQ(css.parse_source("a { color: red; } , { color: blue; }"), 0);
+  ASSERT_EQ(css.stylesheet.rules.size(), 1);
+  EXPECT_EQ(css.selectors[0][0].subject.tag, "a");
+
+  // one unsupported selector in a list drops the whole rule
+  EXPECT_EQ(css.parse_source("a:hover { color: red; }"
+                             "p, a:visited { color: blue; }"
+                             "div > p { width: 10px; }"), 0);
+  ASSERT_EQ(css.stylesheet.rules.size(), 1);
+  ASSERT_EQ(css.selectors[0].size(), 1);
+  EXPECT_EQ(css.selectors[0][0].ancestors.size(), 1);
+  EXPECT_EQ(css.stylesheet.rules[0]->selectors[0].tag, "p");
+  EXPECT_EQ(css.stylesheet.rules[0]->declarations.count("width"), 1);
+
+  EXPECT_NE(css.parse_source("a { color: red; } p { color: blue;"), 0);
+}
+
+TEST(ComplexStylesheet, SkipsComments)
+{
+  ComplexStylesheet css;
+
+  EXPECT_EQ(css.parse_source("/* c */ p { color: red; }"
+                             "/* { not a block } */"
+                             "div /* ancestor */ > .a { width: /* x */ 10px; }"
+                             "/* unterminated"), 0);
+  ASSERT_EQ(css.stylesheet.rules.size(), 2);
+  EXPECT_EQ(css.selectors[0][0].subject.tag, "p");
+  EXPECT_EQ(css.stylesheet.rules[0]->declarations.count("color"), 1);
+
+  const ComplexSelector& sel = css.selectors[1][0];
+  ASSERT_EQ(sel.ancestors.size(), 1);
+  EXPECT_EQ(sel.ancestors[0].first, COMBINATOR_CHILD);
+  EXPECT_EQ(sel.ancestors[0].second.tag, "div");
+  EXPECT_EQ(css.stylesheet.rules[1]->declarations.count("width"), 1);
+}
+
+TEST(ComplexStylesheet, SkipsAtRules)
+{
+  ComplexStylesheet css;
+
+  EXPECT_EQ(css.parse_source("@charset \"utf-8\";"
+                             "@import url(\"a;b.css\");"
+                             "p { color: red; }"
+                             "@media (max-width: 600px) {"
+                             "  p { color: blue; } .x { width: 1px; }"
+                             "}"
+                             "@font-face { font-family: \"}\"; }"
+                             "a { color: green; }"), 0);
+  ASSERT_EQ(css.stylesheet.rules.size(), 2);
+  EXPECT_EQ(css.selectors[0][0].subject.tag, "p");
+  EXPECT_EQ(css.selectors[1][0].subject.tag, "a");
+  EXPECT_TRUE(css.stylesheet.rules[1]->declarations.at("color") ==
+              yacss::CSSBaseValue(yacss::KeywordValue("green")));
+}
+
+// lists that only differ by their ancestors must not share declarations
+TEST(StyleSharingCache, CombinatorsKeyOnTheParentNode)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet css;
+
+  const char* html_source = "<body>"
+                              "<nav><ul><li>a</li><li>b</li></ul></nav>"
+                              "<div><ul><li>c</li><li>d</li></ul></div>"
+                            "</body>";
+
+  htmldriver.parse_source(html_source);
+  css.parse_source("li { color: black; } nav li { color: red; }");
+  ASSERT_EQ(htmldriver.result + css.result, 0);
+
+  RuleIndex index (css);
+  StyleSharingCache cache (index);
+  StyledNode body (htmldriver.dom, cache);
+
+  const StyledNode& nav_ul = *body.children[0]->children[0];
+  const StyledNode& div_ul = *body.children[1]->children[0];
+
+  EXPECT_EQ(color_of(*nav_ul.children[0]), "red");
+  EXPECT_EQ(color_of(*div_ul.children[0]), "black");
+
+  // siblings still share
+  EXPECT_EQ(nav_ul.children[0]->specified_values.get(),
+            nav_ul.children[1]->specified_values.get());
+}
+
+TEST(StyledNode, RestyleWithCombinators)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet css;
+
+  htmldriver.parse_source("<body><div><p><a>link</a></p></div></body>");
+  css.parse_source("a { color: black; } .dark a { color: white; }");
+  ASSERT_EQ(htmldriver.result + css.result, 0);
+
+  RuleIndex index (css);
+  StyleSharingCache cache (index);
+  StyledNode body (htmldriver.dom, cache);
+
+  StyledNode& div = *body.children[0];
+  const StyledNode& link = *div.children[0]->children[0];
+  EXPECT_EQ(color_of(link), "black");
+
+  // the paragraph keeps its style, the link below it still changes
+  static_cast<yahtml::Element*>(div.node.get())->classes.push_back("dark");
+  div.mark_dirty(RESTYLE_SELF);
+
+  RestyleStats stats;
+  body.restyle(cache, stats);
+  EXPECT_EQ(color_of(link), "white");
+}
+
+static void expect_filter_agrees (const RuleIndex& index, const StyledNode& sn,
+                                  AncestorFilter& filter)
+{
+  if (sn.node->type != yahtml::NodeType::Element)
+    return;
+
+  const yahtml::Element& elem =
+      *static_cast<const yahtml::Element*>(sn.node.get());
+  std::vector<MatchedRule> walked = index.matching_rules(elem, sn.parent,
+                                                         nullptr);
+  std::vector<MatchedRule> filtered = index.matching_rules(elem, sn.parent,
+                                                           &filter);
+
+  ASSERT_EQ(walked.size(), filtered.size());
+  for (size_t i = 0; i < walked.size(); i++)
+    EXPECT_EQ(walked[i].first, filtered[i].first);
+
+  filter.push(elem);
+  for (const auto& child : sn.children)
+    expect_filter_agrees(index, *child, filter);
+  filter.pop();
+}
+
+TEST(AncestorFilter, AgreesWithAncestorWalk)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet css;
+
+  std::string html_source = "<body>";
+  for (unsigned i = 0; i < 20; i++) {
+    html_source += "<div class=\"d" + std::to_string(i % 4) + "\">";
+    for (unsigned j = 0; j < 5; j++)
+      html_source += "<ul id=\"u" + std::to_string(j) + "\"><li class=\"i" +
+                     std::to_string((i + j) % 3) + "\"><a>x</a></li></ul>";
+    html_source += "</div>";
+  }
+  html_source += "</body>";
+
+  htmldriver.parse_source(html_source);
+  css.parse_source("body .d1 a { color: red; }"
+                   ".d2 > ul > li.i1 > a { color: blue; }"
+                   "#u3 a, .d0 #u4 .i2 a { color: green; }"
+                   "div div a { color: black; }"
+                   ".d3 li { color: white; }");
+  ASSERT_EQ(htmldriver.result + css.result, 0);
+
+  RuleIndex index (css);
+  StyledNode body (htmldriver.dom, index);
+  AncestorFilter filter;
+
+  expect_filter_agrees(index, body, filter);
+}
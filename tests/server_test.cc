@@ -0,0 +1,277 @@
+#include "gtest/gtest.h"
+#include "yabrowser/Layout.hh"
+#include "yabrowser/RenderServer.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yacss/parser/driver.hh"
+#include "yahtml/parser/driver.hh"
+
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace yabrowser;
+using namespace yabrowser::layout;
+using namespace yabrowser::server;
+using namespace yabrowser::style;
+
+static const char CSS[] = "body, div, p { display: block; }"
+                          "div { padding: 5px; height: 10px; }"
+                          "p { height: 20px; }";
+
+static const char HTML[] = "<body><div></div><p></p></body>";
+
+static RenderRequest request(unsigned documents)
+{
+  RenderRequest request;
+
+  request.width = 200;
+  request.height = 100;
+  request.css = CSS;
+  for (unsigned i = 0; i < documents; i++)
+    request.documents.push_back(HTML);
+
+  return request;
+}
+
+// the same document, laid out without the server
+static std::string expected_json(unsigned width, unsigned height)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+  std::ostringstream out;
+
+  htmldriver.parse_source(HTML);
+  cssdriver.parse_source(CSS);
+
+  RuleIndex index(cssdriver.stylesheet);
+  index.user_agent_styles = true;
+
+  LayoutTree tree(std::make_shared<StyledNode>(htmldriver.dom, index),
+                  Dimensions(Rect(0.0, 0.0, width, height)));
+  tree.calculate();
+  write_json(out, tree);
+
+  return out.str();
+}
+
+TEST(RenderProtocol, RoundTrips)
+{
+  RenderRequest sent = request(3);
+  RenderRequest received;
+  RenderResponse response;
+  RenderResponse decoded;
+  std::string message;
+
+  sent.format = FORMAT_PPM;
+  sent.documents[1] = "";
+  encode(sent, message);
+  ASSERT_TRUE(decode(message, received));
+  EXPECT_EQ(received.format, FORMAT_PPM);
+  EXPECT_EQ(received.width, 200u);
+  EXPECT_EQ(received.height, 100u);
+  EXPECT_EQ(received.css, sent.css);
+  EXPECT_EQ(received.documents, sent.documents);
+
+  response.results.resize(2);
+  response.results[0].output = "{}";
+  response.results[0].micros = 1ull << 40;
+  response.results[1].status = RENDER_PARSE_ERROR;
+  encode(response, message);
+  ASSERT_TRUE(decode(message, decoded));
+  ASSERT_EQ(decoded.results.size(), 2);
+  EXPECT_EQ(decoded.results[0].status, RENDER_OK);
+  EXPECT_EQ(decoded.results[0].output, "{}");
+  EXPECT_EQ(decoded.results[0].micros, 1ull << 40);
+  EXPECT_EQ(decoded.results[1].status, RENDER_PARSE_ERROR);
+}
+
+TEST(RenderProtocol, RejectsTruncatedMessages)
+{
+  RenderRequest received;
+  std::string message;
+
+  encode(request(2), message);
+  for (size_t size = 0; size < message.size(); size++)
+    EXPECT_FALSE(decode(message.substr(0, size), received)) << size;
+
+  // trailing garbage
+  EXPECT_FALSE(decode(message + "x", received));
+
+  // a count far larger than the message can hold
+  std::string huge = message.substr(0, 12 + 4 + sizeof(CSS) - 1);
+  huge += std::string("\xff\xff\xff\x7f", 4);
+  EXPECT_FALSE(decode(huge, received));
+}
+
+TEST(StylesheetCache, CompilesOnce)
+{
+  StylesheetCache cache(1);
+
+  const CompiledStylesheetPtr first = cache.get(CSS);
+  ASSERT_TRUE(first);
+  EXPECT_TRUE(first->index);
+  EXPECT_EQ(cache.get(CSS), first);
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 1);
+
+  // evicts the first one, which stays alive for whoever holds it
+  ASSERT_TRUE(cache.get("p { display: block; }"));
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_NE(cache.get(CSS), first);
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(first->source, CSS);
+
+  EXPECT_FALSE(cache.get("p { display: block;"));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(Renderer, MatchesLayoutTree)
+{
+  ThreadPool pool(2);
+  Renderer renderer(pool);
+  const std::string expected = expected_json(200, 100);
+
+  const RenderResponse response = renderer.render(request(5));
+  ASSERT_EQ(response.results.size(), 5);
+  for (const auto& result : response.results) {
+    EXPECT_EQ(result.status, RENDER_OK);
+    EXPECT_EQ(result.output, expected);
+  }
+
+  // warm: the stylesheet is compiled once for every request
+  renderer.render(request(1));
+  EXPECT_EQ(renderer.stylesheets.misses(), 1);
+  EXPECT_EQ(renderer.stylesheets.hits(), 1);
+}
+
+TEST(Renderer, RejectsBadRequests)
+{
+  ThreadPool pool(0);
+  Renderer renderer(pool);
+  RenderRequest bad = request(2);
+
+  bad.width = MAX_VIEWPORT_SIZE + 1;
+  for (const auto& result : renderer.render(bad).results)
+    EXPECT_EQ(result.status, RENDER_BAD_REQUEST);
+
+  // 805 MB of PPM would not fit in a response
+  bad = request(1);
+  bad.format = FORMAT_PPM;
+  bad.width = MAX_VIEWPORT_SIZE;
+  bad.height = MAX_VIEWPORT_SIZE;
+  for (const auto& result : renderer.render(bad).results)
+    EXPECT_EQ(result.status, RENDER_BAD_REQUEST);
+
+  bad = request(2);
+  bad.css = "div {";
+  for (const auto& result : renderer.render(bad).results)
+    EXPECT_EQ(result.status, RENDER_PARSE_ERROR);
+}
+
+TEST(RenderServer, ServesClients)
+{
+  const std::string path = testing::TempDir() + "yabrowser_server_test.sock";
+  ThreadPool pool(2);
+  Renderer renderer(pool);
+  RenderServer server(renderer, path);
+  std::thread serving(&RenderServer::serve, &server);
+  const std::string expected = expected_json(200, 100);
+
+  {
+    RenderClient first(path);
+    RenderClient second(path);
+
+    for (unsigned i = 0; i < 3; i++) {
+      RenderClient& client = i % 2 ? first : second;
+      const RenderResponse response = client.render(request(2));
+      ASSERT_EQ(response.results.size(), 2);
+      EXPECT_EQ(response.results[1].output, expected);
+    }
+  }
+
+  // with a connection still open, which stop() has to close
+  RenderClient idle(path);
+  idle.render(request(0));
+  server.stop();
+  serving.join();
+
+  EXPECT_EQ(server.requests(), 4);
+  EXPECT_THROW(idle.render(request(1)), std::runtime_error);
+}
+
+TEST(RenderServer, SurvivesDocumentsThatFailToRender)
+{
+  const std::string path = testing::TempDir() + "yabrowser_server_test.sock";
+  ThreadPool pool(2);
+  Renderer renderer(pool);
+  RenderServer server(renderer, path);
+  std::thread serving(&RenderServer::serve, &server);
+
+  {
+    RenderClient client(path);
+    RenderRequest unsupported = request(0);
+
+    // only the document with a div has something to lay out as flex
+    unsupported.css = std::string(CSS) + "div { display: flex; }";
+    unsupported.documents.push_back(HTML);
+    unsupported.documents.push_back("<body><p></p></body>");
+
+    const RenderResponse failed = client.render(unsupported);
+    ASSERT_EQ(failed.results.size(), 2);
+    EXPECT_EQ(failed.results[0].status, RENDER_ERROR);
+    EXPECT_FALSE(failed.results[0].output.empty());
+    EXPECT_EQ(failed.results[1].status, RENDER_OK);
+
+    // the connection and the server are still up
+    const RenderResponse response = client.render(request(1));
+    ASSERT_EQ(response.results.size(), 1);
+    EXPECT_EQ(response.results[0].status, RENDER_OK);
+    EXPECT_EQ(response.results[0].output, expected_json(200, 100));
+  }
+
+  server.stop();
+  serving.join();
+  EXPECT_EQ(server.requests(), 2);
+}
+
+TEST(RenderServer, AnswersMalformedRequests)
+{
+  const std::string path = testing::TempDir() + "yabrowser_server_test.sock";
+  ThreadPool pool(2);
+  Renderer renderer(pool);
+  RenderServer server(renderer, path);
+  std::thread serving(&RenderServer::serve, &server);
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)),
+            0);
+
+  std::string message = "not a request";
+  RenderResponse response;
+
+  ASSERT_TRUE(write_message(fd, message));
+  ASSERT_TRUE(read_message(fd, message));
+  ASSERT_TRUE(decode(message, response));
+  ASSERT_EQ(response.results.size(), 1);
+  EXPECT_EQ(response.results[0].status, RENDER_BAD_REQUEST);
+
+  // and then hangs up
+  EXPECT_FALSE(read_message(fd, message));
+  ::close(fd);
+
+  server.stop();
+  serving.join();
+  EXPECT_EQ(server.requests(), 0);
+  EXPECT_EQ(server.failures(), 1);
+}
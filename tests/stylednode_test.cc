@@ -1,8 +1,14 @@
 #include "gtest/gtest.h"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/StyleSharingCache.hh"
 #include "yabrowser/StyleTree.hh"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/UserAgentStyles.hh"
 #include "yahtml/parser/driver.hh"
 #include "yacss/parser/driver.hh"
 
+#include <type_traits>
+
 using namespace yabrowser;
 using namespace yabrowser::style;
 using namespace yacss;
@@ -33,10 +39,10 @@ TEST(StyledNode, SingleNodeStyleTree) {
   ::StyledNode sn (h1, *ss);
 
   ASSERT_EQ(sn.node.get(), h1.get());
-  ASSERT_EQ(sn.specified_values.size(), 1);
+  ASSERT_EQ(sn.specified_values->size(), 1);
 
-  yacss::DeclarationContainer* decls = &sn.specified_values;
-  EXPECT_EQ(decls->at("color").get<yacss::KeywordValue>().val, "black");
+  const PropertyTable* decls = sn.specified_values.get();
+  EXPECT_EQ(keyword_name(decls->at("color").keyword), "black");
 
   ASSERT_EQ(sn.children.size(), 1);
   ASSERT_EQ(sn.children[0]->node->type, yahtml::NodeType::Text);
@@ -78,33 +84,32 @@ TEST(StyledNode, TreeWithClassSelector) {
   yacss::Stylesheet* ss = &cssdriver.stylesheet;
 
   ::StyledNode sn (body, *ss);
-  EXPECT_EQ(sn.specified_values.size(), 0); // no specified values for body
+  EXPECT_EQ(sn.specified_values->size(), 0); // no specified values for body
   ASSERT_EQ(sn.children.size(), 2);
 
   // h1
   StyledChild& h1_style = sn.children.at(0);
-  ASSERT_EQ(h1_style->specified_values.size(), 2);
-  EXPECT_EQ(h1_style->specified_values["color"].get<KeywordValue>().val,
+  ASSERT_EQ(h1_style->specified_values->size(), 2);
+  EXPECT_EQ(keyword_name(h1_style->specified_values->at("color").keyword),
             "green");
-  EXPECT_EQ(h1_style->specified_values["width"].get<LengthValue>().val,
-            300);
+  EXPECT_EQ(h1_style->specified_values->at("width").length, 300);
 
   // h1's text
   ASSERT_EQ(h1_style->children.size(), 1);
   StyledChild& h1_text_style = h1_style->children.at(0);
-  EXPECT_EQ(h1_text_style->specified_values.size(), 0);
+  EXPECT_EQ(h1_text_style->specified_values->size(), 0);
 
 
   // h2
   StyledChild& h2_style = sn.children.at(1);
-  ASSERT_EQ(h2_style->specified_values.size(), 1);
-  EXPECT_EQ(h2_style->specified_values["color"].get<KeywordValue>().val,
+  ASSERT_EQ(h2_style->specified_values->size(), 1);
+  EXPECT_EQ(keyword_name(h2_style->specified_values->at("color").keyword),
             "green");
 
   // h2's text
   ASSERT_EQ(h2_style->children.size(), 1);
   StyledChild& h2_text_style = h2_style->children.at(0);
-  EXPECT_EQ(h2_text_style->specified_values.size(), 0);
+  EXPECT_EQ(h2_text_style->specified_values->size(), 0);
 }
 
 TEST(StyledNode, GetExistingValue) {
@@ -137,10 +142,10 @@ TEST(StyledNode, GetExistingValue) {
 
   // h1
   StyledChild& h1_style = sn.children.at(0);
-  ASSERT_EQ(h1_style->specified_values.size(), 2);
-  EXPECT_EQ(h1_style->get_value<KeywordValue>("color")->val, "green");
-  EXPECT_EQ(h1_style->get_value<LengthValue>("width")->val, 300);
-  EXPECT_EQ(h1_style->get_value<LengthValue>("lol"), nullptr);
+  ASSERT_EQ(h1_style->specified_values->size(), 2);
+  EXPECT_EQ(keyword_name(h1_style->get_value("color")->keyword), "green");
+  EXPECT_EQ(h1_style->get_value("width")->length, 300);
+  EXPECT_EQ(h1_style->get_value("lol"), nullptr);
 }
 
 TEST(StyledNode, Display) {
@@ -182,6 +187,79 @@ TEST(StyledNode, Display) {
   EXPECT_EQ(div_style->display, DISPLAY_NONE);
 }
 
+TEST(StyledNode, ComputedStyle) {
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source =
+    "<body>"
+      "<p>"
+        "first"
+      "</p>"
+      "<p>"
+        "second"
+      "</p>"
+      "<h1>"
+      "</h1>"
+    "</body>";
+
+  const char* css_source =
+    "body {"
+      "display: block;"
+      "margin: 8px;"
+      "margin-left: auto;"
+      "font-size: 20px;"
+    "}"
+
+    "p {"
+      "display: block;"
+      "padding-top: 4px;"
+    "}"
+
+    "h1 {"
+      "display: block;"
+      "color: red;"
+      "font-weight: bold;"
+    "}";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result, 0);
+  ASSERT_EQ(cssdriver.result, 0);
+
+  ::StyledNode sn (htmldriver.dom, cssdriver.stylesheet);
+  ASSERT_EQ(sn.children.size(), 3);
+
+  const ComputedStyle& body = *sn.computed;
+  EXPECT_EQ(body.display, DISPLAY_BLOCK);
+  EXPECT_EQ(body.margin.top, ComputedLength(8));
+  EXPECT_EQ(body.margin.left, ComputedLength(0, true));
+  EXPECT_TRUE(body.width.is_auto);
+  EXPECT_EQ(body.padding.top, 0);
+  EXPECT_EQ(body.inherited->font_size, 20);
+  EXPECT_EQ(body.inherited->font_weight, 400);
+
+  StyledChild& p_1 = sn.children.at(0);
+  StyledChild& p_2 = sn.children.at(1);
+  StyledChild& h1 = sn.children.at(2);
+
+  // same declarations under the same parent: one style for both
+  EXPECT_EQ(p_1->computed, p_2->computed);
+  EXPECT_EQ(p_1->computed->padding.top, 4);
+  EXPECT_EQ(p_1->computed->margin.top, ComputedLength(0));
+
+  // nothing inherited is declared, so the group of body is reused, down to
+  // the text nodes
+  EXPECT_EQ(p_1->computed->inherited, sn.computed->inherited);
+  EXPECT_EQ(p_1->children.at(0)->computed->inherited, sn.computed->inherited);
+  EXPECT_EQ(p_1->children.at(0)->computed->display, DISPLAY_INLINE);
+
+  EXPECT_NE(h1->computed->inherited, sn.computed->inherited);
+  EXPECT_EQ(h1->computed->inherited->color, Color(255, 0, 0));
+  EXPECT_EQ(h1->computed->inherited->font_weight, 700);
+  EXPECT_EQ(h1->computed->inherited->font_size, 20);
+}
+
 TEST(SpecifiedValues, DeclarationLookup) {
   yahtml::HTMLDriver htmldriver;
   yacss::CSSDriver cssdriver;
@@ -212,37 +290,283 @@ TEST(SpecifiedValues, DeclarationLookup) {
   StyledChild& h2_style = sn.children.at(1);
 
   // default values
-  const CSSBaseValue zero_length = LengthValue(0, yacss::UNIT_PX);
-  const CSSBaseValue auto_keyword = KeywordValue("auto");
+  const Value zero_length = Value::from_length(0);
+  const Value auto_keyword = Value::from_keyword(KEYWORD_AUTO);
 
   // margin - both specified by the shorthand
-  const CSSBaseValue& margin_left =
+  const Value& margin_left =
     h1_style->decl_lookup({"margin", "margin-left"}, zero_length);
 
-  const CSSBaseValue& margin_right =
+  const Value& margin_right =
     h1_style->decl_lookup({"margin", "margin-right"}, zero_length);
 
-  EXPECT_EQ(margin_left.get<LengthValue>().val, 10);
-  EXPECT_EQ(margin_right.get<LengthValue>().val, 10);
+  EXPECT_EQ(margin_left.length, 10);
+  EXPECT_EQ(margin_right.length, 10);
 
   //width - not specified in the first (keyword)
   //      - specified in the second (length)
-  const CSSBaseValue& h1_width =
+  const Value& h1_width =
     h1_style->decl_lookup({"width"}, auto_keyword);
-  const CSSBaseValue& h2_width =
+  const Value& h2_width =
     h2_style->decl_lookup({"width"}, auto_keyword);
 
-  EXPECT_EQ(h1_width.type, yacss::ValueType::Keyword);
-  EXPECT_EQ(h1_width.get<KeywordValue>().val, "auto");
-  EXPECT_EQ(h2_width.type, yacss::ValueType::Length);
+  EXPECT_EQ(h1_width.kind, VALUE_KEYWORD);
+  EXPECT_EQ(keyword_name(h1_width.keyword), "auto");
+  EXPECT_EQ(h2_width.kind, VALUE_LENGTH);
 
   // border - no shorthand specified. Only one (left) specified
-  const CSSBaseValue& border_left =
+  const Value& border_left =
     h1_style->decl_lookup({"border", "border-left"}, zero_length);
-  const CSSBaseValue& border_right =
+  const Value& border_right =
     h1_style->decl_lookup({"border", "border-right"}, zero_length);
 
-  EXPECT_EQ(border_left.get<LengthValue>().val, 5);
-  EXPECT_EQ(border_right.get<LengthValue>().val, 0);
+  EXPECT_EQ(border_left.length, 5);
+  EXPECT_EQ(border_right.length, 0);
+}
+
+
+TEST(StyledNode, BuiltInPlace) {
+  // children are constructed directly where they live; copying a node (and
+  // with it the whole subtree) is not allowed
+  EXPECT_FALSE(std::is_copy_constructible<StyledNode>::value);
+  EXPECT_FALSE(std::is_copy_assignable<StyledNode>::value);
+
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  htmldriver.parse_source("<ul><li>a</li><li>b</li><li>c</li></ul>");
+  cssdriver.parse_source("li { color: red; }");
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  ::StyledNode sn (htmldriver.dom, cssdriver.stylesheet);
+
+  ASSERT_EQ(sn.children.size(), 3);
+  EXPECT_EQ(sn.children.capacity(), 3);
+  for (unsigned i = 0; i < 3; i++)
+    EXPECT_EQ(sn.children[i]->node.get(), htmldriver.dom->children[i].get());
 }
 
+static void expect_same_tree(const StyledNode& lhs, const StyledNode& rhs) {
+  ASSERT_EQ(lhs.node.get(), rhs.node.get());
+  EXPECT_EQ(lhs.display, rhs.display);
+  EXPECT_EQ(*lhs.specified_values, *rhs.specified_values);
+  ASSERT_EQ(lhs.children.size(), rhs.children.size());
+
+  for (unsigned i = 0; i < lhs.children.size(); i++)
+    expect_same_tree(*lhs.children[i], *rhs.children[i]);
+}
+
+TEST(StyledNode, ParallelMatchesSequential) {
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  std::string html_source = "<body>";
+  for (unsigned i = 0; i < 50; i++) {
+    html_source += "<ul class=\"l" + std::to_string(i % 3) + "\">";
+    for (unsigned j = 0; j < 20; j++)
+      html_source += "<li class=\"item i" + std::to_string(j % 4) +
+                     "\">text <span>more</span></li>";
+    html_source += "</ul>";
+  }
+  html_source += "</body>";
+
+  const char* css_source =
+    "body, ul { display: block; }"
+    ".l1 { display: none; }"
+    ".item { color: red; }"
+    "li.i2 { color: blue; width: 10px; }"
+    "span { margin: auto; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  ::StyledNode sequential (htmldriver.dom, cssdriver.stylesheet);
+
+  RuleIndex index (cssdriver.stylesheet);
+  for (unsigned threads : { 0, 1, 4 }) {
+    yabrowser::ThreadPool pool (threads);
+    StyleSharingCache cache (index);
+
+    // small threshold so that lists and list items get their own tasks
+    ::StyledNode parallel (htmldriver.dom, cache, pool, 8);
+    expect_same_tree(sequential, parallel);
+
+    // body, 3 lists, 3 x 4 items and a span under each distinct item
+    EXPECT_EQ(cache.size(), 28);
+  }
+}
+
+TEST(StyledNode, IncrementalRestyle) {
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source =
+    "<body>"
+      "<ul id=\"first\">"
+        "<li class=\"item\">one</li>"
+        "<li class=\"item\">two</li>"
+      "</ul>"
+      "<ul>"
+        "<li class=\"item\">three</li>"
+      "</ul>"
+    "</body>";
+
+  const char* css_source =
+    "body, ul { display: block; }"
+    ".item { color: red; }"
+    ".done { color: green; }"
+    "#first { width: 10px; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  StyleSharingCache cache (index);
+  ::StyledNode root (htmldriver.dom, cache);
+  const size_t total = root.subtree_size;
+
+  // nothing dirty: the whole tree is reused
+  RestyleStats clean;
+  root.restyle(cache, clean);
+  EXPECT_EQ(clean.restyled, 0);
+  EXPECT_EQ(clean.reused, total);
+
+  // class change on the second item: the item and its text are restyled
+  ::StyledNode& item = *root.children[0]->children[1];
+  auto* elem = static_cast<yahtml::Element*>(item.node.get());
+  elem->classes = { "done" };
+  item.mark_dirty(RESTYLE_SELF);
+  EXPECT_TRUE(root.dirty_descendants);
+
+  RestyleStats stats;
+  root.restyle(cache, stats);
+  EXPECT_EQ(stats.restyled, item.subtree_size);
+  EXPECT_EQ(stats.restyled + stats.reused, total);
+  EXPECT_EQ(keyword_name(item.get_value(PROPERTY_COLOR)->keyword), "green");
+  EXPECT_FALSE(root.dirty_descendants);
+
+  // id change on a list: everything below it has to be looked up again
+  ::StyledNode& list = *root.children[0];
+  static_cast<yahtml::Element*>(list.node.get())->attr_map.erase("id");
+  list.mark_dirty(RESTYLE_SELF);
+
+  RestyleStats id_stats;
+  root.restyle(cache, id_stats);
+  EXPECT_EQ(id_stats.restyled, list.subtree_size);
+  EXPECT_EQ(list.get_value(PROPERTY_WIDTH), nullptr);
+
+  // the second list is removed and its item moved up into body: the
+  // surviving list is kept as it is
+  const ::StyledNode* survivor = root.children[0].get();
+  yahtml::DOMChildren& body_children = htmldriver.dom->children;
+  yahtml::DOMChild moved = body_children[1]->children[0];
+  body_children.erase(body_children.begin() + 1);
+  body_children.push_back(moved);
+  root.mark_dirty(RESTYLE_CHILDREN);
+
+  RestyleStats child_stats;
+  root.restyle(cache, child_stats);
+  ASSERT_EQ(root.children.size(), 2);
+  EXPECT_EQ(root.children[0].get(), survivor);
+  EXPECT_EQ(child_stats.restyled, root.children[1]->subtree_size);
+  EXPECT_EQ(root.subtree_size, child_stats.restyled + child_stats.reused);
+
+  ::StyledNode rebuilt (htmldriver.dom, cssdriver.stylesheet);
+  expect_same_tree(rebuilt, root);
+}
+
+TEST(UserAgentStyles, Tables) {
+  ASSERT_GT(UA_RULE_COUNT, 0);
+  EXPECT_NE(std::string(UA_STYLESHEET_SOURCE).find("display: block"),
+            std::string::npos);
+
+  // sorted and unique, which the lookup relies on
+  for (unsigned i = 1; i < UA_RULE_COUNT; i++)
+    EXPECT_LT(std::string(UA_RULES[i - 1].tag), UA_RULES[i].tag);
+
+  for (unsigned i = 0; i < UA_RULE_COUNT; i++)
+    EXPECT_EQ(user_agent_rule(UA_RULES[i].tag), &UA_RULES[i]);
+
+  EXPECT_EQ(user_agent_rule("span"), nullptr);
+  EXPECT_EQ(user_agent_rule(""), nullptr);
+  EXPECT_EQ(user_agent_rule("zzz"), nullptr);
+
+  PropertyTable h1;
+  insert_user_agent_declarations(h1, "h1");
+  EXPECT_TRUE(h1.find(PROPERTY_DISPLAY)->is_keyword(KEYWORD_BLOCK));
+  EXPECT_TRUE(h1.find(PROPERTY_FONT_WEIGHT)->is_keyword(KEYWORD_BOLD));
+  EXPECT_EQ(*h1.find(PROPERTY_FONT_SIZE), Value::from_length(32));
+}
+
+TEST(UserAgentStyles, CascadeBelowAuthorRules) {
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source =
+    "<body>"
+      "<p>"
+        "<span>text</span>"
+      "</p>"
+      "<p class=\"flat\">"
+      "</p>"
+      "<h1>"
+      "</h1>"
+      "<script>"
+      "</script>"
+    "</body>";
+
+  // author rules win over UA ones of any specificity, and the `margin`
+  // shorthand over the UA's `margin-top`
+  const char* css_source =
+    "body {"
+      "margin-left: 2px;"
+    "}"
+
+    ".flat {"
+      "margin: 1px;"
+    "}"
+
+    "h1 {"
+      "display: inline;"
+    "}";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result, 0);
+  ASSERT_EQ(cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  index.user_agent_styles = true;
+
+  ::StyledNode sn (htmldriver.dom, index);
+  ASSERT_EQ(sn.children.size(), 4);
+
+  const ComputedStyle& body = *sn.computed;
+  EXPECT_EQ(body.display, DISPLAY_BLOCK);
+  EXPECT_EQ(body.margin.top, ComputedLength(8));
+  EXPECT_EQ(body.margin.left, ComputedLength(2));
+
+  const StyledChild& p = sn.children.at(0);
+  EXPECT_EQ(p->display, DISPLAY_BLOCK);
+  EXPECT_EQ(p->computed->margin.top, ComputedLength(16));
+  EXPECT_EQ(p->computed->margin.left, ComputedLength(0));
+  EXPECT_EQ(p->children.at(0)->display, DISPLAY_INLINE);
+
+  const StyledChild& flat = sn.children.at(1);
+  EXPECT_EQ(flat->display, DISPLAY_BLOCK);
+  EXPECT_EQ(flat->computed->margin.top, ComputedLength(1));
+  EXPECT_EQ(flat->computed->margin.bottom, ComputedLength(1));
+
+  const StyledChild& h1 = sn.children.at(2);
+  EXPECT_EQ(h1->display, DISPLAY_INLINE);
+  EXPECT_EQ(h1->computed->inherited->font_weight, 700);
+
+  EXPECT_EQ(sn.children.at(3)->display, DISPLAY_NONE);
+
+  // off by default
+  ::StyledNode author_only (htmldriver.dom, cssdriver.stylesheet);
+  EXPECT_EQ(author_only.display, DISPLAY_INLINE);
+  EXPECT_EQ(author_only.children.at(0)->display, DISPLAY_INLINE);
+}
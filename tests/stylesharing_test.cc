@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+#include "yahtml/parser/driver.hh"
+#include "yacss/parser/driver.hh"
+#include "yabrowser/RuleIndex.hh"
+#include "yabrowser/Selectors.hh"
+#include "yabrowser/StyleSharingCache.hh"
+
+using namespace yabrowser::style;
+using namespace yacss;
+
+TEST(StyleSharingCache, SiblingsShareDeclarations)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<ul>"
+                            "<li class=\"item\">a</li>"
+                            "<li class=\"item\">b</li>"
+                            "<li class=\"item\">c</li>"
+                            "<li class=\"item last\">d</li>"
+                            "</ul>";
+
+  const char* css_source = "ul { display: block; }"
+                           ".item { color: red; }"
+                           ".last { color: blue; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  StyleSharingCache cache (index);
+  StyledNode ul (htmldriver.dom, cache);
+
+  ASSERT_EQ(ul.children.size(), 4);
+  const StyledChild& li0 = ul.children.at(0);
+  const StyledChild& li1 = ul.children.at(1);
+  const StyledChild& li2 = ul.children.at(2);
+  const StyledChild& li3 = ul.children.at(3);
+
+  EXPECT_EQ(li0->specified_values.get(), li1->specified_values.get());
+  EXPECT_EQ(li0->specified_values.get(), li2->specified_values.get());
+  EXPECT_NE(li0->specified_values.get(), li3->specified_values.get());
+
+  EXPECT_EQ(keyword_name(li0->specified_values->at("color").keyword), "red");
+  EXPECT_EQ(keyword_name(li3->specified_values->at("color").keyword), "blue");
+
+  // text nodes never go through the cache
+  EXPECT_EQ(li0->children.at(0)->specified_values.get(),
+            empty_declaration_block().get());
+
+  // ul, li.item, li.item.last
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.size(), 3);
+}
+
+TEST(StyleSharingCache, ClassOrderDoesNotMatter)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<ul>"
+                            "<li class=\"a b\"></li>"
+                            "<li class=\"b a\"></li>"
+                            "<li class=\"b a a\"></li>"
+                            "<li id=\"x\" class=\"a b\"></li>"
+                            "</ul>";
+
+  const char* css_source = ".a.b { color: red; }"
+                           "#x { color: blue; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  StyleSharingCache cache (index);
+  StyledNode ul (htmldriver.dom, cache);
+
+  ASSERT_EQ(ul.children.size(), 4);
+  EXPECT_EQ(ul.children.at(0)->specified_values.get(),
+            ul.children.at(1)->specified_values.get());
+  EXPECT_EQ(ul.children.at(0)->specified_values.get(),
+            ul.children.at(2)->specified_values.get());
+
+  // the id is part of the key
+  EXPECT_NE(ul.children.at(0)->specified_values.get(),
+            ul.children.at(3)->specified_values.get());
+  EXPECT_EQ(keyword_name(ul.children.at(3)->specified_values->at("color")
+                             .keyword),
+            "blue");
+}
+
+TEST(StyleSharingCache, ParentStyleIsPartOfTheKey)
+{
+  yahtml::HTMLDriver htmldriver;
+  yacss::CSSDriver cssdriver;
+
+  const char* html_source = "<body>"
+                            "<ul class=\"x\"><li></li></ul>"
+                            "<ul class=\"y\"><li></li></ul>"
+                            "<ul class=\"y\"><li></li></ul>"
+                            "</body>";
+
+  const char* css_source = "li { color: red; }"
+                           ".x { color: blue; }";
+
+  htmldriver.parse_source(html_source);
+  cssdriver.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + cssdriver.result, 0);
+
+  RuleIndex index (cssdriver.stylesheet);
+  StyleSharingCache cache (index);
+  StyledNode body (htmldriver.dom, cache);
+
+  ASSERT_EQ(body.children.size(), 3);
+  const StyledChild& li_x = body.children.at(0)->children.at(0);
+  const StyledChild& li_y1 = body.children.at(1)->children.at(0);
+  const StyledChild& li_y2 = body.children.at(2)->children.at(0);
+
+  EXPECT_NE(li_x->specified_values.get(), li_y1->specified_values.get());
+  EXPECT_EQ(li_y1->specified_values.get(), li_y2->specified_values.get());
+}
+
+TEST(StyleSharingCache, CousinsShareWithCombinators)
+{
+  yahtml::HTMLDriver htmldriver;
+  ComplexStylesheet stylesheet;
+
+  const char* html_source = "<body>"
+                            "<div class=\"card\"><p></p></div>"
+                            "<div class=\"card\"><p></p></div>"
+                            "<div class=\"note\"><p></p></div>"
+                            "</body>";
+
+  const char* css_source = ".card > p { color: red; }"
+                           "body div p { display: block; }";
+
+  htmldriver.parse_source(html_source);
+  stylesheet.parse_source(css_source);
+  ASSERT_EQ(htmldriver.result + stylesheet.result, 0);
+
+  RuleIndex index (stylesheet);
+  StyleSharingCache cache (index);
+  StyledNode body (htmldriver.dom, cache);
+
+  ASSERT_TRUE(index.has_combinators);
+  ASSERT_EQ(body.children.size(), 3);
+  const StyledChild& p0 = body.children.at(0)->children.at(0);
+  const StyledChild& p1 = body.children.at(1)->children.at(0);
+  const StyledChild& p2 = body.children.at(2)->children.at(0);
+
+  EXPECT_EQ(p0->specified_values.get(), p1->specified_values.get());
+  EXPECT_NE(p0->specified_values.get(), p2->specified_values.get());
+  EXPECT_EQ(keyword_name(p0->specified_values->at("color").keyword), "red");
+  EXPECT_EQ(p2->specified_values->find("color"), nullptr);
+
+  // body, div.card, p, div.note, p
+  EXPECT_EQ(cache.misses(), 5);
+  EXPECT_EQ(cache.hits(), 2);
+
+  // restyling keeps what the build left in the cache
+  RestyleStats stats;
+  body.children.at(1)->mark_dirty(RESTYLE_SELF);
+  body.restyle(cache, stats);
+
+  EXPECT_EQ(p1->specified_values.get(), p0->specified_values.get());
+  EXPECT_EQ(cache.misses(), 5);
+}
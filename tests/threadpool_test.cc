@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+#include "yabrowser/ThreadPool.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace yabrowser;
+
+TEST(ThreadPool, RunsEveryTask)
+{
+  for (unsigned threads : { 0, 1, 4 }) {
+    ThreadPool pool (threads);
+    TaskGroup group (pool);
+    std::atomic<unsigned> sum (0);
+
+    EXPECT_EQ(pool.size(), threads);
+
+    for (unsigned i = 1; i <= 1000; i++)
+      group.run([&sum, i]() { sum += i; });
+
+    group.wait();
+    EXPECT_EQ(sum, 500500);
+  }
+}
+
+static unsigned long parallel_sum (ThreadPool& pool, unsigned long begin,
+                                   unsigned long end)
+{
+  if (end - begin < 64) {
+    unsigned long sum = 0;
+    for (unsigned long i = begin; i < end; i++)
+      sum += i;
+    return sum;
+  }
+
+  unsigned long middle = begin + (end - begin) / 2;
+  unsigned long left = 0;
+  TaskGroup group (pool);
+
+  group.run([&]() { left = parallel_sum(pool, begin, middle); });
+  unsigned long right = parallel_sum(pool, middle, end);
+  group.wait();
+
+  return left + right;
+}
+
+TEST(ThreadPool, NestedGroups)
+{
+  // waiting from inside a task must keep the pool busy instead of
+  // deadlocking it
+  ThreadPool pool (2);
+  EXPECT_EQ(parallel_sum(pool, 0, 100000), 4999950000ul);
+}
+
+TEST(ThreadPool, PropagatesExceptions)
+{
+  ThreadPool pool (2);
+  TaskGroup group (pool);
+  std::atomic<unsigned> ran (0);
+
+  for (unsigned i = 0; i < 10; i++) {
+    group.run([&ran, i]() {
+      ran++;
+      if (i == 5)
+        throw std::runtime_error("lol");
+    });
+  }
+
+  EXPECT_THROW(group.wait(), std::runtime_error);
+  EXPECT_EQ(ran, 10);
+}
+
+TEST(ThreadPool, WaitingBlocksUntilTheLastTaskEnds)
+{
+  // with nothing left to help with, a waiter sleeps while the last task
+  // of its group runs elsewhere, and that task's end wakes it up
+  ThreadPool pool (1);
+  TaskGroup group (pool);
+  std::mutex mutex;
+  std::condition_variable released;
+  bool release = false;
+  std::atomic<bool> started (false);
+
+  group.run([&]() {
+    started = true;
+    std::unique_lock<std::mutex> lock (mutex);
+    released.wait(lock, [&release]() { return release; });
+  });
+
+  while (!started)
+    std::this_thread::yield();
+
+  std::future<void> waited =
+      std::async(std::launch::async, [&group]() { group.wait(); });
+
+  EXPECT_EQ(waited.wait_for(std::chrono::milliseconds(50)),
+            std::future_status::timeout);
+
+  {
+    std::lock_guard<std::mutex> lock (mutex);
+    release = true;
+  }
+  released.notify_all();
+
+  EXPECT_EQ(waited.wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+}
+
+TEST(ThreadPool, RunsQueuedTasksBeforeStopping)
+{
+  std::unique_ptr<ThreadPool> pool (new ThreadPool(2));
+  TaskGroup group (*pool);
+  std::atomic<unsigned> ran (0);
+
+  for (unsigned i = 0; i < 1000; i++)
+    group.run([&ran]() { ran++; });
+
+  pool.reset();
+  EXPECT_EQ(ran, 1000);
+
+  // nothing is left for the group to wait on
+  group.wait();
+}
@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+#include "yabrowser/ThreadPool.hh"
+#include "yabrowser/Trace.hh"
+
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace yabrowser;
+
+#if YABROWSER_TRACING
+
+static void traced_work ()
+{
+  TRACE_SPAN("test", "outer");
+  {
+    TRACE_SPAN("test", "inner");
+  }
+  TRACE_SPAN("test", nullptr);
+}
+
+TEST(Trace, RecordsOnlyWhileEnabled)
+{
+  trace::stop();
+  traced_work();
+
+  trace::start();
+  traced_work();
+  trace::stop();
+  traced_work();
+
+  const std::vector<trace::Event> events = trace::events();
+  ASSERT_EQ(events.size(), 2);
+
+  // parents come before the spans they contain
+  EXPECT_STREQ(events[0].name, "outer");
+  EXPECT_STREQ(events[1].name, "inner");
+  EXPECT_STREQ(events[1].category, "test");
+  EXPECT_LE(events[0].begin, events[1].begin);
+  EXPECT_GE(events[0].begin + events[0].duration,
+            events[1].begin + events[1].duration);
+  EXPECT_EQ(events[0].thread, events[1].thread);
+
+  // starting again drops them
+  trace::start();
+  trace::stop();
+  EXPECT_TRUE(trace::events().empty());
+}
+
+TEST(Trace, StopsRecordingWhenFull)
+{
+  trace::start(3);
+  for (unsigned i = 0; i < 5; i++)
+    traced_work();
+  trace::stop();
+
+  EXPECT_EQ(trace::events().size(), 3);
+  EXPECT_EQ(trace::dropped(), 7);
+
+  trace::start();
+  traced_work();
+  trace::stop();
+  EXPECT_EQ(trace::events().size(), 2);
+  EXPECT_EQ(trace::dropped(), 0);
+}
+
+TEST(Trace, KeepsTheThreadOfEverySpan)
+{
+  ThreadPool pool (4);
+  std::set<unsigned> threads;
+
+  trace::start();
+  {
+    TaskGroup group (pool);
+
+    for (unsigned i = 0; i < 64; i++)
+      group.run([]() {
+        TRACE_SPAN("test", "task");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      });
+    group.wait();
+  }
+  trace::stop();
+
+  const std::vector<trace::Event> events = trace::events();
+  ASSERT_EQ(events.size(), 64);
+
+  for (const auto& event : events) {
+    EXPECT_STREQ(event.name, "task");
+    threads.insert(event.thread);
+  }
+
+  // the waiting thread helps as well, so at least two threads ran tasks
+  EXPECT_GE(threads.size(), 2);
+}
+
+#endif
+
+TEST(Trace, WritesChromeTraceEvents)
+{
+  const std::vector<trace::Event> events = {
+    { "outer", "test", 1500, 2000250, 1 },
+    { "inner", "test", 2000, 1000, 2 }
+  };
+  std::ostringstream out;
+
+  trace::write_json(out, events);
+
+  EXPECT_EQ(out.str(),
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"outer\",\"cat\":\"test\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":1,\"ts\":1.500,\"dur\":2000.250},\n"
+            "{\"name\":\"inner\",\"cat\":\"test\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":2,\"ts\":2.000,\"dur\":1.000},\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+            "\"args\":{\"name\":\"thread 1\"}},\n"
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+            "\"args\":{\"name\":\"thread 2\"}}\n"
+            "]}\n");
+}